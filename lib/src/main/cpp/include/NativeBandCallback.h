@@ -0,0 +1,23 @@
+//
+// Native consumer of decoded bands.
+// Pointer to such function and user data are passed to TiffBitmapFactory.decodeFileDescriptorToBands as longs.
+//
+
+#ifndef TIFFSAMPLE_NATIVEBANDCALLBACK_H
+#define TIFFSAMPLE_NATIVEBANDCALLBACK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//pixels contains rowCount rows of width pixels in RGBA_8888 byte order and is valid only during the call.
+//firstRow is index of first row of band in decoded image. Return 0 to stop decoding
+typedef int (*tiff_band_callback)(void *userData, const uint32_t *pixels, uint32_t firstRow, uint32_t rowCount, uint32_t width);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //TIFFSAMPLE_NATIVEBANDCALLBACK_H
@@ -0,0 +1,74 @@
+//
+// Source of rows of saved image taken from locked pixels of Android bitmap.
+// Rows are converted to sample layout of saved image by bands, so no converted copy of whole bitmap is made.
+// Pixels that already have the layout of saved image, like RGBA_8888 to RGBA or A_8 to grey, are passed to writer as they are.
+//
+
+#ifndef TIFFSAMPLE_NATIVEBITMAPROWS_H
+#define TIFFSAMPLE_NATIVEBITMAPROWS_H
+
+#include <android/bitmap.h>
+#include <cstdlib>
+#include <cstring>
+#include <tiffio.h>
+
+class NativeBitmapRows {
+public:
+    //the same values as ordinals of org.beyka.tiffbitmapfactory.SampleLayout
+    static int const LAYOUT_AUTO = 0;
+    static int const LAYOUT_GRAY = 1;
+    static int const LAYOUT_RGB = 2;
+    static int const LAYOUT_RGBA = 3;
+    //1 bit per pixel for CCITT compression schemes
+    static int const LAYOUT_BILEVEL = 4;
+
+    //Rows of pixels of bitmap described by info. LAYOUT_AUTO keeps channels of bitmap format
+    NativeBitmapRows(const void *pixels, const AndroidBitmapInfo *info, int layout);
+
+    ~NativeBitmapRows();
+
+    //Allocate scratch rows of conversion
+    bool begin();
+
+    //Set bits per sample, samples per pixel, photometric and extra samples of image
+    void setFields(TIFF *image) const;
+
+    int getLayout() const;
+
+    uint32 getWidth() const;
+
+    //Bytes of row of saved image
+    tmsize_t getRowBytes() const;
+
+    int getBitsPerPixel() const;
+
+    //Whether rows of saved image are pixels of bitmap, so readRows needs no buffer
+    bool isDirect() const;
+
+    //Bytes of scratch rows allocated by begin
+    size_t getWorkingMemory() const;
+
+    //Rows [firstRow, firstRow + rowCount) of saved image. Returns pixels of bitmap if isDirect(),
+    //otherwise rows are converted to buffer of rowCount * getRowBytes() bytes
+    const unsigned char *readRows(uint32 firstRow, uint32 rowCount, unsigned char *buffer);
+
+    //Row of ABGR pixels. Returns pixels of RGBA_8888 bitmap, other formats are converted to buffer of width pixels
+    const uint32 *readAbgrRow(uint32 row, uint32 *buffer);
+
+    //Convert count ABGR pixels, like ones from readAbgrRow, to layout of saved image
+    void packRow(const uint32 *abgr, unsigned char *dst, uint32 count);
+
+private:
+    const unsigned char *pixels;
+    uint32 width;
+    uint32 stride;
+    int32_t format;
+    int layout;
+    bool associatedAlpha;
+
+    //ABGR and grey rows for conversions that go through ABGR
+    uint32 *abgrRow;
+    unsigned char *greyRow;
+};
+
+#endif //TIFFSAMPLE_NATIVEBITMAPROWS_H
@@ -0,0 +1,190 @@
+//
+// Writer of image data to strips or tiles of saved image.
+// Chunks could be compressed by several worker threads. Each worker encodes chunks with its own in-memory TIFF
+// that has same setup as saved image, and compressed chunks are written to image in order with raw writes,
+// so file is the same as one written by libtiff on single thread.
+// Horizontal predictor is applied with vector code before encoding, and Deflate chunks are compressed with zlib
+// directly, so level and strategy of zlib could be chosen.
+//
+
+#ifndef TIFFSAMPLE_NATIVECHUNKWRITER_H
+#define TIFFSAMPLE_NATIVECHUNKWRITER_H
+
+#include <android/log.h>
+#include <pthread.h>
+#include <cstdlib>
+#include <cstring>
+#include <tiffio.h>
+#include <zlib.h>
+
+class NativeChunkWriter {
+public:
+    //Writer of rows of rowBytes bytes. All fields of image, including strip or tile size, should be set.
+    //threadCount 0 means number of processors
+    NativeChunkWriter(TIFF *image, tmsize_t rowBytes, int bitsPerPixel, int threadCount);
+
+    ~NativeChunkWriter();
+
+    //Write strips or tiles that cover rows [firstRow, firstRow + rowCount) of image. firstRow should start strip or row of tiles,
+    //rowCount should be multiple of getChunkHeight() except for the last rows of image.
+    //Uncompressed data and bands with one chunk are written on calling thread
+    bool writeRows(const unsigned char *rows, uint32 firstRow, uint32 rowCount);
+
+    //Rows per strip or tile height
+    uint32 getChunkHeight() const;
+
+    int getThreadCount() const;
+
+    //Approximate memory of buffers of chunks and encoders used by writeRows, without rows themselves
+    size_t getWorkingMemory() const;
+
+    //Use fewer threads while working memory exceeds available bytes. One thread is always kept
+    void fitMemory(size_t available);
+
+    //zlib strategy of Deflate compressed chunks, Z_DEFAULT_STRATEGY by default
+    void setDeflateStrategy(int strategy);
+
+    //Encode chunks of rows like writeRows, but on calling thread and keep them in memory instead of writing
+    bool keepRows(const unsigned char *rows, uint32 firstRow, uint32 rowCount);
+
+    //Write kept chunks of the whole image to target with raw writes. Target should have the same fields as image of writer
+    bool writeKept(TIFF *target);
+
+    //Bytes of chunks kept so far
+    size_t getKeptSize() const;
+
+    //TIFF that only holds fields of image for writer that keeps chunks, nothing written to it is stored.
+    //It is freed with TIFFCleanup
+    static TIFF *openFieldsTiff();
+
+private:
+    struct Chunk {
+        unsigned char *data;
+        tmsize_t size;
+        bool ready;
+    };
+
+    //Memory file of worker. Keeps only bytes written after base, so only the last encoded chunk is stored
+    struct MemoryFile {
+        unsigned char *data;
+        tmsize_t capacity;
+        toff_t base;
+        toff_t end;
+        toff_t position;
+    };
+
+    //Buffers and codec of thread that encodes chunks. Chunks that are not Deflate compressed are encoded by libtiff
+    //with memory TIFF
+    struct Encoder {
+        TIFF *tiff;
+        MemoryFile file;
+        z_stream zip;
+        bool zipOpen;
+        unsigned char *tile;
+        unsigned char *predicted;
+    };
+
+    //Write chunks with libtiff on calling thread
+    bool writeSerial();
+
+    //Encode chunks on calling thread and write them raw
+    bool writeEncoded();
+
+    bool writeParallel(int threads);
+
+    //Write encoded chunk to target. JPEG tables of encoder are set before the first chunk
+    bool writeRawChunk(TIFF *target, uint32 index, const Chunk *chunk);
+
+    //Take JPEG tables of encoder, they are the same for all chunks
+    bool takeJpegTables(Encoder *encoder);
+
+    //Pointer to uncompressed data of chunk of current band. Tiles are copied to tile buffer, edges outside of image are zeroed
+    const unsigned char *chunkData(uint32 index, unsigned char *tile, tmsize_t *size) const;
+
+    tmsize_t tileBufferSize() const;
+
+    //Bytes of uncompressed strip or tile
+    size_t chunkBufferSize() const;
+
+    //Whether chunks are encoded by this writer instead of libtiff of image: predictor or Deflate
+    bool encodesItself() const;
+
+    bool openEncoder(Encoder *encoder) const;
+
+    void closeEncoder(Encoder *encoder) const;
+
+    //Open memory TIFF with fields of image that affect encoding of image data
+    TIFF *openEncoderTiff(MemoryFile *file) const;
+
+    //Encode chunk and take compressed bytes
+    bool encodeChunk(Encoder *encoder, uint32 index, Chunk *chunk);
+
+    //Compress chunk with zlib as libtiff Deflate codec does
+    bool deflateChunk(Encoder *encoder, const unsigned char *raw, tmsize_t size, Chunk *chunk);
+
+    void workerLoop();
+
+    static void *workerMain(void *writer);
+
+    static tmsize_t fileRead(thandle_t, void *, tmsize_t);
+
+    static tmsize_t fileWrite(thandle_t, void *, tmsize_t);
+
+    static toff_t fileSeek(thandle_t, toff_t, int);
+
+    static int fileClose(thandle_t);
+
+    static toff_t fileSize(thandle_t);
+
+    static int fileMap(thandle_t, void **, toff_t *);
+
+    static void fileUnmap(thandle_t, void *, toff_t);
+
+    static tmsize_t fieldsWrite(thandle_t, void *, tmsize_t);
+
+    static toff_t fieldsSeek(thandle_t, toff_t, int);
+
+    static toff_t fieldsSize(thandle_t);
+
+    TIFF *image;
+    tmsize_t rowBytes;
+    int bitsPerPixel;
+    uint32 width;
+    uint32 height;
+    bool tiled;
+    uint32 chunkWidth;
+    uint32 chunkHeight;
+    uint32 chunksAcross;
+    uint16 compression;
+    int threadCount;
+    //Horizontal predictor applied by writer
+    bool predictor;
+    bool deflate;
+    int deflateLevel;
+    int deflateStrategy;
+
+    //Band of rows that is written now
+    const unsigned char *data;
+    uint32 dataRow;
+    uint32 firstChunk;
+    uint32 endChunk;
+
+    //State shared with workers, guarded by mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    Chunk *chunks;
+    uint32 nextChunk;
+    uint32 writtenChunks;
+    uint32 window;
+    bool failed;
+    void *jpegTables;
+    uint32 jpegTablesSize;
+
+    //Chunks of the whole image encoded by keepRows and their encoder
+    Chunk *keptChunks;
+    size_t keptSize;
+    Encoder keptEncoder;
+    bool keptEncoderOpen;
+};
+
+#endif //TIFFSAMPLE_NATIVECHUNKWRITER_H
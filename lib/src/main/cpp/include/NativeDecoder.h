@@ -14,6 +14,9 @@
 #include <csignal>
 #include <csetjmp>
 #include "NativeExceptions.h"
+#include "NativeRawReader.h"
+#include "NativeRowReader.h"
+#include "NativeRowSink.h"
 
 class NativeDecoder {
 public:
@@ -23,6 +26,19 @@ public:
 
     jobject getBitmap();
 
+    //Decode image to bands of bandHeight rows and pass them to native callback or, if it is 0, to Java listener
+    jboolean decodeBands(jint bandHeight, jobject bandListener, jlong bandCallback, jlong bandCallbackData);
+
+    //Decode image directly into direct buffer converting pixels to PixelFormat
+    jboolean decodeInto(jobject buffer, jint rowStride, jint pixelFormat);
+
+    //Decode image directly into direct buffer as YUV 4:2:0 image in YuvFormat
+    jboolean decodeYuv(jobject buffer, jint rowStride, jint yuvFormat);
+
+    //Decode image directly into direct buffer as normalized tensor of tensorWidth x tensorHeight cells or of decoded size if they are 0.
+    //Number of channels is length of mean
+    jboolean decodeTensor(jobject buffer, jint tensorWidth, jint tensorHeight, jint layout, jint type, jfloatArray mean, jfloatArray std);
+
 private:
     //constants
     static uint const colorMask = 0xFF;
@@ -33,6 +49,11 @@ private:
     static int const DECODE_METHOD_IMAGE = 1;
     static int const DECODE_METHOD_TILE = 2;
     static int const DECODE_METHOD_STRIP = 3;
+    static int const DECODE_METHOD_STREAM = 4;
+    //rows that are read at once from single strip by scanline or raw reader
+    static uint32 const SCANLINE_CHUNK_ROWS = 16;
+    //pixels of 8 bits of every byte value
+    static uint32 const BIT_TABLE_SIZE = 256 * 8;
 
     static int const DECODE_MODE_FILE_PATH = 1;
     static int const DECODE_MODE_FILE_DESCRIPTOR = 2;
@@ -45,8 +66,8 @@ private:
 
     static jmp_buf tile_buf;
     static jmp_buf strip_buf;
-    static jmp_buf image_buf;
     static jmp_buf general_buf;
+    static jmp_buf stream_buf;
 
     jobject optionsObject;
     jobject listenerObject;
@@ -71,23 +92,113 @@ private:
     jint boundHeight;
     char hasBounds;
     unsigned long availableMemory;
+    jfloat floatMinValue;
+    jfloat floatMaxValue;
+    //total ink limit of CMYK pixels in percent from inCmykInkLimit option, 0 for naive conversion
+    jint cmykInkLimit;
+    NativeRawReader *rawReader;
+    //only alpha of pixels is used, for ALPHA_8 bitmaps
+    bool alphaOnly;
+    //samples of inBands option, bandCount is 0 if option is not set
+    int bands[4];
+    int bandCount;
+    //number of reduced resolution SubIFD from inOverview option, 0 for full resolution directory
+    int overview;
+    uint32 streamChunkRows;
+    uint32 *bandPixels;
+    uint32 bandWidth;
+    jobject bandListenerObject;
+    jlong bandCallbackPointer;
+    jlong bandCallbackUserData;
+
+    //Destination of decoding by streaming rows of region. Decoder opens image, checks memory and reports errors,
+    //target checks destination, allocates sink and streams region to it
+    class StreamTarget {
+    public:
+        explicit StreamTarget(NativeDecoder *decoder);
+
+        virtual ~StreamTarget();
+
+        void setRegion(uint32 regionWidth, uint32 regionHeight, int inSampleSize, int orientation);
+
+        //Check destination. Returns error message or nullptr
+        virtual const char *check() = 0;
+
+        //Memory of sink and of streaming window. Target could choose bigger window that fits into budget
+        virtual unsigned long estimateMemory(unsigned long budget) = 0;
+
+        //Allocate sink. Returns error message or nullptr
+        virtual const char *init() = 0;
+
+        //Stream region to sink. Returns error message or nullptr
+        virtual const char *decode(bool *stopped);
+
+    protected:
+        NativeDecoder *decoder;
+        NativeRowSink *sink;
+        uint32 regionWidth;
+        uint32 regionHeight;
+        uint32 outWidth;
+        uint32 outHeight;
+        int inSampleSize;
+        NativeOrientationMap map;
+    };
+
+    class BandTarget;
+    class BufferTarget;
+    class YuvTarget;
+    class TensorTarget;
 
     //methods
+    jboolean decodeToTarget(const char *, StreamTarget *);
+
     int getDirectoryCount();
 
+    //Number of SubIFDs of current directory
+    int getOverviewCount();
+
+    //Switch from current directory to its SubIFD of overview option. Return false if there is no such SubIFD
+    bool setOverview();
+
     void writeDataToOptions(int);
 
+    bool initDecoding(jint *, jboolean *, jint *);
+
     jobject createBitmap(int, int);
 
-    jint *getSampledRasterFromImage(int, int *, int *);
+    bool checkImageFormat();
 
-    jint *getSampledRasterFromImageWithBounds(int, int *, int *);
+    bool initRawReader();
 
-    jint applyFilterForImage(int x, int y, const unsigned int *raster) const;
+    int readRGBAStrip(uint32, uint32 *);
 
-    jint *getSampledRasterFromStrip(int, int *, int *);
+    int readRGBATile(uint32, uint32, uint32 *);
+
+    int planDecode(int, int);
+
+    void writeDecodePlan(int, unsigned long);
+
+    unsigned long estimateMemory(int, int, int);
 
-    jint *getSampledRasterFromStripWithBounds(int, int *, int *);
+    unsigned long estimateStreamMemory(unsigned long, unsigned long, int, unsigned long);
+
+    bool useScanlineReader();
+
+    bool skipStripRows(int);
+
+    bool useBilevelReader();
+
+    jint *getSampledRasterFromStream(int, int *, int *);
+
+    const char *streamRegion(int, uint32, uint32, uint32, uint32, NativeRowSink *, jlong, bool *);
+
+    const char *streamBilevelRegion(int, uint32, uint32, uint32, uint32, NativeRowSink *, jlong, bool *);
+
+    bool deliverBand(uint32, uint32);
+
+    static bool bandSinkConsumer(void *, uint32, uint32);
+
+    jint *getSampledRasterFromStrip(int, int *, int *);
 
     bool needStripVerticalFlip();
 
@@ -134,9 +245,9 @@ private:
 
     static void stripErrorHandler(int code, siginfo_t *siginfo, void *sc);
 
-    static void imageErrorHandler(int code, siginfo_t *siginfo, void *sc);
-
     static void generalErrorHandler(int code, siginfo_t *siginfo, void *sc);
+
+    static void streamErrorHandler(int code, siginfo_t *siginfo, void *sc);
 };
 
 #endif //TIFFSAMPLE_NATIVEDECODER_H
@@ -0,0 +1,83 @@
+//
+// Writer of reduced resolution overviews of saved image.
+// Source rows go through stages that average 2x2 blocks, one stage per level, so every pixel of overview
+// is average of 2^level x 2^level block of source. Only one row per stage and one band of tiles per level are kept.
+// Several levels are made in one pass over source: the first of them is written to image while rows pass,
+// next ones are compressed to memory and written with raw writes after directory of previous level.
+// Rows of stages are packed to sample layout of saved image by source of rows.
+//
+
+#ifndef TIFFSAMPLE_NATIVEOVERVIEWWRITER_H
+#define TIFFSAMPLE_NATIVEOVERVIEWWRITER_H
+
+#include <cstdlib>
+#include <cstring>
+#include <tiffio.h>
+#include "NativeBitmapRows.h"
+#include "NativeChunkWriter.h"
+
+class NativeOverviewWriter {
+public:
+    //Writer of levelCount levels from firstLevel >= 1 of rows of source. Level firstLevel is written to images[0],
+    //that is current directory of saved image, next levels are kept in memory. Every image should have fields of its level,
+    //including size of level and fields set by source
+    NativeOverviewWriter(TIFF **images, int levelCount, NativeBitmapRows *source, int firstLevel, int threadCount);
+
+    ~NativeOverviewWriter();
+
+    //Size of image side at level: halved level times with rounding up
+    static uint32 levelSize(uint32 size, int level);
+
+    //Approximate memory of rows of stages, bands of tiles, writers of tiles and uncompressed size of kept levels
+    size_t getWorkingMemory() const;
+
+    //Use fewer threads for compression of the first level while working memory exceeds available bytes
+    void fitMemory(size_t available);
+
+    //zlib strategy of Deflate compressed tiles
+    void setDeflateStrategy(int strategy);
+
+    //Allocate rows of stages and bands of tiles
+    bool begin();
+
+    //Receive next row of source image with ABGR pixels. Row is not used after return
+    bool writeRow(const uint32 *row);
+
+    //Write rows that are left in stages and last bands
+    bool finish();
+
+    //Write kept level firstLevel + index, index >= 1, to current directory of target that has fields of images[index]
+    bool writeKept(int index, TIFF *target);
+
+private:
+    bool pushRow(int stage, const uint32 *row);
+
+    bool emitRow(int index, const uint32 *row);
+
+    bool flushBand(int index);
+
+    size_t getRowsMemory() const;
+
+    NativeBitmapRows *source;
+    uint32 sourceWidth;
+    int firstLevel;
+    int levelCount;
+    //Number of stages, that is the last level
+    int stageCount;
+
+    //Writer, packed band and size of every level
+    NativeChunkWriter **writers;
+    unsigned char **bands;
+    uint32 *bandRows;
+    uint32 *bandFirstRow;
+    uint32 *levelWidth;
+    tmsize_t *levelRowBytes;
+    size_t keptMemory;
+
+    //Row waiting for pair at every stage and row produced by stage
+    uint32 **heldRows;
+    bool *held;
+    uint32 **outRows;
+};
+
+#endif //TIFFSAMPLE_NATIVEOVERVIEWWRITER_H
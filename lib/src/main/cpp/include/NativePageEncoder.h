@@ -0,0 +1,93 @@
+//
+// Compression of pages saved together ahead of writing them.
+// Page encoder compresses strips or tiles of one page to memory with chunk writer on worker thread,
+// then writer of file puts them to its directory with raw writes, so file is the same as one written page by page.
+// Queue of pages runs encoders on pool of threads in page order, so page is written while the next ones are compressed.
+//
+
+#ifndef TIFFSAMPLE_NATIVEPAGEENCODER_H
+#define TIFFSAMPLE_NATIVEPAGEENCODER_H
+
+#include <pthread.h>
+#include <cstdlib>
+#include <tiffio.h>
+#include "NativeTiffSaver.h"
+#include "NativeBitmapRows.h"
+#include "NativeChunkWriter.h"
+
+class NativePageEncoder {
+public:
+    //Encoder of page of rows with height saved with options. Options should live until encoder is deleted
+    NativePageEncoder(NativeBitmapRows *rows, uint32 height, const NativeSaveOptions *options);
+
+    ~NativePageEncoder();
+
+    //Approximate memory of compressed page, its band of converted rows and encoder
+    size_t getMemory() const;
+
+    //Convert and compress all rows of page. Called on worker thread
+    bool encode();
+
+    //Write compressed strips or tiles to current directory of image. Page fields of image should be set by setPageFields
+    bool write(TIFF *image);
+
+private:
+    NativeBitmapRows *rows;
+    uint32 height;
+    uint32 bandHeight;
+    size_t memory;
+    //TIFF that only holds fields of page for chunk writer
+    TIFF *scratch;
+    NativeChunkWriter *chunkWriter;
+};
+
+class NativePageQueue {
+public:
+    //Queue of count pages, null pages are written without encoder. Workers keep encoded pages within memory
+    //and at most two pages per thread ahead of writer. No threads means that pages are encoded by waitPage
+    NativePageQueue(NativePageEncoder **pages, int count, int threadCount, size_t memory);
+
+    ~NativePageQueue();
+
+    //Wait until page is encoded. Returns false if encoding failed
+    bool waitPage(int index);
+
+    //Page was written, so its memory is free. Called for every page in order
+    void pageWritten(int index);
+
+    //Stop workers after pages they encode now and wait for them
+    void stop();
+
+private:
+    //States of pages
+    static int const PAGE_WAITING = 0;
+    static int const PAGE_ENCODING = 1;
+    static int const PAGE_ENCODED = 2;
+    static int const PAGE_FAILED = 3;
+
+    //Take next page in order if memory and window allow. Called with mutex locked, returns -1 if there is no page to take
+    int takePage();
+
+    void workerLoop();
+
+    static void *workerMain(void *queue);
+
+    NativePageEncoder **pages;
+    int count;
+    size_t memory;
+
+    pthread_t *workers;
+    int workerCount;
+
+    //State shared with workers, guarded by mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    int *states;
+    int nextPage;
+    int writtenPages;
+    int window;
+    size_t usedMemory;
+    bool stopped;
+};
+
+#endif //TIFFSAMPLE_NATIVEPAGEENCODER_H
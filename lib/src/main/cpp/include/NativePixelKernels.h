@@ -0,0 +1,138 @@
+//
+// Pixel conversion kernels shared by decoder and saver.
+// Conversion kernels have NEON and SSE paths and a scalar fallback used for tails and other ABIs.
+// Kernels marked as scalar only have no vector path.
+//
+
+#ifndef TIFFSAMPLE_NATIVEPIXELKERNELS_H
+#define TIFFSAMPLE_NATIVEPIXELKERNELS_H
+
+#include <cstdint>
+
+//Find min and max of finite values. NaN and infinity are skipped. min and max keep their values if there is no finite value
+void pixels_float_min_max(const float *src, uint32_t count, float *min, float *max);
+
+//dst = clamp((src - offset) * scale, 0, 255). NaN gives 0
+void pixels_float_to_byte(const float *src, uint8_t *dst, uint32_t count, float offset, float scale);
+
+//Convert values to signed bytes: clamp(round(src), -128, 127). Halves are rounded up
+void pixels_float_to_int8(const float *src, int8_t *dst, uint32_t count);
+
+//Convert IEEE 754 half precision values to float
+void pixels_half_to_float(const uint16_t *src, float *dst, uint32_t count);
+
+//Expand 8 bit grey samples to opaque ABGR pixels
+void pixels_gray_to_abgr(const uint8_t *src, uint32_t *dst, uint32_t count);
+
+//Expand packed 8 bit RGB samples to opaque ABGR pixels
+void pixels_rgb_to_abgr(const uint8_t *src, uint32_t *dst, uint32_t count);
+
+//Interleave 8 bit planes of samples to ABGR pixels. a may be nullptr for opaque pixels
+void pixels_planes_to_abgr(const uint8_t *r, const uint8_t *g, const uint8_t *b, const uint8_t *a, uint32_t *dst, uint32_t count);
+
+//Expand plane of 8 bit alpha samples to black ABGR pixels. a may be nullptr for opaque pixels
+void pixels_alpha_to_abgr(const uint8_t *a, uint32_t *dst, uint32_t count);
+
+//Expand RGB_565 pixels of Android bitmap to opaque ABGR pixels. High bits of every field fill its low bits
+void pixels_rgb565_to_abgr(const uint16_t *src, uint32_t *dst, uint32_t count);
+
+//Expand RGB_565 pixels of Android bitmap to packed 8 bit R, G, B samples the same way as pixels_rgb565_to_abgr
+void pixels_rgb565_to_rgb(const uint16_t *src, uint8_t *dst, uint32_t count);
+
+//Expand RGBA_4444 pixels of Android bitmap (red in the highest 4 bits, alpha in the lowest) to ABGR pixels: v * 17
+void pixels_rgba4444_to_abgr(const uint16_t *src, uint32_t *dst, uint32_t count);
+
+//Multiply colors of ABGR pixels by their alpha as libtiff does for unassociated alpha: (c * a + 127) / 255
+void pixels_premultiply_abgr(uint32_t *px, uint32_t count);
+
+//Gather samples of pixels that take pixelBytes bytes to ABGR pixels. offsets holds byte offsets of R, G and B samples
+//in pixel and offset of alpha sample or -1 for opaque pixels
+void pixels_gather_to_abgr(const uint8_t *src, uint32_t pixelBytes, const int32_t *offsets, uint32_t *dst, uint32_t count);
+
+//Scale 16 bit samples to 8 bits as libtiff RGBA interface does for colors: (v * 255 + 32767) / 65535
+void pixels_u16_to_u8(const uint16_t *src, uint8_t *dst, uint32_t count);
+
+//Convert 8 bit C, M, Y, K samples to opaque ABGR pixels as libtiff RGBA interface does: r = (255 - k) * (255 - c) / 255.
+//Pixels have samplesPerPixel >= 4 samples, extra ones are skipped
+void pixels_cmyk_to_abgr(const uint8_t *src, uint32_t samplesPerPixel, uint32_t *dst, uint32_t count);
+
+//Convert 8 bit CMYK samples like pixels_cmyk_to_abgr after total ink is limited to inkLimit, 255 to 1020 in units of samples.
+//C, M and Y of pixels with more ink are multiplied by (inkLimit - k) / (c + m + y) and truncated, so limit is never exceeded
+void pixels_cmyk_limited_to_abgr(const uint8_t *src, uint32_t samplesPerPixel, uint32_t inkLimit, uint32_t *dst, uint32_t count);
+
+//Conversion of CIE XYZ to display colors with the steps of libtiff TIFFXYZToRGB.
+//colors maps index of luminance step to 8 bit color and has range + 1 entries for each channel
+struct PixelsXYZToRGB {
+    float matrix[9];
+    float minLuminance[3];
+    float maxLuminance[3];
+    float step[3];
+    int32_t range;
+    const uint8_t *colors[3];
+};
+
+//Look up XYZ of 8 bit CIE L*a*b* pixels (a and b signed) in tables of 256 * 256 X values for L and a,
+//256 Y values for L and 256 * 256 Z values for L and b. Scalar only: every value is a table lookup
+void pixels_lab8_to_xyz(const uint8_t *src, const float *tableX, const float *tableY, const float *tableZ, float *x, float *y, float *z, uint32_t count);
+
+//Convert 16 bit CIE L*a*b* pixels (L unsigned, a and b signed) to XYZ with the steps of libtiff TIFFCIELab16ToXYZ.
+//white holds X, Y and Z of reference white
+void pixels_lab16_to_xyz(const uint16_t *src, const float *white, float *x, float *y, float *z, uint32_t count);
+
+//Convert XYZ to opaque ABGR pixels
+void pixels_xyz_to_abgr(const float *x, const float *y, const float *z, const PixelsXYZToRGB *conv, uint32_t *dst, uint32_t count);
+
+//Pack ABGR pixels to R, G, B bytes
+void pixels_abgr_to_rgb(const uint32_t *src, uint8_t *dst, uint32_t count);
+
+//Pack ABGR pixels to B, G, R bytes
+void pixels_abgr_to_bgr(const uint32_t *src, uint8_t *dst, uint32_t count);
+
+//Reorder ABGR pixels to A, R, G, B bytes
+void pixels_abgr_to_argb(const uint32_t *src, uint8_t *dst, uint32_t count);
+
+//Take alpha samples of ABGR pixels
+void pixels_abgr_to_alpha(const uint32_t *src, uint8_t *dst, uint32_t count);
+
+//Split ABGR pixels to float planes of red, green and blue samples
+void pixels_abgr_to_float(const uint32_t *src, float *r, float *g, float *b, uint32_t count);
+
+//Luminance of ABGR pixels with the same weights as saver uses for grey images (0.2125, 0.7154, 0.0721)
+void pixels_abgr_to_gray(const uint32_t *src, uint8_t *dst, uint32_t count);
+
+//Pack grey samples to bits, most significant bit first: bit is set for sample >= threshold.
+//Unused bits of last byte are zero
+void pixels_gray_to_bits(const uint8_t *src, uint8_t threshold, uint8_t *dst, uint32_t count);
+
+//BT.601 limited range luma of ABGR pixels: ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16
+void pixels_abgr_to_y(const uint32_t *src, uint8_t *dst, uint32_t count);
+
+//BT.601 limited range chroma of 2x2 blocks of two rows of width ABGR pixels: (width + 1) / 2 values of u and of v.
+//Colors of block are averaged before conversion. bottom may be the same as top for last row of image with odd height
+void pixels_abgr_to_uv(const uint32_t *top, const uint32_t *bottom, uint32_t width, uint8_t *u, uint8_t *v);
+
+//Averages of 2x2 blocks of two rows of width ABGR pixels, rounded to nearest: (width + 1) / 2 pixels.
+//Last block of odd width takes its only column twice, bottom may be the same as top for last row of odd height
+void pixels_abgr_half_row(const uint32_t *top, const uint32_t *bottom, uint32_t width, uint32_t *dst);
+
+//Horizontal differencing of TIFF predictor 2 for row of count 8 bit samples with stride samples per pixel:
+//dst[i] = src[i] - src[i - stride], the first pixel is copied
+void pixels_horizontal_diff(const uint8_t *src, uint8_t *dst, uint32_t count, uint32_t stride);
+
+//Average of 3x3 neighbourhood for pixels x = start + i * step of mid row, i < count.
+//top may be nullptr for first row of image, bottom for last one. Pixels outside of width are skipped. Scalar only
+void pixels_box3_row(const uint32_t *top, const uint32_t *mid, const uint32_t *bottom, uint32_t width, uint32_t start, uint32_t step, uint32_t *dst, uint32_t count);
+
+//Fill table of 256 * (8 / bitsPerSample) pixels: pixels of all samples of every byte value, most significant bits first.
+//colors holds pixel for each of 1 << bitsPerSample sample values. bitsPerSample is 1, 2, 4 or 8. Scalar only
+void pixels_build_index_table(const uint32_t *colors, uint32_t bitsPerSample, uint32_t *table);
+
+//Expand count packed samples that start at bit firstBit of src to pixels with table from pixels_build_index_table.
+//Scalar only: whole bytes are expanded by copying their pixels from table
+void pixels_indexed_to_abgr(const uint8_t *src, uint32_t firstBit, uint32_t bitsPerSample, const uint32_t *table, uint32_t *dst, uint32_t count);
+
+//Add number of set bits in blocks of step bits that start at bit firstBit of src to counts, one block per counter.
+//Scalar only: bits are counted with popcount builtins
+void pixels_bits_count(const uint8_t *src, uint32_t firstBit, uint32_t step, uint32_t *counts, uint32_t count);
+
+#endif //TIFFSAMPLE_NATIVEPIXELKERNELS_H
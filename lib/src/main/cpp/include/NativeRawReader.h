@@ -0,0 +1,170 @@
+//
+// Reader for sample layouts that libtiff RGBA interface can't handle or converts pixel by pixel:
+// floating point samples, packed palette or greyscale indices, YCbCr JPEG that libjpeg converts to RGB,
+// CMYK and CIE L*a*b* samples that are converted with vector kernels, separate planes of RGB samples
+// and samples that are selected by inBands option.
+// Decodes strips and tiles with TIFFReadEncodedStrip/TIFFReadEncodedTile and converts them to ABGR pixels.
+// readRGBAStrip and readRGBATile return rasters with the same layout as
+// TIFFReadRGBAStrip and TIFFReadRGBATile so decoder can use them as replacement.
+//
+
+#ifndef TIFFSAMPLE_NATIVERAWREADER_H
+#define TIFFSAMPLE_NATIVERAWREADER_H
+
+#include <android/log.h>
+#include <cstdlib>
+#include <cstring>
+#include <tiffio.h>
+#include "NativePixelKernels.h"
+
+class NativeRawReader {
+public:
+    explicit NativeRawReader(TIFF *);
+
+    ~NativeRawReader();
+
+    //Check if image is stored with floating point samples
+    static bool isFloatImage(TIFF *);
+
+    //Check if image is stored with packed palette indices or low bit greyscale samples that are expanded with table.
+    //1 bit greyscale strips are left to bilevel decoding of decoder
+    static bool isIndexedImage(TIFF *);
+
+    //Check if image is JPEG compressed with contiguous YCbCr samples that libjpeg can convert to RGB itself
+    static bool isJpegYCbCrImage(TIFF *);
+
+    //Check if image has contiguous 8 bit CMYK samples
+    static bool isCmykImage(TIFF *);
+
+    //Check if image has contiguous 8 or 16 bit CIE L*a*b* samples
+    static bool isLabImage(TIFF *);
+
+    //Check if image has 8 bit RGB samples in separate planes
+    static bool isPlanarImage(TIFF *);
+
+    //Check if image has more than one strip or tile in each plane
+    static bool hasSeveralBlocks(TIFF *);
+
+    //Read only alpha plane of planar images, colors are left black. Should be called before init()
+    void readAlphaOnly();
+
+    //Decode samples with given indices as R, G, B and A (-1 for opaque pixels) instead of colors of image.
+    //count is number of indices in option, 1 index gives grey. Should be called before checkSupport()
+    void selectBands(const int *, int);
+
+    //Check if reader can decode current directory. Return nullptr if it can or error message otherwise
+    const char *checkSupport() const;
+
+    //Allocate work buffers. Should be called before reading
+    bool init();
+
+    //Memory in bytes that reader allocates in init()
+    unsigned long getWorkingMemory() const;
+
+    //Find min and max of finite samples in one pass over strips or tiles
+    bool computeFloatRange();
+
+    //Set range of floating point values that is mapped to 0..255
+    void setFloatRange(float, float);
+
+    //Limit total ink of CMYK pixels to percent from 100 to 400 before conversion, 0 for naive conversion
+    void setInkLimit(int);
+
+    float getFloatMin() const;
+
+    float getFloatMax() const;
+
+    int readRGBAStrip(uint32 row, uint32 *raster);
+
+    int readRGBATile(uint32 col, uint32 row, uint32 *raster);
+
+    //Read rectangle of pixels in file order. Row r of rectangle is written to dst + r * rowStep.
+    //If mirror is true pixels of each row are written from right to left
+    int readRows(uint32 x, uint32 y, uint32 w, uint32 h, uint32 *dst, long rowStep, bool mirror);
+
+private:
+    static int const FLIP_VERTICALLY = 1;
+    static int const FLIP_HORIZONTALLY = 2;
+
+    static int const SAMPLES_FLOAT = 0;
+    static int const SAMPLES_INDEXED = 1;
+    //strips and tiles of YCbCr JPEG are decoded by libjpeg to 8 bit RGB samples
+    static int const SAMPLES_RGB = 2;
+    static int const SAMPLES_CMYK = 3;
+    static int const SAMPLES_LAB = 4;
+    //only planes of samples that are needed are read, block holds them one after another
+    static int const SAMPLES_PLANAR = 5;
+    //8 or 16 bit samples that are chosen by inBands, contiguous or in planes
+    static int const SAMPLES_BANDS = 6;
+
+    TIFF *image;
+    uint32 width;
+    uint32 height;
+    uint16 samplesPerPixel;
+    uint16 bitsPerSample;
+    uint16 sampleFormat;
+    uint16 photometric;
+    uint16 planarConfig;
+    uint16 orientation;
+    int colorChannels;
+    int alphaIndex;
+    bool unassociatedAlpha;
+
+    bool tiled;
+    uint32 blockWidth;
+    uint32 blockHeight;
+    unsigned char *block;
+    tmsize_t blockBufferSize;
+    long cachedBlock;
+
+    bool alphaOnly;
+    //samples that are decoded as R, G, B and A, -1 for opaque pixels
+    int bandSamples[4];
+    int bandCount;
+    //colors are multiplied by alpha sample
+    bool premultiplyBands;
+    //samples of planes that are read to block and plane of each of bandSamples
+    uint16 planeSamples[4];
+    uint32 planeCount;
+    int bandPlanes[4];
+
+    float *floatRow;
+    unsigned char *byteRow;
+    uint32 *pixelRow;
+
+    int sampleKind;
+    //pixels of all samples of every byte value
+    uint32 *indexTable;
+
+    //X and Z for every L and a or b, then Y for every L of 8 bit samples
+    float *labTables;
+    unsigned char *labColors;
+    float labWhite[3];
+    PixelsXYZToRGB xyzToRGB;
+    //total ink of CMYK pixels in units of samples, 0 if it isn't limited
+    uint32 inkLimit;
+
+    float floatMin;
+    float floatMax;
+    float floatScale;
+
+    bool readsPlanes() const;
+
+    void choosePlanes();
+
+    void convertPlanes(const unsigned char *, uint32, uint32 *);
+
+    bool loadBlock(uint32);
+
+    const float *floatSamples(const unsigned char *, uint32);
+
+    void convertRow(const unsigned char *, uint32, uint32, uint32 *);
+
+    bool buildIndexTable();
+
+    bool buildLabTables();
+
+    static int flipFor(int, int);
+};
+
+#endif //TIFFSAMPLE_NATIVERAWREADER_H
@@ -0,0 +1,137 @@
+//
+// Sources of decoded rows for streaming decode.
+// Readers return ABGR rows of a column window in file order (top row first, without applying TIFFTAG_ORIENTATION).
+//
+
+#ifndef TIFFSAMPLE_NATIVEROWREADER_H
+#define TIFFSAMPLE_NATIVEROWREADER_H
+
+#include <android/log.h>
+#include <cstdlib>
+#include <cstring>
+#include <tiffio.h>
+#include "NativeRawReader.h"
+
+class NativeRowReader {
+public:
+    NativeRowReader(TIFF *, uint32 x, uint32 width);
+
+    virtual ~NativeRowReader();
+
+    //Prepare reader for reading up to maxRows rows at once. Return nullptr or error message
+    virtual const char *begin(uint32 maxRows) = 0;
+
+    //Read rows [y, y + count) of column window to dst. Stride of dst is getWidth()
+    virtual bool readRows(uint32 y, uint32 count, uint32 *dst) = 0;
+
+    //Check if any row could be read without decoding rows above it, so rows that are not needed could be skipped
+    virtual bool canSkipRows() const;
+
+    uint32 getX() const;
+
+    uint32 getWidth() const;
+
+protected:
+    //Size of largest compressed strip or tile that libtiff reads at once
+    static unsigned long maxRawBlockSize(TIFF *);
+
+    TIFF *image;
+    uint32 x;
+    uint32 width;
+};
+
+//Reads rows with libtiff RGBA interface using row and column offsets of TIFFRGBAImage
+class NativeRGBARowReader : public NativeRowReader {
+public:
+    NativeRGBARowReader(TIFF *, uint32 x, uint32 width);
+
+    ~NativeRGBARowReader() override;
+
+    const char *begin(uint32 maxRows) override;
+
+    bool readRows(uint32 y, uint32 count, uint32 *dst) override;
+
+    //Memory that reader and libtiff allocate for reading rows rows at once
+    static unsigned long estimateMemory(TIFF *, uint32 width, uint32 rows);
+
+    //Check if libtiff can start reading from column offset.
+    //libtiff computes column offset in bytes as col_offset * samplesperpixel, so it works only for 8 bit samples
+    static bool canUseColumnOffset(TIFF *);
+
+private:
+    TIFFRGBAImage img;
+    bool started;
+    bool useColumnOffset;
+    uint32 imageWidth;
+    uint32 *wideRows;
+};
+
+//Reads rows of stripped image one by one with TIFFReadScanline and converts them with put routine of TIFFRGBAImage.
+//Only one scanline of file samples is decoded at once instead of whole strip,
+//so rows of huge single strip images are read in a few rows of memory.
+//Rows of uncompressed images are read directly from their offset in file
+class NativeScanlineRowReader : public NativeRowReader {
+public:
+    NativeScanlineRowReader(TIFF *, uint32 x, uint32 width);
+
+    ~NativeScanlineRowReader() override;
+
+    const char *begin(uint32 maxRows) override;
+
+    bool readRows(uint32 y, uint32 count, uint32 *dst) override;
+
+    bool canSkipRows() const override;
+
+    //Read samples of row as they are stored in file, without conversion to pixels.
+    //Returns pointer to scanline that is valid until next read or nullptr on error
+    const unsigned char *readScanline(uint32 row);
+
+    //Memory that reader and libtiff allocate for reading rows
+    static unsigned long estimateMemory(TIFF *, uint32 width);
+
+    //Check if image can be read by scanlines: stripped image with contiguous samples.
+    //Subsampled YCbCr is supported only for jpeg compression where libjpeg converts it to RGB
+    static bool canRead(TIFF *);
+
+    //Check if rows of image are stored uncompressed, so offset of every row in file is known
+    static bool hasDirectRows(TIFF *);
+
+private:
+    //Offset of column window in bytes of scanline or -1 if window starts inside of byte
+    static tmsize_t columnOffset(TIFF *, uint32 x);
+
+    //Read samples of uncompressed row from file to scanline
+    bool readDirectRow(uint32 row);
+
+    TIFFRGBAImage img;
+    bool started;
+    uint32 imageWidth;
+    uint32 rowsPerStrip;
+    uint32 nextRow;
+    tmsize_t offset;
+    unsigned char *scanline;
+    tmsize_t scanlineSize;
+    uint32 *wideRow;
+
+    bool directRows;
+    uint16 bitsPerSample;
+    bool reverseBits;
+};
+
+//Reads rows with NativeRawReader
+class NativeRawRowReader : public NativeRowReader {
+public:
+    NativeRawRowReader(TIFF *, NativeRawReader *, uint32 x, uint32 width);
+
+    const char *begin(uint32 maxRows) override;
+
+    bool readRows(uint32 y, uint32 count, uint32 *dst) override;
+
+    //Decoded strip stays cached, so skipped rows are only not converted. Tiles would be decoded again for every row
+    bool canSkipRows() const override;
+
+private:
+    NativeRawReader *rawReader;
+};
+
+#endif //TIFFSAMPLE_NATIVEROWREADER_H
@@ -0,0 +1,215 @@
+//
+// Consumers of decoded rows for streaming decode.
+//
+
+#ifndef TIFFSAMPLE_NATIVEROWSINK_H
+#define TIFFSAMPLE_NATIVEROWSINK_H
+
+#include <jni.h>
+#include <cstdlib>
+#include <cstdint>
+#include <tiffio.h>
+
+//Maps pixels of image in file order to image with applied TIFFTAG_ORIENTATION
+class NativeOrientationMap {
+public:
+    NativeOrientationMap(uint32 width, uint32 height, int orientation);
+
+    uint32 getDisplayWidth() const;
+
+    uint32 getDisplayHeight() const;
+
+    int getOrientation() const;
+
+    //Position of pixel (0, y) in display raster and distance to pixel (1, y)
+    void rowPlacement(uint32 y, long *offset, long *step) const;
+
+private:
+    uint32 width;
+    uint32 height;
+    int orientation;
+};
+
+class NativeRowSink {
+public:
+    virtual ~NativeRowSink();
+
+    //Receive row y of output image. Rows come in file order, each row contains ABGR pixels
+    virtual bool writeRow(uint32 y, const uint32 *row) = 0;
+};
+
+//Writes rows to raster applying orientation
+class NativeRasterSink : public NativeRowSink {
+public:
+    NativeRasterSink(jint *raster, uint32 width, uint32 height, int orientation);
+
+    bool writeRow(uint32 y, const uint32 *row) override;
+
+private:
+    jint *raster;
+    uint32 width;
+    NativeOrientationMap map;
+};
+
+//Converts rows to pixel format and writes them to memory with row stride applying orientation
+class NativeBufferSink : public NativeRowSink {
+public:
+    //the same values as ordinals of org.beyka.tiffbitmapfactory.PixelFormat
+    static int const FORMAT_ARGB = 1;
+    static int const FORMAT_RGBA = 2;
+    static int const FORMAT_RGB = 3;
+    static int const FORMAT_BGR = 4;
+    static int const FORMAT_GRAY_8 = 5;
+
+    //Bytes per pixel of format or 0 for unknown format
+    static int bytesPerPixel(int format);
+
+    NativeBufferSink(uint8_t *buffer, long rowStride, int format, uint32 width, uint32 height, int orientation, bool swapRedBlue);
+
+    ~NativeBufferSink() override;
+
+    //Allocate line for conversion
+    bool init();
+
+    bool writeRow(uint32 y, const uint32 *row) override;
+
+private:
+    uint8_t *buffer;
+    long rowStride;
+    int format;
+    int pixelBytes;
+    uint32 width;
+    bool swapRedBlue;
+    uint32 *swappedLine;
+    uint8_t *convertedLine;
+    NativeOrientationMap map;
+};
+
+//Converts rows to BT.601 limited range YUV 4:2:0 and writes luma plane and chroma of every pair of lines applying orientation.
+//Buffer has luma plane of height rows with row stride, then chroma planes of (height + 1) / 2 rows:
+//U and V with half of row stride for I420, interleaved V and U or U and V with row stride for NV21 and NV12
+class NativeYuvSink : public NativeRowSink {
+public:
+    //the same values as ordinals of org.beyka.tiffbitmapfactory.YuvFormat
+    static int const FORMAT_I420 = 1;
+    static int const FORMAT_NV21 = 2;
+    static int const FORMAT_NV12 = 3;
+
+    //Bytes of buffer for display image of height rows or 0 for unknown format
+    static jlong bufferSize(int format, long rowStride, uint32 height);
+
+    NativeYuvSink(uint8_t *buffer, long rowStride, int format, uint32 width, uint32 height, int orientation, bool swapRedBlue);
+
+    ~NativeYuvSink() override;
+
+    //Memory that init allocates for rows of width pixels
+    static unsigned long getWorkingMemory(uint32 width);
+
+    //Allocate lines for conversion
+    bool init();
+
+    bool writeRow(uint32 y, const uint32 *row) override;
+
+private:
+    uint8_t *buffer;
+    long rowStride;
+    uint8_t *planeU;
+    uint8_t *planeV;
+    long chromaStride;
+    long chromaStep;
+    uint32 width;
+    bool swapRedBlue;
+    NativeOrientationMap map;
+    uint32 *line;
+    uint32 *pendingLine;
+    long pending;
+    uint8_t *luma;
+    uint8_t *chromaU;
+    uint8_t *chromaV;
+};
+
+//Resizes rows to cells of tensor by averaging of pixels that every cell covers and accumulates
+//normalized channels (value - mean) / std in float32 or int8 tensor applying orientation.
+//Upscaled cells repeat nearest pixel
+class NativeTensorSink : public NativeRowSink {
+public:
+    //the same values as ordinals of org.beyka.tiffbitmapfactory.TensorLayout
+    static int const LAYOUT_NCHW = 1;
+    static int const LAYOUT_NHWC = 2;
+    //the same values as ordinals of org.beyka.tiffbitmapfactory.TensorType
+    static int const TYPE_FLOAT32 = 1;
+    static int const TYPE_INT8 = 2;
+
+    //Bytes per value of type or 0 for unknown type
+    static int bytesPerValue(int type);
+
+    //width and height are size of decoded image before orientation, channels is 1 for luminance or 3 for red, green and blue
+    NativeTensorSink(uint8_t *tensor, int layout, int type, uint32 tensorWidth, uint32 tensorHeight, int channels, const float *mean, const float *std,
+                     uint32 width, uint32 height, int orientation, bool swapRedBlue);
+
+    ~NativeTensorSink() override;
+
+    //Memory that init allocates
+    unsigned long getWorkingMemory() const;
+
+    //Allocate lines and maps of cells and clear tensor
+    bool init();
+
+    bool writeRow(uint32 y, const uint32 *row) override;
+
+    //Write int8 values after last row
+    void finish();
+
+private:
+    //Pixels of display image that cell t covers along axis are start[t]..end[t] - 1,
+    //cells that cover pixel d are first[d]..stop[d] - 1
+    struct Axis {
+        uint32 *start;
+        uint32 *end;
+        uint32 *first;
+        uint32 *stop;
+        float *weight;
+    };
+
+    static void buildAxis(Axis *axis, uint32 cells, uint32 pixels);
+
+    uint8_t *tensor;
+    int layout;
+    int type;
+    uint32 tensorWidth;
+    uint32 tensorHeight;
+    int channels;
+    float scale[3];
+    float offset[3];
+    uint32 width;
+    bool swapRedBlue;
+    NativeOrientationMap map;
+    Axis axisX;
+    Axis axisY;
+    uint32 *axisMemory;
+    float *planes;
+    float *values;
+};
+
+//Collects rows into bands of fixed height and passes every filled band to consumer.
+//Only orientations that keep rows in place can be collected: rows are optionally mirrored
+class NativeBandSink : public NativeRowSink {
+public:
+    //consumer receives context, index of first row of band and number of rows in it. Returning false stops decoding
+    typedef bool (*Consumer)(void *context, uint32 firstRow, uint32 rowCount);
+
+    NativeBandSink(uint32 *band, uint32 width, uint32 bandRows, uint32 totalRows, bool mirror, Consumer consumer, void *context);
+
+    bool writeRow(uint32 y, const uint32 *row) override;
+
+private:
+    uint32 *band;
+    uint32 width;
+    uint32 bandRows;
+    uint32 totalRows;
+    bool mirror;
+    Consumer consumer;
+    void *context;
+};
+
+#endif //TIFFSAMPLE_NATIVEROWSINK_H
@@ -21,6 +21,38 @@ extern "C" {
 JNIEXPORT jobject JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeFD
   (JNIEnv *, jclass, jint, jobject, jobject);
 
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffBitmapFactory
+ * Method:    nativeDecodeBandsFD
+ * Signature: (ILorg/beyka/tiffbitmapfactory/TiffBitmapFactory$Options;ILorg/beyka/tiffbitmapfactory/IBandListener;JJLorg/beyka/tiffbitmapfactory/IProgressListener;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeBandsFD
+  (JNIEnv *, jclass, jint, jobject, jint, jobject, jlong, jlong, jobject);
+
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffBitmapFactory
+ * Method:    nativeDecodeIntoFD
+ * Signature: (ILorg/beyka/tiffbitmapfactory/TiffBitmapFactory$Options;Ljava/nio/ByteBuffer;IILorg/beyka/tiffbitmapfactory/IProgressListener;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeIntoFD
+  (JNIEnv *, jclass, jint, jobject, jobject, jint, jint, jobject);
+
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffBitmapFactory
+ * Method:    nativeDecodeYuvFD
+ * Signature: (ILorg/beyka/tiffbitmapfactory/TiffBitmapFactory$Options;Ljava/nio/ByteBuffer;IILorg/beyka/tiffbitmapfactory/IProgressListener;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeYuvFD
+  (JNIEnv *, jclass, jint, jobject, jobject, jint, jint, jobject);
+
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffBitmapFactory
+ * Method:    nativeDecodeTensorFD
+ * Signature: (ILorg/beyka/tiffbitmapfactory/TiffBitmapFactory$Options;Ljava/nio/ByteBuffer;IIII[F[FLorg/beyka/tiffbitmapfactory/IProgressListener;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeTensorFD
+  (JNIEnv *, jclass, jint, jobject, jobject, jint, jint, jint, jint, jfloatArray, jfloatArray, jobject);
+
 /*
  * Class:     com_example_beyka_tiffexample_TiffBitmapFactory
  * Method:    nativeCloseFd
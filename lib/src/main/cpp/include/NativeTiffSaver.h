@@ -6,9 +6,13 @@
 #include <tiffio.h>
 #include "fcntl.h"
 #include "unistd.h"
+#include <sys/stat.h>
 #include <ctime>
 #include "string.h"
 #include "NativeExceptions.h"
+#include "NativeBitmapRows.h"
+#include "NativeChunkWriter.h"
+#include "NativeOverviewWriter.h"
 
 #ifndef _Included_org_beyka_tiffbitmapfactory_TiffSaver
 #define _Included_org_beyka_tiffbitmapfactory_TiffSaver
@@ -23,10 +27,112 @@ extern "C" {
 JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffSaver_save
   (JNIEnv *, jclass, jstring, jint, jobject, jobject, jboolean);
 
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffSaver
+ * Method:    saveAll
+ */
+JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffSaver_saveAll
+  (JNIEnv *, jclass, jstring, jint, jobjectArray, jobject);
+
 JNIEXPORT void JNICALL Java_org_beyka_tiffbitmapfactory_TiffSaver_closeFd
   (JNIEnv *, jclass, jint);
 
-unsigned char *convertArgbToBilevel(uint32 *, jint, jint);
+//File of saved pages. Image is opened by the first page, so format of file is chosen by it.
+//fd -1 means that file is opened by path of the first page.
+//Output fails when page breaks after its data is written, then no more pages are written and image is closed without flushing.
+//needsBigTiff is set when classic file can't be opened for appending because pages would grow it over its limit
+typedef struct {
+    int fd;
+    bool append;
+    TIFF *image;
+    bool failed;
+    bool needsBigTiff;
+} NativeTiffOutput;
+
+//Options of saved pages read from TiffSaver.SaveOptions. Strings are held until releaseSaveOptions
+typedef struct {
+    size_t availableMemory;
+    jboolean throwException;
+    jint stripSize;
+    bool tiled;
+    jint tileWidth;
+    jint tileHeight;
+    jint overviewLevels;
+    jlong bigTiffThreshold;
+    jint compressionThreads;
+    jint compression;
+    jint orientation;
+    jint sampleLayout;
+    jint predictor;
+    jint deflateLevel;
+    jint deflateStrategy;
+    float xResolution;
+    float yResolution;
+    uint16 resUnit;
+    jstring jAuthor;
+    const char *author;
+    jstring jCopyright;
+    const char *copyright;
+    jstring jImageDescription;
+    const char *imageDescription;
+    char *hostComputer;
+} NativeSaveOptions;
+
+class NativePageEncoder;
+
+//Write bitmap as new directory of output. Image of output is opened if it isn't yet and stays open
+jboolean writeTiffPage(JNIEnv *, jstring, NativeTiffOutput *, jobject, jobject);
+
+//Read options of saving. Returns false, with exception if options ask for it, when layout of strips or tiles is invalid
+bool readSaveOptions(JNIEnv *, jstring, jobject, NativeSaveOptions *);
+
+void releaseSaveOptions(JNIEnv *, NativeSaveOptions *);
+
+//Check and lock pixels of bitmap. Returns false, with exception if options ask for it, when bitmap can't be saved
+bool lockBitmap(JNIEnv *, jstring, jobject, const NativeSaveOptions *, AndroidBitmapInfo *, void **);
+
+bool isBilevel(const NativeSaveOptions *);
+
+//Sample layout of saved image, CCITT schemes are always bilevel
+int pageLayout(const NativeSaveOptions *);
+
+int pageOverviewCount(const NativeSaveOptions *, uint32, uint32);
+
+//Uncompressed size of page with its overviews
+unsigned long long estimatePageSize(const NativeSaveOptions *, NativeBitmapRows *, uint32);
+
+//Open file of output, if it isn't open yet, and TIFF image. Format is chosen by estimated size of written data.
+//Existing classic file is not opened for appending when estimated size reaches bigTiffThreshold or 4 GB
+bool openOutput(JNIEnv *, jstring, NativeTiffOutput *, unsigned long long, const NativeSaveOptions *);
+
+//Close image of output, or only file when image isn't opened and closeFd is true
+void closeOutput(NativeTiffOutput *, bool);
+
+//Set all fields of page of rows with height to current directory of image
+void setPageFields(TIFF *, const NativeSaveOptions *, NativeBitmapRows *, uint32);
+
+//Discard fields of current directory of image that has no data written, so it is not written on close
+void dropDirectory(TIFF *);
+
+//Write page with overviews as new directory of output image. Image data is taken from encoded page if it isn't null,
+//otherwise it is converted and compressed by bands. Required memory is set when page doesn't fit into available memory.
+//Page that fails before its data is written leaves no directory, page that fails later marks output as failed
+bool writeBitmapPage(NativeTiffOutput *, NativeBitmapRows *, uint32, const NativeSaveOptions *, NativePageEncoder *, size_t *);
+
+void throwOpenError(JNIEnv *, jstring, const NativeTiffOutput *);
+
+void throwWriteError(JNIEnv *, jstring, const NativeSaveOptions *, size_t);
+
+//Set fields of overview level of page with width and height to current directory of image
+void setOverviewFields(TIFF *, const NativeSaveOptions *, NativeBitmapRows *, uint32, uint32, int);
+
+//Memory of the least demanding pass of writeOverviews, that is of the largest single level
+size_t overviewMemory(NativeBitmapRows *, uint32, uint32, int, const NativeSaveOptions *, size_t);
+
+//Write overview levels of page to SubIFDs that follow its directory
+int writeOverviews(TIFF *, NativeBitmapRows *, uint32, uint32, int, const NativeSaveOptions *, size_t, size_t *);
+
+void setCompressionFields(TIFF *, int, int, int);
 
 char *getCreationDate();
 
@@ -0,0 +1,42 @@
+#include <jni.h>
+#include <android/log.h>
+#include <stdlib.h>
+#include <tiffio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "NativeExceptions.h"
+#include "NativeTiffSaver.h"
+
+#ifndef _Included_org_beyka_tiffbitmapfactory_TiffWriter
+#define _Included_org_beyka_tiffbitmapfactory_TiffWriter
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffWriter
+ * Method:    nativeOpen
+ * Signature: (Ljava/lang/String;IZ)J
+ */
+JNIEXPORT jlong JNICALL Java_org_beyka_tiffbitmapfactory_TiffWriter_nativeOpen
+  (JNIEnv *, jclass, jstring, jint, jboolean);
+
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffWriter
+ * Method:    nativeAddPage
+ * Signature: (JLjava/lang/String;Landroid/graphics/Bitmap;Lorg/beyka/tiffbitmapfactory/TiffSaver$SaveOptions;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffWriter_nativeAddPage
+  (JNIEnv *, jclass, jlong, jstring, jobject, jobject);
+
+/*
+ * Class:     org_beyka_tiffbitmapfactory_TiffWriter
+ * Method:    nativeClose
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_org_beyka_tiffbitmapfactory_TiffWriter_nativeClose
+  (JNIEnv *, jclass, jlong);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,192 @@
+//
+// Source of rows of saved image taken from locked pixels of Android bitmap.
+//
+
+#include "NativeBitmapRows.h"
+#include "NativePixelKernels.h"
+
+//Half of the brightest grey, pixels from it are white in bilevel image
+static uint8_t const bilevelThreshold = 127;
+
+NativeBitmapRows::NativeBitmapRows(const void *px, const AndroidBitmapInfo *info, int lt) {
+    pixels = (const unsigned char *) px;
+    width = info->width;
+    stride = info->stride;
+    format = info->format;
+    layout = lt;
+    //bitmaps are premultiplied unless flags tell otherwise
+    uint32_t alpha = info->flags & ANDROID_BITMAP_FLAGS_ALPHA_MASK;
+    associatedAlpha = alpha != ANDROID_BITMAP_FLAGS_ALPHA_UNPREMUL;
+    if (layout == LAYOUT_AUTO) {
+        if (format == ANDROID_BITMAP_FORMAT_A_8) {
+            layout = LAYOUT_GRAY;
+        } else if (format == ANDROID_BITMAP_FORMAT_RGB_565 || alpha == ANDROID_BITMAP_FLAGS_ALPHA_OPAQUE) {
+            layout = LAYOUT_RGB;
+        } else {
+            layout = LAYOUT_RGBA;
+        }
+    }
+    abgrRow = nullptr;
+    greyRow = nullptr;
+}
+
+NativeBitmapRows::~NativeBitmapRows() {
+    if (abgrRow) free(abgrRow);
+    if (greyRow) free(greyRow);
+}
+
+bool NativeBitmapRows::begin() {
+    if (isDirect()) {
+        return true;
+    }
+    abgrRow = (uint32 *) malloc((size_t) width * sizeof(uint32));
+    if (layout == LAYOUT_BILEVEL) {
+        greyRow = (unsigned char *) malloc(width);
+        return abgrRow && greyRow;
+    }
+    return abgrRow != nullptr;
+}
+
+void NativeBitmapRows::setFields(TIFF *image) const {
+    switch (layout) {
+        case LAYOUT_BILEVEL:
+            TIFFSetField(image, TIFFTAG_BITSPERSAMPLE, 1);
+            TIFFSetField(image, TIFFTAG_SAMPLESPERPIXEL, 1);
+            TIFFSetField(image, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(image, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
+            break;
+        case LAYOUT_GRAY:
+            TIFFSetField(image, TIFFTAG_BITSPERSAMPLE, 8);
+            TIFFSetField(image, TIFFTAG_SAMPLESPERPIXEL, 1);
+            TIFFSetField(image, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+            break;
+        case LAYOUT_RGB:
+            TIFFSetField(image, TIFFTAG_BITSPERSAMPLE, 8);
+            TIFFSetField(image, TIFFTAG_SAMPLESPERPIXEL, 3);
+            TIFFSetField(image, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+            break;
+        default: {
+            uint16 extraSample = associatedAlpha ? EXTRASAMPLE_ASSOCALPHA : EXTRASAMPLE_UNASSALPHA;
+            TIFFSetField(image, TIFFTAG_BITSPERSAMPLE, 8);
+            TIFFSetField(image, TIFFTAG_SAMPLESPERPIXEL, 4);
+            TIFFSetField(image, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+            TIFFSetField(image, TIFFTAG_EXTRASAMPLES, 1, &extraSample);
+            break;
+        }
+    }
+}
+
+int NativeBitmapRows::getLayout() const {
+    return layout;
+}
+
+uint32 NativeBitmapRows::getWidth() const {
+    return width;
+}
+
+tmsize_t NativeBitmapRows::getRowBytes() const {
+    switch (layout) {
+        case LAYOUT_BILEVEL:
+            return (tmsize_t) (width + 7) / 8;
+        case LAYOUT_GRAY:
+            return (tmsize_t) width;
+        case LAYOUT_RGB:
+            return (tmsize_t) width * 3;
+        default:
+            return (tmsize_t) width * sizeof(uint32);
+    }
+}
+
+int NativeBitmapRows::getBitsPerPixel() const {
+    switch (layout) {
+        case LAYOUT_BILEVEL:
+            return 1;
+        case LAYOUT_GRAY:
+            return 8;
+        case LAYOUT_RGB:
+            return 24;
+        default:
+            return 32;
+    }
+}
+
+bool NativeBitmapRows::isDirect() const {
+    return (layout == LAYOUT_RGBA && format == ANDROID_BITMAP_FORMAT_RGBA_8888 && stride == width * sizeof(uint32))
+           || (layout == LAYOUT_GRAY && format == ANDROID_BITMAP_FORMAT_A_8 && stride == width);
+}
+
+size_t NativeBitmapRows::getWorkingMemory() const {
+    if (isDirect()) {
+        return 0;
+    }
+    return (size_t) width * sizeof(uint32) + (layout == LAYOUT_BILEVEL ? width : 0);
+}
+
+const unsigned char *NativeBitmapRows::readRows(uint32 firstRow, uint32 rowCount, unsigned char *buffer) {
+    if (isDirect()) {
+        return pixels + (size_t) firstRow * stride;
+    }
+    tmsize_t rowBytes = getRowBytes();
+    for (uint32 r = 0; r < rowCount; r++) {
+        const unsigned char *src = pixels + (size_t) (firstRow + r) * stride;
+        unsigned char *dst = buffer + r * rowBytes;
+        //formats that have samples of layout are converted without ABGR row
+        if ((layout == LAYOUT_RGBA && format == ANDROID_BITMAP_FORMAT_RGBA_8888)
+            || (layout == LAYOUT_GRAY && format == ANDROID_BITMAP_FORMAT_A_8)) {
+            memcpy(dst, src, rowBytes);
+        } else if (layout == LAYOUT_RGB && format == ANDROID_BITMAP_FORMAT_RGB_565) {
+            pixels_rgb565_to_rgb((const uint16_t *) src, dst, width);
+        } else if (layout == LAYOUT_RGBA) {
+            readAbgrRow(firstRow + r, (uint32 *) dst);
+        } else {
+            packRow(readAbgrRow(firstRow + r, abgrRow), dst, width);
+        }
+    }
+    return buffer;
+}
+
+const uint32 *NativeBitmapRows::readAbgrRow(uint32 row, uint32 *buffer) {
+    const unsigned char *src = pixels + (size_t) row * stride;
+    switch (format) {
+        case ANDROID_BITMAP_FORMAT_RGBA_8888:
+            return (const uint32 *) src;
+        case ANDROID_BITMAP_FORMAT_RGBA_4444:
+            pixels_rgba4444_to_abgr((const uint16_t *) src, buffer, width);
+            break;
+        case ANDROID_BITMAP_FORMAT_RGB_565:
+            pixels_rgb565_to_abgr((const uint16_t *) src, buffer, width);
+            break;
+        case ANDROID_BITMAP_FORMAT_A_8:
+            pixels_alpha_to_abgr(src, buffer, width);
+            break;
+        default:
+            memset(buffer, 0, (size_t) width * sizeof(uint32));
+            break;
+    }
+    return buffer;
+}
+
+void NativeBitmapRows::packRow(const uint32 *abgr, unsigned char *dst, uint32 count) {
+    switch (layout) {
+        case LAYOUT_BILEVEL:
+            pixels_abgr_to_gray(abgr, greyRow, count);
+            pixels_gray_to_bits(greyRow, bilevelThreshold, dst, count);
+            break;
+        case LAYOUT_GRAY:
+            //grey of alpha mask is its alpha
+            if (format == ANDROID_BITMAP_FORMAT_A_8) {
+                pixels_abgr_to_alpha(abgr, dst, count);
+            } else {
+                pixels_abgr_to_gray(abgr, dst, count);
+            }
+            break;
+        case LAYOUT_RGB:
+            pixels_abgr_to_rgb(abgr, dst, count);
+            break;
+        default:
+            if ((const unsigned char *) abgr != dst) {
+                memcpy(dst, abgr, (size_t) count * sizeof(uint32));
+            }
+            break;
+    }
+}
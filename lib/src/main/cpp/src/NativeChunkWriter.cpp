@@ -0,0 +1,681 @@
+//
+// Writer of image data to strips or tiles of saved image.
+//
+
+#include "NativeChunkWriter.h"
+#include "NativePixelKernels.h"
+#include <unistd.h>
+
+//Approximate state of codec of worker, deflate takes the most
+static size_t const encoderMemory = 512 * 1024;
+
+static void copyShortField(TIFF *from, TIFF *to, uint32 tag) {
+    uint16 value;
+    if (TIFFGetField(from, tag, &value)) {
+        TIFFSetField(to, tag, value);
+    }
+}
+
+static void copyLongField(TIFF *from, TIFF *to, uint32 tag) {
+    uint32 value;
+    if (TIFFGetField(from, tag, &value)) {
+        TIFFSetField(to, tag, value);
+    }
+}
+
+//Codec pseudo tags are int values and exist only for their compression scheme
+static void copyIntField(TIFF *from, TIFF *to, uint32 tag) {
+    int value;
+    if (TIFFGetField(from, tag, &value)) {
+        TIFFSetField(to, tag, value);
+    }
+}
+
+NativeChunkWriter::NativeChunkWriter(TIFF *img, tmsize_t rb, int bpp, int threads) {
+    image = img;
+    rowBytes = rb;
+    bitsPerPixel = bpp;
+    threadCount = threads > 0 ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    width = 0;
+    height = 0;
+    compression = COMPRESSION_NONE;
+    TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(image, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetField(image, TIFFTAG_COMPRESSION, &compression);
+    tiled = TIFFIsTiled(image);
+    if (tiled) {
+        TIFFGetField(image, TIFFTAG_TILEWIDTH, &chunkWidth);
+        TIFFGetField(image, TIFFTAG_TILELENGTH, &chunkHeight);
+        chunksAcross = (width + chunkWidth - 1) / chunkWidth;
+    } else {
+        chunkWidth = width;
+        chunkHeight = height;
+        TIFFGetField(image, TIFFTAG_ROWSPERSTRIP, &chunkHeight);
+        if (chunkHeight > height) {
+            chunkHeight = height;
+        }
+        chunksAcross = 1;
+    }
+
+    //predictor is used by libtiff only with these schemes
+    deflate = compression == COMPRESSION_ADOBE_DEFLATE || compression == COMPRESSION_DEFLATE;
+    uint16 predictorValue = PREDICTOR_NONE;
+    TIFFGetField(image, TIFFTAG_PREDICTOR, &predictorValue);
+    predictor = predictorValue == PREDICTOR_HORIZONTAL && (deflate || compression == COMPRESSION_LZW)
+                && bitsPerPixel % 8 == 0;
+    deflateLevel = Z_DEFAULT_COMPRESSION;
+    if (deflate) {
+        TIFFGetField(image, TIFFTAG_ZIPQUALITY, &deflateLevel);
+        //levels above 9 are libdeflate ones
+        if (deflateLevel > Z_BEST_COMPRESSION) {
+            deflateLevel = Z_BEST_COMPRESSION;
+        } else if (deflateLevel < Z_DEFAULT_COMPRESSION) {
+            deflateLevel = Z_DEFAULT_COMPRESSION;
+        }
+    }
+    deflateStrategy = Z_DEFAULT_STRATEGY;
+
+    data = nullptr;
+    dataRow = 0;
+    firstChunk = 0;
+    endChunk = 0;
+    chunks = nullptr;
+    nextChunk = 0;
+    writtenChunks = 0;
+    window = 0;
+    failed = false;
+    jpegTables = nullptr;
+    jpegTablesSize = 0;
+    keptChunks = nullptr;
+    keptSize = 0;
+    keptEncoderOpen = false;
+}
+
+NativeChunkWriter::~NativeChunkWriter() {
+    if (keptEncoderOpen) {
+        closeEncoder(&keptEncoder);
+    }
+    if (keptChunks) {
+        uint32 count = chunksAcross * ((height + chunkHeight - 1) / chunkHeight);
+        for (uint32 i = 0; i < count; i++) {
+            if (keptChunks[i].data) {
+                free(keptChunks[i].data);
+            }
+        }
+        free(keptChunks);
+    }
+    if (jpegTables) {
+        free(jpegTables);
+    }
+}
+
+uint32 NativeChunkWriter::getChunkHeight() const {
+    return chunkHeight;
+}
+
+int NativeChunkWriter::getThreadCount() const {
+    return threadCount;
+}
+
+size_t NativeChunkWriter::getWorkingMemory() const {
+    size_t chunkBytes = chunkBufferSize();
+    size_t tile = tiled ? chunkBytes : 0;
+    if (compression == COMPRESSION_NONE || (threadCount <= 1 && !encodesItself())) {
+        //tile buffer and buffer of libtiff for encoded chunk
+        return tile + chunkBytes;
+    }
+    //every encoder has tile buffer, predicted chunk, encoded chunk in codec output and in taken copy and state of codec
+    size_t encoder = tile + (predictor ? chunkBytes : 0) + chunkBytes * 2 + encoderMemory;
+    if (threadCount <= 1) {
+        return encoder;
+    }
+    //window of two chunks per worker waits for writing
+    return (size_t) threadCount * (encoder + chunkBytes * 2);
+}
+
+void NativeChunkWriter::fitMemory(size_t available) {
+    while (threadCount > 1 && getWorkingMemory() > available) {
+        threadCount--;
+    }
+}
+
+void NativeChunkWriter::setDeflateStrategy(int strategy) {
+    deflateStrategy = strategy;
+}
+
+bool NativeChunkWriter::encodesItself() const {
+    return predictor || deflate;
+}
+
+bool NativeChunkWriter::writeRows(const unsigned char *rows, uint32 firstRow, uint32 rowCount) {
+    if (chunkHeight == 0 || firstRow % chunkHeight != 0 || (rowCount % chunkHeight != 0 && firstRow + rowCount != height)) {
+        return false;
+    }
+    data = rows;
+    dataRow = firstRow;
+    firstChunk = firstRow / chunkHeight * chunksAcross;
+    endChunk = (firstRow + rowCount + chunkHeight - 1) / chunkHeight * chunksAcross;
+    uint32 threads = (uint32) threadCount < endChunk - firstChunk ? threadCount : endChunk - firstChunk;
+    if (compression == COMPRESSION_NONE) {
+        return writeSerial();
+    }
+    if (threads <= 1) {
+        return encodesItself() ? writeEncoded() : writeSerial();
+    }
+    return writeParallel(threads);
+}
+
+bool NativeChunkWriter::writeSerial() {
+    unsigned char *tile = nullptr;
+    if (tiled) {
+        tile = (unsigned char *) malloc(tileBufferSize());
+        if (!tile) {
+            return false;
+        }
+    }
+    bool ok = true;
+    for (uint32 i = firstChunk; i < endChunk && ok; i++) {
+        tmsize_t size;
+        void *chunk = (void *) chunkData(i, tile, &size);
+        if (tiled) {
+            ok = TIFFWriteEncodedTile(image, i, chunk, size) != -1;
+        } else {
+            ok = TIFFWriteEncodedStrip(image, i, chunk, size) != -1;
+        }
+    }
+    if (tile) {
+        free(tile);
+    }
+    return ok;
+}
+
+bool NativeChunkWriter::writeEncoded() {
+    Encoder encoder;
+    bool ok = openEncoder(&encoder);
+    for (uint32 i = firstChunk; i < endChunk && ok; i++) {
+        Chunk chunk;
+        ok = encodeChunk(&encoder, i, &chunk);
+        if (ok) {
+            ok = writeRawChunk(image, i, &chunk);
+            free(chunk.data);
+        }
+    }
+    closeEncoder(&encoder);
+    return ok;
+}
+
+bool NativeChunkWriter::writeRawChunk(TIFF *target, uint32 index, const Chunk *chunk) {
+    //raw writes don't set up codec of image, so JPEG tables are taken from encoder of worker.
+    //Tables are set by the worker together with its first chunk and can't be changed after writing starts
+    if (index == 0 && jpegTables) {
+        TIFFSetField(target, TIFFTAG_JPEGTABLES, jpegTablesSize, jpegTables);
+    }
+    if (tiled) {
+        return TIFFWriteRawTile(target, index, chunk->data, chunk->size) != -1;
+    }
+    return TIFFWriteRawStrip(target, index, chunk->data, chunk->size) != -1;
+}
+
+bool NativeChunkWriter::takeJpegTables(Encoder *encoder) {
+    if (compression != COMPRESSION_JPEG || jpegTables) {
+        return true;
+    }
+    uint32 count = 0;
+    void *tables = nullptr;
+    if (TIFFGetField(encoder->tiff, TIFFTAG_JPEGTABLES, &count, &tables) && count > 0) {
+        jpegTables = malloc(count);
+        if (!jpegTables) {
+            return false;
+        }
+        memcpy(jpegTables, tables, count);
+        jpegTablesSize = count;
+    }
+    return true;
+}
+
+bool NativeChunkWriter::keepRows(const unsigned char *rows, uint32 firstRow, uint32 rowCount) {
+    if (chunkHeight == 0 || firstRow % chunkHeight != 0 || (rowCount % chunkHeight != 0 && firstRow + rowCount != height)) {
+        return false;
+    }
+    if (!keptChunks) {
+        keptChunks = (Chunk *) calloc(chunksAcross * ((height + chunkHeight - 1) / chunkHeight), sizeof(Chunk));
+        if (!keptChunks) {
+            return false;
+        }
+    }
+    if (!keptEncoderOpen) {
+        keptEncoderOpen = true;
+        if (!openEncoder(&keptEncoder)) {
+            return false;
+        }
+    }
+    data = rows;
+    dataRow = firstRow;
+    uint32 first = firstRow / chunkHeight * chunksAcross;
+    uint32 end = (firstRow + rowCount + chunkHeight - 1) / chunkHeight * chunksAcross;
+    for (uint32 i = first; i < end; i++) {
+        if (!encodeChunk(&keptEncoder, i, &keptChunks[i]) || !takeJpegTables(&keptEncoder)) {
+            return false;
+        }
+        keptSize += keptChunks[i].size;
+    }
+    return true;
+}
+
+bool NativeChunkWriter::writeKept(TIFF *target) {
+    uint32 count = chunksAcross * ((height + chunkHeight - 1) / chunkHeight);
+    if (!keptChunks) {
+        return false;
+    }
+    for (uint32 i = 0; i < count; i++) {
+        if (!keptChunks[i].ready || !writeRawChunk(target, i, &keptChunks[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t NativeChunkWriter::getKeptSize() const {
+    return keptSize;
+}
+
+bool NativeChunkWriter::writeParallel(int threads) {
+    chunks = (Chunk *) calloc(endChunk - firstChunk, sizeof(Chunk));
+    pthread_t *workers = (pthread_t *) malloc(sizeof(pthread_t) * threads);
+    if (!chunks || !workers) {
+        free(chunks);
+        free(workers);
+        chunks = nullptr;
+        return encodesItself() ? writeEncoded() : writeSerial();
+    }
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&changed, nullptr);
+    nextChunk = firstChunk;
+    writtenChunks = firstChunk;
+    failed = false;
+
+    //workers wait for window until all of them are started
+    pthread_mutex_lock(&mutex);
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&workers[t], nullptr, workerMain, this) != 0) {
+            break;
+        }
+        started++;
+    }
+    //workers keep at most window compressed chunks waiting for writing
+    window = started * 2;
+    pthread_mutex_unlock(&mutex);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeChunkWriter", "Compress %d chunks with %d threads", endChunk - firstChunk, started);
+
+    if (started == 0) {
+        //no thread could be created, so chunks are compressed by calling thread
+        free(workers);
+        free(chunks);
+        chunks = nullptr;
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&mutex);
+        return encodesItself() ? writeEncoded() : writeSerial();
+    }
+
+    bool ok = true;
+    for (uint32 i = firstChunk; i < endChunk && ok; i++) {
+        Chunk *chunk = &chunks[i - firstChunk];
+        pthread_mutex_lock(&mutex);
+        while (!chunk->ready && !failed) {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        ok = chunk->ready && chunk->data;
+        pthread_mutex_unlock(&mutex);
+        if (!ok) {
+            break;
+        }
+
+        ok = writeRawChunk(image, i, chunk);
+
+        pthread_mutex_lock(&mutex);
+        free(chunk->data);
+        chunk->data = nullptr;
+        writtenChunks = i + 1;
+        if (!ok) {
+            failed = true;
+        }
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    if (!ok) {
+        pthread_mutex_lock(&mutex);
+        failed = true;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], nullptr);
+    }
+    free(workers);
+
+    if (jpegTables) {
+        free(jpegTables);
+        jpegTables = nullptr;
+    }
+    for (uint32 i = 0; i < endChunk - firstChunk; i++) {
+        if (chunks[i].data) {
+            free(chunks[i].data);
+        }
+    }
+    free(chunks);
+    chunks = nullptr;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+    return ok;
+}
+
+void *NativeChunkWriter::workerMain(void *writer) {
+    ((NativeChunkWriter *) writer)->workerLoop();
+    return nullptr;
+}
+
+void NativeChunkWriter::workerLoop() {
+    Encoder encoder;
+    bool ok = openEncoder(&encoder);
+
+    while (true) {
+        pthread_mutex_lock(&mutex);
+        while (ok && !failed && nextChunk < endChunk && nextChunk >= writtenChunks + window) {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        if (!ok || failed || nextChunk >= endChunk) {
+            if (!ok) {
+                failed = true;
+                pthread_cond_broadcast(&changed);
+            }
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+        uint32 index = nextChunk++;
+        pthread_mutex_unlock(&mutex);
+
+        Chunk chunk;
+        ok = encodeChunk(&encoder, index, &chunk);
+
+        pthread_mutex_lock(&mutex);
+        if (ok) {
+            chunks[index - firstChunk] = chunk;
+            ok = takeJpegTables(&encoder);
+        }
+        if (!ok) {
+            failed = true;
+        }
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    closeEncoder(&encoder);
+}
+
+bool NativeChunkWriter::openEncoder(Encoder *encoder) const {
+    memset(encoder, 0, sizeof(Encoder));
+    bool ok = true;
+    if (tiled) {
+        encoder->tile = (unsigned char *) malloc(tileBufferSize());
+        ok = encoder->tile != nullptr;
+    }
+    if (ok && predictor) {
+        encoder->predicted = (unsigned char *) malloc(chunkBufferSize());
+        ok = encoder->predicted != nullptr;
+    }
+    if (ok && deflate) {
+        //the same stream as deflateInit of libtiff Deflate codec, with chosen strategy
+        ok = deflateInit2(&encoder->zip, deflateLevel, Z_DEFLATED, MAX_WBITS, 8, deflateStrategy) == Z_OK;
+        encoder->zipOpen = ok;
+    } else if (ok) {
+        encoder->tiff = openEncoderTiff(&encoder->file);
+        ok = encoder->tiff != nullptr;
+    }
+    return ok;
+}
+
+void NativeChunkWriter::closeEncoder(Encoder *encoder) const {
+    if (encoder->tiff) {
+        //encoder is discarded without writing directory
+        TIFFCleanup(encoder->tiff);
+    }
+    if (encoder->zipOpen) {
+        deflateEnd(&encoder->zip);
+    }
+    if (encoder->file.data) {
+        free(encoder->file.data);
+    }
+    if (encoder->tile) {
+        free(encoder->tile);
+    }
+    if (encoder->predicted) {
+        free(encoder->predicted);
+    }
+}
+
+bool NativeChunkWriter::encodeChunk(Encoder *encoder, uint32 index, Chunk *chunk) {
+    tmsize_t size;
+    void *raw = (void *) chunkData(index, encoder->tile, &size);
+    if (predictor) {
+        //libtiff differences every row of strip or tile separately
+        tmsize_t chunkRowBytes = tiled ? (tmsize_t) chunkWidth * bitsPerPixel / 8 : rowBytes;
+        uint32 stride = (uint32) bitsPerPixel / 8;
+        for (tmsize_t offset = 0; offset < size; offset += chunkRowBytes) {
+            pixels_horizontal_diff((const uint8_t *) raw + offset, encoder->predicted + offset, (uint32) chunkRowBytes, stride);
+        }
+        raw = encoder->predicted;
+    }
+    if (deflate) {
+        return deflateChunk(encoder, (const unsigned char *) raw, size, chunk);
+    }
+
+    TIFF *tiff = encoder->tiff;
+    MemoryFile *file = &encoder->file;
+    tmsize_t encoded;
+    if (tiled) {
+        encoded = TIFFWriteEncodedTile(tiff, index, raw, size);
+    } else {
+        encoded = TIFFWriteEncodedStrip(tiff, index, raw, size);
+    }
+    if (encoded == -1) {
+        return false;
+    }
+
+    //offsets and byte counts of tiles are stored in same fields as ones of strips
+    toff_t *offsets = nullptr;
+    toff_t *byteCounts = nullptr;
+    if (!TIFFGetField(tiff, TIFFTAG_STRIPOFFSETS, &offsets) || !TIFFGetField(tiff, TIFFTAG_STRIPBYTECOUNTS, &byteCounts)) {
+        return false;
+    }
+    toff_t offset = offsets[index];
+    toff_t count = byteCounts[index];
+    if (offset < file->base || offset + count > file->end) {
+        return false;
+    }
+    chunk->data = (unsigned char *) malloc(count > 0 ? count : 1);
+    if (!chunk->data) {
+        return false;
+    }
+    memcpy(chunk->data, file->data + (offset - file->base), count);
+    chunk->size = count;
+    chunk->ready = true;
+    //bytes of this chunk are not needed in memory file anymore
+    file->base = file->end;
+    return true;
+}
+
+bool NativeChunkWriter::deflateChunk(Encoder *encoder, const unsigned char *raw, tmsize_t size, Chunk *chunk) {
+    z_stream *zip = &encoder->zip;
+    if (deflateReset(zip) != Z_OK) {
+        return false;
+    }
+    uLong bound = deflateBound(zip, (uLong) size);
+    chunk->data = (unsigned char *) malloc(bound);
+    if (!chunk->data) {
+        return false;
+    }
+    zip->next_in = (Bytef *) raw;
+    zip->avail_in = (uInt) size;
+    zip->next_out = chunk->data;
+    zip->avail_out = (uInt) bound;
+    if (::deflate(zip, Z_FINISH) != Z_STREAM_END) {
+        free(chunk->data);
+        chunk->data = nullptr;
+        return false;
+    }
+    chunk->size = (tmsize_t) zip->total_out;
+    chunk->ready = true;
+    return true;
+}
+
+const unsigned char *NativeChunkWriter::chunkData(uint32 index, unsigned char *tile, tmsize_t *size) const {
+    if (!tiled) {
+        //rows of strips are contiguous in band, so strips are written without copying
+        uint32 row = index * chunkHeight;
+        uint32 rows = height - row < chunkHeight ? height - row : chunkHeight;
+        *size = rows * rowBytes;
+        return data + (row - dataRow) * rowBytes;
+    }
+
+    //tile width is multiple of 16, so tiles start at whole bytes even for bilevel images
+    uint32 x = (index % chunksAcross) * chunkWidth;
+    uint32 y = (index / chunksAcross) * chunkHeight;
+    tmsize_t tileRowBytes = (tmsize_t) chunkWidth * bitsPerPixel / 8;
+    tmsize_t offset = (tmsize_t) x * bitsPerPixel / 8;
+    tmsize_t copyBytes = rowBytes - offset < tileRowBytes ? rowBytes - offset : tileRowBytes;
+    //parts of edge tiles outside of image are filled with zeros
+    if (copyBytes < tileRowBytes || y + chunkHeight > height) {
+        memset(tile, 0, tileRowBytes * chunkHeight);
+    }
+    for (uint32 r = 0; r < chunkHeight && y + r < height; r++) {
+        memcpy(tile + r * tileRowBytes, data + (y + r - dataRow) * rowBytes + offset, copyBytes);
+    }
+    *size = tileRowBytes * chunkHeight;
+    return tile;
+}
+
+tmsize_t NativeChunkWriter::tileBufferSize() const {
+    return (tmsize_t) chunkWidth * bitsPerPixel / 8 * chunkHeight;
+}
+
+size_t NativeChunkWriter::chunkBufferSize() const {
+    return tiled ? (size_t) tileBufferSize() : (size_t) rowBytes * chunkHeight;
+}
+
+TIFF *NativeChunkWriter::openEncoderTiff(MemoryFile *file) const {
+    //offsets of memory file keep growing with encoded chunks, so encoder is BigTIFF. Encoded data doesn't depend on it
+    TIFF *encoder = TIFFClientOpen("NativeChunkWriter", "w8m", (thandle_t) file,
+                                   fileRead, fileWrite, fileSeek, fileClose, fileSize, fileMap, fileUnmap);
+    if (!encoder) {
+        return nullptr;
+    }
+    TIFFSetField(encoder, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(encoder, TIFFTAG_IMAGELENGTH, height);
+    copyShortField(image, encoder, TIFFTAG_BITSPERSAMPLE);
+    copyShortField(image, encoder, TIFFTAG_SAMPLESPERPIXEL);
+    copyShortField(image, encoder, TIFFTAG_PHOTOMETRIC);
+    copyShortField(image, encoder, TIFFTAG_PLANARCONFIG);
+    copyShortField(image, encoder, TIFFTAG_FILLORDER);
+    uint16 extraCount = 0;
+    uint16 *extraSamples = nullptr;
+    if (TIFFGetField(image, TIFFTAG_EXTRASAMPLES, &extraCount, &extraSamples) && extraCount > 0) {
+        TIFFSetField(encoder, TIFFTAG_EXTRASAMPLES, extraCount, extraSamples);
+    }
+    if (tiled) {
+        TIFFSetField(encoder, TIFFTAG_TILEWIDTH, chunkWidth);
+        TIFFSetField(encoder, TIFFTAG_TILELENGTH, chunkHeight);
+    } else {
+        TIFFSetField(encoder, TIFFTAG_ROWSPERSTRIP, chunkHeight);
+    }
+    //codec fields should be set after compression
+    TIFFSetField(encoder, TIFFTAG_COMPRESSION, compression);
+    copyLongField(image, encoder, TIFFTAG_GROUP3OPTIONS);
+    copyLongField(image, encoder, TIFFTAG_GROUP4OPTIONS);
+    copyIntField(image, encoder, TIFFTAG_JPEGQUALITY);
+    copyIntField(image, encoder, TIFFTAG_JPEGCOLORMODE);
+    copyIntField(image, encoder, TIFFTAG_JPEGTABLESMODE);
+    return encoder;
+}
+
+TIFF *NativeChunkWriter::openFieldsTiff() {
+    //only header is written when TIFF is opened, directories and data are never written
+    return TIFFClientOpen("fields", "w", nullptr, fileRead, fieldsWrite, fieldsSeek, fileClose, fieldsSize, fileMap, fileUnmap);
+}
+
+tmsize_t NativeChunkWriter::fieldsWrite(thandle_t, void *, tmsize_t size) {
+    return size;
+}
+
+toff_t NativeChunkWriter::fieldsSeek(thandle_t, toff_t offset, int whence) {
+    return whence == SEEK_SET ? offset : 0;
+}
+
+toff_t NativeChunkWriter::fieldsSize(thandle_t) {
+    return 0;
+}
+
+tmsize_t NativeChunkWriter::fileRead(thandle_t, void *, tmsize_t) {
+    return 0;
+}
+
+tmsize_t NativeChunkWriter::fileWrite(thandle_t handle, void *buf, tmsize_t size) {
+    MemoryFile *file = (MemoryFile *) handle;
+    toff_t end = file->position + size;
+    //bytes before base belong to chunks that were already taken, so they are dropped
+    if (end > file->base) {
+        toff_t skip = file->position < file->base ? file->base - file->position : 0;
+        tmsize_t need = (tmsize_t) (end - file->base);
+        if (need > file->capacity) {
+            tmsize_t capacity = file->capacity * 2 > need ? file->capacity * 2 : need;
+            unsigned char *grown = (unsigned char *) realloc(file->data, capacity);
+            if (!grown) {
+                return 0;
+            }
+            file->data = grown;
+            file->capacity = capacity;
+        }
+        if (file->position + skip > file->end) {
+            //gap after seek past end is read as zeros
+            memset(file->data + (file->end - file->base), 0, file->position + skip - file->end);
+        }
+        memcpy(file->data + (file->position + skip - file->base), (unsigned char *) buf + skip, size - skip);
+    }
+    file->position = end;
+    if (end > file->end) {
+        file->end = end;
+    }
+    return size;
+}
+
+toff_t NativeChunkWriter::fileSeek(thandle_t handle, toff_t offset, int whence) {
+    MemoryFile *file = (MemoryFile *) handle;
+    switch (whence) {
+        case SEEK_CUR:
+            file->position += offset;
+            break;
+        case SEEK_END:
+            file->position = file->end + offset;
+            break;
+        default:
+            file->position = offset;
+            break;
+    }
+    return file->position;
+}
+
+int NativeChunkWriter::fileClose(thandle_t) {
+    return 0;
+}
+
+toff_t NativeChunkWriter::fileSize(thandle_t handle) {
+    return ((MemoryFile *) handle)->end;
+}
+
+int NativeChunkWriter::fileMap(thandle_t, void **, toff_t *) {
+    return 0;
+}
+
+void NativeChunkWriter::fileUnmap(thandle_t, void *, toff_t) {
+}
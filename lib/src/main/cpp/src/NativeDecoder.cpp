@@ -4,11 +4,14 @@
 
 #include "NativeDecoder.h"
 #include <string>
+#include <cmath>
+#include "NativePixelKernels.h"
+#include "NativeBandCallback.h"
 
 jmp_buf NativeDecoder::tile_buf;
 jmp_buf NativeDecoder::strip_buf;
-jmp_buf NativeDecoder::image_buf;
 jmp_buf NativeDecoder::general_buf;
+jmp_buf NativeDecoder::stream_buf;
 
 //Constructor for decoding from file descriptor
 NativeDecoder::NativeDecoder(JNIEnv *e, jclass c, jint fd, jobject opts, jobject listener) {
@@ -30,6 +33,20 @@ NativeDecoder::NativeDecoder(JNIEnv *e, jclass c, jint fd, jobject opts, jobject
     boundX = boundY = boundWidth = boundHeight = -1;
     hasBounds = 0;
 
+    floatMinValue = floatMaxValue = NAN;
+    cmykInkLimit = 0;
+    rawReader = nullptr;
+    alphaOnly = false;
+    bandCount = 0;
+    overview = 0;
+    streamChunkRows = 0;
+
+    bandPixels = nullptr;
+    bandWidth = 0;
+    bandListenerObject = nullptr;
+    bandCallbackPointer = 0;
+    bandCallbackUserData = 0;
+
     preferedConfig = nullptr;
     image = nullptr;
 
@@ -40,6 +57,11 @@ NativeDecoder::NativeDecoder(JNIEnv *e, jclass c, jint fd, jobject opts, jobject
 
 NativeDecoder::~NativeDecoder() {
     __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Destructor");
+    if (rawReader) {
+        delete rawReader;
+        rawReader = nullptr;
+    }
+
     if (image) {
         TIFFClose(image);
         image = nullptr;
@@ -90,6 +112,504 @@ jobject NativeDecoder::getBitmap() {
         return nullptr;
     }
 
+    jint inSampleSize = 1;
+    jboolean inJustDecodeBounds = false;
+    jint inDirectoryNumber = 0;
+    if (!initDecoding(&inSampleSize, &inJustDecodeBounds, &inDirectoryNumber)) {
+        return nullptr;
+    }
+
+    jobject java_bitmap = nullptr;
+
+    writeDataToOptions(inDirectoryNumber);
+
+    if (!inJustDecodeBounds) {
+        progressTotal = origwidth * origheight;
+        sendProgress(0, progressTotal);
+        java_bitmap = createBitmap(inSampleSize, inDirectoryNumber);
+    }
+
+    return java_bitmap;
+}
+
+NativeDecoder::StreamTarget::StreamTarget(NativeDecoder *d) : map(0, 0, ORIENTATION_TOPLEFT) {
+    decoder = d;
+    sink = nullptr;
+    regionWidth = regionHeight = outWidth = outHeight = 0;
+    inSampleSize = 1;
+}
+
+NativeDecoder::StreamTarget::~StreamTarget() {
+    delete sink;
+}
+
+void NativeDecoder::StreamTarget::setRegion(uint32 width, uint32 height, int sampleSize, int orientation) {
+    regionWidth = width;
+    regionHeight = height;
+    inSampleSize = sampleSize;
+    outWidth = width / sampleSize;
+    outHeight = height / sampleSize;
+    map = NativeOrientationMap(outWidth, outHeight, orientation);
+}
+
+const char *NativeDecoder::StreamTarget::decode(bool *stopped) {
+    return decoder->streamRegion(inSampleSize, 0, 0, outWidth, outHeight, sink, 0, stopped);
+}
+
+//Bands of rows that are passed to native callback or to Java listener
+class NativeDecoder::BandTarget : public NativeDecoder::StreamTarget {
+public:
+    BandTarget(NativeDecoder *d, jint height) : StreamTarget(d) {
+        bandHeight = height;
+        bandRows = groupRows = 0;
+        band = nullptr;
+    }
+
+    ~BandTarget() override {
+        free(band);
+        decoder->bandPixels = nullptr;
+    }
+
+    const char *check() override {
+        if (bandHeight < 1) {
+            return "Band height should be greater than 0";
+        }
+        uint32 displayHeight = map.getDisplayHeight();
+        bandRows = (uint32) bandHeight < displayHeight ? bandHeight : displayHeight;
+        return nullptr;
+    }
+
+    unsigned long estimateMemory(unsigned long budget) override {
+        //Rows of orientations 1 and 2 come in display order and are collected to bands while file is read once.
+        //Other orientations need window of file for group of bands: last rows for flipped image or columns for rotated one.
+        //Group is whole region when it fits into budget, otherwise it is halved down to one band, so file is read as few times as memory allows
+        uint32 displayHeight = map.getDisplayHeight();
+        groupRows = bandRows;
+        if (map.getOrientation() <= ORIENTATION_TOPRIGHT) {
+            unsigned long mem = (unsigned long) bandRows * map.getDisplayWidth() * sizeof(uint32);
+            return mem + decoder->estimateStreamMemory(regionWidth, regionHeight, inSampleSize, mem);
+        }
+        groupRows = displayHeight;
+        unsigned long mem = estimateGroupMemory();
+        while (mem > budget && groupRows > bandRows) {
+            groupRows = (groupRows / 2 + bandRows - 1) / bandRows * bandRows;
+            mem = estimateGroupMemory();
+        }
+        return mem;
+    }
+
+    const char *init() override {
+        band = (uint32 *) malloc((size_t) groupRows * map.getDisplayWidth() * sizeof(uint32));
+        if (!band) {
+            return "Can\'t allocate memory for band";
+        }
+        decoder->bandPixels = band;
+        decoder->bandWidth = map.getDisplayWidth();
+        return nullptr;
+    }
+
+    const char *decode(bool *stopped) override {
+        int orientation = map.getOrientation();
+        uint32 displayWidth = map.getDisplayWidth();
+        uint32 displayHeight = map.getDisplayHeight();
+        if (orientation <= ORIENTATION_TOPRIGHT) {
+            NativeBandSink bandSink(band, displayWidth, bandRows, displayHeight, orientation == ORIENTATION_TOPRIGHT, bandSinkConsumer, decoder);
+            return decoder->streamRegion(inSampleSize, 0, 0, outWidth, outHeight, &bandSink, 0, stopped);
+        }
+
+        const char *err = nullptr;
+        jlong progress = 0;
+        for (uint32 firstRow = 0; firstRow < displayHeight && !err && !*stopped; firstRow += groupRows) {
+            uint32 rows = displayHeight - firstRow < groupRows ? displayHeight - firstRow : groupRows;
+            //window of sampled image that becomes rows firstRow..firstRow + rows of display
+            uint32 x = 0, y = 0, columns = outWidth, lines = outHeight;
+            switch (orientation) {
+                case ORIENTATION_BOTRIGHT:
+                case ORIENTATION_BOTLEFT:
+                    y = outHeight - firstRow - rows;
+                    lines = rows;
+                    break;
+                case ORIENTATION_LEFTTOP:
+                case ORIENTATION_RIGHTTOP:
+                    x = firstRow;
+                    columns = rows;
+                    break;
+                default:
+                    x = outWidth - firstRow - rows;
+                    columns = rows;
+                    break;
+            }
+            NativeRasterSink rasterSink((jint *) band, columns, lines, orientation);
+            err = decoder->streamRegion(inSampleSize, x, y, columns, lines, &rasterSink, progress, stopped);
+            progress += (jlong) columns * lines * inSampleSize * inSampleSize;
+            for (uint32 row = 0; row < rows && !err && !*stopped; row += bandRows) {
+                decoder->bandPixels = band + (size_t) row * displayWidth;
+                *stopped = !decoder->deliverBand(firstRow + row, rows - row < bandRows ? rows - row : bandRows);
+            }
+        }
+        return err;
+    }
+
+private:
+    jint bandHeight;
+    uint32 bandRows;
+    //display rows that are decoded from one window of file
+    uint32 groupRows;
+    uint32 *band;
+
+    unsigned long estimateGroupMemory() {
+        bool rotated = map.getOrientation() > ORIENTATION_BOTLEFT;
+        unsigned long windowSize = (unsigned long) groupRows * inSampleSize + (inSampleSize > 1 ? 2 : 0);
+        unsigned long windowWidth = rotated && windowSize < regionWidth ? windowSize : regionWidth;
+        unsigned long windowHeight = !rotated && windowSize < regionHeight ? windowSize : regionHeight;
+        unsigned long mem = (unsigned long) groupRows * map.getDisplayWidth() * sizeof(uint32);
+        return mem + decoder->estimateStreamMemory(windowWidth, windowHeight, inSampleSize, mem);
+    }
+};
+
+//Direct buffer with row stride in PixelFormat
+class NativeDecoder::BufferTarget : public NativeDecoder::StreamTarget {
+public:
+    BufferTarget(NativeDecoder *d, jobject b, jint stride, jint format) : StreamTarget(d) {
+        buffer = b;
+        rowStride = stride;
+        pixelFormat = format;
+        dst = nullptr;
+    }
+
+    const char *check() override {
+        JNIEnv *env = decoder->env;
+        uint32 displayWidth = map.getDisplayWidth();
+        uint32 displayHeight = map.getDisplayHeight();
+        int pixelBytes = NativeBufferSink::bytesPerPixel(pixelFormat);
+        long minRowStride = (long) displayWidth * pixelBytes;
+        if (rowStride == 0) {
+            rowStride = minRowStride;
+        }
+        dst = (uint8_t *) env->GetDirectBufferAddress(buffer);
+        jlong capacity = env->GetDirectBufferCapacity(buffer);
+        if (pixelBytes == 0) {
+            return "Unknown pixel format";
+        } else if (rowStride < minRowStride) {
+            return "Row stride is less than width of decoded image";
+        } else if (!dst || capacity < 0) {
+            return "Buffer should be direct";
+        } else if (outWidth == 0 || outHeight == 0) {
+            return "Decoded image is empty";
+        } else if (capacity < (jlong) (displayHeight - 1) * rowStride + minRowStride) {
+            return "Buffer is too small for decoded image";
+        }
+        return nullptr;
+    }
+
+    unsigned long estimateMemory(unsigned long budget) override {
+        //rows are converted into buffer as they are decoded, so only reader works in memory
+        unsigned long mem = (unsigned long) outWidth * (NativeBufferSink::bytesPerPixel(pixelFormat) + (decoder->invertRedAndBlue ? sizeof(uint32) : 0)); //lines of sink
+        return mem + decoder->estimateStreamMemory(regionWidth, regionHeight, inSampleSize, mem);
+    }
+
+    const char *init() override {
+        auto *bufferSink = new NativeBufferSink(dst, rowStride, pixelFormat, outWidth, outHeight, map.getOrientation(), decoder->invertRedAndBlue);
+        sink = bufferSink;
+        return bufferSink->init() ? nullptr : "Can\'t allocate memory for converted line";
+    }
+
+private:
+    jobject buffer;
+    jint rowStride;
+    jint pixelFormat;
+    uint8_t *dst;
+};
+
+//Direct buffer with YUV 4:2:0 image in YuvFormat
+class NativeDecoder::YuvTarget : public NativeDecoder::StreamTarget {
+public:
+    YuvTarget(NativeDecoder *d, jobject b, jint stride, jint format) : StreamTarget(d) {
+        buffer = b;
+        rowStride = stride;
+        yuvFormat = format;
+        dst = nullptr;
+    }
+
+    const char *check() override {
+        JNIEnv *env = decoder->env;
+        uint32 displayWidth = map.getDisplayWidth();
+        uint32 displayHeight = map.getDisplayHeight();
+        //Chroma of odd width takes the same bytes as of next even width
+        long minRowStride = (displayWidth + 1) & ~1;
+        if (rowStride == 0) {
+            rowStride = minRowStride;
+        }
+        dst = (uint8_t *) env->GetDirectBufferAddress(buffer);
+        jlong capacity = env->GetDirectBufferCapacity(buffer);
+        jlong bufferSize = NativeYuvSink::bufferSize(yuvFormat, rowStride, displayHeight);
+        if (bufferSize == 0) {
+            return "Unknown YUV format";
+        } else if (rowStride < minRowStride) {
+            return "Row stride is less than width of decoded image rounded up to even number";
+        } else if (!dst || capacity < 0) {
+            return "Buffer should be direct";
+        } else if (outWidth == 0 || outHeight == 0) {
+            return "Decoded image is empty";
+        } else if (capacity < bufferSize) {
+            return "Buffer is too small for decoded image";
+        }
+        return nullptr;
+    }
+
+    unsigned long estimateMemory(unsigned long budget) override {
+        //rows are converted into buffer as they are decoded, so only reader and two lines of sink work in memory
+        unsigned long mem = NativeYuvSink::getWorkingMemory(outWidth);
+        return mem + decoder->estimateStreamMemory(regionWidth, regionHeight, inSampleSize, mem);
+    }
+
+    const char *init() override {
+        auto *yuvSink = new NativeYuvSink(dst, rowStride, yuvFormat, outWidth, outHeight, map.getOrientation(), decoder->invertRedAndBlue);
+        sink = yuvSink;
+        return yuvSink->init() ? nullptr : "Can\'t allocate memory for converted line";
+    }
+
+private:
+    jobject buffer;
+    jint rowStride;
+    jint yuvFormat;
+    uint8_t *dst;
+};
+
+//Direct buffer with normalized tensor
+class NativeDecoder::TensorTarget : public NativeDecoder::StreamTarget {
+public:
+    TensorTarget(NativeDecoder *d, jobject b, jint width, jint height, jint l, jint t, jfloatArray m, jfloatArray s) : StreamTarget(d) {
+        buffer = b;
+        tensorWidth = width;
+        tensorHeight = height;
+        layout = l;
+        type = t;
+        meanArray = m;
+        stdArray = s;
+        tensorSink = nullptr;
+    }
+
+    const char *check() override {
+        JNIEnv *env = decoder->env;
+        if (tensorWidth == 0) {
+            tensorWidth = map.getDisplayWidth();
+        }
+        if (tensorHeight == 0) {
+            tensorHeight = map.getDisplayHeight();
+        }
+
+        float meanValues[3] = {0.f, 0.f, 0.f};
+        float stdValues[3] = {1.f, 1.f, 1.f};
+        jsize channels = env->GetArrayLength(meanArray);
+        if (channels == 1 || channels == 3) {
+            env->GetFloatArrayRegion(meanArray, 0, channels, meanValues);
+            env->GetFloatArrayRegion(stdArray, 0, channels, stdValues);
+        }
+
+        int valueBytes = NativeTensorSink::bytesPerValue(type);
+        auto *dst = (uint8_t *) env->GetDirectBufferAddress(buffer);
+        jlong capacity = env->GetDirectBufferCapacity(buffer);
+        if (valueBytes == 0) {
+            return "Unknown tensor type";
+        } else if (layout != NativeTensorSink::LAYOUT_NCHW && layout != NativeTensorSink::LAYOUT_NHWC) {
+            return "Unknown tensor layout";
+        } else if (channels != 1 && channels != 3) {
+            return "Tensor should have 1 or 3 channels";
+        } else if (!dst || capacity < 0) {
+            return "Buffer should be direct";
+        } else if (outWidth == 0 || outHeight == 0 || tensorWidth <= 0 || tensorHeight <= 0) {
+            return "Decoded image is empty";
+        } else if (capacity < (jlong) tensorWidth * tensorHeight * channels * valueBytes) {
+            return "Buffer is too small for tensor";
+        }
+        tensorSink = new NativeTensorSink(dst, layout, type, tensorWidth, tensorHeight, channels, meanValues, stdValues, outWidth, outHeight, map.getOrientation(), decoder->invertRedAndBlue);
+        sink = tensorSink;
+        return nullptr;
+    }
+
+    unsigned long estimateMemory(unsigned long budget) override {
+        //rows are resized and normalized into tensor as they are decoded, so only reader and maps of cells work in memory
+        unsigned long mem = tensorSink->getWorkingMemory();
+        return mem + decoder->estimateStreamMemory(regionWidth, regionHeight, inSampleSize, mem);
+    }
+
+    const char *init() override {
+        return tensorSink->init() ? nullptr : "Can\'t allocate memory for tensor lines";
+    }
+
+    const char *decode(bool *stopped) override {
+        const char *err = StreamTarget::decode(stopped);
+        if (!err && !*stopped) {
+            tensorSink->finish();
+        }
+        return err;
+    }
+
+private:
+    jobject buffer;
+    jint tensorWidth;
+    jint tensorHeight;
+    jint layout;
+    jint type;
+    jfloatArray meanArray;
+    jfloatArray stdArray;
+    NativeTensorSink *tensorSink;
+};
+
+jboolean NativeDecoder::decodeBands(jint bandHeight, jobject bandListener, jlong bandCallback, jlong bandCallbackData) {
+    bandListenerObject = bandListener;
+    bandCallbackPointer = bandCallback;
+    bandCallbackUserData = bandCallbackData;
+    BandTarget target(this, bandHeight);
+    return decodeToTarget("decodeBands", &target);
+}
+
+jboolean NativeDecoder::decodeInto(jobject buffer, jint rowStride, jint pixelFormat) {
+    BufferTarget target(this, buffer, rowStride, pixelFormat);
+    return decodeToTarget("decodeInto", &target);
+}
+
+jboolean NativeDecoder::decodeYuv(jobject buffer, jint rowStride, jint yuvFormat) {
+    YuvTarget target(this, buffer, rowStride, yuvFormat);
+    return decodeToTarget("decodeYuv", &target);
+}
+
+jboolean NativeDecoder::decodeTensor(jobject buffer, jint tensorWidth, jint tensorHeight, jint layout, jint type, jfloatArray mean, jfloatArray std) {
+    TensorTarget target(this, buffer, tensorWidth, tensorHeight, layout, type, mean, std);
+    return decodeToTarget("decodeTensor", &target);
+}
+
+//Common part of decoding by streaming rows: catch SIGSEGV, open image, check destination and memory and stream region to target.
+//Target is owned by caller, so its sink and buffers are freed after SIGSEGV as well
+jboolean NativeDecoder::decodeToTarget(const char *name, StreamTarget *target) {
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", name);
+
+    //init signal handler for catch SIGSEGV error that could be raised in libtiff
+    struct sigaction act{};
+    memset(&act, 0, sizeof(act));
+    sigemptyset(&act.sa_mask);
+    act.sa_sigaction = generalErrorHandler;
+    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    if (sigaction(SIGSEGV, &act, 0) < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
+    }
+
+    //check for error
+    if (setjmp(NativeDecoder::general_buf)) {
+        const char *err = "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
+        if (throwException) {
+            throwDecodeFileException(err);
+        }
+        return JNI_FALSE;
+    }
+
+    jint inSampleSize = 1;
+    jboolean inJustDecodeBounds = false;
+    jint inDirectoryNumber = 0;
+    if (!initDecoding(&inSampleSize, &inJustDecodeBounds, &inDirectoryNumber)) {
+        return JNI_FALSE;
+    }
+
+    writeDataToOptions(inDirectoryNumber);
+
+    if (inJustDecodeBounds) {
+        return JNI_TRUE;
+    }
+
+    if (!checkImageFormat()) {
+        return JNI_FALSE;
+    }
+
+    uint32 regionWidth = hasBounds ? boundWidth : origwidth;
+    uint32 regionHeight = hasBounds ? boundHeight : origheight;
+    target->setRegion(regionWidth, regionHeight, inSampleSize, useOrientationTag ? origorientation : ORIENTATION_TOPLEFT);
+    const char *message = target->check();
+    if (message) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
+        if (throwException) {
+            throwDecodeFileException(message);
+        }
+        return JNI_FALSE;
+    }
+
+    unsigned long readerMem = rawReader ? rawReader->getWorkingMemory() : 0;
+    unsigned long estimateMem = readerMem + target->estimateMemory(availableMemory > readerMem ? availableMemory - readerMem : 0);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %s %lu %s %d", name, "estimateMem", estimateMem, "chunk rows", streamChunkRows);
+    if (estimateMem > availableMemory) {
+        if (throwException) {
+            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
+        }
+        return JNI_FALSE;
+    }
+    writeDecodePlan(DECODE_METHOD_STREAM, estimateMem);
+
+    message = target->init();
+    if (message) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
+        if (throwException) {
+            throwDecodeFileException(message);
+        }
+        return JNI_FALSE;
+    }
+
+    progressTotal = (jlong) regionWidth * regionHeight;
+    sendProgress(0, progressTotal);
+
+    bool stopped = false;
+    const char *err = target->decode(&stopped);
+    if (stopped) {
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Decoding stopped");
+        return JNI_FALSE;
+    }
+    if (err) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
+        if (throwException) {
+            throwDecodeFileException(err);
+        }
+        return JNI_FALSE;
+    }
+
+    sendProgress(progressTotal, progressTotal);
+    return JNI_TRUE;
+}
+
+//Pass rows of current band to native callback or to Java listener. Returns false if consumer wants to stop decoding
+bool NativeDecoder::deliverBand(uint32 firstRow, uint32 rowCount) {
+    uint32 *band = bandPixels;
+    uint32 width = bandWidth;
+    size_t count = (size_t) rowCount * width;
+    if (invertRedAndBlue) {
+        for (size_t i = 0; i < count; i++) {
+            uint32 tmp = band[i];
+            band[i] = (tmp & 0xff00ff00) | ((tmp & 0x00ff0000) >> 16) | ((tmp & 0xff) << 16);
+        }
+    }
+
+    if (bandCallbackPointer) {
+        auto callback = (tiff_band_callback) bandCallbackPointer;
+        return callback((void *) bandCallbackUserData, band, firstRow, rowCount, width) != 0;
+    }
+
+    jobject buffer = env->NewDirectByteBuffer(band, count * sizeof(uint32));
+    if (!buffer) {
+        return false;
+    }
+    jclass bandListenerClass = env->GetObjectClass(bandListenerObject);
+    jmethodID methodid = env->GetMethodID(bandListenerClass, "onBand", "(Ljava/nio/ByteBuffer;III)Z");
+    jboolean result = env->CallBooleanMethod(bandListenerObject, methodid, buffer, (jint) firstRow, (jint) rowCount, (jint) width);
+    env->DeleteLocalRef(buffer);
+    env->DeleteLocalRef(bandListenerClass);
+    if (env->ExceptionCheck()) {
+        //let exception of listener reach the caller
+        return false;
+    }
+    return result;
+}
+
+//Read options, open file and check decode area. Common part of decoding to bitmap and to bands
+bool NativeDecoder::initDecoding(jint *inSampleSize, jboolean *inJustDecodeBounds, jint *inDirectoryNumber) {
     //Get options from TiffBitmapFactory$Options
     jfieldID gOptions_ThrowExceptionFieldID = env->GetFieldID(jBitmapOptionsClass, "inThrowException", "Z");
     throwException = env->GetBooleanField(optionsObject, gOptions_ThrowExceptionFieldID);
@@ -98,25 +618,28 @@ jobject NativeDecoder::getBitmap() {
     useOrientationTag = env->GetBooleanField(optionsObject, gOptions_UseOrientationTagFieldID);
 
     jfieldID gOptions_sampleSizeFieldID = env->GetFieldID(jBitmapOptionsClass, "inSampleSize", "I");
-    jint inSampleSize = env->GetIntField(optionsObject, gOptions_sampleSizeFieldID);
-    if (inSampleSize != 1 && inSampleSize % 2 != 0) {
+    *inSampleSize = env->GetIntField(optionsObject, gOptions_sampleSizeFieldID);
+    if (*inSampleSize != 1 && *inSampleSize % 2 != 0) {
         const char *message = "inSampleSize should be power of 2\0";
         __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
         if (throwException) {
             throwDecodeFileException(message);
         }
-        return nullptr;
+        return false;
     }
 
     jfieldID gOptions_justDecodeBoundsFieldID = env->GetFieldID(jBitmapOptionsClass, "inJustDecodeBounds", "Z");
-    jboolean inJustDecodeBounds = env->GetBooleanField(optionsObject, gOptions_justDecodeBoundsFieldID);
+    *inJustDecodeBounds = env->GetBooleanField(optionsObject, gOptions_justDecodeBoundsFieldID);
 
     jfieldID gOptions_invertRedAndBlueFieldID = env->GetFieldID(jBitmapOptionsClass, "inSwapRedBlueColors", "Z");
     invertRedAndBlue = env->GetBooleanField(optionsObject, gOptions_invertRedAndBlueFieldID);
 
     jfieldID gOptions_DirectoryCountFieldID = env->GetFieldID(jBitmapOptionsClass, "inDirectoryNumber", "I");
-    jint inDirectoryNumber = env->GetIntField(optionsObject, gOptions_DirectoryCountFieldID);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "param directoryCount", inDirectoryNumber);
+    *inDirectoryNumber = env->GetIntField(optionsObject, gOptions_DirectoryCountFieldID);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "param directoryCount", *inDirectoryNumber);
+
+    jfieldID gOptions_OverviewFieldID = env->GetFieldID(jBitmapOptionsClass, "inOverview", "I");
+    overview = env->GetIntField(optionsObject, gOptions_OverviewFieldID);
 
     jfieldID gOptions_AvailableMemoryFieldID = env->GetFieldID(jBitmapOptionsClass, "inAvailableMemory", "J");
     unsigned long inAvailableMemory = env->GetLongField(optionsObject, gOptions_AvailableMemoryFieldID);
@@ -124,6 +647,28 @@ jobject NativeDecoder::getBitmap() {
     jfieldID gOptions_PreferedConfigFieldID = env->GetFieldID(jBitmapOptionsClass, "inPreferredConfig", "Lorg/beyka/tiffbitmapfactory/TiffBitmapFactory$ImageConfig;");
     jobject config = env->GetObjectField(optionsObject, gOptions_PreferedConfigFieldID);
 
+    jfieldID gOptions_FloatMinValueFieldID = env->GetFieldID(jBitmapOptionsClass, "inFloatMinValue", "F");
+    floatMinValue = env->GetFloatField(optionsObject, gOptions_FloatMinValueFieldID);
+
+    jfieldID gOptions_FloatMaxValueFieldID = env->GetFieldID(jBitmapOptionsClass, "inFloatMaxValue", "F");
+    floatMaxValue = env->GetFloatField(optionsObject, gOptions_FloatMaxValueFieldID);
+
+    jfieldID gOptions_CmykInkLimitFieldID = env->GetFieldID(jBitmapOptionsClass, "inCmykInkLimit", "I");
+    cmykInkLimit = env->GetIntField(optionsObject, gOptions_CmykInkLimitFieldID);
+
+    jfieldID gOptions_BandsFieldID = env->GetFieldID(jBitmapOptionsClass, "inBands", "[I");
+    auto bandsArray = (jintArray) env->GetObjectField(optionsObject, gOptions_BandsFieldID);
+    if (bandsArray) {
+        //count of wrong length is kept for error message of raw reader
+        bandCount = env->GetArrayLength(bandsArray);
+        jint *values = env->GetIntArrayElements(bandsArray, nullptr);
+        for (int i = 0; i < 4 && i < bandCount; i++) {
+            bands[i] = values[i];
+        }
+        env->ReleaseIntArrayElements(bandsArray, values, JNI_ABORT);
+        env->DeleteLocalRef(bandsArray);
+    }
+
     if (inAvailableMemory > 0) {
         availableMemory = inAvailableMemory;
     }
@@ -142,7 +687,7 @@ jobject NativeDecoder::getBitmap() {
     jobject decodeArea = env->GetObjectField(optionsObject, gOptions_DecodeAreaFieldId);
 
     //if directory number < 0 set it to 0
-    if (inDirectoryNumber < 0) inDirectoryNumber = 0;
+    if (*inDirectoryNumber < 0) *inDirectoryNumber = 0;
 
     //Open tiff file
     const char *strPath = nullptr;
@@ -166,7 +711,7 @@ jobject NativeDecoder::getBitmap() {
         } else {
             __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t open file descriptor fd=%d", jFd);
         }
-        return nullptr;
+        return false;
     } else {
         if (decodingMode == DECODE_MODE_FILE_PATH) {
             env->ReleaseStringUTFChars(jPath, strPath);
@@ -174,7 +719,15 @@ jobject NativeDecoder::getBitmap() {
     }
     __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Tiff is open");
 
-    TIFFSetDirectory(image, inDirectoryNumber);
+    TIFFSetDirectory(image, *inDirectoryNumber);
+    if (!setOverview()) {
+        const char *message = "Directory has no overview with number inOverview";
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
+        if (throwException) {
+            throwDecodeFileException(message);
+        }
+        return false;
+    }
     TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &origwidth);
     TIFFGetField(image, TIFFTAG_IMAGELENGTH, &origheight);
 
@@ -198,7 +751,7 @@ jobject NativeDecoder::getBitmap() {
                 throwDecodeFileException(message);
             }
             env->DeleteLocalRef(decodeAreaClass);
-            return nullptr;
+            return false;
         }
         if (boundY >= origheight - 1) {
             const char *message = "Y of left top corner of decode area should be less than image height";
@@ -207,7 +760,7 @@ jobject NativeDecoder::getBitmap() {
                 throwDecodeFileException(message);
             }
             env->DeleteLocalRef(decodeAreaClass);
-            return nullptr;
+            return false;
         }
 
         if (boundX < 0) boundX = 0;
@@ -222,7 +775,7 @@ jobject NativeDecoder::getBitmap() {
                 throwDecodeFileException(message);
             }
             env->DeleteLocalRef(decodeAreaClass);
-            return nullptr;
+            return false;
         }
         if (boundHeight < 1) {
             const char *message = "Height of decode area can\'t be less than 1";
@@ -231,7 +784,7 @@ jobject NativeDecoder::getBitmap() {
                 throwDecodeFileException(message);
             }
             env->DeleteLocalRef(decodeAreaClass);
-            return nullptr;
+            return false;
         }
 
         __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "Decode X", boundX);
@@ -244,17 +797,7 @@ jobject NativeDecoder::getBitmap() {
         env->DeleteLocalRef(decodeArea);
     }
 
-    jobject java_bitmap = nullptr;
-
-    writeDataToOptions(inDirectoryNumber);
-
-    if (!inJustDecodeBounds) {
-        progressTotal = origwidth * origheight;
-        sendProgress(0, progressTotal);
-        java_bitmap = createBitmap(inSampleSize, inDirectoryNumber);
-    }
-
-    return java_bitmap;
+    return true;
 }
 
 jobject NativeDecoder::createBitmap(int inSampleSize, int directoryNumber) {
@@ -266,15 +809,9 @@ jobject NativeDecoder::createBitmap(int inSampleSize, int directoryNumber) {
         configInt = env->GetIntField(preferedConfig, ordinalFieldID);
         env->DeleteLocalRef(configClass);
     }
+    alphaOnly = configInt == ALPHA_8;
 
-    int bitdepth = 1;
-    TIFFGetField(image, TIFFTAG_BITSPERSAMPLE, &bitdepth);
-    if (bitdepth != 1 && bitdepth != 4 && bitdepth != 8 && bitdepth != 16) {
-        const char *err = "Only 1, 4, 8 and 16 bits per sample are supported";
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
-        if (throwException) {
-            throwDecodeFileException(err);
-        }
+    if (!checkImageFormat()) {
         return nullptr;
     }
 
@@ -283,23 +820,19 @@ jobject NativeDecoder::createBitmap(int inSampleSize, int directoryNumber) {
 
     jint *raster = nullptr;
 
-    if (hasBounds) {
-        switch (getDecodeMethod()) {
-            case DECODE_METHOD_IMAGE:
-                raster = getSampledRasterFromImageWithBounds(inSampleSize, &newBitmapWidth, &newBitmapHeight);
-                break;
-            case DECODE_METHOD_TILE:
-                raster = getSampledRasterFromTileWithBounds(inSampleSize, &newBitmapWidth, &newBitmapHeight);
-                break;
-            case DECODE_METHOD_STRIP:
-                raster = getSampledRasterFromStripWithBounds(inSampleSize, &newBitmapWidth, &newBitmapHeight);
-                break;
+    int decodeMethod = planDecode(inSampleSize, configInt);
+    //single strip images and decode area of stripped images are streamed,
+    //so only rows and columns of area are decoded and sampled on the fly
+    bool streamed = decodeMethod == DECODE_METHOD_STREAM || decodeMethod == DECODE_METHOD_IMAGE
+            || (decodeMethod == DECODE_METHOD_STRIP && (hasBounds || skipStripRows(inSampleSize) || useBilevelReader()));
+    if (streamed) {
+        raster = getSampledRasterFromStream(inSampleSize, &newBitmapWidth, &newBitmapHeight);
+    } else if (hasBounds) {
+        if (decodeMethod == DECODE_METHOD_TILE) {
+            raster = getSampledRasterFromTileWithBounds(inSampleSize, &newBitmapWidth, &newBitmapHeight);
         }
     } else {
-        switch (getDecodeMethod()) {
-            case DECODE_METHOD_IMAGE:
-                raster = getSampledRasterFromImage(inSampleSize, &newBitmapWidth, &newBitmapHeight);
-                break;
+        switch (decodeMethod) {
             case DECODE_METHOD_TILE:
                 raster = getSampledRasterFromTile(inSampleSize, &newBitmapWidth, &newBitmapHeight);
                 break;
@@ -415,73 +948,718 @@ jobject NativeDecoder::createBitmap(int inSampleSize, int directoryNumber) {
     return java_bitmap;
 }
 
-jint *NativeDecoder::getSampledRasterFromStrip(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
-    //init signal handler for catch SIGSEGV error that could be raised in libtiff
-    struct sigaction act;
-    memset(&act, 0, sizeof(act));
-    sigemptyset(&act.sa_mask);
-    act.sa_sigaction = stripErrorHandler;
-    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
-    if (sigaction(SIGSEGV, &act, 0) < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
+//Check that samples of image can be decoded. Images with inBands option, floating point, indexed, YCbCr JPEG, CMYK,
+//CIE L*a*b* and planar images also get raw reader
+bool NativeDecoder::checkImageFormat() {
+    int bitdepth = 1;
+    TIFFGetField(image, TIFFTAG_BITSPERSAMPLE, &bitdepth);
+    if (bandCount > 0) {
+        //only selected samples are converted, other planes are not read at all
+        if (!initRawReader()) {
+            return false;
+        }
+    } else if (NativeRawReader::isFloatImage(image)) {
+        //floating point samples can't be decoded with libtiff RGBA interface
+        if (!initRawReader()) {
+            return false;
+        }
+    } else if (NativeRawReader::isIndexedImage(image)) {
+        //packed indices are expanded with table of whole bytes instead of libtiff conversion of every pixel
+        if (!initRawReader()) {
+            return false;
+        }
+    } else if ((NativeRawReader::isJpegYCbCrImage(image) || NativeRawReader::isCmykImage(image) || NativeRawReader::isLabImage(image)
+                || NativeRawReader::isPlanarImage(image)) && NativeRawReader::hasSeveralBlocks(image)) {
+        //libjpeg converts YCbCr to RGB, CMYK and CIE L*a*b* are converted and separate planes are interleaved by vector kernels
+        //instead of libtiff code for every pixel. Single strip is left to readers that don't keep whole decoded strip
+        if (!initRawReader()) {
+            return false;
+        }
+    } else if (cmykInkLimit > 0 && NativeRawReader::isCmykImage(image)) {
+        //libtiff has only naive conversion, so single strip of CMYK is read by raw reader as well when ink is limited
+        if (!initRawReader()) {
+            return false;
+        }
+    } else if (bitdepth != 1 && bitdepth != 4 && bitdepth != 8 && bitdepth != 16) {
+        const char *err = "Only 1, 4, 8 and 16 bits per sample are supported";
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
+        if (throwException) {
+            throwDecodeFileException(err);
+        }
+        return false;
     }
+    return true;
+}
 
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "width", origwidth);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "height", origheight);
-
-    jint *pixels = nullptr;
-    *bitmapWidth = origwidth / inSampleSize;
-    *bitmapHeight = origheight / inSampleSize;
-    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
-    int origImageBufferSize = origwidth * origheight;
-
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "new width", *bitmapWidth);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "new height", *bitmapHeight);
-
-    uint32 stripSize = TIFFStripSize(image);
-    uint32 stripMax = TIFFNumberOfStrips(image);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "strip size ", stripSize);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "stripMax  ", stripMax);
-    int rowPerStrip = -1;
-    TIFFGetField(image, TIFFTAG_ROWSPERSTRIP, &rowPerStrip);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "rowsperstrip", rowPerStrip);
+bool NativeDecoder::initRawReader() {
+    rawReader = new NativeRawReader(image);
+    if (bandCount > 0) {
+        rawReader->selectBands(bands, bandCount);
+    }
+    if (alphaOnly) {
+        rawReader->readAlphaOnly();
+    }
+    rawReader->setInkLimit(cmykInkLimit);
+    const char *err = rawReader->checkSupport();
+    if (err) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
+        if (throwException) {
+            throwDecodeFileException(err);
+        }
+        return false;
+    }
 
-    unsigned long estimateMem = 0;
-    estimateMem += (sizeof(jint) * pixelsBufferSize); //buffer for decoded pixels
-    estimateMem += (origwidth * sizeof(uint32)); //work line for rotate strip
-    estimateMem += (origwidth * rowPerStrip * sizeof(uint32) * 2); //current and next strips
-    estimateMem += (sizeof(jint) * origwidth * 2); //bottom and top lines for reading pixel(matrixBottomLine, matrixTopLine)
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
+    unsigned long estimateMem = rawReader->getWorkingMemory();
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %lu", "raw reader estimateMem", estimateMem);
     if (estimateMem > availableMemory) {
         if (throwException) {
             throw_not_enough_memory_exception(env, availableMemory, estimateMem);
         }
-        return nullptr;
+        return false;
     }
 
-    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
-    if (pixels == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
-        return nullptr;
+    if (!rawReader->init()) {
+        const char *message = "Can\'t allocate memory for raw samples";
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
+        if (throwException) {
+            throwDecodeFileException(message);
+        }
+        return false;
     }
 
-    auto *work_line_buf = (uint32 *) _TIFFmalloc(origwidth * sizeof(uint32));
-
-    uint32 *raster;
-    uint32 *rasterForBottomLine; // in this raster copy next strip for getting bottom line in matrix color selection
-    if (rowPerStrip == -1 && stripMax == 1) {
-        raster = (uint32 *) _TIFFmalloc(origImageBufferSize * sizeof(uint32));
-        rasterForBottomLine = (uint32 *) _TIFFmalloc(origImageBufferSize * sizeof(uint32));
-    } else {
-        raster = (uint32 *) _TIFFmalloc(origwidth * rowPerStrip * sizeof(uint32));
-        rasterForBottomLine = (uint32 *) _TIFFmalloc(origwidth * rowPerStrip * sizeof(uint32));
-    }
-    if (rowPerStrip == -1) {
-        rowPerStrip = origheight;
+    if (!NativeRawReader::isFloatImage(image)) {
+        return true;
     }
 
-    int targetY = 0;
-    int nextStripOffset = 0;
+    //Map caller range or range of finite values to 0..255
+    if (std::isnan(floatMinValue) || std::isnan(floatMaxValue)) {
+        if (!rawReader->computeFloatRange()) {
+            const char *message = "Can\'t read floating point samples";
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
+            if (throwException) {
+                throwDecodeFileException(message);
+            }
+            return false;
+        }
+    }
+    float min = std::isnan(floatMinValue) ? rawReader->getFloatMin() : floatMinValue;
+    float max = std::isnan(floatMaxValue) ? rawReader->getFloatMax() : floatMaxValue;
+    rawReader->setFloatRange(min, max);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %f %f", "float range", min, max);
+
+    jfieldID gOptions_outFloatMinValueFieldID = env->GetFieldID(jBitmapOptionsClass, "outFloatMinValue", "F");
+    env->SetFloatField(optionsObject, gOptions_outFloatMinValueFieldID, min);
+    jfieldID gOptions_outFloatMaxValueFieldID = env->GetFieldID(jBitmapOptionsClass, "outFloatMaxValue", "F");
+    env->SetFloatField(optionsObject, gOptions_outFloatMaxValueFieldID, max);
+
+    return true;
+}
+
+//Choose decode method that fits into available memory.
+//If usual method for this image needs too much memory image is decoded by streaming rows
+int NativeDecoder::planDecode(int inSampleSize, int config) {
+    int method = getDecodeMethod();
+    unsigned long estimateMem = estimateMemory(method, inSampleSize, config);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d %s %lu", "decode method", method, "estimateMem", estimateMem);
+    if (estimateMem > availableMemory) {
+        method = DECODE_METHOD_STREAM;
+        estimateMem = estimateMemory(method, inSampleSize, config);
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %lu %s %d", "stream estimateMem", estimateMem, "chunk rows", streamChunkRows);
+        if (estimateMem > availableMemory) {
+            //even decoded pixels don't fit
+            if (throwException) {
+                throw_not_enough_memory_exception(env, availableMemory, estimateMem);
+            }
+            return -1;
+        }
+    }
+
+    writeDecodePlan(method, estimateMem);
+
+    return method;
+}
+
+//Report chosen decode method and its memory estimate in options
+void NativeDecoder::writeDecodePlan(int method, unsigned long estimateMem) {
+    jclass decodeMethodClass = env->FindClass("org/beyka/tiffbitmapfactory/DecodeMethod");
+    jfieldID decodeMethodFieldId = nullptr;
+    switch (method) {
+        case DECODE_METHOD_IMAGE:
+            decodeMethodFieldId = env->GetStaticFieldID(decodeMethodClass, "IMAGE", "Lorg/beyka/tiffbitmapfactory/DecodeMethod;");
+            break;
+        case DECODE_METHOD_TILE:
+            decodeMethodFieldId = env->GetStaticFieldID(decodeMethodClass, "TILE", "Lorg/beyka/tiffbitmapfactory/DecodeMethod;");
+            break;
+        case DECODE_METHOD_STRIP:
+            decodeMethodFieldId = env->GetStaticFieldID(decodeMethodClass, "STRIP", "Lorg/beyka/tiffbitmapfactory/DecodeMethod;");
+            break;
+        case DECODE_METHOD_STREAM:
+            decodeMethodFieldId = env->GetStaticFieldID(decodeMethodClass, "STREAM", "Lorg/beyka/tiffbitmapfactory/DecodeMethod;");
+            break;
+    }
+    jobject decodeMethodObj = env->GetStaticObjectField(decodeMethodClass, decodeMethodFieldId);
+    jfieldID gOptions_outDecodeMethodFieldId = env->GetFieldID(jBitmapOptionsClass, "outDecodeMethod", "Lorg/beyka/tiffbitmapfactory/DecodeMethod;");
+    env->SetObjectField(optionsObject, gOptions_outDecodeMethodFieldId, decodeMethodObj);
+    jfieldID gOptions_outEstimatedMemoryFieldId = env->GetFieldID(jBitmapOptionsClass, "outEstimatedMemory", "J");
+    env->SetLongField(optionsObject, gOptions_outEstimatedMemoryFieldId, estimateMem);
+    env->DeleteLocalRef(decodeMethodObj);
+    env->DeleteLocalRef(decodeMethodClass);
+}
+
+//Working set of decoding with given method. Buffers that are allocated at the same time are summed.
+//For streaming also chooses number of rows that are read at once
+unsigned long NativeDecoder::estimateMemory(int method, int inSampleSize, int config) {
+    unsigned long width = hasBounds ? boundWidth : origwidth;
+    unsigned long height = hasBounds ? boundHeight : origheight;
+    unsigned long outPixels = (width / inSampleSize) * (height / inSampleSize);
+
+    unsigned long estimateMem = 0;
+    switch (method) {
+        case DECODE_METHOD_IMAGE: {
+            //rows are streamed from single strip
+            estimateMem += outPixels * sizeof(jint); //buffer for decoded pixels
+            estimateMem += estimateStreamMemory(width, height, inSampleSize, estimateMem);
+            break;
+        }
+        case DECODE_METHOD_STRIP: {
+            int rowPerStrip = -1;
+            TIFFGetField(image, TIFFTAG_ROWSPERSTRIP, &rowPerStrip);
+            estimateMem += outPixels * sizeof(jint); //buffer for decoded pixels
+            if (hasBounds || skipStripRows(inSampleSize) || useBilevelReader()) {
+                //strips are streamed in columns of decode area, only in sampled rows or as packed bits
+                estimateMem += estimateStreamMemory(width, height, inSampleSize, estimateMem);
+                break;
+            }
+            estimateMem += origwidth * sizeof(uint32); //work line for rotate strip
+            estimateMem += (unsigned long) origwidth * rowPerStrip * sizeof(uint32) * 2; //current and next strips
+            estimateMem += origwidth * sizeof(jint) * 2; //bottom and top lines for reading pixel(matrixBottomLine, matrixTopLine)
+            break;
+        }
+        case DECODE_METHOD_TILE: {
+            uint32 tileWidth = 0, tileHeight = 0;
+            TIFFGetField(image, TIFFTAG_TILEWIDTH, &tileWidth);
+            TIFFGetField(image, TIFFTAG_TILELENGTH, &tileHeight);
+            unsigned long tileBuffers = tileWidth * tileHeight * sizeof(uint32) * 3 + tileWidth * sizeof(uint32); //current, left and right tiles and work line
+            if (hasBounds) {
+                //pixels of all tiles in decode area, then they are cropped to final buffer
+                unsigned long tilesWidth = ((boundX + boundWidth) / tileWidth + 1 - boundX / tileWidth) * tileWidth / inSampleSize;
+                unsigned long tilesHeight = ((boundY + boundHeight) / tileHeight + 1 - boundY / tileHeight) * tileHeight / inSampleSize;
+                unsigned long tilesPixels = tilesWidth * tilesHeight * sizeof(jint);
+                unsigned long decodeStage = tilesPixels + tileBuffers;
+                unsigned long cropStage = tilesPixels + outPixels * sizeof(jint);
+                estimateMem += decodeStage > cropStage ? decodeStage : cropStage;
+            } else {
+                estimateMem += outPixels * sizeof(jint) + tileBuffers;
+            }
+            break;
+        }
+        case DECODE_METHOD_STREAM: {
+            estimateMem += outPixels * sizeof(jint); //buffer for decoded pixels
+            estimateMem += estimateStreamMemory(width, height, inSampleSize, estimateMem);
+            break;
+        }
+    }
+
+    if (rawReader) {
+        estimateMem += rawReader->getWorkingMemory();
+    }
+
+    //conversion of decoded pixels to bitmap config
+    if (config == ALPHA_8) {
+        estimateMem += outPixels;
+    } else if (config == RGB_565) {
+        estimateMem += outPixels * sizeof(unsigned short);
+    }
+
+    return estimateMem;
+}
+
+//Working set of streaming window of region, without output buffer. usedMemory is memory that is allocated by caller.
+//Chooses number of rows that are read at once so that they fit into rest of available memory
+unsigned long NativeDecoder::estimateStreamMemory(unsigned long width, unsigned long height, int inSampleSize, unsigned long usedMemory) {
+    if (useBilevelReader()) {
+        //one packed scanline, counters of sampled pixels and one output line or table of expanded bytes
+        streamChunkRows = 1;
+        unsigned long outWidth = width / inSampleSize;
+        unsigned long mem = NativeScanlineRowReader::estimateMemory(image, origwidth) + outWidth * sizeof(uint32);
+        mem += inSampleSize > 1 ? outWidth * sizeof(uint32) : BIT_TABLE_SIZE * sizeof(uint32);
+        return mem;
+    }
+
+    unsigned long rowBytes = width * sizeof(uint32);
+    unsigned long fixedMem = 0;
+    if (inSampleSize > 1) {
+        fixedMem += rowBytes * 2; //top and middle lines of filter
+        fixedMem += (width / inSampleSize) * sizeof(uint32); //filtered line
+    }
+    unsigned long rowMem = rowBytes; //rows that are read at once
+    uint32 blockHeight = 0;
+    if (TIFFIsTiled(image)) {
+        TIFFGetField(image, TIFFTAG_TILELENGTH, &blockHeight);
+    } else {
+        TIFFGetFieldDefaulted(image, TIFFTAG_ROWSPERSTRIP, &blockHeight);
+    }
+    bool scanlines = useScanlineReader();
+    if (scanlines) {
+        fixedMem += NativeScanlineRowReader::estimateMemory(image, width);
+    } else if (!rawReader) {
+        unsigned long readerMem = NativeRGBARowReader::estimateMemory(image, width, 0);
+        fixedMem += readerMem;
+        rowMem += NativeRGBARowReader::estimateMemory(image, width, 1) - readerMem;
+    }
+    if (blockHeight == 0 || blockHeight > (uint32) origheight) blockHeight = origheight;
+
+    //libtiff decodes strip from the beginning for every read inside it,
+    //so single strip image is read with as many rows as fits. Otherwise read by strip or tile.
+    //Scanline reader continues decoding of strip from previous row and raw reader keeps decoded strip, so they need only a few rows
+    unsigned long freeMem = availableMemory > usedMemory + fixedMem ? availableMemory - usedMemory - fixedMem : 0;
+    unsigned long fitRows = freeMem / rowMem;
+    unsigned long rows = blockHeight >= (uint32) origheight ? height : blockHeight;
+    if ((scanlines || rawReader) && rows > SCANLINE_CHUNK_ROWS) rows = SCANLINE_CHUNK_ROWS;
+    if (rows > fitRows) rows = fitRows;
+    if (rows > height) rows = height;
+    if (rows < 1) rows = 1;
+    streamChunkRows = rows;
+    return fixedMem + rowMem * rows;
+}
+
+//Single strip images are read by scanlines, RGBA interface of libtiff would decode the whole strip for every chunk of rows.
+//Rows of uncompressed images are read directly from file, so rows that are not sampled are not read at all
+bool NativeDecoder::useScanlineReader() {
+    if (rawReader || TIFFIsTiled(image)) {
+        return false;
+    }
+    return (TIFFNumberOfStrips(image) == 1 && NativeScanlineRowReader::canRead(image)) || NativeScanlineRowReader::hasDirectRows(image);
+}
+
+//1 bit greyscale images, like fax pages, are read as packed bits. Sampled pixels get grey level of share of
+//white pixels in their block instead of 3x3 filter, that keeps thin lines of text visible on thumbnails
+bool NativeDecoder::useBilevelReader() {
+    if (rawReader || TIFFIsTiled(image)) {
+        return false;
+    }
+    uint16 samplesPerPixel = 1;
+    uint16 bitsPerSample = 1;
+    uint16 photometric = 0;
+    TIFFGetFieldDefaulted(image, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetFieldDefaulted(image, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetField(image, TIFFTAG_PHOTOMETRIC, &photometric);
+    return samplesPerPixel == 1 && bitsPerSample == 1
+           && (photometric == PHOTOMETRIC_MINISWHITE || photometric == PHOTOMETRIC_MINISBLACK)
+           && NativeScanlineRowReader::canRead(image);
+}
+
+//Sampled stripped images that are stored uncompressed are streamed with reading of sampled rows only.
+//Scanline reader reads them from file, raw reader converts only them from its cached strip
+bool NativeDecoder::skipStripRows(int inSampleSize) {
+    return inSampleSize > 1 && NativeScanlineRowReader::hasDirectRows(image);
+}
+
+jint *NativeDecoder::getSampledRasterFromStream(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "getSampledRasterFromStream");
+
+    uint32 regionWidth = hasBounds ? boundWidth : origwidth;
+    uint32 regionHeight = hasBounds ? boundHeight : origheight;
+    *bitmapWidth = regionWidth / inSampleSize;
+    *bitmapHeight = regionHeight / inSampleSize;
+    uint32 outWidth = *bitmapWidth;
+    uint32 outHeight = *bitmapHeight;
+
+    if (streamChunkRows == 0) {
+        estimateMemory(DECODE_METHOD_STREAM, inSampleSize, ARGB_8888);
+    }
+
+    jint *pixels = (jint *) malloc(sizeof(jint) * outWidth * outHeight);
+    if (!pixels) {
+        const char *err = "Can\'t allocate memory for decoded pixels";
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
+        if (throwException) {
+            throwDecodeFileException(err);
+        }
+        return nullptr;
+    }
+    NativeRasterSink sink(pixels, outWidth, outHeight, useOrientationTag ? origorientation : ORIENTATION_TOPLEFT);
+
+    progressTotal = (jlong) regionWidth * regionHeight;
+    bool stopped = false;
+    const char *err = streamRegion(inSampleSize, 0, 0, outWidth, outHeight, &sink, 0, &stopped);
+    if (stopped) {
+        free(pixels);
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
+        return nullptr;
+    }
+    if (err) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
+        free(pixels);
+        if (throwException) {
+            throwDecodeFileException(err);
+        }
+        return nullptr;
+    }
+
+    return pixels;
+}
+
+//Decode window of sampled decode area: columns outX..outX + outColumns and rows outY..outY + outRows
+//and write its rows to sink. Rows of window are numbered from 0.
+//Filter of sampled pixels uses neighbours outside of window, so window is read with one pixel around it.
+//Returns error message or nullptr. stopped is set if thread was interrupted or sink refused row
+const char *NativeDecoder::streamRegion(int inSampleSize, uint32 outX, uint32 outY, uint32 outColumns, uint32 outRows, NativeRowSink *sink, jlong progressBase, bool *stopped) {
+    *stopped = false;
+
+    //init signal handler for catch SIGSEGV error that could be raised in libtiff
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    sigemptyset(&act.sa_mask);
+    act.sa_sigaction = streamErrorHandler;
+    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    if (sigaction(SIGSEGV, &act, 0) < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
+    }
+
+    if (useBilevelReader()) {
+        return streamBilevelRegion(inSampleSize, outX, outY, outColumns, outRows, sink, progressBase, stopped);
+    }
+
+    uint32 regionX = hasBounds ? boundX : 0;
+    uint32 regionY = hasBounds ? boundY : 0;
+    uint32 regionWidth = hasBounds ? boundWidth : origwidth;
+    uint32 regionHeight = hasBounds ? boundHeight : origheight;
+
+    //window in pixels of decode area
+    uint32 context = inSampleSize > 1 ? 1 : 0;
+    uint32 firstX = outX * inSampleSize;
+    uint32 firstY = outY * inSampleSize;
+    uint32 windowX = firstX - (firstX < context ? firstX : context);
+    uint32 windowY = firstY - (firstY < context ? firstY : context);
+    uint32 windowRight = (outX + outColumns - 1) * inSampleSize + context + 1;
+    uint32 windowBottom = (outY + outRows - 1) * inSampleSize + context + 1;
+    if (windowRight > regionWidth) windowRight = regionWidth;
+    if (windowBottom > regionHeight) windowBottom = regionHeight;
+    uint32 windowWidth = windowRight - windowX;
+
+    uint32 chunkRows = streamChunkRows > 0 ? streamChunkRows : 1;
+    if (chunkRows > windowBottom - windowY) chunkRows = windowBottom - windowY;
+    //chunks of whole strips or tiles start at their borders, so every block is decoded once
+    uint32 blockRows = 0;
+    if (TIFFIsTiled(image)) {
+        TIFFGetField(image, TIFFTAG_TILELENGTH, &blockRows);
+    } else {
+        TIFFGetFieldDefaulted(image, TIFFTAG_ROWSPERSTRIP, &blockRows);
+    }
+
+    auto *chunk = (uint32 *) _TIFFmalloc((tmsize_t) chunkRows * windowWidth * sizeof(uint32));
+    uint32 *topLine = nullptr;
+    uint32 *midLine = nullptr;
+    uint32 *filteredLine = nullptr;
+    if (inSampleSize > 1) {
+        topLine = (uint32 *) malloc(sizeof(uint32) * windowWidth);
+        midLine = (uint32 *) malloc(sizeof(uint32) * windowWidth);
+        filteredLine = (uint32 *) malloc(sizeof(uint32) * outColumns);
+    }
+    NativeRowReader *reader;
+    if (rawReader) {
+        reader = new NativeRawRowReader(image, rawReader, regionX + windowX, windowWidth);
+    } else if (useScanlineReader()) {
+        reader = new NativeScanlineRowReader(image, regionX + windowX, windowWidth);
+    } else {
+        reader = new NativeRGBARowReader(image, regionX + windowX, windowWidth);
+    }
+
+    auto releaseBuffers = [&]() {
+        delete reader;
+        reader = nullptr;
+        if (chunk) {
+            _TIFFfree(chunk);
+            chunk = nullptr;
+        }
+        if (topLine) {
+            free(topLine);
+            topLine = nullptr;
+        }
+        if (midLine) {
+            free(midLine);
+            midLine = nullptr;
+        }
+        if (filteredLine) {
+            free(filteredLine);
+            filteredLine = nullptr;
+        }
+    };
+
+    //check for error
+    if (setjmp(NativeDecoder::stream_buf)) {
+        releaseBuffers();
+        return "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
+    }
+
+    const char *err = nullptr;
+    if (!chunk || (inSampleSize > 1 && (!topLine || !midLine || !filteredLine))) {
+        err = "Can\'t allocate memory for stream buffers";
+    } else {
+        err = reader->begin(chunkRows);
+    }
+
+    //when rows could be read in any order only 3 rows around every sampled row are read
+    bool sparse = inSampleSize > 1 && reader->canSkipRows();
+
+    uint32 targetY = 0;
+    uint32 centerY = firstY;
+    uint32 rows = 0;
+    for (uint32 y = windowY; !err && y < windowBottom && targetY < outRows; y += rows) {
+        if (checkStop()) {
+            releaseBuffers();
+            *stopped = true;
+            return nullptr;
+        }
+        jlong progress = progressBase + (jlong) (y - windowY) * windowWidth;
+        sendProgress(progress < progressTotal ? progress : progressTotal, progressTotal);
+
+        rows = windowBottom - y < chunkRows ? windowBottom - y : chunkRows;
+        if (blockRows > 0 && blockRows <= chunkRows && rows > blockRows - (regionY + y) % blockRows) {
+            rows = blockRows - (regionY + y) % blockRows;
+        }
+        if (!sparse && !reader->readRows(regionY + y, rows, chunk)) {
+            err = "Can\'t read image rows";
+            break;
+        }
+
+        for (uint32 i = 0; i < rows && targetY < outRows; i++) {
+            uint32 row = y + i;
+            uint32 *line = chunk + i * windowWidth;
+            if (sparse) {
+                if (row + 1 < centerY || row > centerY + 1) {
+                    continue;
+                }
+                if (!reader->readRows(regionY + row, 1, line)) {
+                    err = "Can\'t read image rows";
+                    break;
+                }
+            }
+            bool written = true;
+            if (inSampleSize == 1) {
+                written = sink->writeRow(targetY++, line);
+            } else {
+                //keep 3 lines around every sampled line for the filter
+                if (row + 1 == centerY) {
+                    memcpy(topLine, line, sizeof(uint32) * windowWidth);
+                }
+                if (row == centerY) {
+                    memcpy(midLine, line, sizeof(uint32) * windowWidth);
+                }
+                if (row == centerY + 1) {
+                    pixels_box3_row(centerY > 0 ? topLine : nullptr, midLine, line, windowWidth, firstX - windowX, inSampleSize, filteredLine, outColumns);
+                    written = sink->writeRow(targetY++, filteredLine);
+                    centerY += inSampleSize;
+                    if (row + 1 == centerY) {
+                        memcpy(topLine, line, sizeof(uint32) * windowWidth);
+                    }
+                }
+            }
+            if (!written) {
+                releaseBuffers();
+                *stopped = true;
+                return nullptr;
+            }
+        }
+    }
+
+    releaseBuffers();
+    return err;
+}
+
+//Decode window of sampled decode area of 1 bit image, same as streamRegion.
+//Rows are read as packed bits. Without sampling bits are expanded to pixels with table of whole bytes,
+//otherwise every pixel gets grey level from number of set bits in its inSampleSize x inSampleSize block
+const char *NativeDecoder::streamBilevelRegion(int inSampleSize, uint32 outX, uint32 outY, uint32 outColumns, uint32 outRows, NativeRowSink *sink, jlong progressBase, bool *stopped) {
+    uint32 regionX = hasBounds ? boundX : 0;
+    uint32 regionY = hasBounds ? boundY : 0;
+
+    uint16 photometric = 0;
+    TIFFGetField(image, TIFFTAG_PHOTOMETRIC, &photometric);
+    bool whiteIsZero = photometric == PHOTOMETRIC_MINISWHITE;
+    uint32 black = 0xFF000000;
+    uint32 white = 0xFFFFFFFF;
+
+    auto *line = (uint32 *) malloc(sizeof(uint32) * outColumns);
+    uint32 *counts = nullptr;
+    uint32 *table = nullptr;
+    if (inSampleSize > 1) {
+        counts = (uint32 *) malloc(sizeof(uint32) * outColumns);
+    } else {
+        table = (uint32 *) malloc(sizeof(uint32) * BIT_TABLE_SIZE);
+    }
+    NativeScanlineRowReader *reader = new NativeScanlineRowReader(image, 0, origwidth);
+
+    auto releaseBuffers = [&]() {
+        delete reader;
+        reader = nullptr;
+        if (line) {
+            free(line);
+            line = nullptr;
+        }
+        if (counts) {
+            free(counts);
+            counts = nullptr;
+        }
+        if (table) {
+            free(table);
+            table = nullptr;
+        }
+    };
+
+    //check for error
+    if (setjmp(NativeDecoder::stream_buf)) {
+        releaseBuffers();
+        return "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
+    }
+
+    const char *err = nullptr;
+    if (!line || (inSampleSize > 1 ? !counts : !table)) {
+        err = "Can\'t allocate memory for stream buffers";
+    } else {
+        err = reader->begin(1);
+    }
+    if (!err && table) {
+        uint32 colors[2] = {whiteIsZero ? white : black, whiteIsZero ? black : white};
+        pixels_build_index_table(colors, 1, table);
+    }
+
+    uint32 firstBit = regionX + outX * inSampleSize;
+    uint32 blockArea = inSampleSize * inSampleSize;
+    for (uint32 targetY = 0; !err && targetY < outRows; targetY++) {
+        if (checkStop()) {
+            releaseBuffers();
+            *stopped = true;
+            return nullptr;
+        }
+        jlong progress = progressBase + (jlong) targetY * inSampleSize * outColumns * inSampleSize;
+        sendProgress(progress < progressTotal ? progress : progressTotal, progressTotal);
+
+        uint32 row = regionY + (outY + targetY) * inSampleSize;
+        if (inSampleSize == 1) {
+            const unsigned char *samples = reader->readScanline(row);
+            if (!samples) {
+                err = "Can\'t read image rows";
+                break;
+            }
+            pixels_indexed_to_abgr(samples, firstBit, 1, table, line, outColumns);
+        } else {
+            memset(counts, 0, sizeof(uint32) * outColumns);
+            for (int r = 0; r < inSampleSize && !err; r++) {
+                const unsigned char *samples = reader->readScanline(row + r);
+                if (!samples) {
+                    err = "Can\'t read image rows";
+                } else {
+                    pixels_bits_count(samples, firstBit, inSampleSize, counts, outColumns);
+                }
+            }
+            if (err) {
+                break;
+            }
+            for (uint32 i = 0; i < outColumns; i++) {
+                uint32 level = whiteIsZero ? blockArea - counts[i] : counts[i];
+                uint32 grey = (level * 255 + blockArea / 2) / blockArea;
+                line[i] = black | grey * 0x010101;
+            }
+        }
+
+        if (!sink->writeRow(targetY, line)) {
+            releaseBuffers();
+            *stopped = true;
+            return nullptr;
+        }
+    }
+
+    releaseBuffers();
+    return err;
+}
+
+int NativeDecoder::readRGBAStrip(uint32 row, uint32 *raster) {
+    if (rawReader) {
+        return rawReader->readRGBAStrip(row, raster);
+    }
+    return TIFFReadRGBAStrip(image, row, raster);
+}
+
+int NativeDecoder::readRGBATile(uint32 col, uint32 row, uint32 *raster) {
+    if (rawReader) {
+        return rawReader->readRGBATile(col, row, raster);
+    }
+    return TIFFReadRGBATile(image, col, row, raster);
+}
+
+jint *NativeDecoder::getSampledRasterFromStrip(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
+    //init signal handler for catch SIGSEGV error that could be raised in libtiff
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    sigemptyset(&act.sa_mask);
+    act.sa_sigaction = stripErrorHandler;
+    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    if (sigaction(SIGSEGV, &act, 0) < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
+    }
+
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "width", origwidth);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "height", origheight);
+
+    jint *pixels = nullptr;
+    *bitmapWidth = origwidth / inSampleSize;
+    *bitmapHeight = origheight / inSampleSize;
+    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
+    int origImageBufferSize = origwidth * origheight;
+
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "new width", *bitmapWidth);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "new height", *bitmapHeight);
+
+    uint32 stripSize = TIFFStripSize(image);
+    uint32 stripMax = TIFFNumberOfStrips(image);
+    //strips of separate planes follow each other, rows of image are covered by strips of the first plane
+    uint16 planarConfig = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(image, TIFFTAG_PLANARCONFIG, &planarConfig);
+    if (planarConfig == PLANARCONFIG_SEPARATE) {
+        uint16 samplesPerPixel = 1;
+        TIFFGetFieldDefaulted(image, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+        stripMax /= samplesPerPixel;
+    }
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "strip size ", stripSize);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "stripMax  ", stripMax);
+    int rowPerStrip = -1;
+    TIFFGetField(image, TIFFTAG_ROWSPERSTRIP, &rowPerStrip);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "rowsperstrip", rowPerStrip);
+
+    unsigned long estimateMem = estimateMemory(DECODE_METHOD_STRIP, inSampleSize, ARGB_8888);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
+    if (estimateMem > availableMemory) {
+        if (throwException) {
+            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
+        }
+        return nullptr;
+    }
+
+    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
+    if (pixels == nullptr) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
+        return nullptr;
+    }
+
+    auto *work_line_buf = (uint32 *) _TIFFmalloc(origwidth * sizeof(uint32));
+
+    uint32 *raster;
+    uint32 *rasterForBottomLine; // in this raster copy next strip for getting bottom line in matrix color selection
+    if (rowPerStrip == -1 && stripMax == 1) {
+        raster = (uint32 *) _TIFFmalloc(origImageBufferSize * sizeof(uint32));
+        rasterForBottomLine = (uint32 *) _TIFFmalloc(origImageBufferSize * sizeof(uint32));
+    } else {
+        raster = (uint32 *) _TIFFmalloc(origwidth * rowPerStrip * sizeof(uint32));
+        rasterForBottomLine = (uint32 *) _TIFFmalloc(origwidth * rowPerStrip * sizeof(uint32));
+    }
+    if (rowPerStrip == -1) {
+        rowPerStrip = origheight;
+    }
+
+    int targetY = 0;
+    int nextStripOffset = 0;
     int globalLineCounter = 0;
 
     auto *matrixTopLine = (uint32 *) malloc(sizeof(jint) * origwidth);
@@ -528,7 +1706,7 @@ jint *NativeDecoder::getSampledRasterFromStrip(int inSampleSize, int *bitmapWidt
 
             //If next strip is exist - decode it, invert lines
             if (i + rowPerStrip < stripMax * rowPerStrip) {
-                TIFFReadRGBAStrip(image, i + rowPerStrip, rasterForBottomLine);
+                readRGBAStrip(i + rowPerStrip, rasterForBottomLine);
                 isSecondRasterExist = 1;
 
                 rows_to_write = 0;
@@ -546,7 +1724,7 @@ jint *NativeDecoder::getSampledRasterFromStrip(int inSampleSize, int *bitmapWidt
             }
         } else {
             //if second raster is not exist - first processing - read first and second raster
-            TIFFReadRGBAStrip(image, i, raster);
+            readRGBAStrip(i, raster);
             //invert lines, because libtiff origin is bottom left instead of top left
             rows_to_write = 0;
             if (i + rowPerStrip > origheight) {
@@ -561,7 +1739,7 @@ jint *NativeDecoder::getSampledRasterFromStrip(int inSampleSize, int *bitmapWidt
 
             //if next strip is exist - read it and invert lines
             if (i + rowPerStrip < origheight) {
-                TIFFReadRGBAStrip(image, i + rowPerStrip, rasterForBottomLine);
+                readRGBAStrip(i + rowPerStrip, rasterForBottomLine);
                 isSecondRasterExist = 1;
 
                 //invert lines, because libtiff origin is bottom left instead of top left
@@ -698,1194 +1876,13 @@ jint *NativeDecoder::getSampledRasterFromStrip(int inSampleSize, int *bitmapWidt
     return pixels;
 }
 
-jint *NativeDecoder::getSampledRasterFromStripWithBounds(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "getSampledRasterFromStripWithBounds");
-
-    //init signal handler for catch SIGSEGV error that could be raised in libtiff
-    struct sigaction act;
-    memset(&act, 0, sizeof(act));
-    sigemptyset(&act.sa_mask);
-    act.sa_sigaction = stripErrorHandler;
-    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
-    if (sigaction(SIGSEGV, &act, 0) < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
-    }
-
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "width", origwidth);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "height", origheight);
-
-    jint *pixels = nullptr;
-    *bitmapWidth = origwidth / inSampleSize;
-    *bitmapHeight = boundHeight / inSampleSize;//origheight / inSampleSize;
-    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
-    int origImageBufferSize = origwidth * origheight;
-
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "new width", *bitmapWidth);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "new height", *bitmapHeight);
-
-    uint32 stripSize = TIFFStripSize(image);
-    uint32 stripMax = TIFFNumberOfStrips(image);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "strip size ", stripSize);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "stripMax  ", stripMax);
-    int rowPerStrip = -1;
-    TIFFGetField(image, TIFFTAG_ROWSPERSTRIP, &rowPerStrip);
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "rowsperstrip", rowPerStrip);
-
-    unsigned long estimateMem = 0;
-    estimateMem += (sizeof(jint) * pixelsBufferSize); //temp buffer for decoded pixels
-    estimateMem += (sizeof(jint) * (boundWidth / inSampleSize) * (boundHeight / inSampleSize)); //final buffer that will store original image
-    estimateMem += (origwidth * sizeof(uint32)); //work line for rotate strip
-    estimateMem += (origwidth * rowPerStrip * sizeof(uint32) * 2); //current and next strips
-    estimateMem += (sizeof(jint) * origwidth * 2); //bottom and top lines for reading pixel(matrixBottomLine, matrixTopLine)
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
-    if (estimateMem > availableMemory) {
-        if (throwException) {
-            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
-        }
-        return nullptr;
-    }
-
-    progressTotal = pixelsBufferSize + (boundWidth / inSampleSize) * (boundHeight / inSampleSize);
-    sendProgress(0, progressTotal);
-    jlong processedProgress = 0;
-
-    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
-    if (pixels == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
-        return nullptr;
-    }
-
-    auto *work_line_buf = (uint32 *) _TIFFmalloc(origwidth * sizeof(uint32));
-
-    uint32 *raster;
-    uint32 *rasterForBottomLine; // in this raster copy next strip for getting bottom line in matrix color selection
-    if (rowPerStrip == -1 && stripMax == 1) {
-        raster = (uint32 *) _TIFFmalloc(origImageBufferSize * sizeof(uint32));
-        rasterForBottomLine = (uint32 *) _TIFFmalloc(origImageBufferSize * sizeof(uint32));
-    } else {
-        raster = (uint32 *) _TIFFmalloc(origwidth * rowPerStrip * sizeof(uint32));
-        rasterForBottomLine = (uint32 *) _TIFFmalloc(origwidth * rowPerStrip * sizeof(uint32));
-    }
-    if (rowPerStrip == -1) {
-        rowPerStrip = origheight;
-    }
-
-    int targetY = 0;
-    int nextStripOffset = 0;
-    int globalLineCounter = 0;
-
-    auto *matrixTopLine = (uint32 *) malloc(sizeof(jint) * origwidth);
-    auto *matrixBottomLine = (uint32 *) malloc(sizeof(jint) * origwidth);
-
-    int isSecondRasterExist = 0;
-    int ok = 1;
-    uint32 rows_to_write = 0;
-
-    //check for error
-    if (setjmp(NativeDecoder::strip_buf)) {
-        if (raster) {
-            _TIFFfree(raster);
-            raster = nullptr;
-        }
-        if (rasterForBottomLine) {
-            _TIFFfree(rasterForBottomLine);
-            rasterForBottomLine = nullptr;
-        }
-        if (matrixTopLine) {
-            _TIFFfree(matrixTopLine);
-            matrixTopLine = nullptr;
-        }
-        if (matrixBottomLine) {
-            _TIFFfree(matrixBottomLine);
-            matrixBottomLine = nullptr;
-        }
-
-        const char *err = "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
-        if (throwException) {
-            throwDecodeFileException(err);
-        }
-
-        return nullptr;
-    }
-
-    for (int i = 0; (i < stripMax * rowPerStrip || i > boundY + boundHeight); i += rowPerStrip) {
-
-        if (i + rowPerStrip <= boundY) {
-            continue;
-        }
-        if (i > boundY + boundHeight) {
-            break;
-        }
-
-        sendProgress(processedProgress * *bitmapWidth, progressTotal);
-        processedProgress += rowPerStrip / inSampleSize;
-
-        //if second raster is exist - copy it to work raster end decode next strip
-        if (isSecondRasterExist) {
-            _TIFFmemcpy(raster, rasterForBottomLine, origwidth * rowPerStrip * sizeof(uint32));
-
-            //If next strip is exist - decode it, invert lines
-            if (i + rowPerStrip < stripMax * rowPerStrip) {
-                TIFFReadRGBAStrip(image, i + rowPerStrip, rasterForBottomLine);
-                isSecondRasterExist = 1;
-
-                rows_to_write = 0;
-                if (i + rowPerStrip * 2 > origheight) {
-                    rows_to_write = origheight - i - rowPerStrip;
-                } else {
-                    rows_to_write = rowPerStrip;
-                }
-
-                if (needStripVerticalFlip()) {
-                    flipPixelsVerticalWithBuffer(origwidth, rows_to_write, rasterForBottomLine, work_line_buf);
-                }
-            } else {
-                isSecondRasterExist = 0;
-            }
-        } else {
-            //if second raster is not exist - first processing - read first and second raster
-            TIFFReadRGBAStrip(image, i, raster);
-            //invert lines, because libtiff origin is bottom left instead of top left
-            rows_to_write = 0;
-            if (i + rowPerStrip > origheight) {
-                rows_to_write = origheight - i;
-            } else {
-                rows_to_write = rowPerStrip;
-            }
-
-            if (needStripVerticalFlip()) {
-                flipPixelsVerticalWithBuffer(origwidth, rows_to_write, raster, work_line_buf);
-            }
-
-            //if next strip is exist - read it and invert lines
-            if (i + rowPerStrip < origheight) {
-                TIFFReadRGBAStrip(image, i + rowPerStrip, rasterForBottomLine);
-                isSecondRasterExist = 1;
-
-                //invert lines, because libtiff origin is bottom left instead of top left
-                rows_to_write = 0;
-                if (i + rowPerStrip * 2 > origheight) {
-                    rows_to_write = origheight - i - rowPerStrip;
-                } else {
-                    rows_to_write = rowPerStrip;
-                }
-                if (needStripVerticalFlip()) {
-                    flipPixelsVerticalWithBuffer(origwidth, rows_to_write, rasterForBottomLine, work_line_buf);
-                }
-            }
-        }
-
-        if (isSecondRasterExist) {
-            _TIFFmemcpy(matrixBottomLine, rasterForBottomLine /*+ lineAddrToCopyBottomLine * origwidth*/, sizeof(unsigned int) * origwidth);
-        }
-        for (int sourceStripY = 0; targetY < *bitmapHeight && sourceStripY < rowPerStrip; sourceStripY++) {
-            if (checkStop()) {
-                if (raster) {
-                    _TIFFfree(raster);
-                    raster = nullptr;
-                }
-                if (rasterForBottomLine) {
-                    _TIFFfree(rasterForBottomLine);
-                    rasterForBottomLine = nullptr;
-                }
-                if (matrixTopLine) {
-                    _TIFFfree(matrixTopLine);
-                    matrixTopLine = nullptr;
-                }
-                if (matrixBottomLine) {
-                    _TIFFfree(matrixBottomLine);
-                    matrixBottomLine = nullptr;
-                }
-                __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
-                return nullptr;
-            }
-
-            if (i + sourceStripY >= boundY) {
-                // if total line of source image is equal to inSampleSize*N then process this line
-                if (globalLineCounter % inSampleSize == 0) {
-                    for (int targetX = 0, sourceStripX = 0; targetX < *bitmapWidth; sourceStripX += inSampleSize) {
-                        jint crPix;
-                        if (inSampleSize == 1) {
-                            crPix = raster[sourceStripY * origwidth + sourceStripX];
-                        } else {
-                            crPix = applyFilterForStrip(sourceStripX, sourceStripY, raster, matrixTopLine, matrixBottomLine, rowPerStrip, globalLineCounter, isSecondRasterExist);
-                        }
-                        pixels[targetY * *bitmapWidth + targetX] = crPix;
-                        targetX++;
-                    }
-                    targetY++;
-                }
-                //increment global source image line counter
-                globalLineCounter++;
-            }
-
-            if (sourceStripY == rowPerStrip - 1 && i + rowPerStrip < origheight) {
-                _TIFFmemcpy(matrixTopLine, raster + sourceStripY * origwidth, sizeof(unsigned int) * origwidth);
-            }
-        }
-    }
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Decoding finished. Free memory");
-
-    //Close Buffers
-    if (raster) {
-        _TIFFfree(raster);
-        raster = nullptr;
-    }
-
-    if (rasterForBottomLine) {
-        _TIFFfree(rasterForBottomLine);
-        rasterForBottomLine = nullptr;
-    }
-
-    if (matrixTopLine) {
-        _TIFFfree(matrixTopLine);
-        matrixTopLine = nullptr;
-    }
-
-    if (matrixBottomLine) {
-        _TIFFfree(matrixBottomLine);
-        matrixBottomLine = nullptr;
-    }
-
-    processedProgress *= *bitmapWidth;
-
-    if (useOrientationTag) {
-        uint32 buf;
-        switch (origorientation) {
-            case ORIENTATION_TOPLEFT:
-            case ORIENTATION_TOPRIGHT:
-                break;
-            case ORIENTATION_BOTRIGHT:
-            case ORIENTATION_BOTLEFT:
-                flipPixelsVertical(*bitmapWidth, *bitmapHeight, pixels);
-                break;
-            case ORIENTATION_LEFTTOP:
-                rotateRaster(pixels, 90, bitmapWidth, bitmapHeight);
-                flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-                buf = *bitmapWidth;
-                *bitmapWidth = *bitmapHeight;
-                *bitmapHeight = buf;
-                break;
-            case ORIENTATION_RIGHTTOP:
-                rotateRaster(pixels, 270, bitmapWidth, bitmapHeight);
-                flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-                buf = *bitmapWidth;
-                *bitmapWidth = *bitmapHeight;
-                *bitmapHeight = buf;
-                break;
-            case ORIENTATION_RIGHTBOT:
-                rotateRaster(pixels, 90, bitmapWidth, bitmapHeight);
-                buf = *bitmapWidth;
-                *bitmapWidth = *bitmapHeight;
-                *bitmapHeight = buf;
-                break;
-            case ORIENTATION_LEFTBOT:
-                rotateRaster(pixels, 270, bitmapWidth, bitmapHeight);
-                buf = *bitmapWidth;
-                *bitmapWidth = *bitmapHeight;
-                *bitmapHeight = buf;
-                break;
-        }
-
-    } else if (origorientation == ORIENTATION_TOPRIGHT || origorientation == ORIENTATION_BOTRIGHT || origorientation == ORIENTATION_RIGHTTOP || origorientation == ORIENTATION_RIGHTBOT) {
-        flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-    }
-
-    uint32 tmpPixelBufferSize = (boundWidth / inSampleSize) * (boundHeight / inSampleSize);
-
-    estimateMem = (sizeof(jint) * pixelsBufferSize); //temp buffer for decoded pixels
-    estimateMem += (sizeof(jint) * tmpPixelBufferSize); //final buffer that will store original image
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
-    if (estimateMem > availableMemory) {
-        if (throwException) {
-            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
-        }
-        return nullptr;
-    }
-
-    jint *tmpPixels = (jint *) malloc(sizeof(jint) * tmpPixelBufferSize);
-    uint32 startPosX = 0;
-
-    if (useOrientationTag && (origorientation == ORIENTATION_TOPRIGHT || origorientation == ORIENTATION_BOTRIGHT
-                              || origorientation == ORIENTATION_LEFTBOT || origorientation == ORIENTATION_RIGHTBOT)) {
-        startPosX = *bitmapWidth - boundX / inSampleSize;
-        for (int ox = startPosX, nx = 0; nx < boundWidth / inSampleSize; ox--, nx++) {
-            sendProgress(processedProgress + nx * boundWidth / inSampleSize, progressTotal);
-            for (int oy = 0, ny = 0; ny < boundHeight / inSampleSize; oy++, ny++) {
-                if (useOrientationTag && (origorientation > 4)) {
-                    tmpPixels[nx * (boundHeight / inSampleSize) + ny] = pixels[ox * *bitmapHeight + oy];
-                } else {
-                    tmpPixels[ny * (boundWidth / inSampleSize) + nx] = pixels[oy * *bitmapWidth + ox];
-                }
-            }
-        }
-    } else {
-        startPosX = boundX / inSampleSize;
-        for (int ox = startPosX, nx = 0; nx < boundWidth / inSampleSize; ox++, nx++) {
-            sendProgress(processedProgress + nx * boundWidth / inSampleSize, progressTotal);
-            for (int oy = 0, ny = 0; ny < boundHeight / inSampleSize; oy++, ny++) {
-                if (useOrientationTag && (origorientation > 4)) {
-                    tmpPixels[nx * (boundHeight / inSampleSize) + ny] = pixels[ox * *bitmapHeight + oy];
-                } else {
-                    tmpPixels[ny * (boundWidth / inSampleSize) + nx] = pixels[oy * *bitmapWidth + ox];
-                }
-            }
-        }
-    }
-
-    free(pixels);
-    pixels = tmpPixels;
-    *bitmapWidth = boundWidth / inSampleSize;
-    *bitmapHeight = boundHeight / inSampleSize;
-
-    return pixels;
-}
-
-bool NativeDecoder::needStripVerticalFlip() {
-    return origorientation <= 2;
-}
-
-//Apply filter to pixel
-jint NativeDecoder::applyFilterForStrip(int x, int y, const uint32 *raster, const unsigned int *matrixTopLine, const unsigned int *matrixBottomLine, int rowPerStrip, int globalLineCounter, int isSecondRasterExist) const {
-    jint crPix = raster[y * origwidth + x];
-    int sum = 1;
-
-    int alpha = colorMask & crPix >> 24;
-    int red = colorMask & crPix >> 16;
-    int green = colorMask & crPix >> 8;
-    int blue = colorMask & crPix;
-
-    //topleft
-    if (x - 1 >= 0 && y - 1 >= 0) {
-        crPix = raster[(y - 1) * origwidth + x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    } else if (x - 1 >= 0 && y - 1 == -1 && globalLineCounter > 0) {
-        crPix = matrixTopLine[x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-    //top
-    if (y - 1 >= 0) {
-        crPix = raster[(y - 1) * origwidth + x];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    } else if (y - 1 == -1 && globalLineCounter > 0) {
-        crPix = matrixTopLine[x];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    // topright
-    if (x + 1 < origwidth && y - 1 >= 0) {
-        crPix = raster[(y - 1) * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    } else if (x + 1 < origwidth && y - 1 == -1 && globalLineCounter > 0) {
-        crPix = matrixTopLine[x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    //right
-    if (x + 1 < origwidth) {
-        crPix = raster[y * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    //bottomright
-    if (x + 1 < origwidth && y + 1 < rowPerStrip) {
-        crPix = raster[(y + 1) * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    } else if (x + 1 < origwidth && y + 1 == rowPerStrip && isSecondRasterExist) {
-        crPix = matrixBottomLine[x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    //bottom
-    if (y + 1 < rowPerStrip) {
-        crPix = raster[(y + 1) * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    } else if (y + 1 == rowPerStrip && isSecondRasterExist) {
-        crPix = matrixBottomLine[x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    //bottomleft
-    if (x - 1 >= 0 && y + 1 < rowPerStrip) {
-        crPix = raster[(y + 1) * origwidth + x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    } else if (x - 1 >= 0 && y + 1 == rowPerStrip && isSecondRasterExist) {
-        crPix = matrixBottomLine[x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    //left
-    if (x - 1 >= 0) {
-        crPix = raster[y * origwidth + x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
-    }
-
-    red /= sum;
-    if (red > 255) red = 255;
-    if (red < 0) red = 0;
-
-    green /= sum;
-    if (green > 255) green = 255;
-    if (green < 0) green = 0;
-
-    blue /= sum;
-    if (blue > 255) blue = 255;
-    if (blue < 0) blue = 0;
-
-    alpha /= sum;
-    if (alpha > 255) alpha = 255;
-    if (alpha < 0) alpha = 0;
-
-    crPix = (alpha << 24) | (red << 16) | (green << 8) | (blue);
-    return crPix;
-}
-
-jint *NativeDecoder::getSampledRasterFromTile(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
-    //init signal handler for catch SIGSEGV error that could be raised in libtiff
-    struct sigaction act;
-    memset(&act, 0, sizeof(act));
-    sigemptyset(&act.sa_mask);
-    act.sa_sigaction = tileErrorHandler;
-    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
-    if (sigaction(SIGSEGV, &act, 0) < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
-    }
-
-    jint *pixels = nullptr;
-    *bitmapWidth = origwidth / inSampleSize;
-    *bitmapHeight = origheight / inSampleSize;
-    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
-
-    uint32 tileWidth = 0, tileHeight = 0;
-    TIFFGetField(image, TIFFTAG_TILEWIDTH, &tileWidth);
-    TIFFGetField(image, TIFFTAG_TILELENGTH, &tileHeight);
-
-    unsigned long estimateMem = 0;
-    estimateMem += (sizeof(jint) * pixelsBufferSize); //buffer for decoded pixels
-    estimateMem += (tileWidth * tileHeight * sizeof(uint32)) * 3; //current, left and right tiles buffers
-    estimateMem += (tileWidth * sizeof(uint32)); //work line for rotate tile
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
-    if (estimateMem > availableMemory) {
-        if (throwException) {
-            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
-        }
-        return nullptr;
-    }
-
-    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
-    if (pixels == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
-        return nullptr;
-    }
-
-    uint32 row, column;
-
-    //main worker tile
-    auto *rasterTile = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
-    //left tile
-    auto *rasterTileLeft = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
-    //right tile
-    auto *rasterTileRight = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
-
-    auto *work_line_buf = (uint32 *) _TIFFmalloc(tileWidth * sizeof(uint32));
-
-    //this variable calculate processed pixels for x and y direction to make right offsets at the begining of next tile
-    //offset calculated from condition globalProcessed % inSampleSize should be 0
-    uint32 globalProcessedX = 0;
-    uint32 globalProcessedY = 0;
-
-    //check for error
-    if (setjmp(NativeDecoder::tile_buf)) {
-        if (rasterTile) {
-            _TIFFfree(rasterTile);
-            rasterTile = nullptr;
-        }
-        if (rasterTileLeft) {
-            _TIFFfree(rasterTileLeft);
-            rasterTileLeft = nullptr;
-        }
-        if (rasterTileRight) {
-            _TIFFfree(rasterTileRight);
-            rasterTileRight = nullptr;
-        }
-        if (work_line_buf) {
-            _TIFFfree(work_line_buf);
-            work_line_buf = nullptr;
-        }
-
-        const char *err = "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
-        if (throwException) {
-            throwDecodeFileException(err);
-        }
-
-        return nullptr;
-    }
-
-    for (row = 0; row < origheight; row += tileHeight) {
-        short leftTileExists = 0;
-        short rightTileExists = 0;
-        for (column = 0; column < origwidth; column += tileWidth) {
-            sendProgress(row * origwidth + column, progressTotal);
-
-            //If not first column - we should have previous tile - copy it to left tile buffer
-            if (column != 0) {
-                _TIFFmemcpy(rasterTileLeft, rasterTile, tileWidth * tileHeight * sizeof(uint32));
-                leftTileExists = 1;
-            } else {
-                leftTileExists = 0;
-            }
-
-            //if current column + tile width is less than origin width - we have right tile - copy it to current tile and read next tile to rasterTileRight buffer
-            if (column + tileWidth < origwidth && rightTileExists) {
-                _TIFFmemcpy(rasterTile, rasterTileRight, tileWidth * tileHeight * sizeof(uint32));
-                TIFFReadRGBATile(image, column + tileWidth, row, rasterTileRight);
-                rightTileExists = 1;
-            } else if (column + tileWidth < origwidth) {
-                //have right tile but this is first tile in row, so need to read raster and right raster
-                TIFFReadRGBATile(image, column + tileWidth, row, rasterTileRight);
-                TIFFReadRGBATile(image, column, row, rasterTile);
-                rightTileExists = 1;
-
-                //in that case we also need to invert lines in rasterTile
-                switch (origorientation) {
-                    case 1:
-                    case 5:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 2:
-                    case 6:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 3:
-                    case 7:
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                }
-            } else {
-                //otherwise we haven't right tile buffer, so we should read tile to current buffer
-                TIFFReadRGBATile(image, column, row, rasterTile);
-                rightTileExists = 0;
-            }
-
-            //if we have right tile - current tile already rotated and we need to rotate only right tile
-            if (rightTileExists) {
-                switch (origorientation) {
-                    case 1:
-                    case 5:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        break;
-                    case 2:
-                    case 6:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        break;
-                    case 3:
-                    case 7:
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        break;
-                }
-            } else {
-                //otherwise - current tile not rotated so rotate it
-                //tile orig is on bottom left - should change lines
-                switch (origorientation) {
-                    case 1:
-                    case 5:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 2:
-                    case 6:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 3:
-                    case 7:
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                }
-            }
-
-            if (inSampleSize == 1) {
-                int rowHasPixels = 0;
-                for (int th = 0, bh = 0; th < tileHeight; th++) {
-                    for (int tw = 0, bw = 0; tw < tileWidth; tw++) {
-                        uint32 srcPosition = th * tileWidth + tw;
-                        if (rasterTile[srcPosition] != 0) {
-                            int position = 0;
-                            if (origorientation <= 4) {
-                                position = (row + bh) * *bitmapWidth + column + bw;
-                            } else {
-                                position = (column + bw) * *bitmapHeight + row + bh;
-                            }
-                            pixels[position] = rasterTile[srcPosition];
-                            rowHasPixels = 1;
-                            bw++;
-                        }
-                    }
-                    if (rowHasPixels) {
-                        bh++;
-                        rowHasPixels = 0;
-                    }
-                }
-            } else {
-                //Tile could begin from not filled pixel(pixel[x,y] == 0). This variables allow to calculate begining of filled pixels
-                int tileStartDataX = -1;
-                int tileStartDataY = -1;
-
-                for (int origTileY = 0, pixY = row / inSampleSize; origTileY < tileHeight && pixY < *bitmapHeight; origTileY++) {
-                    if (checkStop()) {
-                        if (rasterTile) {
-                            _TIFFfree(rasterTile);
-                            rasterTile = nullptr;
-                        }
-                        if (rasterTileLeft) {
-                            _TIFFfree(rasterTileLeft);
-                            rasterTileLeft = nullptr;
-                        }
-                        if (rasterTileRight) {
-                            _TIFFfree(rasterTileRight);
-                            rasterTileRight = nullptr;
-                        }
-                        if (work_line_buf) {
-                            _TIFFfree(work_line_buf);
-                            work_line_buf = nullptr;
-                        }
-                        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
-                        return nullptr;
-                    }
-
-                    if (tileStartDataY != -1 && globalProcessedY % inSampleSize != 0) {
-                        if (tileStartDataY != -1) {
-                            globalProcessedY++;
-                        }
-                    } else {
-                        for (int origTileX = 0, pixX = column / inSampleSize; origTileX < tileWidth && pixX < *bitmapWidth; origTileX++) {
-                            if (tileStartDataX != -1 && globalProcessedX % inSampleSize != 0) {
-                                if (tileStartDataX != -1) {
-                                    globalProcessedX++;
-                                }
-                            } else {
-                                if (rasterTile[origTileY * tileWidth + origTileX] != 0) {
-                                    if (tileStartDataX == -1) {
-                                        tileStartDataX = origTileX;
-                                    }
-                                    if (tileStartDataY == -1) {
-                                        tileStartDataY = origTileY;
-                                    }
-
-                                    jint crPix = applyFilterForTile(origTileX, origTileY, rasterTile, rasterTileLeft, rasterTileRight, tileWidth, tileHeight, leftTileExists, rightTileExists);
-
-                                    int position;
-                                    if (origorientation <= 4) {
-                                        position = pixY * *bitmapWidth + pixX;
-                                    } else {
-                                        position = pixX * *bitmapHeight + pixY;
-                                    }
-                                    pixels[position] = crPix;
-                                } else {
-                                    if (tileStartDataX != -1) tileStartDataX = -1;
-                                    if (tileStartDataY != -1) tileStartDataY = -1;
-                                }
-
-                                if (tileStartDataX != -1) {
-                                    pixX++;
-                                    globalProcessedX++;
-                                }
-                            }
-                        }
-                        if (tileStartDataY != -1) {
-                            pixY++;
-                            globalProcessedY++;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    if (rasterTile) {
-        _TIFFfree(rasterTile);
-        rasterTile = nullptr;
-    }
-    if (rasterTileLeft) {
-        _TIFFfree(rasterTileLeft);
-        rasterTileLeft = nullptr;
-    }
-    if (rasterTileRight) {
-        _TIFFfree(rasterTileRight);
-        rasterTileRight = nullptr;
-    }
-    if (work_line_buf) {
-        _TIFFfree(work_line_buf);
-        work_line_buf = nullptr;
-    }
-
-    if (useOrientationTag) {
-        switch (origorientation) {
-            case ORIENTATION_TOPLEFT:
-            case ORIENTATION_LEFTTOP:
-                break;
-            case ORIENTATION_TOPRIGHT:
-                flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-                break;
-            case ORIENTATION_RIGHTTOP:
-                flipPixelsHorizontal(*bitmapHeight, *bitmapWidth, pixels);
-                break;
-            case ORIENTATION_BOTRIGHT:
-            case ORIENTATION_RIGHTBOT:
-                rotateRaster(pixels, 180, bitmapWidth, bitmapHeight);
-                break;
-            case ORIENTATION_BOTLEFT:
-                flipPixelsVertical(*bitmapWidth, *bitmapHeight, pixels);
-                break;
-            case ORIENTATION_LEFTBOT:
-                flipPixelsVertical(*bitmapHeight, *bitmapWidth, pixels);
-                break;
-        }
-    } else {
-        if (origorientation > 4) {
-            uint32 buf = *bitmapWidth;
-            *bitmapWidth = *bitmapHeight;
-            *bitmapHeight = buf;
-            rotateRaster(pixels, 90, bitmapWidth, bitmapHeight);
-            flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-        }
-    }
-
-    return pixels;
-}
-
-jint *NativeDecoder::getSampledRasterFromTileWithBounds(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
-    //init signal handler for catch SIGSEGV error that could be raised in libtiff
-    struct sigaction act;
-    memset(&act, 0, sizeof(act));
-    sigemptyset(&act.sa_mask);
-    act.sa_sigaction = tileErrorHandler;
-    act.sa_flags = SA_SIGINFO | SA_ONSTACK;
-    if (sigaction(SIGSEGV, &act, 0) < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
-    }
-
-    //First read all tiles that are on necessary area
-
-    uint32 tileWidth = 0, tileHeight = 0;
-    TIFFGetField(image, TIFFTAG_TILEWIDTH, &tileWidth);
-    TIFFGetField(image, TIFFTAG_TILELENGTH, &tileHeight);
-
-    //find first and last tile to process
-    auto firstTileX = (uint32) (boundX / tileWidth);
-    auto firstTileY = (uint32) (boundY / tileHeight);
-
-    uint32 lastTileX = (uint32) ((boundX + boundWidth) / tileWidth) + 1;
-    uint32 lastTileY = (uint32) ((boundY + boundHeight) / tileHeight) + 1;
-
-    jint *pixels = nullptr;
-    *bitmapWidth = /*boundWidth*/ (lastTileX - firstTileX) * tileWidth / inSampleSize;//origwidth / inSampleSize;
-    *bitmapHeight = /*boundHeight*/ (lastTileY - firstTileY) * tileHeight / inSampleSize;//origheight / inSampleSize;
-    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
-
-    unsigned long estimateMem = 0;
-    estimateMem += (sizeof(jint) * pixelsBufferSize); //buffer for decoded pixels
-    estimateMem += (tileWidth * tileHeight * sizeof(uint32)) * 3; //current, left and right tiles buffers
-    estimateMem += (tileWidth * sizeof(uint32)); //work line for rotate tile
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
-    if (estimateMem > availableMemory) {
-        if (throwException) {
-            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
-        }
-        return nullptr;
-    }
-
-    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
-    if (pixels == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
-        return nullptr;
-    }
-
-    progressTotal = pixelsBufferSize + (boundWidth / inSampleSize) * (boundHeight / inSampleSize);
-    sendProgress(0, progressTotal);
-    jlong processedProgress = 0;
-
-    uint32 row, column, rowDest, columnDest;
-
-    //main worker tile
-    auto *rasterTile = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
-    //left tile
-    auto *rasterTileLeft = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
-    //right tile
-    auto *rasterTileRight = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
-
-    auto *work_line_buf = (uint32 *) _TIFFmalloc(tileWidth * sizeof(uint32));
-
-    //check for error
-    if (setjmp(NativeDecoder::tile_buf)) {
-        if (rasterTile) {
-            _TIFFfree(rasterTile);
-            rasterTile = nullptr;
-        }
-        if (rasterTileLeft) {
-            _TIFFfree(rasterTileLeft);
-            rasterTileLeft = nullptr;
-        }
-        if (rasterTileRight) {
-            _TIFFfree(rasterTileRight);
-            rasterTileRight = nullptr;
-        }
-        if (work_line_buf) {
-            _TIFFfree(work_line_buf);
-            work_line_buf = nullptr;
-        }
-
-        const char *err = "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", err);
-        if (throwException) {
-            throwDecodeFileException(err);
-        }
-
-        return nullptr;
-    }
-
-    //this variable calculate processed pixels for x and y direction to make right offsets at the begining of next tile
-    //offset calculated from condition globalProcessed % inSampleSize should be 0
-    uint32 globalProcessedX = 0;
-    uint32 globalProcessedY = 0;
-
-    uint32 progressRow = 0;
-    uint32 progressColumn = 0;
-
-    rowDest = columnDest = 0;
-    for (row = firstTileY * tileHeight; row < lastTileY * tileHeight; row += tileHeight, progressRow += tileHeight) {
-        columnDest = 0;
-        short leftTileExists = 0;
-        short rightTileExists = 0;
-        for (column = firstTileX * tileWidth; column < lastTileX * tileWidth; column += tileWidth, progressColumn += tileWidth) {
-            processedProgress = progressRow * *bitmapWidth + progressColumn;
-            sendProgress(processedProgress, progressTotal);
-
-            //If not first column - we should have previous tile - copy it to left tile buffer
-            if (column != firstTileY) {
-                _TIFFmemcpy(rasterTileLeft, rasterTile, tileWidth * tileHeight * sizeof(uint32));
-                leftTileExists = 1;
-            } else {
-                leftTileExists = 0;
-            }
-            //if current column + tile width is less than origin width - we have right tile - copy it to current tile and read next tile to rasterTileRight buffer
-            if (column + tileWidth < origwidth && rightTileExists) {
-                _TIFFmemcpy(rasterTile, rasterTileRight, tileWidth * tileHeight * sizeof(uint32));
-                TIFFReadRGBATile(image, column + tileWidth, row, rasterTileRight);
-                rightTileExists = 1;
-            } else if (column + tileWidth < origwidth) {
-                //have right tile but this is first tile in row, so need to read raster and right raster
-                TIFFReadRGBATile(image, column + tileWidth, row, rasterTileRight);
-                TIFFReadRGBATile(image, column, row, rasterTile);
-                rightTileExists = 1;
-
-                //in that case we also need to invert lines in rasterTile
-                switch (origorientation) {
-                    case 1:
-                    case 5:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 2:
-                    case 6:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 3:
-                    case 7:
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                }
-            } else {
-                //otherwise we haven't right tile buffer, so we should read tile to current buffer
-                TIFFReadRGBATile(image, column, row, rasterTile);
-                rightTileExists = 0;
-            }
-
-            //if we have right tile - current tile already rotated and we need to rotate only right tile
-            if (rightTileExists) {
-                switch (origorientation) {
-                    case 1:
-                    case 5:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        break;
-                    case 2:
-                    case 6:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        break;
-                    case 3:
-                    case 7:
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
-                        break;
-                }
-            } else {
-                //otherwise - current tile not rotated so rotate it
-                //tile orig is on bottom left - should change lines
-                switch (origorientation) {
-                    case 1:
-                    case 5:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 2:
-                    case 6:
-                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                    case 3:
-                    case 7:
-                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
-                        break;
-                }
-            }
-
-            //Tile could begin from not filled pixel(pixel[x,y] == 0). This variables allow to calculate begining of filled pixels
-            int tileStartDataX = -1;
-            int tileStartDataY = -1;
-
-            for (int origTileY = 0, pixY = rowDest / inSampleSize; origTileY < tileHeight && pixY < *bitmapHeight; origTileY++) {
-                if (checkStop()) {
-                    if (rasterTile) {
-                        _TIFFfree(rasterTile);
-                        rasterTile = nullptr;
-                    }
-                    if (rasterTileLeft) {
-                        _TIFFfree(rasterTileLeft);
-                        rasterTileLeft = nullptr;
-                    }
-                    if (rasterTileRight) {
-                        _TIFFfree(rasterTileRight);
-                        rasterTileRight = nullptr;
-                    }
-                    if (work_line_buf) {
-                        _TIFFfree(work_line_buf);
-                        work_line_buf = nullptr;
-                    }
-                    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
-                    return nullptr;
-                }
-
-                if (tileStartDataY != -1 && globalProcessedY % inSampleSize != 0) {
-                    if (tileStartDataY != -1) {
-                        globalProcessedY++;
-                    }
-                } else {
-                    for (int origTileX = 0, pixX = columnDest / inSampleSize; origTileX < tileWidth && pixX < *bitmapWidth; origTileX++) {
-                        if (tileStartDataX != -1 && globalProcessedX % inSampleSize != 0) {
-                            if (tileStartDataX != -1) {
-                                globalProcessedX++;
-                            }
-                        } else {
-                            if (rasterTile[origTileY * tileWidth + origTileX] != 0) {
-                                if (tileStartDataX == -1) {
-                                    tileStartDataX = origTileX;
-                                }
-                                if (tileStartDataY == -1) {
-                                    tileStartDataY = origTileY;
-                                }
-
-                                jint crPix;
-                                if (inSampleSize == 1) {
-                                    crPix = rasterTile[origTileY * tileWidth + origTileX];
-                                } else {
-                                    crPix = applyFilterForTile(origTileX, origTileY, rasterTile, rasterTileLeft, rasterTileRight, tileWidth, tileHeight, leftTileExists, rightTileExists);
-                                }
-
-                                int position;
-                                if (origorientation <= 4) {
-                                    position = pixY * *bitmapWidth + pixX;
-                                } else {
-                                    position = pixX * *bitmapHeight + pixY;
-                                }
-                                pixels[position] = crPix;
-                            } else {
-                                if (tileStartDataX != -1) tileStartDataX = -1;
-                                if (tileStartDataY != -1) tileStartDataY = -1;
-                            }
-
-                            if (tileStartDataX != -1) {
-                                pixX++;
-                                globalProcessedX++;
-                            }
-
-                        }
-                    }
-                    if (tileStartDataY != -1) {
-                        pixY++;
-                        globalProcessedY++;
-                    }
-                }
-            }
-            columnDest += tileWidth;
-        }
-        rowDest += tileHeight;
-    }
-
-    if (rasterTile) {
-        _TIFFfree(rasterTile);
-        rasterTile = nullptr;
-    }
-    if (rasterTileLeft) {
-        _TIFFfree(rasterTileLeft);
-        rasterTileLeft = nullptr;
-    }
-    if (rasterTileRight) {
-        _TIFFfree(rasterTileRight);
-        rasterTileRight = nullptr;
-    }
-    if (work_line_buf) {
-        _TIFFfree(work_line_buf);
-        work_line_buf = nullptr;
-    }
-
-    //Copy necessary pixels to new array if orientation <=4
-    uint32 tmpPixelBufferSize = (boundWidth / inSampleSize) * (boundHeight / inSampleSize);
-
-    estimateMem = (sizeof(jint) * pixelsBufferSize); //buffer for decoded pixels
-    estimateMem += (sizeof(jint) * tmpPixelBufferSize); //finall buffer
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
-    if (estimateMem > availableMemory) {
-        if (throwException) {
-            throw_not_enough_memory_exception(env, availableMemory, estimateMem);
-        }
-        return nullptr;
-    }
-
-    if (origorientation <= 4) {
-        jint *tmpPixels = (jint *) malloc(sizeof(jint) * tmpPixelBufferSize);
-        uint32 startPosX = boundX % tileWidth / inSampleSize;//(firstTileX * tileWidth - tileWidth + boundX) / inSampleSize;
-        uint32 startPosY = boundY % tileHeight / inSampleSize;//(firstTileY * tileHeight - tileHeight + boundY) /inSampleSize;
-        for (int ox = startPosX, nx = 0; nx < boundWidth / inSampleSize; ox++, nx++) {
-            sendProgress(processedProgress + nx * (boundHeight / inSampleSize), progressTotal);
-            for (int oy = startPosY, ny = 0; ny < boundHeight / inSampleSize; oy++, ny++) {
-                tmpPixels[ny * (boundWidth / inSampleSize) + nx] = pixels[oy * *bitmapWidth + ox];
-            }
-        }
-
-        free(pixels);
-        pixels = tmpPixels;
-        *bitmapWidth = boundWidth / inSampleSize;
-        *bitmapHeight = boundHeight / inSampleSize;
-    }
-
-    if (useOrientationTag) {
-        switch (origorientation) {
-            case ORIENTATION_TOPLEFT:
-            case ORIENTATION_LEFTTOP:
-                break;
-            case ORIENTATION_TOPRIGHT:
-                flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-                break;
-            case ORIENTATION_RIGHTTOP:
-                flipPixelsHorizontal(*bitmapHeight, *bitmapWidth, pixels);
-                break;
-            case ORIENTATION_BOTRIGHT:
-            case ORIENTATION_RIGHTBOT:
-                rotateRaster(pixels, 180, bitmapWidth, bitmapHeight);
-                break;
-            case ORIENTATION_BOTLEFT:
-                flipPixelsVertical(*bitmapWidth, *bitmapHeight, pixels);
-                break;
-            case ORIENTATION_LEFTBOT:
-                flipPixelsVertical(*bitmapHeight, *bitmapWidth, pixels);
-                break;
-        }
-    } else {
-        if (origorientation > 4) {
-            uint32 buf = *bitmapWidth;
-            *bitmapWidth = *bitmapHeight;
-            *bitmapHeight = buf;
-            rotateRaster(pixels, 90, bitmapWidth, bitmapHeight);
-            flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
-        }
-    }
-
-    //Copy necessary pixels to new array if orientation >4
-    if (origorientation > 4) {
-        jint *tmpPixels = (jint *) malloc(sizeof(jint) * tmpPixelBufferSize);
-        uint32 startPosX = boundX % tileWidth / inSampleSize;
-        uint32 startPosY = boundY % tileHeight / inSampleSize;
-        for (int ox = startPosX, nx = 0; nx < boundWidth / inSampleSize; ox++, nx++) {
-            sendProgress(processedProgress + nx * (boundHeight / inSampleSize), progressTotal);
-            for (int oy = startPosY, ny = 0; ny < boundHeight / inSampleSize; oy++, ny++) {
-                if (useOrientationTag) {
-                    tmpPixels[nx * (boundHeight / inSampleSize) + ny] = pixels[ox * *bitmapHeight + oy];
-                } else {
-                    tmpPixels[ny * (boundWidth / inSampleSize) + nx] = pixels[oy * *bitmapWidth + ox];
-                }
-            }
-        }
-
-        free(pixels);
-        pixels = tmpPixels;
-        *bitmapWidth = boundWidth / inSampleSize;
-        *bitmapHeight = boundHeight / inSampleSize;
-    }
-
-    return pixels;
+bool NativeDecoder::needStripVerticalFlip() {
+    return origorientation <= 2;
 }
 
 //Apply filter to pixel
-jint NativeDecoder::applyFilterForTile(int x, int y, const uint32 *rasterTile, const uint32 *rasterTileLeft, const uint32 *rasterTileRight, uint32 tileWidth, uint32 tileHeight, short leftTileExists, short rightTileExists) const {
-    jint crPix = rasterTile[y * tileWidth + x];
+jint NativeDecoder::applyFilterForStrip(int x, int y, const uint32 *raster, const unsigned int *matrixTopLine, const unsigned int *matrixBottomLine, int rowPerStrip, int globalLineCounter, int isSecondRasterExist) const {
+    jint crPix = raster[y * origwidth + x];
     int sum = 1;
 
     int alpha = colorMask & crPix >> 24;
@@ -1893,156 +1890,125 @@ jint NativeDecoder::applyFilterForTile(int x, int y, const uint32 *rasterTile, c
     int green = colorMask & crPix >> 8;
     int blue = colorMask & crPix;
 
-    //using kernel 3x3
-
     //topleft
     if (x - 1 >= 0 && y - 1 >= 0) {
-        crPix = rasterTile[(y - 1) * tileWidth + x - 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
-    } else if (y - 1 >= 0 && leftTileExists) {
-        crPix = rasterTileLeft[(y - 1) * tileWidth + tileWidth - 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+        crPix = raster[(y - 1) * origwidth + x - 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
+    } else if (x - 1 >= 0 && y - 1 == -1 && globalLineCounter > 0) {
+        crPix = matrixTopLine[x - 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
-
     //top
     if (y - 1 >= 0) {
-        crPix = rasterTile[(y - 1) * tileWidth + x];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+        crPix = raster[(y - 1) * origwidth + x];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
+    } else if (y - 1 == -1 && globalLineCounter > 0) {
+        crPix = matrixTopLine[x];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     // topright
-    if (x + 1 < tileWidth && y - 1 >= 0) {
-        crPix = rasterTile[(y - 1) * tileWidth + x + 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
-    } else if (y - 1 >= 0 && rightTileExists) {
-        crPix = rasterTileRight[(y - 1) * tileWidth];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+    if (x + 1 < origwidth && y - 1 >= 0) {
+        crPix = raster[(y - 1) * origwidth + x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
+    } else if (x + 1 < origwidth && y - 1 == -1 && globalLineCounter > 0) {
+        crPix = matrixTopLine[x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     //right
-    if (x + 1 < tileWidth) {
-        crPix = rasterTile[y * tileWidth + x + 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
-    } else if (rightTileExists) {
-        crPix = rasterTileRight[y * tileWidth];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+    if (x + 1 < origwidth) {
+        crPix = raster[y * origwidth + x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     //bottomright
-    if (x + 1 < tileWidth && y + 1 < tileHeight) {
-        crPix = rasterTile[(y + 1) * tileWidth + x + 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
-    } else if (y + 1 < tileHeight && rightTileExists) {
-        crPix = rasterTileRight[(y + 1) * tileWidth];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+    if (x + 1 < origwidth && y + 1 < rowPerStrip) {
+        crPix = raster[(y + 1) * origwidth + x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
+    } else if (x + 1 < origwidth && y + 1 == rowPerStrip && isSecondRasterExist) {
+        crPix = matrixBottomLine[x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     //bottom
-    if (y + 1 < tileHeight) {
-        crPix = rasterTile[(y + 1) * tileWidth + x];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+    if (y + 1 < rowPerStrip) {
+        crPix = raster[(y + 1) * origwidth + x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
+    } else if (y + 1 == rowPerStrip && isSecondRasterExist) {
+        crPix = matrixBottomLine[x + 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     //bottomleft
-    if (x - 1 >= 0 && y + 1 < tileHeight) {
-        crPix = rasterTile[(y + 1) * tileWidth + x - 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
-    } else if (y + 1 < tileHeight && leftTileExists) {
-        crPix = rasterTileLeft[(y + 1) * tileWidth + tileWidth - 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+    if (x - 1 >= 0 && y + 1 < rowPerStrip) {
+        crPix = raster[(y + 1) * origwidth + x - 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
+    } else if (x - 1 >= 0 && y + 1 == rowPerStrip && isSecondRasterExist) {
+        crPix = matrixBottomLine[x - 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     //left
     if (x - 1 >= 0) {
-        crPix = rasterTile[y * tileWidth + x - 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
-    } else if (leftTileExists) {
-        crPix = rasterTileLeft[y * tileWidth + tileWidth - 1];
-        if (crPix != 0) {
-            red += colorMask & crPix >> 16;
-            green += colorMask & crPix >> 8;
-            blue += colorMask & crPix;
-            alpha += colorMask & crPix >> 24;
-            sum++;
-        }
+        crPix = raster[y * origwidth + x - 1];
+        red += colorMask & crPix >> 16;
+        green += colorMask & crPix >> 8;
+        blue += colorMask & crPix;
+        alpha += colorMask & crPix >> 24;
+        sum++;
     }
 
     red /= sum;
@@ -2065,32 +2031,28 @@ jint NativeDecoder::applyFilterForTile(int x, int y, const uint32 *rasterTile, c
     return crPix;
 }
 
-jint *NativeDecoder::getSampledRasterFromImage(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
+jint *NativeDecoder::getSampledRasterFromTile(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
     //init signal handler for catch SIGSEGV error that could be raised in libtiff
     struct sigaction act;
     memset(&act, 0, sizeof(act));
     sigemptyset(&act.sa_mask);
-    act.sa_sigaction = imageErrorHandler;
+    act.sa_sigaction = tileErrorHandler;
     act.sa_flags = SA_SIGINFO | SA_ONSTACK;
     if (sigaction(SIGSEGV, &act, 0) < 0) {
         __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
     }
 
-    //buffer size for decoding tiff image in RGBA format
-    int origBufferSize = origwidth * origheight * sizeof(unsigned int);
-
+    jint *pixels = nullptr;
     *bitmapWidth = origwidth / inSampleSize;
     *bitmapHeight = origheight / inSampleSize;
-    //buffer size for creating scaled image;
-    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight * sizeof(jint);
+    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
 
-    /**Estimate usage of memory for decoding*/
-    unsigned long estimateMem = origBufferSize;//origBufferSize - size of decoded RGBA image
-    if (inSampleSize > 1) {
-        estimateMem += pixelsBufferSize; //if inSmapleSize greater than 1 we need aditional vevory for scaled image
-    }
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
+    uint32 tileWidth = 0, tileHeight = 0;
+    TIFFGetField(image, TIFFTAG_TILEWIDTH, &tileWidth);
+    TIFFGetField(image, TIFFTAG_TILELENGTH, &tileHeight);
 
+    unsigned long estimateMem = estimateMemory(DECODE_METHOD_TILE, inSampleSize, ARGB_8888);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
     if (estimateMem > availableMemory) {
         if (throwException) {
             throw_not_enough_memory_exception(env, availableMemory, estimateMem);
@@ -2098,25 +2060,45 @@ jint *NativeDecoder::getSampledRasterFromImage(int inSampleSize, int *bitmapWidt
         return nullptr;
     }
 
-    unsigned int *origBuffer = nullptr;
-
-    origBuffer = (unsigned int *) _TIFFmalloc(origBufferSize);
-    if (origBuffer == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for origBuffer");
+    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
+    if (pixels == nullptr) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
         return nullptr;
     }
 
-    jint *pixels = nullptr;
+    uint32 row, column;
+
+    //main worker tile
+    auto *rasterTile = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
+    //left tile
+    auto *rasterTileLeft = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
+    //right tile
+    auto *rasterTileRight = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
+
+    auto *work_line_buf = (uint32 *) _TIFFmalloc(tileWidth * sizeof(uint32));
+
+    //this variable calculate processed pixels for x and y direction to make right offsets at the begining of next tile
+    //offset calculated from condition globalProcessed % inSampleSize should be 0
+    uint32 globalProcessedX = 0;
+    uint32 globalProcessedY = 0;
 
     //check for error
-    if (setjmp(NativeDecoder::image_buf)) {
-        if (origBuffer) {
-            _TIFFfree(origBuffer);
-            origBuffer = nullptr;
+    if (setjmp(NativeDecoder::tile_buf)) {
+        if (rasterTile) {
+            _TIFFfree(rasterTile);
+            rasterTile = nullptr;
+        }
+        if (rasterTileLeft) {
+            _TIFFfree(rasterTileLeft);
+            rasterTileLeft = nullptr;
+        }
+        if (rasterTileRight) {
+            _TIFFfree(rasterTileRight);
+            rasterTileRight = nullptr;
         }
-        if (pixels) {
-            free(pixels);
-            pixels = nullptr;
+        if (work_line_buf) {
+            _TIFFfree(work_line_buf);
+            work_line_buf = nullptr;
         }
 
         const char *err = "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
@@ -2128,110 +2110,271 @@ jint *NativeDecoder::getSampledRasterFromImage(int inSampleSize, int *bitmapWidt
         return nullptr;
     }
 
-    if (0 == TIFFReadRGBAImageOriented(image, origwidth, origheight, origBuffer, ORIENTATION_TOPLEFT, 0)) {
-        free(origBuffer);
-        const char *message = "Error reading image";
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
-        if (throwException) {
-            throwDecodeFileException(message);
-        }
-        return nullptr;
-    }
+    for (row = 0; row < origheight; row += tileHeight) {
+        short leftTileExists = 0;
+        short rightTileExists = 0;
+        for (column = 0; column < origwidth; column += tileWidth) {
+            sendProgress(row * origwidth + column, progressTotal);
 
-    if (inSampleSize == 1) {
-        // Use buffer as is.
-        pixels = (jint *) origBuffer;
-    } else {
-        // Sample the buffer.
-        pixels = (jint *) malloc(pixelsBufferSize);
-        if (pixels == nullptr) {
-            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
-            return nullptr;
-        } else {
-            for (int targetY = 0, sourceY = 0; targetY < *bitmapHeight; targetY++, sourceY += inSampleSize) {
+            //If not first column - we should have previous tile - copy it to left tile buffer
+            if (column != 0) {
+                _TIFFmemcpy(rasterTileLeft, rasterTile, tileWidth * tileHeight * sizeof(uint32));
+                leftTileExists = 1;
+            } else {
+                leftTileExists = 0;
+            }
 
-                sendProgress(sourceY * origwidth, progressTotal);
+            //if current column + tile width is less than origin width - we have right tile - copy it to current tile and read next tile to rasterTileRight buffer
+            if (column + tileWidth < origwidth && rightTileExists) {
+                _TIFFmemcpy(rasterTile, rasterTileRight, tileWidth * tileHeight * sizeof(uint32));
+                readRGBATile(column + tileWidth, row, rasterTileRight);
+                rightTileExists = 1;
+            } else if (column + tileWidth < origwidth) {
+                //have right tile but this is first tile in row, so need to read raster and right raster
+                readRGBATile(column + tileWidth, row, rasterTileRight);
+                readRGBATile(column, row, rasterTile);
+                rightTileExists = 1;
 
-                if (checkStop()) {
-                    //TODO clear memory
-                    if (origBuffer) {
-                        _TIFFfree(origBuffer);
-                        origBuffer = nullptr;
+                //in that case we also need to invert lines in rasterTile
+                switch (origorientation) {
+                    case 1:
+                    case 5:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 2:
+                    case 6:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 3:
+                    case 7:
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                }
+            } else {
+                //otherwise we haven't right tile buffer, so we should read tile to current buffer
+                readRGBATile(column, row, rasterTile);
+                rightTileExists = 0;
+            }
+
+            //if we have right tile - current tile already rotated and we need to rotate only right tile
+            if (rightTileExists) {
+                switch (origorientation) {
+                    case 1:
+                    case 5:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        break;
+                    case 2:
+                    case 6:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        break;
+                    case 3:
+                    case 7:
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        break;
+                }
+            } else {
+                //otherwise - current tile not rotated so rotate it
+                //tile orig is on bottom left - should change lines
+                switch (origorientation) {
+                    case 1:
+                    case 5:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 2:
+                    case 6:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 3:
+                    case 7:
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                }
+            }
+
+            if (inSampleSize == 1) {
+                int rowHasPixels = 0;
+                for (int th = 0, bh = 0; th < tileHeight; th++) {
+                    for (int tw = 0, bw = 0; tw < tileWidth; tw++) {
+                        uint32 srcPosition = th * tileWidth + tw;
+                        if (rasterTile[srcPosition] != 0) {
+                            int position = 0;
+                            if (origorientation <= 4) {
+                                position = (row + bh) * *bitmapWidth + column + bw;
+                            } else {
+                                position = (column + bw) * *bitmapHeight + row + bh;
+                            }
+                            pixels[position] = rasterTile[srcPosition];
+                            rowHasPixels = 1;
+                            bw++;
+                        }
                     }
-                    if (pixels) {
-                        free(pixels);
-                        pixels = nullptr;
+                    if (rowHasPixels) {
+                        bh++;
+                        rowHasPixels = 0;
                     }
-                    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
-                    return nullptr;
                 }
+            } else {
+                //Tile could begin from not filled pixel(pixel[x,y] == 0). This variables allow to calculate begining of filled pixels
+                int tileStartDataX = -1;
+                int tileStartDataY = -1;
+
+                for (int origTileY = 0, pixY = row / inSampleSize; origTileY < tileHeight && pixY < *bitmapHeight; origTileY++) {
+                    if (checkStop()) {
+                        if (rasterTile) {
+                            _TIFFfree(rasterTile);
+                            rasterTile = nullptr;
+                        }
+                        if (rasterTileLeft) {
+                            _TIFFfree(rasterTileLeft);
+                            rasterTileLeft = nullptr;
+                        }
+                        if (rasterTileRight) {
+                            _TIFFfree(rasterTileRight);
+                            rasterTileRight = nullptr;
+                        }
+                        if (work_line_buf) {
+                            _TIFFfree(work_line_buf);
+                            work_line_buf = nullptr;
+                        }
+                        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
+                        return nullptr;
+                    }
+
+                    if (tileStartDataY != -1 && globalProcessedY % inSampleSize != 0) {
+                        if (tileStartDataY != -1) {
+                            globalProcessedY++;
+                        }
+                    } else {
+                        for (int origTileX = 0, pixX = column / inSampleSize; origTileX < tileWidth && pixX < *bitmapWidth; origTileX++) {
+                            if (tileStartDataX != -1 && globalProcessedX % inSampleSize != 0) {
+                                if (tileStartDataX != -1) {
+                                    globalProcessedX++;
+                                }
+                            } else {
+                                if (rasterTile[origTileY * tileWidth + origTileX] != 0) {
+                                    if (tileStartDataX == -1) {
+                                        tileStartDataX = origTileX;
+                                    }
+                                    if (tileStartDataY == -1) {
+                                        tileStartDataY = origTileY;
+                                    }
+
+                                    jint crPix = applyFilterForTile(origTileX, origTileY, rasterTile, rasterTileLeft, rasterTileRight, tileWidth, tileHeight, leftTileExists, rightTileExists);
+
+                                    int position;
+                                    if (origorientation <= 4) {
+                                        position = pixY * *bitmapWidth + pixX;
+                                    } else {
+                                        position = pixX * *bitmapHeight + pixY;
+                                    }
+                                    pixels[position] = crPix;
+                                } else {
+                                    if (tileStartDataX != -1) tileStartDataX = -1;
+                                    if (tileStartDataY != -1) tileStartDataY = -1;
+                                }
 
-                for (int targetX = 0, sourceX = 0; targetX < *bitmapWidth; targetX++, sourceX += inSampleSize) {
-                    jint crPix = applyFilterForImage(sourceX, sourceY, origBuffer);
-                    pixels[targetY * *bitmapWidth + targetX] = crPix;
+                                if (tileStartDataX != -1) {
+                                    pixX++;
+                                    globalProcessedX++;
+                                }
+                            }
+                        }
+                        if (tileStartDataY != -1) {
+                            pixY++;
+                            globalProcessedY++;
+                        }
+                    }
                 }
             }
         }
+    }
 
-        //Close Buffer
-        if (origBuffer) {
-            _TIFFfree(origBuffer);
-            origBuffer = nullptr;
-        }
+    if (rasterTile) {
+        _TIFFfree(rasterTile);
+        rasterTile = nullptr;
+    }
+    if (rasterTileLeft) {
+        _TIFFfree(rasterTileLeft);
+        rasterTileLeft = nullptr;
+    }
+    if (rasterTileRight) {
+        _TIFFfree(rasterTileRight);
+        rasterTileRight = nullptr;
+    }
+    if (work_line_buf) {
+        _TIFFfree(work_line_buf);
+        work_line_buf = nullptr;
     }
 
     if (useOrientationTag) {
-        fixOrientation(pixels, pixelsBufferSize, *bitmapWidth, *bitmapHeight);
-    } else {
         switch (origorientation) {
             case ORIENTATION_TOPLEFT:
             case ORIENTATION_LEFTTOP:
                 break;
             case ORIENTATION_TOPRIGHT:
-            case ORIENTATION_RIGHTTOP:
                 flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
                 break;
+            case ORIENTATION_RIGHTTOP:
+                flipPixelsHorizontal(*bitmapHeight, *bitmapWidth, pixels);
+                break;
             case ORIENTATION_BOTRIGHT:
             case ORIENTATION_RIGHTBOT:
                 rotateRaster(pixels, 180, bitmapWidth, bitmapHeight);
                 break;
             case ORIENTATION_BOTLEFT:
+                flipPixelsVertical(*bitmapWidth, *bitmapHeight, pixels);
+                break;
             case ORIENTATION_LEFTBOT:
-                rotateRaster(pixels, 180, bitmapWidth, bitmapHeight);
-                flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
+                flipPixelsVertical(*bitmapHeight, *bitmapWidth, pixels);
                 break;
         }
+    } else {
+        if (origorientation > 4) {
+            uint32 buf = *bitmapWidth;
+            *bitmapWidth = *bitmapHeight;
+            *bitmapHeight = buf;
+            rotateRaster(pixels, 90, bitmapWidth, bitmapHeight);
+            flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
+        }
     }
 
     return pixels;
 }
 
-jint *NativeDecoder::getSampledRasterFromImageWithBounds(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
+jint *NativeDecoder::getSampledRasterFromTileWithBounds(int inSampleSize, int *bitmapWidth, int *bitmapHeight) {
     //init signal handler for catch SIGSEGV error that could be raised in libtiff
     struct sigaction act;
     memset(&act, 0, sizeof(act));
     sigemptyset(&act.sa_mask);
-    act.sa_sigaction = imageErrorHandler;
+    act.sa_sigaction = tileErrorHandler;
     act.sa_flags = SA_SIGINFO | SA_ONSTACK;
     if (sigaction(SIGSEGV, &act, 0) < 0) {
         __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t setup signal handler. Working without errors catching mechanism");
     }
 
-    //buffer size for decoding tiff image in RGBA format
-    int origBufferSize = origwidth * origheight * sizeof(unsigned int);
+    //First read all tiles that are on necessary area
 
-    *bitmapWidth = boundWidth / inSampleSize;//origwidth / inSampleSize;
-    *bitmapHeight = boundHeight / inSampleSize;//origheight / inSampleSize;
-    //buffer size for creating scaled image;
-    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight * sizeof(jint);
+    uint32 tileWidth = 0, tileHeight = 0;
+    TIFFGetField(image, TIFFTAG_TILEWIDTH, &tileWidth);
+    TIFFGetField(image, TIFFTAG_TILELENGTH, &tileHeight);
 
-    /**Estimate usage of memory for decoding*/
-    unsigned long estimateMem = origBufferSize;//origBufferSize - size of decoded RGBA image
-    //if (inSampleSize > 1) {
-    estimateMem += pixelsBufferSize; //if inSampleSize greater than 1 we need additional memory for scaled image
-    //}
-    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
+    //find first and last tile to process
+    auto firstTileX = (uint32) (boundX / tileWidth);
+    auto firstTileY = (uint32) (boundY / tileHeight);
 
+    uint32 lastTileX = (uint32) ((boundX + boundWidth) / tileWidth) + 1;
+    uint32 lastTileY = (uint32) ((boundY + boundHeight) / tileHeight) + 1;
+
+    jint *pixels = nullptr;
+    *bitmapWidth = /*boundWidth*/ (lastTileX - firstTileX) * tileWidth / inSampleSize;//origwidth / inSampleSize;
+    *bitmapHeight = /*boundHeight*/ (lastTileY - firstTileY) * tileHeight / inSampleSize;//origheight / inSampleSize;
+    uint32 pixelsBufferSize = *bitmapWidth * *bitmapHeight;
+
+    unsigned long estimateMem = estimateMemory(DECODE_METHOD_TILE, inSampleSize, ARGB_8888);
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s %d", "estimateMem", estimateMem);
     if (estimateMem > availableMemory) {
         if (throwException) {
             throw_not_enough_memory_exception(env, availableMemory, estimateMem);
@@ -2239,18 +2382,44 @@ jint *NativeDecoder::getSampledRasterFromImageWithBounds(int inSampleSize, int *
         return nullptr;
     }
 
-    unsigned int *origBuffer = nullptr;
-    jint *pixels = nullptr;
+    pixels = (jint *) malloc(sizeof(jint) * pixelsBufferSize);
+    if (pixels == nullptr) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
+        return nullptr;
+    }
+
+    progressTotal = pixelsBufferSize + (boundWidth / inSampleSize) * (boundHeight / inSampleSize);
+    sendProgress(0, progressTotal);
+    jlong processedProgress = 0;
+
+    uint32 row, column, rowDest, columnDest;
+
+    //main worker tile
+    auto *rasterTile = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
+    //left tile
+    auto *rasterTileLeft = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
+    //right tile
+    auto *rasterTileRight = (uint32 *) _TIFFmalloc(tileWidth * tileHeight * sizeof(uint32));
+
+    auto *work_line_buf = (uint32 *) _TIFFmalloc(tileWidth * sizeof(uint32));
 
     //check for error
-    if (setjmp(NativeDecoder::image_buf)) {
-        if (origBuffer) {
-            _TIFFfree(origBuffer);
-            origBuffer = nullptr;
+    if (setjmp(NativeDecoder::tile_buf)) {
+        if (rasterTile) {
+            _TIFFfree(rasterTile);
+            rasterTile = nullptr;
+        }
+        if (rasterTileLeft) {
+            _TIFFfree(rasterTileLeft);
+            rasterTileLeft = nullptr;
+        }
+        if (rasterTileRight) {
+            _TIFFfree(rasterTileRight);
+            rasterTileRight = nullptr;
         }
-        if (pixels) {
-            free(pixels);
-            pixels = nullptr;
+        if (work_line_buf) {
+            _TIFFfree(work_line_buf);
+            work_line_buf = nullptr;
         }
 
         const char *err = "Caught SIGSEGV signal(Segmentation fault or invalid memory reference)";
@@ -2262,96 +2431,279 @@ jint *NativeDecoder::getSampledRasterFromImageWithBounds(int inSampleSize, int *
         return nullptr;
     }
 
-    origBuffer = (unsigned int *) _TIFFmalloc(origBufferSize);
-    if (origBuffer == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for origBuffer");
-        return nullptr;
-    }
+    //this variable calculate processed pixels for x and y direction to make right offsets at the begining of next tile
+    //offset calculated from condition globalProcessed % inSampleSize should be 0
+    uint32 globalProcessedX = 0;
+    uint32 globalProcessedY = 0;
 
-    if (0 == TIFFReadRGBAImageOriented(image, origwidth, origheight, origBuffer, ORIENTATION_TOPLEFT, 0)) {
-        free(origBuffer);
-        const char *message = "Error reading image";
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "%s", message);
-        if (throwException) {
-            throwDecodeFileException(message);
-        }
-        return nullptr;
-    }
+    uint32 progressRow = 0;
+    uint32 progressColumn = 0;
 
-    progressTotal = boundWidth / inSampleSize * boundHeight / inSampleSize;
+    rowDest = columnDest = 0;
+    for (row = firstTileY * tileHeight; row < lastTileY * tileHeight; row += tileHeight, progressRow += tileHeight) {
+        columnDest = 0;
+        short leftTileExists = 0;
+        short rightTileExists = 0;
+        for (column = firstTileX * tileWidth; column < lastTileX * tileWidth; column += tileWidth, progressColumn += tileWidth) {
+            processedProgress = progressRow * *bitmapWidth + progressColumn;
+            sendProgress(processedProgress, progressTotal);
 
-    // Sample the buffer.
-    pixels = (jint *) malloc(pixelsBufferSize);
-    if (pixels == nullptr) {
-        __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "Can\'t allocate memory for temp buffer");
-        return nullptr;
-    } else {
-        for (int targetY = 0, sourceY = boundY; targetY < *bitmapHeight; targetY++, sourceY += inSampleSize) {
+            //If not first column - we should have previous tile - copy it to left tile buffer
+            if (column != firstTileY) {
+                _TIFFmemcpy(rasterTileLeft, rasterTile, tileWidth * tileHeight * sizeof(uint32));
+                leftTileExists = 1;
+            } else {
+                leftTileExists = 0;
+            }
+            //if current column + tile width is less than origin width - we have right tile - copy it to current tile and read next tile to rasterTileRight buffer
+            if (column + tileWidth < origwidth && rightTileExists) {
+                _TIFFmemcpy(rasterTile, rasterTileRight, tileWidth * tileHeight * sizeof(uint32));
+                readRGBATile(column + tileWidth, row, rasterTileRight);
+                rightTileExists = 1;
+            } else if (column + tileWidth < origwidth) {
+                //have right tile but this is first tile in row, so need to read raster and right raster
+                readRGBATile(column + tileWidth, row, rasterTileRight);
+                readRGBATile(column, row, rasterTile);
+                rightTileExists = 1;
+
+                //in that case we also need to invert lines in rasterTile
+                switch (origorientation) {
+                    case 1:
+                    case 5:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 2:
+                    case 6:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 3:
+                    case 7:
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                }
+            } else {
+                //otherwise we haven't right tile buffer, so we should read tile to current buffer
+                readRGBATile(column, row, rasterTile);
+                rightTileExists = 0;
+            }
+
+            //if we have right tile - current tile already rotated and we need to rotate only right tile
+            if (rightTileExists) {
+                switch (origorientation) {
+                    case 1:
+                    case 5:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        break;
+                    case 2:
+                    case 6:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        break;
+                    case 3:
+                    case 7:
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTileRight, work_line_buf);
+                        break;
+                }
+            } else {
+                //otherwise - current tile not rotated so rotate it
+                //tile orig is on bottom left - should change lines
+                switch (origorientation) {
+                    case 1:
+                    case 5:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 2:
+                    case 6:
+                        rotateTileLinesVertical(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                    case 3:
+                    case 7:
+                        rotateTileLinesHorizontal(tileHeight, tileWidth, rasterTile, work_line_buf);
+                        break;
+                }
+            }
 
-            sendProgress(sourceY * boundWidth, progressTotal);
+            //Tile could begin from not filled pixel(pixel[x,y] == 0). This variables allow to calculate begining of filled pixels
+            int tileStartDataX = -1;
+            int tileStartDataY = -1;
 
-            if (checkStop()) {
-                //TODO clear memory
-                if (origBuffer) {
-                    _TIFFfree(origBuffer);
-                    origBuffer = nullptr;
+            for (int origTileY = 0, pixY = rowDest / inSampleSize; origTileY < tileHeight && pixY < *bitmapHeight; origTileY++) {
+                if (checkStop()) {
+                    if (rasterTile) {
+                        _TIFFfree(rasterTile);
+                        rasterTile = nullptr;
+                    }
+                    if (rasterTileLeft) {
+                        _TIFFfree(rasterTileLeft);
+                        rasterTileLeft = nullptr;
+                    }
+                    if (rasterTileRight) {
+                        _TIFFfree(rasterTileRight);
+                        rasterTileRight = nullptr;
+                    }
+                    if (work_line_buf) {
+                        _TIFFfree(work_line_buf);
+                        work_line_buf = nullptr;
+                    }
+                    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
+                    return nullptr;
                 }
-                if (pixels) {
-                    free(pixels);
-                    pixels = nullptr;
+
+                if (tileStartDataY != -1 && globalProcessedY % inSampleSize != 0) {
+                    if (tileStartDataY != -1) {
+                        globalProcessedY++;
+                    }
+                } else {
+                    for (int origTileX = 0, pixX = columnDest / inSampleSize; origTileX < tileWidth && pixX < *bitmapWidth; origTileX++) {
+                        if (tileStartDataX != -1 && globalProcessedX % inSampleSize != 0) {
+                            if (tileStartDataX != -1) {
+                                globalProcessedX++;
+                            }
+                        } else {
+                            if (rasterTile[origTileY * tileWidth + origTileX] != 0) {
+                                if (tileStartDataX == -1) {
+                                    tileStartDataX = origTileX;
+                                }
+                                if (tileStartDataY == -1) {
+                                    tileStartDataY = origTileY;
+                                }
+
+                                jint crPix;
+                                if (inSampleSize == 1) {
+                                    crPix = rasterTile[origTileY * tileWidth + origTileX];
+                                } else {
+                                    crPix = applyFilterForTile(origTileX, origTileY, rasterTile, rasterTileLeft, rasterTileRight, tileWidth, tileHeight, leftTileExists, rightTileExists);
+                                }
+
+                                int position;
+                                if (origorientation <= 4) {
+                                    position = pixY * *bitmapWidth + pixX;
+                                } else {
+                                    position = pixX * *bitmapHeight + pixY;
+                                }
+                                pixels[position] = crPix;
+                            } else {
+                                if (tileStartDataX != -1) tileStartDataX = -1;
+                                if (tileStartDataY != -1) tileStartDataY = -1;
+                            }
+
+                            if (tileStartDataX != -1) {
+                                pixX++;
+                                globalProcessedX++;
+                            }
+
+                        }
+                    }
+                    if (tileStartDataY != -1) {
+                        pixY++;
+                        globalProcessedY++;
+                    }
                 }
-                __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffDecoder", "%s", "Thread stopped");
-                return nullptr;
             }
+            columnDest += tileWidth;
+        }
+        rowDest += tileHeight;
+    }
+
+    if (rasterTile) {
+        _TIFFfree(rasterTile);
+        rasterTile = nullptr;
+    }
+    if (rasterTileLeft) {
+        _TIFFfree(rasterTileLeft);
+        rasterTileLeft = nullptr;
+    }
+    if (rasterTileRight) {
+        _TIFFfree(rasterTileRight);
+        rasterTileRight = nullptr;
+    }
+    if (work_line_buf) {
+        _TIFFfree(work_line_buf);
+        work_line_buf = nullptr;
+    }
+
+    //Copy necessary pixels to new array if orientation <=4
+    uint32 tmpPixelBufferSize = (boundWidth / inSampleSize) * (boundHeight / inSampleSize);
 
-            for (int targetX = 0, sourceX = boundX; targetX < *bitmapWidth; targetX++, sourceX += inSampleSize) {
-                jint crPix;
-                if (inSampleSize == 1) {
-                    crPix = origBuffer[sourceY * origwidth + sourceX];
-                } else {
-                    crPix = applyFilterForImage(sourceX, sourceY, origBuffer);
-                }
-                pixels[targetY * *bitmapWidth + targetX] = crPix;
+    if (origorientation <= 4) {
+        jint *tmpPixels = (jint *) malloc(sizeof(jint) * tmpPixelBufferSize);
+        uint32 startPosX = boundX % tileWidth / inSampleSize;//(firstTileX * tileWidth - tileWidth + boundX) / inSampleSize;
+        uint32 startPosY = boundY % tileHeight / inSampleSize;//(firstTileY * tileHeight - tileHeight + boundY) /inSampleSize;
+        for (int ox = startPosX, nx = 0; nx < boundWidth / inSampleSize; ox++, nx++) {
+            sendProgress(processedProgress + nx * (boundHeight / inSampleSize), progressTotal);
+            for (int oy = startPosY, ny = 0; ny < boundHeight / inSampleSize; oy++, ny++) {
+                tmpPixels[ny * (boundWidth / inSampleSize) + nx] = pixels[oy * *bitmapWidth + ox];
             }
         }
-    }
 
-    //Close Buffer
-    if (origBuffer) {
-        _TIFFfree(origBuffer);
-        origBuffer = nullptr;
+        free(pixels);
+        pixels = tmpPixels;
+        *bitmapWidth = boundWidth / inSampleSize;
+        *bitmapHeight = boundHeight / inSampleSize;
     }
 
     if (useOrientationTag) {
-        fixOrientation(pixels, pixelsBufferSize, *bitmapWidth, *bitmapHeight);
-    } else {
-        uint32 buf;
         switch (origorientation) {
             case ORIENTATION_TOPLEFT:
             case ORIENTATION_LEFTTOP:
                 break;
             case ORIENTATION_TOPRIGHT:
-            case ORIENTATION_RIGHTTOP:
                 flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
                 break;
+            case ORIENTATION_RIGHTTOP:
+                flipPixelsHorizontal(*bitmapHeight, *bitmapWidth, pixels);
+                break;
             case ORIENTATION_BOTRIGHT:
             case ORIENTATION_RIGHTBOT:
                 rotateRaster(pixels, 180, bitmapWidth, bitmapHeight);
                 break;
             case ORIENTATION_BOTLEFT:
+                flipPixelsVertical(*bitmapWidth, *bitmapHeight, pixels);
+                break;
             case ORIENTATION_LEFTBOT:
-                rotateRaster(pixels, 180, bitmapWidth, bitmapHeight);
-                flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
+                flipPixelsVertical(*bitmapHeight, *bitmapWidth, pixels);
                 break;
         }
+    } else {
+        if (origorientation > 4) {
+            uint32 buf = *bitmapWidth;
+            *bitmapWidth = *bitmapHeight;
+            *bitmapHeight = buf;
+            rotateRaster(pixels, 90, bitmapWidth, bitmapHeight);
+            flipPixelsHorizontal(*bitmapWidth, *bitmapHeight, pixels);
+        }
+    }
+
+    //Copy necessary pixels to new array if orientation >4
+    if (origorientation > 4) {
+        jint *tmpPixels = (jint *) malloc(sizeof(jint) * tmpPixelBufferSize);
+        uint32 startPosX = boundX % tileWidth / inSampleSize;
+        uint32 startPosY = boundY % tileHeight / inSampleSize;
+        for (int ox = startPosX, nx = 0; nx < boundWidth / inSampleSize; ox++, nx++) {
+            sendProgress(processedProgress + nx * (boundHeight / inSampleSize), progressTotal);
+            for (int oy = startPosY, ny = 0; ny < boundHeight / inSampleSize; oy++, ny++) {
+                if (useOrientationTag) {
+                    tmpPixels[nx * (boundHeight / inSampleSize) + ny] = pixels[ox * *bitmapHeight + oy];
+                } else {
+                    tmpPixels[ny * (boundWidth / inSampleSize) + nx] = pixels[oy * *bitmapWidth + ox];
+                }
+            }
+        }
+
+        free(pixels);
+        pixels = tmpPixels;
+        *bitmapWidth = boundWidth / inSampleSize;
+        *bitmapHeight = boundHeight / inSampleSize;
     }
 
     return pixels;
 }
 
 //Apply filter to pixel
-jint NativeDecoder::applyFilterForImage(int x, int y, const unsigned int *raster) const {
-    jint crPix = raster[y * origwidth + x];
+jint NativeDecoder::applyFilterForTile(int x, int y, const uint32 *rasterTile, const uint32 *rasterTileLeft, const uint32 *rasterTileRight, uint32 tileWidth, uint32 tileHeight, short leftTileExists, short rightTileExists) const {
+    jint crPix = rasterTile[y * tileWidth + x];
     int sum = 1;
 
     int alpha = colorMask & crPix >> 24;
@@ -2363,75 +2715,152 @@ jint NativeDecoder::applyFilterForImage(int x, int y, const unsigned int *raster
 
     //topleft
     if (x - 1 >= 0 && y - 1 >= 0) {
-        crPix = raster[(y - 1) * origwidth + x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+        crPix = rasterTile[(y - 1) * tileWidth + x - 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
+    } else if (y - 1 >= 0 && leftTileExists) {
+        crPix = rasterTileLeft[(y - 1) * tileWidth + tileWidth - 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     //top
     if (y - 1 >= 0) {
-        crPix = raster[(y - 1) * origwidth + x];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+        crPix = rasterTile[(y - 1) * tileWidth + x];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     // topright
-    if (x + 1 < origwidth && y - 1 >= 0) {
-        crPix = raster[(y - 1) * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+    if (x + 1 < tileWidth && y - 1 >= 0) {
+        crPix = rasterTile[(y - 1) * tileWidth + x + 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
+    } else if (y - 1 >= 0 && rightTileExists) {
+        crPix = rasterTileRight[(y - 1) * tileWidth];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     //right
-    if (x + 1 < origwidth) {
-        crPix = raster[y * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+    if (x + 1 < tileWidth) {
+        crPix = rasterTile[y * tileWidth + x + 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
+    } else if (rightTileExists) {
+        crPix = rasterTileRight[y * tileWidth];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     //bottomright
-    if (x + 1 < origwidth && y + 1 < origheight) {
-        crPix = raster[(y + 1) * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+    if (x + 1 < tileWidth && y + 1 < tileHeight) {
+        crPix = rasterTile[(y + 1) * tileWidth + x + 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
+    } else if (y + 1 < tileHeight && rightTileExists) {
+        crPix = rasterTileRight[(y + 1) * tileWidth];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     //bottom
-    if (y + 1 < origheight) {
-        crPix = raster[(y + 1) * origwidth + x + 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+    if (y + 1 < tileHeight) {
+        crPix = rasterTile[(y + 1) * tileWidth + x];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     //bottomleft
-    if (x - 1 >= 0 && y + 1 < origheight) {
-        crPix = raster[(y + 1) * origwidth + x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+    if (x - 1 >= 0 && y + 1 < tileHeight) {
+        crPix = rasterTile[(y + 1) * tileWidth + x - 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
+    } else if (y + 1 < tileHeight && leftTileExists) {
+        crPix = rasterTileLeft[(y + 1) * tileWidth + tileWidth - 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
+
     //left
     if (x - 1 >= 0) {
-        crPix = raster[y * origwidth + x - 1];
-        red += colorMask & crPix >> 16;
-        green += colorMask & crPix >> 8;
-        blue += colorMask & crPix;
-        alpha += colorMask & crPix >> 24;
-        sum++;
+        crPix = rasterTile[y * tileWidth + x - 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
+    } else if (leftTileExists) {
+        crPix = rasterTileLeft[y * tileWidth + tileWidth - 1];
+        if (crPix != 0) {
+            red += colorMask & crPix >> 16;
+            green += colorMask & crPix >> 8;
+            blue += colorMask & crPix;
+            alpha += colorMask & crPix >> 24;
+            sum++;
+        }
     }
 
     red /= sum;
@@ -2450,7 +2879,8 @@ jint NativeDecoder::applyFilterForImage(int x, int y, const unsigned int *raster
     if (alpha > 255) alpha = 255;
     if (alpha < 0) alpha = 0;
 
-    return (alpha << 24) | (red << 16) | (green << 8) | (blue);
+    crPix = (alpha << 24) | (red << 16) | (green << 8) | (blue);
+    return crPix;
 }
 
 int NativeDecoder::getDecodeMethod() {
@@ -2737,6 +3167,29 @@ int NativeDecoder::getDirectoryCount() {
     return dircount;
 }
 
+int NativeDecoder::getOverviewCount() {
+    uint16 count = 0;
+    toff_t *offsets = nullptr;
+    if (!TIFFGetField(image, TIFFTAG_SUBIFD, &count, &offsets)) {
+        return 0;
+    }
+    return count;
+}
+
+bool NativeDecoder::setOverview() {
+    if (overview <= 0) {
+        return true;
+    }
+    uint16 count = 0;
+    toff_t *offsets = nullptr;
+    if (!TIFFGetField(image, TIFFTAG_SUBIFD, &count, &offsets) || overview > count) {
+        return false;
+    }
+    //offsets belong to current directory, so offset is copied before switching
+    toff_t offset = offsets[overview - 1];
+    return TIFFSetSubDirectory(image, offset);
+}
+
 void NativeDecoder::writeDataToOptions(int directoryNumber) {
     TIFFSetDirectory(image, directoryNumber);
     jfieldID gOptions_outDirectoryCountFieldId = env->GetFieldID(jBitmapOptionsClass, "outDirectoryCount", "I");
@@ -2744,6 +3197,9 @@ void NativeDecoder::writeDataToOptions(int directoryNumber) {
     env->SetIntField(optionsObject, gOptions_outDirectoryCountFieldId, dircount);
 
     TIFFSetDirectory(image, directoryNumber);
+    jfieldID gOptions_outOverviewCountFieldId = env->GetFieldID(jBitmapOptionsClass, "outOverviewCount", "I");
+    env->SetIntField(optionsObject, gOptions_outOverviewCountFieldId, getOverviewCount());
+    setOverview();
     TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &origwidth);
     TIFFGetField(image, TIFFTAG_IMAGELENGTH, &origheight);
 
@@ -3160,16 +3616,20 @@ void NativeDecoder::stripErrorHandler(int code, siginfo_t *siginfo, void *sc) {
     longjmp(strip_buf, 1);
 }
 
-void NativeDecoder::imageErrorHandler(int code, siginfo_t *siginfo, void *sc) {
-    __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "imageErrorHandler");
-    longjmp(image_buf, 1);
-}
-
 void NativeDecoder::generalErrorHandler(int code, siginfo_t *siginfo, void *sc) {
     __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "generalErrorHandler");
     longjmp(general_buf, 1);
 }
 
+void NativeDecoder::streamErrorHandler(int code, siginfo_t *siginfo, void *sc) {
+    __android_log_print(ANDROID_LOG_ERROR, "NativeTiffDecoder", "streamErrorHandler");
+    longjmp(stream_buf, 1);
+}
+
+bool NativeDecoder::bandSinkConsumer(void *decoder, uint32 firstRow, uint32 rowCount) {
+    return ((NativeDecoder *) decoder)->deliverBand(firstRow, rowCount);
+}
+
 void NativeDecoder::throwDecodeFileException(const char *message) {
     jstring adinf = env->NewStringUTF(message);
     if (decodingMode == DECODE_MODE_FILE_PATH) {
@@ -0,0 +1,173 @@
+//
+// Writer of reduced resolution overviews of saved image.
+//
+
+#include "NativeOverviewWriter.h"
+#include "NativePixelKernels.h"
+
+NativeOverviewWriter::NativeOverviewWriter(TIFF **images, int count, NativeBitmapRows *src, int first, int threadCount) {
+    source = src;
+    sourceWidth = source->getWidth();
+    firstLevel = first;
+    levelCount = count;
+    stageCount = first + count - 1;
+    writers = (NativeChunkWriter **) calloc(levelCount, sizeof(NativeChunkWriter *));
+    bands = (unsigned char **) calloc(levelCount, sizeof(unsigned char *));
+    bandRows = (uint32 *) calloc(levelCount, sizeof(uint32));
+    bandFirstRow = (uint32 *) calloc(levelCount, sizeof(uint32));
+    levelWidth = (uint32 *) calloc(levelCount, sizeof(uint32));
+    levelRowBytes = (tmsize_t *) calloc(levelCount, sizeof(tmsize_t));
+    keptMemory = 0;
+    for (int i = 0; writers && levelWidth && levelRowBytes && i < levelCount; i++) {
+        levelWidth[i] = levelSize(sourceWidth, firstLevel + i);
+        levelRowBytes[i] = (tmsize_t) levelWidth[i] * source->getBitsPerPixel() / 8;
+        //kept levels are compressed on calling thread while rows pass
+        writers[i] = new NativeChunkWriter(images[i], levelRowBytes[i], source->getBitsPerPixel(), i == 0 ? threadCount : 1);
+        if (i > 0) {
+            keptMemory += (size_t) TIFFTileSize(images[i]) * TIFFNumberOfTiles(images[i]);
+        }
+    }
+    heldRows = nullptr;
+    held = nullptr;
+    outRows = nullptr;
+}
+
+NativeOverviewWriter::~NativeOverviewWriter() {
+    for (int s = 0; s < stageCount; s++) {
+        if (heldRows && heldRows[s]) free(heldRows[s]);
+        if (outRows && outRows[s]) free(outRows[s]);
+    }
+    for (int i = 0; i < levelCount; i++) {
+        if (writers && writers[i]) delete writers[i];
+        if (bands && bands[i]) free(bands[i]);
+    }
+    if (heldRows) free(heldRows);
+    if (outRows) free(outRows);
+    if (held) free(held);
+    if (writers) free(writers);
+    if (bands) free(bands);
+    if (bandRows) free(bandRows);
+    if (bandFirstRow) free(bandFirstRow);
+    if (levelWidth) free(levelWidth);
+    if (levelRowBytes) free(levelRowBytes);
+}
+
+uint32 NativeOverviewWriter::levelSize(uint32 size, int level) {
+    for (int i = 0; i < level; i++) {
+        size = (size + 1) / 2;
+    }
+    return size;
+}
+
+size_t NativeOverviewWriter::getRowsMemory() const {
+    size_t memory = 0;
+    for (int i = 0; writers && i < levelCount && writers[i]; i++) {
+        memory += (size_t) levelRowBytes[i] * writers[i]->getChunkHeight();
+    }
+    for (int s = 0; s < stageCount; s++) {
+        memory += (size_t) (levelSize(sourceWidth, s) + levelSize(sourceWidth, s + 1)) * sizeof(uint32);
+    }
+    return memory;
+}
+
+size_t NativeOverviewWriter::getWorkingMemory() const {
+    size_t memory = getRowsMemory() + keptMemory;
+    for (int i = 0; writers && i < levelCount && writers[i]; i++) {
+        memory += writers[i]->getWorkingMemory();
+    }
+    return memory;
+}
+
+void NativeOverviewWriter::fitMemory(size_t available) {
+    if (!writers || !writers[levelCount - 1]) {
+        return;
+    }
+    size_t other = getWorkingMemory() - writers[0]->getWorkingMemory();
+    writers[0]->fitMemory(available > other ? available - other : 0);
+}
+
+void NativeOverviewWriter::setDeflateStrategy(int strategy) {
+    for (int i = 0; writers && i < levelCount && writers[i]; i++) {
+        writers[i]->setDeflateStrategy(strategy);
+    }
+}
+
+bool NativeOverviewWriter::begin() {
+    if (!writers || !bands || !bandRows || !bandFirstRow || !levelWidth || !levelRowBytes || !writers[levelCount - 1]) {
+        return false;
+    }
+    heldRows = (uint32 **) calloc(stageCount, sizeof(uint32 *));
+    outRows = (uint32 **) calloc(stageCount, sizeof(uint32 *));
+    held = (bool *) calloc(stageCount, sizeof(bool));
+    if (!heldRows || !outRows || !held) {
+        return false;
+    }
+    for (int i = 0; i < levelCount; i++) {
+        uint32 bandHeight = writers[i]->getChunkHeight();
+        bands[i] = (unsigned char *) malloc((size_t) levelRowBytes[i] * bandHeight);
+        if (!bands[i] || bandHeight == 0) {
+            return false;
+        }
+    }
+    for (int s = 0; s < stageCount; s++) {
+        heldRows[s] = (uint32 *) malloc(levelSize(sourceWidth, s) * sizeof(uint32));
+        outRows[s] = (uint32 *) malloc(levelSize(sourceWidth, s + 1) * sizeof(uint32));
+        if (!heldRows[s] || !outRows[s]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NativeOverviewWriter::writeRow(const uint32 *row) {
+    return pushRow(0, row);
+}
+
+bool NativeOverviewWriter::pushRow(int stage, const uint32 *row) {
+    uint32 width = levelSize(sourceWidth, stage);
+    if (!held[stage]) {
+        memcpy(heldRows[stage], row, width * sizeof(uint32));
+        held[stage] = true;
+        return true;
+    }
+    held[stage] = false;
+    pixels_abgr_half_row(heldRows[stage], row, width, outRows[stage]);
+    //stage makes row of level stage + 1
+    if (stage + 1 >= firstLevel && !emitRow(stage + 1 - firstLevel, outRows[stage])) {
+        return false;
+    }
+    return stage == stageCount - 1 || pushRow(stage + 1, outRows[stage]);
+}
+
+bool NativeOverviewWriter::emitRow(int index, const uint32 *row) {
+    source->packRow(row, bands[index] + (size_t) bandRows[index] * levelRowBytes[index], levelWidth[index]);
+    bandRows[index]++;
+    return bandRows[index] < writers[index]->getChunkHeight() || flushBand(index);
+}
+
+bool NativeOverviewWriter::finish() {
+    //row without pair at odd height is averaged with itself, its result may be held by next stage
+    for (int s = 0; s < stageCount; s++) {
+        if (held[s] && !pushRow(s, heldRows[s])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < levelCount; i++) {
+        if (bandRows[i] > 0 && !flushBand(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NativeOverviewWriter::flushBand(int index) {
+    bool ok = index == 0 ? writers[index]->writeRows(bands[index], bandFirstRow[index], bandRows[index])
+                         : writers[index]->keepRows(bands[index], bandFirstRow[index], bandRows[index]);
+    bandFirstRow[index] += bandRows[index];
+    bandRows[index] = 0;
+    return ok;
+}
+
+bool NativeOverviewWriter::writeKept(int index, TIFF *target) {
+    return index > 0 && index < levelCount && writers[index]->writeKept(target);
+}
@@ -0,0 +1,206 @@
+//
+// Compression of pages saved together ahead of writing them.
+//
+
+#include "NativePageEncoder.h"
+
+//Size of band of converted rows that is compressed at once
+static size_t const bandBytes = 1024 * 1024;
+
+NativePageEncoder::NativePageEncoder(NativeBitmapRows *rs, uint32 h, const NativeSaveOptions *options) {
+    rows = rs;
+    height = h;
+    bandHeight = h;
+    memory = (size_t) -1;
+    chunkWriter = nullptr;
+    scratch = NativeChunkWriter::openFieldsTiff();
+    if (!scratch) {
+        return;
+    }
+    setPageFields(scratch, options, rows, height);
+
+    //page is compressed by one thread, pages are compressed in parallel
+    tmsize_t rowBytes = rows->getRowBytes();
+    chunkWriter = new NativeChunkWriter(scratch, rowBytes, rows->getBitsPerPixel(), 1);
+    chunkWriter->setDeflateStrategy(options->deflateStrategy);
+    uint32 chunkHeight = chunkWriter->getChunkHeight();
+    size_t chunkRowBytes = (size_t) rowBytes * chunkHeight;
+    if (!rows->isDirect() && chunkHeight > 0) {
+        size_t bandChunkRows = bandBytes / chunkRowBytes > 0 ? bandBytes / chunkRowBytes : 1;
+        if (bandChunkRows < (size_t) (height + chunkHeight - 1) / chunkHeight) {
+            bandHeight = (uint32) bandChunkRows * chunkHeight;
+        }
+    }
+    //compressed page is counted by its uncompressed size
+    memory = (size_t) rowBytes * height + chunkWriter->getWorkingMemory();
+    if (!rows->isDirect()) {
+        memory += rows->getWorkingMemory() + (size_t) rowBytes * bandHeight;
+    }
+}
+
+NativePageEncoder::~NativePageEncoder() {
+    if (chunkWriter) {
+        delete chunkWriter;
+    }
+    if (scratch) {
+        //nothing of scratch is stored, so it is freed without flushing
+        TIFFCleanup(scratch);
+    }
+}
+
+size_t NativePageEncoder::getMemory() const {
+    return memory;
+}
+
+bool NativePageEncoder::encode() {
+    if (!chunkWriter) {
+        return false;
+    }
+    unsigned char *band = nullptr;
+    if (!rows->isDirect()) {
+        band = (unsigned char *) malloc((size_t) bandHeight * rows->getRowBytes());
+    }
+    bool ok = rows->begin() && (rows->isDirect() || band);
+    for (uint32 y = 0; y < height && ok; y += bandHeight) {
+        uint32 count = height - y < bandHeight ? height - y : bandHeight;
+        ok = chunkWriter->keepRows(rows->readRows(y, count, band), y, count);
+    }
+    if (band) {
+        free(band);
+    }
+    return ok;
+}
+
+bool NativePageEncoder::write(TIFF *image) {
+    return chunkWriter && chunkWriter->writeKept(image);
+}
+
+NativePageQueue::NativePageQueue(NativePageEncoder **ps, int c, int threadCount, size_t m) {
+    pages = ps;
+    count = c;
+    memory = m;
+    nextPage = 0;
+    writtenPages = 0;
+    window = threadCount * 2;
+    usedMemory = 0;
+    stopped = false;
+    workerCount = 0;
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&changed, nullptr);
+    states = (int *) calloc(count, sizeof(int));
+    workers = threadCount > 0 && states ? (pthread_t *) malloc(sizeof(pthread_t) * threadCount) : nullptr;
+    //pages that workers don't take are encoded by waitPage, so failed start only makes saving slower.
+    //Workers wait for mutex until workerCount is set, so they respect window from the first page
+    pthread_mutex_lock(&mutex);
+    for (int t = 0; workers && t < threadCount; t++) {
+        if (pthread_create(&workers[workerCount], nullptr, workerMain, this) != 0) {
+            __android_log_print(ANDROID_LOG_WARN, "NativePageEncoder", "Unable to start worker %d", t);
+            break;
+        }
+        workerCount++;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+NativePageQueue::~NativePageQueue() {
+    stop();
+    if (workers) {
+        free(workers);
+    }
+    if (states) {
+        free(states);
+    }
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+int NativePageQueue::takePage() {
+    while (nextPage < count && !pages[nextPage]) {
+        nextPage++;
+    }
+    if (nextPage == count || !states) {
+        return -1;
+    }
+    //writer waits for the page after the written ones only when nothing is kept, so it is always taken
+    size_t pageMemory = pages[nextPage]->getMemory();
+    bool ahead = workerCount > 0 && nextPage - writtenPages >= window;
+    if (ahead || (usedMemory > 0 && usedMemory + pageMemory > memory)) {
+        return -1;
+    }
+    usedMemory += pageMemory;
+    states[nextPage] = PAGE_ENCODING;
+    return nextPage++;
+}
+
+bool NativePageQueue::waitPage(int index) {
+    if (!states) {
+        return false;
+    }
+    pthread_mutex_lock(&mutex);
+    while (states[index] == PAGE_WAITING || states[index] == PAGE_ENCODING) {
+        int taken = workerCount == 0 ? takePage() : -1;
+        if (taken == -1) {
+            pthread_cond_wait(&changed, &mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&mutex);
+        bool ok = pages[taken]->encode();
+        pthread_mutex_lock(&mutex);
+        states[taken] = ok ? PAGE_ENCODED : PAGE_FAILED;
+    }
+    bool encoded = states[index] == PAGE_ENCODED;
+    pthread_mutex_unlock(&mutex);
+    return encoded;
+}
+
+void NativePageQueue::pageWritten(int index) {
+    if (!states) {
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    writtenPages = index + 1;
+    if (pages[index] && states[index] != PAGE_WAITING) {
+        usedMemory -= pages[index]->getMemory();
+    }
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+}
+
+void NativePageQueue::stop() {
+    pthread_mutex_lock(&mutex);
+    stopped = true;
+    int started = workerCount;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&mutex);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], nullptr);
+    }
+    pthread_mutex_lock(&mutex);
+    workerCount = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+void NativePageQueue::workerLoop() {
+    pthread_mutex_lock(&mutex);
+    while (!stopped) {
+        int index = takePage();
+        if (index == -1) {
+            if (nextPage == count) {
+                break;
+            }
+            pthread_cond_wait(&changed, &mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&mutex);
+        bool ok = pages[index]->encode();
+        pthread_mutex_lock(&mutex);
+        states[index] = ok ? PAGE_ENCODED : PAGE_FAILED;
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void *NativePageQueue::workerMain(void *queue) {
+    ((NativePageQueue *) queue)->workerLoop();
+    return nullptr;
+}
@@ -0,0 +1,1335 @@
+//
+// Pixel conversion kernels shared by decoder and saver.
+//
+
+#include "NativePixelKernels.h"
+#include <cfloat>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXELS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXELS_SSE2 1
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define PIXELS_SSSE3 1
+#endif
+#endif
+
+void pixels_float_min_max(const float *src, uint32_t count, float *min, float *max) {
+    float mn = *min;
+    float mx = *max;
+    uint32_t i = 0;
+#if PIXELS_NEON
+    if (count >= 4) {
+        const float32x4_t zero = vdupq_n_f32(0.f);
+        const float32x4_t big = vdupq_n_f32(FLT_MAX);
+        const float32x4_t small = vdupq_n_f32(-FLT_MAX);
+        float32x4_t vmn = vdupq_n_f32(mn);
+        float32x4_t vmx = vdupq_n_f32(mx);
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t x = vld1q_f32(src + i);
+            //x - x is 0 only for finite values
+            uint32x4_t finite = vceqq_f32(vsubq_f32(x, x), zero);
+            vmn = vminq_f32(vmn, vbslq_f32(finite, x, big));
+            vmx = vmaxq_f32(vmx, vbslq_f32(finite, x, small));
+        }
+        float lanes[4];
+        vst1q_f32(lanes, vmn);
+        for (int l = 0; l < 4; l++) if (lanes[l] < mn) mn = lanes[l];
+        vst1q_f32(lanes, vmx);
+        for (int l = 0; l < 4; l++) if (lanes[l] > mx) mx = lanes[l];
+    }
+#elif PIXELS_SSE2
+    if (count >= 4) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 big = _mm_set1_ps(FLT_MAX);
+        const __m128 small = _mm_set1_ps(-FLT_MAX);
+        __m128 vmn = _mm_set1_ps(mn);
+        __m128 vmx = _mm_set1_ps(mx);
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(src + i);
+            //x - x is 0 only for finite values
+            __m128 finite = _mm_cmpeq_ps(_mm_sub_ps(x, x), zero);
+            vmn = _mm_min_ps(vmn, _mm_or_ps(_mm_and_ps(finite, x), _mm_andnot_ps(finite, big)));
+            vmx = _mm_max_ps(vmx, _mm_or_ps(_mm_and_ps(finite, x), _mm_andnot_ps(finite, small)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, vmn);
+        for (int l = 0; l < 4; l++) if (lanes[l] < mn) mn = lanes[l];
+        _mm_storeu_ps(lanes, vmx);
+        for (int l = 0; l < 4; l++) if (lanes[l] > mx) mx = lanes[l];
+    }
+#endif
+    for (; i < count; i++) {
+        float x = src[i];
+        if (x - x != 0.f) continue;
+        if (x < mn) mn = x;
+        if (x > mx) mx = x;
+    }
+    *min = mn;
+    *max = mx;
+}
+
+void pixels_float_to_byte(const float *src, uint8_t *dst, uint32_t count, float offset, float scale) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    const float32x4_t vo = vdupq_n_f32(offset);
+    const float32x4_t vs = vdupq_n_f32(scale);
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t top = vdupq_n_f32(255.f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    for (; i + 16 <= count; i += 16) {
+        uint16x4_t p[4];
+        for (int k = 0; k < 4; k++) {
+            float32x4_t v = vmulq_f32(vsubq_f32(vld1q_f32(src + i + k * 4), vo), vs);
+            //NaN survives min/max but converts to 0
+            v = vminq_f32(vmaxq_f32(v, zero), top);
+            p[k] = vmovn_u32(vcvtq_u32_f32(vaddq_f32(v, half)));
+        }
+        uint8x8_t lo = vmovn_u16(vcombine_u16(p[0], p[1]));
+        uint8x8_t hi = vmovn_u16(vcombine_u16(p[2], p[3]));
+        vst1q_u8(dst + i, vcombine_u8(lo, hi));
+    }
+#elif PIXELS_SSE2
+    const __m128 vo = _mm_set1_ps(offset);
+    const __m128 vs = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(255.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 16 <= count; i += 16) {
+        __m128i p[4];
+        for (int k = 0; k < 4; k++) {
+            __m128 v = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src + i + k * 4), vo), vs);
+            //maxps returns second operand if any of them is NaN
+            v = _mm_min_ps(_mm_max_ps(v, zero), top);
+            p[k] = _mm_cvttps_epi32(_mm_add_ps(v, half));
+        }
+        __m128i lo = _mm_packs_epi32(p[0], p[1]);
+        __m128i hi = _mm_packs_epi32(p[2], p[3]);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        float v = (src[i] - offset) * scale;
+        dst[i] = v > 0.f ? (v < 255.f ? (uint8_t) (v + 0.5f) : 255) : 0;
+    }
+}
+
+void pixels_float_to_int8(const float *src, int8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+    //values are shifted to 0..255, rounded as unsigned and shifted back by flipping of sign bit
+#if PIXELS_NEON
+    const float32x4_t bottom = vdupq_n_f32(-128.f);
+    const float32x4_t top = vdupq_n_f32(127.f);
+    const float32x4_t shift = vdupq_n_f32(128.5f);
+    const uint8x16_t sign = vdupq_n_u8(0x80);
+    for (; i + 16 <= count; i += 16) {
+        uint16x4_t p[4];
+        for (int k = 0; k < 4; k++) {
+            float32x4_t v = vminq_f32(vmaxq_f32(vld1q_f32(src + i + k * 4), bottom), top);
+            p[k] = vmovn_u32(vcvtq_u32_f32(vaddq_f32(v, shift)));
+        }
+        uint8x8_t lo = vmovn_u16(vcombine_u16(p[0], p[1]));
+        uint8x8_t hi = vmovn_u16(vcombine_u16(p[2], p[3]));
+        vst1q_s8(dst + i, vreinterpretq_s8_u8(veorq_u8(vcombine_u8(lo, hi), sign)));
+    }
+#elif PIXELS_SSE2
+    const __m128 bottom = _mm_set1_ps(-128.f);
+    const __m128 top = _mm_set1_ps(127.f);
+    const __m128 shift = _mm_set1_ps(128.5f);
+    const __m128i sign = _mm_set1_epi8((char) 0x80);
+    for (; i + 16 <= count; i += 16) {
+        __m128i p[4];
+        for (int k = 0; k < 4; k++) {
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + k * 4), bottom), top);
+            p[k] = _mm_cvttps_epi32(_mm_add_ps(v, shift));
+        }
+        __m128i lo = _mm_packs_epi32(p[0], p[1]);
+        __m128i hi = _mm_packs_epi32(p[2], p[3]);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(_mm_packus_epi16(lo, hi), sign));
+    }
+#endif
+    for (; i < count; i++) {
+        float v = src[i];
+        v = v > -128.f ? (v < 127.f ? v : 127.f) : -128.f;
+        dst[i] = (int8_t) ((uint8_t) (v + 128.5f) ^ 0x80);
+    }
+}
+
+static inline float halfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            //subnormal half is normal float
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                exp--;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+        }
+    } else if (exp == 0x1F) {
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+void pixels_half_to_float(const uint16_t *src, float *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON && defined(__aarch64__)
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = halfToFloat(src[i]);
+    }
+}
+
+void pixels_gray_to_abgr(const uint8_t *src, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    uint8x16x4_t px;
+    px.val[3] = vdupq_n_u8(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t g = vld1q_u8(src + i);
+        px.val[0] = g;
+        px.val[1] = g;
+        px.val[2] = g;
+        vst4q_u8((uint8_t *) (dst + i), px);
+    }
+#elif PIXELS_SSE2
+    const __m128i alpha = _mm_set1_epi8((char) 0xFF);
+    for (; i + 16 <= count; i += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i gg = _mm_unpacklo_epi8(g, g);
+        __m128i ga = _mm_unpacklo_epi8(g, alpha);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(gg, ga));
+        gg = _mm_unpackhi_epi8(g, g);
+        ga = _mm_unpackhi_epi8(g, alpha);
+        _mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128((__m128i *) (dst + i + 12), _mm_unpackhi_epi16(gg, ga));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = 0xFF000000 | (src[i] * 0x010101u);
+    }
+}
+
+void pixels_rgb_to_abgr(const uint8_t *src, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    uint8x16x4_t px;
+    px.val[3] = vdupq_n_u8(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+        px.val[0] = rgb.val[0];
+        px.val[1] = rgb.val[1];
+        px.val[2] = rgb.val[2];
+        vst4q_u8((uint8_t *) (dst + i), px);
+    }
+#elif PIXELS_SSSE3
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+    //each load takes 16 bytes but uses 12 of them, so keep 4 bytes of source after the last pixel
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i * 3));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t *p = src + i * 3;
+        dst[i] = 0xFF000000 | ((uint32_t) p[2] << 16) | ((uint32_t) p[1] << 8) | p[0];
+    }
+}
+
+void pixels_planes_to_abgr(const uint8_t *r, const uint8_t *g, const uint8_t *b, const uint8_t *a, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    uint8x16x4_t px;
+    px.val[3] = vdupq_n_u8(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        px.val[0] = vld1q_u8(r + i);
+        px.val[1] = vld1q_u8(g + i);
+        px.val[2] = vld1q_u8(b + i);
+        if (a) {
+            px.val[3] = vld1q_u8(a + i);
+        }
+        vst4q_u8((uint8_t *) (dst + i), px);
+    }
+#elif PIXELS_SSE2
+    const __m128i opaque = _mm_set1_epi8((char) 0xFF);
+    for (; i + 16 <= count; i += 16) {
+        __m128i vr = _mm_loadu_si128((const __m128i *) (r + i));
+        __m128i vg = _mm_loadu_si128((const __m128i *) (g + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        __m128i va = a ? _mm_loadu_si128((const __m128i *) (a + i)) : opaque;
+        __m128i rg = _mm_unpacklo_epi8(vr, vg);
+        __m128i ba = _mm_unpacklo_epi8(vb, va);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+        rg = _mm_unpackhi_epi8(vr, vg);
+        ba = _mm_unpackhi_epi8(vb, va);
+        _mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *) (dst + i + 12), _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t alpha = a ? a[i] : 0xFF;
+        dst[i] = (alpha << 24) | ((uint32_t) b[i] << 16) | ((uint32_t) g[i] << 8) | r[i];
+    }
+}
+
+void pixels_alpha_to_abgr(const uint8_t *a, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+    if (!a) {
+        for (; i < count; i++) {
+            dst[i] = 0xFF000000;
+        }
+        return;
+    }
+#if PIXELS_NEON
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vmovl_u8(vld1_u8(a + i));
+        uint32x4_t lo = vmovl_u16(vget_low_u16(v));
+        uint32x4_t hi = vmovl_u16(vget_high_u16(v));
+        vst1q_u32(dst + i, vshlq_n_u32(lo, 24));
+        vst1q_u32(dst + i + 4, vshlq_n_u32(hi, 24));
+    }
+#elif PIXELS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (a + i));
+        //alpha goes to the highest byte of each pixel
+        __m128i lo = _mm_unpacklo_epi8(zero, v);
+        __m128i hi = _mm_unpackhi_epi8(zero, v);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(zero, lo));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(zero, lo));
+        _mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(zero, hi));
+        _mm_storeu_si128((__m128i *) (dst + i + 12), _mm_unpackhi_epi16(zero, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = (uint32_t) a[i] << 24;
+    }
+}
+
+void pixels_rgb565_to_abgr(const uint16_t *src, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    uint8x8x4_t px;
+    px.val[3] = vdup_n_u8(0xFF);
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        //every field is moved to the top of byte and its high bits are inserted below
+        uint8x8_t r = vshrn_n_u16(v, 8);
+        uint8x8_t g = vshrn_n_u16(vshlq_n_u16(v, 5), 8);
+        uint8x8_t b = vshrn_n_u16(vshlq_n_u16(v, 11), 8);
+        px.val[0] = vsri_n_u8(r, r, 5);
+        px.val[1] = vsri_n_u8(g, g, 6);
+        px.val[2] = vsri_n_u8(b, b, 5);
+        vst4_u8((uint8_t *) (dst + i), px);
+    }
+#elif PIXELS_SSE2
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i alpha = _mm_set1_epi16((short) 0xFF00);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i r = _mm_srli_epi16(v, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask6);
+        __m128i b = _mm_and_si128(v, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        //r | g << 8 and b | a << 8 in 16 bit lanes are interleaved to pixels
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, alpha);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        uint32_t r = p >> 11;
+        uint32_t g = (p >> 5) & 0x3F;
+        uint32_t b = p & 0x1F;
+        r = (r << 3) | (r >> 2);
+        g = (g << 2) | (g >> 4);
+        b = (b << 3) | (b >> 2);
+        dst[i] = 0xFF000000 | (b << 16) | (g << 8) | r;
+    }
+}
+
+void pixels_rgb565_to_rgb(const uint16_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        uint8x8_t r = vshrn_n_u16(v, 8);
+        uint8x8_t g = vshrn_n_u16(vshlq_n_u16(v, 5), 8);
+        uint8x8_t b = vshrn_n_u16(vshlq_n_u16(v, 11), 8);
+        uint8x8x3_t rgb;
+        rgb.val[0] = vsri_n_u8(r, r, 5);
+        rgb.val[1] = vsri_n_u8(g, g, 6);
+        rgb.val[2] = vsri_n_u8(b, b, 5);
+        vst3_u8(dst + i * 3, rgb);
+    }
+#elif PIXELS_SSSE3
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    //each store writes 16 bytes but 12 of them are pixels, next store or the tail overwrites the rest
+    for (; i + 10 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i r = _mm_srli_epi16(v, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask6);
+        __m128i b = _mm_and_si128(v, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        _mm_storeu_si128((__m128i *) (dst + i * 3), _mm_shuffle_epi8(_mm_unpacklo_epi16(rg, b), shuffle));
+        _mm_storeu_si128((__m128i *) (dst + i * 3 + 12), _mm_shuffle_epi8(_mm_unpackhi_epi16(rg, b), shuffle));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        uint32_t r = p >> 11;
+        uint32_t g = (p >> 5) & 0x3F;
+        uint32_t b = p & 0x1F;
+        uint8_t *d = dst + i * 3;
+        d[0] = (r << 3) | (r >> 2);
+        d[1] = (g << 2) | (g >> 4);
+        d[2] = (b << 3) | (b >> 2);
+    }
+}
+
+void pixels_rgba4444_to_abgr(const uint16_t *src, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    uint8x8x4_t px;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        uint8x8_t r = vshrn_n_u16(v, 8);
+        uint8x8_t g = vshrn_n_u16(vshlq_n_u16(v, 4), 8);
+        uint8x8_t b = vshrn_n_u16(vshlq_n_u16(v, 8), 8);
+        uint8x8_t a = vshrn_n_u16(vshlq_n_u16(v, 12), 8);
+        px.val[0] = vsri_n_u8(r, r, 4);
+        px.val[1] = vsri_n_u8(g, g, 4);
+        px.val[2] = vsri_n_u8(b, b, 4);
+        px.val[3] = vsri_n_u8(a, a, 4);
+        vst4_u8((uint8_t *) (dst + i), px);
+    }
+#elif PIXELS_SSE2
+    const __m128i mask4 = _mm_set1_epi16(0x0F);
+    const __m128i scale = _mm_set1_epi16(17);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        //4 bit value v becomes v * 17
+        __m128i r = _mm_mullo_epi16(_mm_srli_epi16(v, 12), scale);
+        __m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(v, 8), mask4), scale);
+        __m128i b = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(v, 4), mask4), scale);
+        __m128i a = _mm_mullo_epi16(_mm_and_si128(v, mask4), scale);
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+        __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        uint32_t r = (p >> 12) * 17;
+        uint32_t g = ((p >> 8) & 0x0F) * 17;
+        uint32_t b = ((p >> 4) & 0x0F) * 17;
+        uint32_t a = (p & 0x0F) * 17;
+        dst[i] = (a << 24) | (b << 16) | (g << 8) | r;
+    }
+}
+
+void pixels_premultiply_abgr(uint32_t *px, uint32_t count) {
+    uint32_t i = 0;
+    //x / 255 == (x + (x >> 8) + 1) >> 8 for x up to 255 * 255 + 127
+#if PIXELS_NEON
+    const uint16x8_t half = vdupq_n_u16(127);
+    const uint16x8_t one = vdupq_n_u16(1);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t v = vld4q_u8((const uint8_t *) (px + i));
+        for (int c = 0; c < 3; c++) {
+            uint16x8_t lo = vmlal_u8(half, vget_low_u8(v.val[c]), vget_low_u8(v.val[3]));
+            uint16x8_t hi = vmlal_u8(half, vget_high_u8(v.val[c]), vget_high_u8(v.val[3]));
+            lo = vaddq_u16(vaddq_u16(lo, vshrq_n_u16(lo, 8)), one);
+            hi = vaddq_u16(vaddq_u16(hi, vshrq_n_u16(hi, 8)), one);
+            v.val[c] = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+        }
+        vst4q_u8((uint8_t *) (px + i), v);
+    }
+#elif PIXELS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(127);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (px + i));
+        __m128i p[2];
+        for (int h = 0; h < 2; h++) {
+            __m128i c = h == 0 ? _mm_unpacklo_epi8(v, zero) : _mm_unpackhi_epi8(v, zero);
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i x = _mm_add_epi16(_mm_mullo_epi16(c, a), half);
+            p[h] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), one), 8);
+        }
+        __m128i colors = _mm_andnot_si128(alphaMask, _mm_packus_epi16(p[0], p[1]));
+        _mm_storeu_si128((__m128i *) (px + i), _mm_or_si128(colors, _mm_and_si128(v, alphaMask)));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = px[i];
+        uint32_t a = p >> 24;
+        uint32_t r = ((p & 0xFF) * a + 127) / 255;
+        uint32_t g = (((p >> 8) & 0xFF) * a + 127) / 255;
+        uint32_t b = (((p >> 16) & 0xFF) * a + 127) / 255;
+        px[i] = (a << 24) | (b << 16) | (g << 8) | r;
+    }
+}
+
+void pixels_gather_to_abgr(const uint8_t *src, uint32_t pixelBytes, const int32_t *offsets, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if (PIXELS_NEON && defined(__aarch64__)) || PIXELS_SSSE3
+    const uint32_t opaque = offsets[3] < 0 ? 0xFF000000 : 0;
+    //one 16 byte load holds all samples of up to 4 pixels. Index with high bit set gives zero byte
+    uint32_t step = pixelBytes <= 16 ? 16 / pixelBytes : 0;
+    if (step > 4) step = 4;
+    if (step > 0) {
+        uint8_t indices[16];
+        memset(indices, 0x80, sizeof(indices));
+        for (uint32_t p = 0; p < step; p++) {
+            for (int c = 0; c < 4; c++) {
+                if (offsets[c] >= 0) {
+                    indices[p * 4 + c] = (uint8_t) (p * pixelBytes + offsets[c]);
+                }
+            }
+        }
+        //lanes after step pixels are garbage and are overwritten by next pixels, so whole 4 pixels should fit
+        uint32_t end = count * pixelBytes;
+#if PIXELS_NEON
+        const uint8x16_t shuffle = vld1q_u8(indices);
+        const uint32x4_t alpha = vdupq_n_u32(opaque);
+        for (; i + 4 <= count && i * pixelBytes + 16 <= end; i += step) {
+            uint8x16_t v = vqtbl1q_u8(vld1q_u8(src + i * pixelBytes), shuffle);
+            vst1q_u32(dst + i, vorrq_u32(vreinterpretq_u32_u8(v), alpha));
+        }
+#else
+        const __m128i shuffle = _mm_loadu_si128((const __m128i *) indices);
+        const __m128i alpha = _mm_set1_epi32((int) opaque);
+        for (; i + 4 <= count && i * pixelBytes + 16 <= end; i += step) {
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + i * pixelBytes)), shuffle);
+            _mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(v, alpha));
+        }
+#endif
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t *px = src + i * pixelBytes;
+        uint32_t a = offsets[3] >= 0 ? px[offsets[3]] : 0xFF;
+        dst[i] = (a << 24) | (px[offsets[2]] << 16) | (px[offsets[1]] << 8) | px[offsets[0]];
+    }
+}
+
+void pixels_u16_to_u8(const uint16_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+    //with t = min(v + 128, 65535) result is (t - (t >> 8)) >> 8 for all 16 bit values
+#if PIXELS_NEON
+    const uint16x8_t half = vdupq_n_u16(128);
+    for (; i + 16 <= count; i += 16) {
+        uint16x8_t lo = vqaddq_u16(vld1q_u16(src + i), half);
+        uint16x8_t hi = vqaddq_u16(vld1q_u16(src + i + 8), half);
+        lo = vsubq_u16(lo, vshrq_n_u16(lo, 8));
+        hi = vsubq_u16(hi, vshrq_n_u16(hi, 8));
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+    }
+#elif PIXELS_SSE2
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = _mm_adds_epu16(_mm_loadu_si128((const __m128i *) (src + i)), half);
+        __m128i hi = _mm_adds_epu16(_mm_loadu_si128((const __m128i *) (src + i + 8)), half);
+        lo = _mm_srli_epi16(_mm_sub_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_sub_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t t = src[i] + 128u;
+        if (t > 65535) t = 65535;
+        dst[i] = (uint8_t) ((t - (t >> 8)) >> 8);
+    }
+}
+
+void pixels_cmyk_to_abgr(const uint8_t *src, uint32_t samplesPerPixel, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+    //x / 255 == (x + (x >> 8) + 1) >> 8 for products of two bytes
+#if PIXELS_NEON
+    if (samplesPerPixel == 4) {
+        const uint16x8_t one = vdupq_n_u16(1);
+        uint8x16x4_t px;
+        px.val[3] = vdupq_n_u8(0xFF);
+        for (; i + 16 <= count; i += 16) {
+            uint8x16x4_t cmyk = vld4q_u8(src + i * 4);
+            uint8x16_t k = vmvnq_u8(cmyk.val[3]);
+            for (int c = 0; c < 3; c++) {
+                uint8x16_t ink = vmvnq_u8(cmyk.val[c]);
+                uint16x8_t lo = vmull_u8(vget_low_u8(ink), vget_low_u8(k));
+                uint16x8_t hi = vmull_u8(vget_high_u8(ink), vget_high_u8(k));
+                lo = vaddq_u16(vaddq_u16(lo, vshrq_n_u16(lo, 8)), one);
+                hi = vaddq_u16(vaddq_u16(hi, vshrq_n_u16(hi, 8)), one);
+                px.val[c] = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+            }
+            vst4q_u8((uint8_t *) (dst + i), px);
+        }
+    }
+#elif PIXELS_SSE2
+    if (samplesPerPixel == 4) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i full = _mm_set1_epi16(255);
+        const __m128i one = _mm_set1_epi16(1);
+        //k lane of each pixel becomes alpha
+        const __m128i alpha = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i * 4));
+            __m128i p[2];
+            for (int h = 0; h < 2; h++) {
+                __m128i inv = _mm_sub_epi16(full, h == 0 ? _mm_unpacklo_epi8(v, zero) : _mm_unpackhi_epi8(v, zero));
+                __m128i k = _mm_shufflehi_epi16(_mm_shufflelo_epi16(inv, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                __m128i x = _mm_mullo_epi16(inv, k);
+                x = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), one), 8);
+                p[h] = _mm_or_si128(x, alpha);
+            }
+            _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(p[0], p[1]));
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t *p = src + i * samplesPerPixel;
+        uint32_t k = 255 - p[3];
+        uint32_t r = k * (255 - p[0]) / 255;
+        uint32_t g = k * (255 - p[1]) / 255;
+        uint32_t b = k * (255 - p[2]) / 255;
+        dst[i] = 0xFF000000 | (b << 16) | (g << 8) | r;
+    }
+}
+
+void pixels_cmyk_limited_to_abgr(const uint8_t *src, uint32_t samplesPerPixel, uint32_t inkLimit, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+    //sums and products of samples are exact in floats, truncated quotient of product and 255 is the integer one
+#if PIXELS_NEON && defined(__aarch64__)
+    if (samplesPerPixel == 4) {
+        const float32x4_t limit = vdupq_n_f32((float) inkLimit);
+        const float32x4_t full = vdupq_n_f32(255.f);
+        const float32x4_t one = vdupq_n_f32(1.f);
+        uint8x16x4_t px;
+        px.val[3] = vdupq_n_u8(0xFF);
+        for (; i + 16 <= count; i += 16) {
+            uint8x16x4_t cmyk = vld4q_u8(src + i * 4);
+            uint16x8_t wide[4][2];
+            for (int s = 0; s < 4; s++) {
+                wide[s][0] = vmovl_u8(vget_low_u8(cmyk.val[s]));
+                wide[s][1] = vmovl_high_u8(cmyk.val[s]);
+            }
+            uint16x8_t colors[3][2];
+            for (int h = 0; h < 2; h++) {
+                uint32x4_t quarters[3][2];
+                for (int q = 0; q < 2; q++) {
+                    float32x4_t f[4];
+                    for (int s = 0; s < 4; s++) {
+                        f[s] = vcvtq_f32_u32(q == 0 ? vmovl_u16(vget_low_u16(wide[s][h])) : vmovl_high_u16(wide[s][h]));
+                    }
+                    float32x4_t avail = vsubq_f32(limit, f[3]);
+                    float32x4_t cmy = vaddq_f32(vaddq_f32(f[0], f[1]), f[2]);
+                    uint32x4_t over = vcgtq_f32(cmy, avail);
+                    float32x4_t scale = vdivq_f32(avail, vmaxq_f32(cmy, one));
+                    float32x4_t k = vsubq_f32(full, f[3]);
+                    for (int c = 0; c < 3; c++) {
+                        float32x4_t ink = vbslq_f32(over, vcvtq_f32_u32(vcvtq_u32_f32(vmulq_f32(f[c], scale))), f[c]);
+                        quarters[c][q] = vcvtq_u32_f32(vdivq_f32(vmulq_f32(k, vsubq_f32(full, ink)), full));
+                    }
+                }
+                for (int c = 0; c < 3; c++) {
+                    colors[c][h] = vcombine_u16(vmovn_u32(quarters[c][0]), vmovn_u32(quarters[c][1]));
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                px.val[c] = vcombine_u8(vmovn_u16(colors[c][0]), vmovn_u16(colors[c][1]));
+            }
+            vst4q_u8((uint8_t *) (dst + i), px);
+        }
+    }
+#elif PIXELS_SSE2
+    if (samplesPerPixel == 4) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+        const __m128 limit = _mm_set1_ps((float) inkLimit);
+        const __m128 full = _mm_set1_ps(255.f);
+        const __m128 one = _mm_set1_ps(1.f);
+        for (; i + 4 <= count; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i * 4));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            //samples of one pixel in each vector are transposed to one sample of 4 pixels in each vector
+            __m128 f[4];
+            f[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+            f[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+            f[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+            f[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+            _MM_TRANSPOSE4_PS(f[0], f[1], f[2], f[3]);
+            __m128 avail = _mm_sub_ps(limit, f[3]);
+            __m128 cmy = _mm_add_ps(_mm_add_ps(f[0], f[1]), f[2]);
+            __m128 over = _mm_cmpgt_ps(cmy, avail);
+            __m128 scale = _mm_div_ps(avail, _mm_max_ps(cmy, one));
+            __m128 k = _mm_sub_ps(full, f[3]);
+            __m128i p = alpha;
+            for (int c = 0; c < 3; c++) {
+                __m128 limited = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(f[c], scale)));
+                __m128 ink = _mm_or_ps(_mm_and_ps(over, limited), _mm_andnot_ps(over, f[c]));
+                __m128i color = _mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(k, _mm_sub_ps(full, ink)), full));
+                p = _mm_or_si128(p, _mm_slli_epi32(color, c * 8));
+            }
+            _mm_storeu_si128((__m128i *) (dst + i), p);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        const uint8_t *p = src + i * samplesPerPixel;
+        uint32_t ink[3] = {p[0], p[1], p[2]};
+        uint32_t avail = inkLimit - p[3];
+        uint32_t cmy = ink[0] + ink[1] + ink[2];
+        if (cmy > avail) {
+            float scale = (float) avail / (float) cmy;
+            for (int c = 0; c < 3; c++) {
+                ink[c] = (uint32_t) ((float) ink[c] * scale);
+            }
+        }
+        uint32_t k = 255 - p[3];
+        uint32_t r = k * (255 - ink[0]) / 255;
+        uint32_t g = k * (255 - ink[1]) / 255;
+        uint32_t b = k * (255 - ink[2]) / 255;
+        dst[i] = 0xFF000000 | (b << 16) | (g << 8) | r;
+    }
+}
+
+void pixels_lab8_to_xyz(const uint8_t *src, const float *tableX, const float *tableY, const float *tableZ, float *x, float *y, float *z, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++, src += 3) {
+        uint32_t l = (uint32_t) src[0] << 8;
+        x[i] = tableX[l | src[1]];
+        y[i] = tableY[src[0]];
+        z[i] = tableZ[l | src[2]];
+    }
+}
+
+static inline void labToXYZ(float L, float a, float b, const float *white, float *x, float *y, float *z) {
+    float cby;
+    if (L < 8.856F) {
+        *y = (L * white[1]) / 903.292F;
+        cby = 7.787F * (*y / white[1]) + 16.0F / 116.0F;
+    } else {
+        cby = (L + 16.0F) / 116.0F;
+        *y = white[1] * cby * cby * cby;
+    }
+    float tmp = a / 256.0F / 500.0F + cby;
+    *x = tmp < 0.2069F ? white[0] * (tmp - 0.13793F) / 7.787F : white[0] * tmp * tmp * tmp;
+    tmp = cby - b / 256.0F / 200.0F;
+    *z = tmp < 0.2069F ? white[2] * (tmp - 0.13793F) / 7.787F : white[2] * tmp * tmp * tmp;
+}
+
+//Operations are done in the same order as in libtiff, so results are the same without fused multiply-add
+void pixels_lab16_to_xyz(const uint16_t *src, const float *white, float *x, float *y, float *z, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON && defined(__aarch64__)
+    const float32x4_t x0 = vdupq_n_f32(white[0]);
+    const float32x4_t y0 = vdupq_n_f32(white[1]);
+    const float32x4_t z0 = vdupq_n_f32(white[2]);
+    const float32x4_t knee = vdupq_n_f32(0.2069F);
+    const float32x4_t offset = vdupq_n_f32(0.13793F);
+    const float32x4_t slope = vdupq_n_f32(7.787F);
+    for (; i + 4 <= count; i += 4) {
+        uint16x4x3_t lab = vld3_u16(src + i * 3);
+        float32x4_t L = vdivq_f32(vmulq_f32(vcvtq_f32_u32(vmovl_u16(lab.val[0])), vdupq_n_f32(100.0F)), vdupq_n_f32(65535.0F));
+        float32x4_t a = vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_u16(lab.val[1])));
+        float32x4_t b = vcvtq_f32_s32(vmovl_s16(vreinterpret_s16_u16(lab.val[2])));
+        float32x4_t darkY = vdivq_f32(vmulq_f32(L, y0), vdupq_n_f32(903.292F));
+        float32x4_t darkCby = vaddq_f32(vmulq_f32(slope, vdivq_f32(darkY, y0)), vdupq_n_f32(16.0F / 116.0F));
+        float32x4_t cby = vdivq_f32(vaddq_f32(L, vdupq_n_f32(16.0F)), vdupq_n_f32(116.0F));
+        float32x4_t Y = vmulq_f32(vmulq_f32(vmulq_f32(y0, cby), cby), cby);
+        uint32x4_t dark = vcltq_f32(L, vdupq_n_f32(8.856F));
+        cby = vbslq_f32(dark, darkCby, cby);
+        vst1q_f32(y + i, vbslq_f32(dark, darkY, Y));
+        float32x4_t t = vaddq_f32(vdivq_f32(vdivq_f32(a, vdupq_n_f32(256.0F)), vdupq_n_f32(500.0F)), cby);
+        float32x4_t linear = vdivq_f32(vmulq_f32(x0, vsubq_f32(t, offset)), slope);
+        vst1q_f32(x + i, vbslq_f32(vcltq_f32(t, knee), linear, vmulq_f32(vmulq_f32(vmulq_f32(x0, t), t), t)));
+        t = vsubq_f32(cby, vdivq_f32(vdivq_f32(b, vdupq_n_f32(256.0F)), vdupq_n_f32(200.0F)));
+        linear = vdivq_f32(vmulq_f32(z0, vsubq_f32(t, offset)), slope);
+        vst1q_f32(z + i, vbslq_f32(vcltq_f32(t, knee), linear, vmulq_f32(vmulq_f32(vmulq_f32(z0, t), t), t)));
+    }
+#elif PIXELS_SSE2
+    const __m128 x0 = _mm_set1_ps(white[0]);
+    const __m128 y0 = _mm_set1_ps(white[1]);
+    const __m128 z0 = _mm_set1_ps(white[2]);
+    const __m128 knee = _mm_set1_ps(0.2069F);
+    const __m128 offset = _mm_set1_ps(0.13793F);
+    const __m128 slope = _mm_set1_ps(7.787F);
+    for (; i + 4 <= count; i += 4) {
+        const uint16_t *p = src + i * 3;
+        __m128 L = _mm_div_ps(_mm_mul_ps(_mm_setr_ps(p[0], p[3], p[6], p[9]), _mm_set1_ps(100.0F)), _mm_set1_ps(65535.0F));
+        __m128 a = _mm_setr_ps((int16_t) p[1], (int16_t) p[4], (int16_t) p[7], (int16_t) p[10]);
+        __m128 b = _mm_setr_ps((int16_t) p[2], (int16_t) p[5], (int16_t) p[8], (int16_t) p[11]);
+        __m128 darkY = _mm_div_ps(_mm_mul_ps(L, y0), _mm_set1_ps(903.292F));
+        __m128 darkCby = _mm_add_ps(_mm_mul_ps(slope, _mm_div_ps(darkY, y0)), _mm_set1_ps(16.0F / 116.0F));
+        __m128 cby = _mm_div_ps(_mm_add_ps(L, _mm_set1_ps(16.0F)), _mm_set1_ps(116.0F));
+        __m128 Y = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(y0, cby), cby), cby);
+        __m128 dark = _mm_cmplt_ps(L, _mm_set1_ps(8.856F));
+        cby = _mm_or_ps(_mm_and_ps(dark, darkCby), _mm_andnot_ps(dark, cby));
+        _mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(dark, darkY), _mm_andnot_ps(dark, Y)));
+        __m128 t = _mm_add_ps(_mm_div_ps(_mm_div_ps(a, _mm_set1_ps(256.0F)), _mm_set1_ps(500.0F)), cby);
+        __m128 linear = _mm_div_ps(_mm_mul_ps(x0, _mm_sub_ps(t, offset)), slope);
+        __m128 below = _mm_cmplt_ps(t, knee);
+        _mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(below, linear), _mm_andnot_ps(below, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(x0, t), t), t))));
+        t = _mm_sub_ps(cby, _mm_div_ps(_mm_div_ps(b, _mm_set1_ps(256.0F)), _mm_set1_ps(200.0F)));
+        linear = _mm_div_ps(_mm_mul_ps(z0, _mm_sub_ps(t, offset)), slope);
+        below = _mm_cmplt_ps(t, knee);
+        _mm_storeu_ps(z + i, _mm_or_ps(_mm_and_ps(below, linear), _mm_andnot_ps(below, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(z0, t), t), t))));
+    }
+#endif
+    for (; i < count; i++) {
+        const uint16_t *p = src + i * 3;
+        labToXYZ((float) p[0] * 100.0F / 65535.0F, (float) (int16_t) p[1], (float) (int16_t) p[2], white, x + i, y + i, z + i);
+    }
+}
+
+static inline uint32_t xyzPixel(const PixelsXYZToRGB *conv, const int32_t *index) {
+    uint32_t px = 0xFF000000;
+    for (int c = 0; c < 3; c++) {
+        int32_t n = index[c] < conv->range ? index[c] : conv->range;
+        px |= (uint32_t) conv->colors[c][n] << (c * 8);
+    }
+    return px;
+}
+
+void pixels_xyz_to_abgr(const float *x, const float *y, const float *z, const PixelsXYZToRGB *conv, uint32_t *dst, uint32_t count) {
+    uint32_t i = 0;
+    const float *m = conv->matrix;
+#if (PIXELS_NEON && defined(__aarch64__)) || PIXELS_SSE2
+    int32_t index[3][4];
+    for (; i + 4 <= count; i += 4) {
+#if PIXELS_NEON
+        float32x4_t vx = vld1q_f32(x + i);
+        float32x4_t vy = vld1q_f32(y + i);
+        float32x4_t vz = vld1q_f32(z + i);
+        for (int c = 0; c < 3; c++) {
+            float32x4_t lum = vaddq_f32(vaddq_f32(vmulq_n_f32(vx, m[c * 3]), vmulq_n_f32(vy, m[c * 3 + 1])), vmulq_n_f32(vz, m[c * 3 + 2]));
+            float32x4_t low = vdupq_n_f32(conv->minLuminance[c]);
+            lum = vminq_f32(vmaxq_f32(lum, low), vdupq_n_f32(conv->maxLuminance[c]));
+            vst1q_s32(index[c], vcvtq_s32_f32(vdivq_f32(vsubq_f32(lum, low), vdupq_n_f32(conv->step[c]))));
+        }
+#else
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 vz = _mm_loadu_ps(z + i);
+        for (int c = 0; c < 3; c++) {
+            __m128 lum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[c * 3]), vx), _mm_mul_ps(_mm_set1_ps(m[c * 3 + 1]), vy)), _mm_mul_ps(_mm_set1_ps(m[c * 3 + 2]), vz));
+            __m128 low = _mm_set1_ps(conv->minLuminance[c]);
+            lum = _mm_min_ps(_mm_max_ps(lum, low), _mm_set1_ps(conv->maxLuminance[c]));
+            _mm_storeu_si128((__m128i *) index[c], _mm_cvttps_epi32(_mm_div_ps(_mm_sub_ps(lum, low), _mm_set1_ps(conv->step[c]))));
+        }
+#endif
+        for (int l = 0; l < 4; l++) {
+            int32_t lane[3] = {index[0][l], index[1][l], index[2][l]};
+            dst[i + l] = xyzPixel(conv, lane);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        int32_t lane[3];
+        for (int c = 0; c < 3; c++) {
+            float lum = m[c * 3] * x[i] + m[c * 3 + 1] * y[i] + m[c * 3 + 2] * z[i];
+            lum = lum > conv->minLuminance[c] ? lum : conv->minLuminance[c];
+            lum = lum < conv->maxLuminance[c] ? lum : conv->maxLuminance[c];
+            lane[c] = (int32_t) ((lum - conv->minLuminance[c]) / conv->step[c]);
+        }
+        dst[i] = xyzPixel(conv, lane);
+    }
+}
+
+void pixels_abgr_to_rgb(const uint32_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (src + i));
+        uint8x16x3_t rgb;
+        rgb.val[0] = px.val[0];
+        rgb.val[1] = px.val[1];
+        rgb.val[2] = px.val[2];
+        vst3q_u8(dst + i * 3, rgb);
+    }
+#elif PIXELS_SSSE3
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    //each store writes 16 bytes but 12 of them are pixels, next store or the tail overwrites the rest
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i * 3), _mm_shuffle_epi8(v, shuffle));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        uint8_t *d = dst + i * 3;
+        d[0] = p & 0xFF;
+        d[1] = (p >> 8) & 0xFF;
+        d[2] = (p >> 16) & 0xFF;
+    }
+}
+
+void pixels_abgr_to_bgr(const uint32_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (src + i));
+        uint8x16x3_t bgr;
+        bgr.val[0] = px.val[2];
+        bgr.val[1] = px.val[1];
+        bgr.val[2] = px.val[0];
+        vst3q_u8(dst + i * 3, bgr);
+    }
+#elif PIXELS_SSSE3
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    //each store writes 16 bytes but 12 of them are pixels, next store or the tail overwrites the rest
+    for (; i + 6 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i * 3), _mm_shuffle_epi8(v, shuffle));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        uint8_t *d = dst + i * 3;
+        d[0] = (p >> 16) & 0xFF;
+        d[1] = (p >> 8) & 0xFF;
+        d[2] = p & 0xFF;
+    }
+}
+
+void pixels_abgr_to_argb(const uint32_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t v = vld1q_u32(src + i);
+        vst1q_u8(dst + i * 4, vreinterpretq_u8_u32(vsriq_n_u32(vshlq_n_u32(v, 8), v, 24)));
+    }
+#elif PIXELS_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_si128((__m128i *) (dst + i * 4), _mm_or_si128(_mm_slli_epi32(v, 8), _mm_srli_epi32(v, 24)));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        uint8_t *d = dst + i * 4;
+        d[0] = p >> 24;
+        d[1] = p & 0xFF;
+        d[2] = (p >> 8) & 0xFF;
+        d[3] = (p >> 16) & 0xFF;
+    }
+}
+
+void pixels_abgr_to_alpha(const uint32_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (src + i));
+        vst1q_u8(dst + i, px.val[3]);
+    }
+#elif PIXELS_SSE2
+    for (; i + 16 <= count; i += 16) {
+        __m128i a0 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *) (src + i)), 24);
+        __m128i a1 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *) (src + i + 4)), 24);
+        __m128i a2 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *) (src + i + 8)), 24);
+        __m128i a3 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *) (src + i + 12)), 24);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = src[i] >> 24;
+    }
+}
+
+void pixels_abgr_to_float(const uint32_t *src, float *r, float *g, float *b, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t px = vld4_u8((const uint8_t *) (src + i));
+        float *planes[3] = {r, g, b};
+        for (int c = 0; c < 3; c++) {
+            uint16x8_t v = vmovl_u8(px.val[c]);
+            vst1q_f32(planes[c] + i, vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))));
+            vst1q_f32(planes[c] + i + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))));
+        }
+    }
+#elif PIXELS_SSE2
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        _mm_storeu_ps(r + i, _mm_cvtepi32_ps(_mm_and_si128(v, mask)));
+        _mm_storeu_ps(g + i, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), mask)));
+        _mm_storeu_ps(b + i, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask)));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        r[i] = (float) (p & 0xFF);
+        g[i] = (float) ((p >> 8) & 0xFF);
+        b[i] = (float) ((p >> 16) & 0xFF);
+    }
+}
+
+void pixels_abgr_to_gray(const uint32_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    const uint8x8_t wr = vdup_n_u8(54);
+    const uint8x8_t wg = vdup_n_u8(183);
+    const uint8x8_t wb = vdup_n_u8(19);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (src + i));
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), wr);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), wg);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[2]), wb);
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), wr);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), wg);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[2]), wb);
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+#elif PIXELS_SSE2
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i wrb = _mm_set1_epi32((19 << 16) | 54);
+    const __m128i wg = _mm_set1_epi32(183);
+    const __m128i round = _mm_set1_epi32(128);
+    for (; i + 16 <= count; i += 16) {
+        __m128i y[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i + k * 4));
+            //r and b in 16 bit lanes, then g and a
+            __m128i rb = _mm_madd_epi16(_mm_and_si128(v, mask), wrb);
+            __m128i g = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), mask), wg);
+            y[k] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(rb, g), round), 8);
+        }
+        __m128i lo = _mm_packs_epi32(y[0], y[1]);
+        __m128i hi = _mm_packs_epi32(y[2], y[3]);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        dst[i] = (54 * (p & 0xFF) + 183 * ((p >> 8) & 0xFF) + 19 * ((p >> 16) & 0xFF) + 128) >> 8;
+    }
+}
+
+void pixels_gray_to_bits(const uint8_t *src, uint8_t threshold, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    static const uint8_t weights[16] = {128, 64, 32, 16, 8, 4, 2, 1, 128, 64, 32, 16, 8, 4, 2, 1};
+    const uint8x16_t w = vld1q_u8(weights);
+    const uint8x16_t t = vdupq_n_u8(threshold);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t set = vandq_u8(vcgeq_u8(vld1q_u8(src + i), t), w);
+        //sum of weights of every 8 samples is their byte
+        uint64x2_t bytes = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(set)));
+        dst[i / 8] = (uint8_t) vgetq_lane_u64(bytes, 0);
+        dst[i / 8 + 1] = (uint8_t) vgetq_lane_u64(bytes, 1);
+    }
+#elif PIXELS_SSE2
+    const __m128i w = _mm_setr_epi8((char) 128, 64, 32, 16, 8, 4, 2, 1, (char) 128, 64, 32, 16, 8, 4, 2, 1);
+    const __m128i t = _mm_set1_epi8((char) threshold);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        //unsigned v >= t where max(v, t) == v
+        __m128i set = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, t), v), w);
+        //sum of absolute differences adds weights of every 8 samples
+        __m128i bytes = _mm_sad_epu8(set, zero);
+        dst[i / 8] = (uint8_t) _mm_cvtsi128_si32(bytes);
+        dst[i / 8 + 1] = (uint8_t) _mm_extract_epi16(bytes, 4);
+    }
+#endif
+    for (; i < count; i += 8) {
+        uint8_t byte = 0;
+        for (uint32_t k = 0; k < 8 && i + k < count; k++) {
+            if (src[i + k] >= threshold) {
+                byte |= 0x80 >> k;
+            }
+        }
+        dst[i / 8] = byte;
+    }
+}
+
+void pixels_abgr_to_y(const uint32_t *src, uint8_t *dst, uint32_t count) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    const uint8x8_t wr = vdup_n_u8(66);
+    const uint8x8_t wg = vdup_n_u8(129);
+    const uint8x8_t wb = vdup_n_u8(25);
+    const uint8x16_t base = vdupq_n_u8(16);
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t px = vld4q_u8((const uint8_t *) (src + i));
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), wr);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), wg);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[2]), wb);
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), wr);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), wg);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[2]), wb);
+        vst1q_u8(dst + i, vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)), base));
+    }
+#elif PIXELS_SSE2
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i wrb = _mm_set1_epi32((25 << 16) | 66);
+    const __m128i wg = _mm_set1_epi32(129);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i base = _mm_set1_epi8(16);
+    for (; i + 16 <= count; i += 16) {
+        __m128i y[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (src + i + k * 4));
+            __m128i rb = _mm_madd_epi16(_mm_and_si128(v, mask), wrb);
+            __m128i g = _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), mask), wg);
+            y[k] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(rb, g), round), 8);
+        }
+        __m128i lo = _mm_packs_epi32(y[0], y[1]);
+        __m128i hi = _mm_packs_epi32(y[2], y[3]);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_add_epi8(_mm_packus_epi16(lo, hi), base));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t p = src[i];
+        dst[i] = ((66 * (p & 0xFF) + 129 * ((p >> 8) & 0xFF) + 25 * ((p >> 16) & 0xFF) + 128) >> 8) + 16;
+    }
+}
+
+void pixels_abgr_to_uv(const uint32_t *top, const uint32_t *bottom, uint32_t width, uint8_t *u, uint8_t *v) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    const int16x8_t round = vdupq_n_s16(128);
+    const int16x8_t base = vdupq_n_s16(128);
+    for (; 2 * i + 16 <= width; i += 8) {
+        uint8x16x4_t t = vld4q_u8((const uint8_t *) (top + 2 * i));
+        uint8x16x4_t b = vld4q_u8((const uint8_t *) (bottom + 2 * i));
+        int16x8_t c[3];
+        for (int k = 0; k < 3; k++) {
+            //sums of 2x2 blocks fit 16 bits, averages of them are colors again
+            c[k] = vreinterpretq_s16_u16(vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(t.val[k]), b.val[k]), 2));
+        }
+        int16x8_t cu = vmlaq_n_s16(vmlaq_n_s16(vmulq_n_s16(c[0], -38), c[1], -74), c[2], 112);
+        int16x8_t cv = vmlaq_n_s16(vmlaq_n_s16(vmulq_n_s16(c[0], 112), c[1], -94), c[2], -18);
+        vst1_u8(u + i, vqmovun_s16(vaddq_s16(vshrq_n_s16(vaddq_s16(cu, round), 8), base)));
+        vst1_u8(v + i, vqmovun_s16(vaddq_s16(vshrq_n_s16(vaddq_s16(cv, round), 8), base)));
+    }
+#elif PIXELS_SSE2
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i wu_rb = _mm_set1_epi32((112 << 16) | (uint16_t) -38);
+    const __m128i wu_g = _mm_set1_epi32((uint16_t) -74);
+    const __m128i wv_rb = _mm_set1_epi32((int) (((uint32_t) (uint16_t) -18 << 16) | 112));
+    const __m128i wv_g = _mm_set1_epi32((uint16_t) -94);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i base = _mm_set1_epi32(128);
+    for (; 2 * i + 8 <= width; i += 4) {
+        //r, b and g, a of pixels in 16 bit lanes, summed over rows and then over pairs of pixels
+        __m128i rb[2], ga[2];
+        for (int k = 0; k < 2; k++) {
+            __m128i t = _mm_loadu_si128((const __m128i *) (top + 2 * i + k * 4));
+            __m128i b = _mm_loadu_si128((const __m128i *) (bottom + 2 * i + k * 4));
+            __m128i srb = _mm_add_epi16(_mm_and_si128(t, mask), _mm_and_si128(b, mask));
+            __m128i sga = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(t, 8), mask), _mm_and_si128(_mm_srli_epi32(b, 8), mask));
+            srb = _mm_add_epi16(srb, _mm_srli_epi64(srb, 32));
+            sga = _mm_add_epi16(sga, _mm_srli_epi64(sga, 32));
+            rb[k] = _mm_shuffle_epi32(srb, _MM_SHUFFLE(3, 1, 2, 0));
+            ga[k] = _mm_shuffle_epi32(sga, _MM_SHUFFLE(3, 1, 2, 0));
+        }
+        __m128i crb = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(rb[0], rb[1]), two), 2);
+        __m128i cga = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(ga[0], ga[1]), two), 2);
+        __m128i cu = _mm_add_epi32(_mm_madd_epi16(crb, wu_rb), _mm_madd_epi16(cga, wu_g));
+        __m128i cv = _mm_add_epi32(_mm_madd_epi16(crb, wv_rb), _mm_madd_epi16(cga, wv_g));
+        cu = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(cu, round), 8), base);
+        cv = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(cv, round), 8), base);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(cu, cv), _mm_setzero_si128());
+        uint32_t lanes[2];
+        _mm_storel_epi64((__m128i *) lanes, packed);
+        memcpy(u + i, &lanes[0], 4);
+        memcpy(v + i, &lanes[1], 4);
+    }
+#endif
+    uint32_t count = (width + 1) / 2;
+    for (; i < count; i++) {
+        //last block of odd width takes its only column twice
+        uint32_t x0 = 2 * i;
+        uint32_t x1 = x0 + 1 < width ? x0 + 1 : x0;
+        uint32_t px[4] = {top[x0], top[x1], bottom[x0], bottom[x1]};
+        int32_t c[3] = {0, 0, 0};
+        for (int k = 0; k < 4; k++) {
+            c[0] += px[k] & 0xFF;
+            c[1] += (px[k] >> 8) & 0xFF;
+            c[2] += (px[k] >> 16) & 0xFF;
+        }
+        for (int k = 0; k < 3; k++) {
+            c[k] = (c[k] + 2) >> 2;
+        }
+        u[i] = (uint8_t) (((-38 * c[0] - 74 * c[1] + 112 * c[2] + 128) >> 8) + 128);
+        v[i] = (uint8_t) (((112 * c[0] - 94 * c[1] - 18 * c[2] + 128) >> 8) + 128);
+    }
+}
+
+void pixels_abgr_half_row(const uint32_t *top, const uint32_t *bottom, uint32_t width, uint32_t *dst) {
+    uint32_t i = 0;
+#if PIXELS_NEON
+    for (; 2 * i + 16 <= width; i += 8) {
+        uint8x16x4_t t = vld4q_u8((const uint8_t *) (top + 2 * i));
+        uint8x16x4_t b = vld4q_u8((const uint8_t *) (bottom + 2 * i));
+        uint8x8x4_t out;
+        for (int k = 0; k < 4; k++) {
+            out.val[k] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(t.val[k]), b.val[k]), 2);
+        }
+        vst4_u8((uint8_t *) (dst + i), out);
+    }
+#elif PIXELS_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    for (; 2 * i + 4 <= width; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i *) (top + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i *) (bottom + 2 * i));
+        //channels of pixels 0, 1 and 2, 3 in 16 bit lanes, summed over rows
+        __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(t, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(b, zero));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+        _mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(sum, sum));
+    }
+#endif
+    uint32_t count = (width + 1) / 2;
+    for (; i < count; i++) {
+        uint32_t x0 = 2 * i;
+        uint32_t x1 = x0 + 1 < width ? x0 + 1 : x0;
+        //sum channels in 16 bit lanes: at most 4 * 255 fits
+        uint32_t rb = (top[x0] & 0x00FF00FF) + (top[x1] & 0x00FF00FF) + (bottom[x0] & 0x00FF00FF) + (bottom[x1] & 0x00FF00FF);
+        uint32_t ga = ((top[x0] >> 8) & 0x00FF00FF) + ((top[x1] >> 8) & 0x00FF00FF) + ((bottom[x0] >> 8) & 0x00FF00FF) + ((bottom[x1] >> 8) & 0x00FF00FF);
+        rb = ((rb + 0x00020002) >> 2) & 0x00FF00FF;
+        ga = ((ga + 0x00020002) >> 2) & 0x00FF00FF;
+        dst[i] = rb | (ga << 8);
+    }
+}
+
+void pixels_horizontal_diff(const uint8_t *src, uint8_t *dst, uint32_t count, uint32_t stride) {
+    uint32_t i = 0;
+    for (; i < stride && i < count; i++) {
+        dst[i] = src[i];
+    }
+#if PIXELS_NEON
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(dst + i, vsubq_u8(vld1q_u8(src + i), vld1q_u8(src + i - stride)));
+    }
+#elif PIXELS_SSE2
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i left = _mm_loadu_si128((const __m128i *) (src + i - stride));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_sub_epi8(v, left));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = src[i] - src[i - stride];
+    }
+}
+
+void pixels_box3_row(const uint32_t *top, const uint32_t *mid, const uint32_t *bottom, uint32_t width, uint32_t start, uint32_t step, uint32_t *dst, uint32_t count) {
+    const uint32_t *rows[3] = {top, mid, bottom};
+    int rowCount = (top ? 1 : 0) + 1 + (bottom ? 1 : 0);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t x = start + i * step;
+        uint32_t left = x > 0 ? x - 1 : x;
+        uint32_t right = x + 1 < width ? x + 1 : x;
+        uint32_t n = (right - left + 1) * rowCount;
+        //sum channels in 16 bit lanes: at most 9 * 255 fits
+        uint32_t rb = 0;
+        uint32_t ga = 0;
+        for (int r = 0; r < 3; r++) {
+            const uint32_t *row = rows[r];
+            if (!row) continue;
+            for (uint32_t c = left; c <= right; c++) {
+                uint32_t p = row[c];
+                rb += p & 0x00FF00FF;
+                ga += (p >> 8) & 0x00FF00FF;
+            }
+        }
+        dst[i] = ((rb & 0xFFFF) / n) | (((rb >> 16) / n) << 16) | (((ga & 0xFFFF) / n) << 8) | (((ga >> 16) / n) << 24);
+    }
+}
+
+void pixels_build_index_table(const uint32_t *colors, uint32_t bitsPerSample, uint32_t *table) {
+    uint32_t perByte = 8 / bitsPerSample;
+    uint32_t mask = (1u << bitsPerSample) - 1;
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        for (uint32_t i = 0; i < perByte; i++) {
+            table[byte * perByte + i] = colors[(byte >> (8 - bitsPerSample * (i + 1))) & mask];
+        }
+    }
+}
+
+void pixels_indexed_to_abgr(const uint8_t *src, uint32_t firstBit, uint32_t bitsPerSample, const uint32_t *table, uint32_t *dst, uint32_t count) {
+    uint32_t perByte = 8 / bitsPerSample;
+    uint32_t i = 0;
+    uint32_t bit = firstBit;
+    for (; i < count && (bit & 7); i++, bit += bitsPerSample) {
+        dst[i] = table[src[bit >> 3] * perByte + (bit & 7) / bitsPerSample];
+    }
+    //whole bytes are expanded with one lookup
+    for (; i + perByte <= count; i += perByte, bit += 8) {
+        memcpy(dst + i, table + src[bit >> 3] * perByte, perByte * sizeof(uint32_t));
+    }
+    for (; i < count; i++, bit += bitsPerSample) {
+        dst[i] = table[src[bit >> 3] * perByte + (bit & 7) / bitsPerSample];
+    }
+}
+
+//Number of set bits in [first, first + n) of src, most significant bit first
+static inline uint32_t countBits(const uint8_t *src, uint32_t first, uint32_t n) {
+    uint32_t count = 0;
+    const uint8_t *p = src + (first >> 3);
+    uint32_t head = first & 7;
+    if (head) {
+        uint32_t take = 8 - head < n ? 8 - head : n;
+        uint32_t mask = (0xFFu >> head) & (0xFFu << (8 - head - take));
+        count += __builtin_popcount(*p++ & mask);
+        n -= take;
+    }
+    for (; n >= 64; n -= 64, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        count += __builtin_popcountll(word);
+    }
+    for (; n >= 8; n -= 8) {
+        count += __builtin_popcount(*p++);
+    }
+    if (n) {
+        count += __builtin_popcount(*p & (0xFFu << (8 - n)) & 0xFFu);
+    }
+    return count;
+}
+
+void pixels_bits_count(const uint8_t *src, uint32_t firstBit, uint32_t step, uint32_t *counts, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        counts[i] += countBits(src, firstBit + i * step, step);
+    }
+}
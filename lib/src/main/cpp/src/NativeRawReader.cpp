@@ -0,0 +1,819 @@
+//
+// Reader for sample layouts that libtiff RGBA interface can't handle or converts pixel by pixel.
+//
+
+#include "NativeRawReader.h"
+#include "NativePixelKernels.h"
+#include <cfloat>
+
+NativeRawReader::NativeRawReader(TIFF *tiff) {
+    image = tiff;
+    width = 0;
+    height = 0;
+    TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(image, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetFieldDefaulted(image, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetFieldDefaulted(image, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(image, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    TIFFGetFieldDefaulted(image, TIFFTAG_PLANARCONFIG, &planarConfig);
+    TIFFGetFieldDefaulted(image, TIFFTAG_ORIENTATION, &orientation);
+    photometric = PHOTOMETRIC_MINISBLACK;
+    TIFFGetField(image, TIFFTAG_PHOTOMETRIC, &photometric);
+    inkLimit = 0;
+
+    sampleKind = SAMPLES_FLOAT;
+    if (isIndexedImage(image)) {
+        sampleKind = SAMPLES_INDEXED;
+    } else if (isJpegYCbCrImage(image)) {
+        //Color conversion and upsampling of libjpeg are much faster than ones of libtiff.
+        //Strip and tile sizes are recomputed by libtiff for RGB samples
+        TIFFSetField(image, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+        photometric = PHOTOMETRIC_RGB;
+        sampleKind = SAMPLES_RGB;
+    } else if (isCmykImage(image)) {
+        sampleKind = SAMPLES_CMYK;
+    } else if (isLabImage(image)) {
+        sampleKind = SAMPLES_LAB;
+    } else if (isPlanarImage(image)) {
+        sampleKind = SAMPLES_PLANAR;
+    }
+
+    colorChannels = (photometric == PHOTOMETRIC_RGB && samplesPerPixel >= 3) ? 3 : 1;
+    alphaIndex = -1;
+    unassociatedAlpha = false;
+    uint16 extraCount = 0;
+    uint16 *extraTypes = nullptr;
+    if (TIFFGetField(image, TIFFTAG_EXTRASAMPLES, &extraCount, &extraTypes) && extraCount > 0 && samplesPerPixel > colorChannels) {
+        if (extraTypes[0] == EXTRASAMPLE_ASSOCALPHA || extraTypes[0] == EXTRASAMPLE_UNASSALPHA) {
+            alphaIndex = colorChannels;
+            unassociatedAlpha = extraTypes[0] == EXTRASAMPLE_UNASSALPHA;
+        } else if (extraTypes[0] == EXTRASAMPLE_UNSPECIFIED && sampleKind == SAMPLES_PLANAR) {
+            //RGBA interface of libtiff takes unspecified extra sample of RGB images as associated alpha
+            alphaIndex = colorChannels;
+        }
+    } else if (extraCount == 0 && samplesPerPixel == 4 && sampleKind == SAMPLES_PLANAR) {
+        //as well as fourth sample without extra samples tag
+        alphaIndex = colorChannels;
+    }
+
+    tiled = TIFFIsTiled(image) != 0;
+    if (tiled) {
+        TIFFGetField(image, TIFFTAG_TILEWIDTH, &blockWidth);
+        TIFFGetField(image, TIFFTAG_TILELENGTH, &blockHeight);
+    } else {
+        blockWidth = width;
+        TIFFGetFieldDefaulted(image, TIFFTAG_ROWSPERSTRIP, &blockHeight);
+        if (blockHeight > height) blockHeight = height;
+    }
+    block = nullptr;
+    blockBufferSize = 0;
+    cachedBlock = -1;
+
+    alphaOnly = false;
+    bandCount = 0;
+    for (int c = 0; c < 4; c++) {
+        bandSamples[c] = -1;
+    }
+    if (sampleKind == SAMPLES_PLANAR) {
+        for (int c = 0; c < 3; c++) {
+            bandSamples[c] = c;
+        }
+        bandSamples[3] = alphaIndex;
+    }
+    premultiplyBands = unassociatedAlpha;
+    planeCount = 0;
+    choosePlanes();
+
+    floatRow = nullptr;
+    byteRow = nullptr;
+    pixelRow = nullptr;
+
+    indexTable = nullptr;
+    labTables = nullptr;
+    labColors = nullptr;
+
+    floatMin = 0.f;
+    floatMax = 1.f;
+    floatScale = 255.f;
+}
+
+NativeRawReader::~NativeRawReader() {
+    if (block) {
+        _TIFFfree(block);
+        block = nullptr;
+    }
+    if (floatRow) {
+        free(floatRow);
+        floatRow = nullptr;
+    }
+    if (byteRow) {
+        free(byteRow);
+        byteRow = nullptr;
+    }
+    if (pixelRow) {
+        free(pixelRow);
+        pixelRow = nullptr;
+    }
+    if (indexTable) {
+        free(indexTable);
+        indexTable = nullptr;
+    }
+    if (labTables) {
+        free(labTables);
+        labTables = nullptr;
+    }
+    if (labColors) {
+        free(labColors);
+        labColors = nullptr;
+    }
+}
+
+bool NativeRawReader::isFloatImage(TIFF *tiff) {
+    uint16 format = SAMPLEFORMAT_UINT;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &format);
+    return format == SAMPLEFORMAT_IEEEFP;
+}
+
+bool NativeRawReader::isIndexedImage(TIFF *tiff) {
+    uint16 samples = 1;
+    uint16 bits = 1;
+    uint16 format = SAMPLEFORMAT_UINT;
+    uint16 photo = PHOTOMETRIC_MINISBLACK;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &format);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photo);
+    if (samples != 1 || format != SAMPLEFORMAT_UINT) {
+        return false;
+    }
+    if (photo == PHOTOMETRIC_PALETTE) {
+        return bits == 1 || bits == 4 || bits == 8;
+    }
+    if (photo == PHOTOMETRIC_MINISBLACK || photo == PHOTOMETRIC_MINISWHITE) {
+        return bits == 4 || (bits == 1 && TIFFIsTiled(tiff));
+    }
+    return false;
+}
+
+bool NativeRawReader::isJpegYCbCrImage(TIFF *tiff) {
+    uint16 compression = COMPRESSION_NONE;
+    uint16 photo = PHOTOMETRIC_MINISBLACK;
+    uint16 samples = 1;
+    uint16 bits = 1;
+    uint16 planar = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photo);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+    return compression == COMPRESSION_JPEG && photo == PHOTOMETRIC_YCBCR && samples == 3 && bits == 8
+           && planar == PLANARCONFIG_CONTIG;
+}
+
+bool NativeRawReader::isCmykImage(TIFF *tiff) {
+    uint16 photo = PHOTOMETRIC_MINISBLACK;
+    uint16 inkSet = INKSET_CMYK;
+    uint16 samples = 1;
+    uint16 bits = 1;
+    uint16 format = SAMPLEFORMAT_UINT;
+    uint16 planar = PLANARCONFIG_CONTIG;
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photo);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_INKSET, &inkSet);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &format);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+    return photo == PHOTOMETRIC_SEPARATED && inkSet == INKSET_CMYK && samples >= 4 && bits == 8
+           && format == SAMPLEFORMAT_UINT && planar == PLANARCONFIG_CONTIG;
+}
+
+bool NativeRawReader::isLabImage(TIFF *tiff) {
+    uint16 photo = PHOTOMETRIC_MINISBLACK;
+    uint16 samples = 1;
+    uint16 bits = 1;
+    uint16 planar = PLANARCONFIG_CONTIG;
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photo);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+    return photo == PHOTOMETRIC_CIELAB && samples == 3 && (bits == 8 || bits == 16) && planar == PLANARCONFIG_CONTIG;
+}
+
+bool NativeRawReader::isPlanarImage(TIFF *tiff) {
+    uint16 photo = PHOTOMETRIC_MINISBLACK;
+    uint16 samples = 1;
+    uint16 bits = 1;
+    uint16 format = SAMPLEFORMAT_UINT;
+    uint16 planar = PLANARCONFIG_CONTIG;
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photo);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLEFORMAT, &format);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+    return photo == PHOTOMETRIC_RGB && samples >= 3 && bits == 8 && format == SAMPLEFORMAT_UINT && planar == PLANARCONFIG_SEPARATE;
+}
+
+bool NativeRawReader::hasSeveralBlocks(TIFF *tiff) {
+    if (TIFFIsTiled(tiff)) {
+        return true;
+    }
+    uint16 samples = 1;
+    uint16 planar = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samples);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planar);
+    uint32 strips = TIFFNumberOfStrips(tiff);
+    return planar == PLANARCONFIG_SEPARATE ? strips > samples : strips > 1;
+}
+
+void NativeRawReader::readAlphaOnly() {
+    alphaOnly = true;
+    choosePlanes();
+}
+
+void NativeRawReader::selectBands(const int *bands, int count) {
+    sampleKind = SAMPLES_BANDS;
+    bandCount = count;
+    for (int c = 0; c < 4; c++) {
+        bandSamples[c] = -1;
+    }
+    if (count == 1) {
+        for (int c = 0; c < 3; c++) {
+            bandSamples[c] = bands[0];
+        }
+    } else if (count == 3 || count == 4) {
+        for (int c = 0; c < count; c++) {
+            bandSamples[c] = bands[c];
+        }
+    }
+    //associated alpha of image is already multiplied into samples
+    premultiplyBands = bandSamples[3] >= 0 && (bandSamples[3] != alphaIndex || unassociatedAlpha);
+    choosePlanes();
+}
+
+bool NativeRawReader::readsPlanes() const {
+    return sampleKind == SAMPLES_PLANAR || (sampleKind == SAMPLES_BANDS && planarConfig == PLANARCONFIG_SEPARATE);
+}
+
+//Colors are not read for alpha only, samples that are not decoded are never read.
+//Sample that is decoded to several channels is read once
+void NativeRawReader::choosePlanes() {
+    planeCount = 0;
+    for (int c = 0; c < 4; c++) {
+        bandPlanes[c] = -1;
+        int sample = bandSamples[c];
+        if (sample < 0 || sample >= samplesPerPixel || (alphaOnly && c < 3)) {
+            continue;
+        }
+        for (uint32 p = 0; p < planeCount; p++) {
+            if (planeSamples[p] == sample) {
+                bandPlanes[c] = (int) p;
+            }
+        }
+        if (bandPlanes[c] < 0) {
+            bandPlanes[c] = (int) planeCount;
+            planeSamples[planeCount++] = (uint16) sample;
+        }
+    }
+}
+
+const char *NativeRawReader::checkSupport() const {
+    if (sampleKind == SAMPLES_BANDS) {
+        if (bandCount != 1 && bandCount != 3 && bandCount != 4) {
+            return "inBands should have 1, 3 or 4 sample indices";
+        }
+        for (int c = 0; c < (bandCount == 1 ? 1 : bandCount); c++) {
+            if (bandSamples[c] < 0 || bandSamples[c] >= samplesPerPixel) {
+                return "inBands has index of sample that image doesn\'t have";
+            }
+        }
+        if (sampleFormat != SAMPLEFORMAT_UINT) {
+            return "inBands is supported only for unsigned integer samples";
+        }
+        if (bitsPerSample != 8 && bitsPerSample != 16) {
+            return "inBands is supported only for 8 and 16 bits samples";
+        }
+        if (photometric == PHOTOMETRIC_YCBCR || photometric == PHOTOMETRIC_PALETTE) {
+            return "inBands is not supported for YCbCr and palette images";
+        }
+    }
+    if (sampleKind != SAMPLES_FLOAT) {
+        if (width == 0 || height == 0 || blockWidth == 0 || blockHeight == 0) {
+            return "Image has wrong dimensions";
+        }
+        return nullptr;
+    }
+    if (sampleFormat != SAMPLEFORMAT_IEEEFP) {
+        return "Raw reader supports only floating point, indexed, YCbCr JPEG, CMYK, CIE L*a*b* and planar RGB samples";
+    }
+    if (bitsPerSample != 16 && bitsPerSample != 32) {
+        return "Only 16 and 32 bits floating point samples are supported";
+    }
+    if (planarConfig != PLANARCONFIG_CONTIG && samplesPerPixel > 1) {
+        return "Floating point samples are supported only for contiguous planar config";
+    }
+    if (photometric != PHOTOMETRIC_MINISBLACK && photometric != PHOTOMETRIC_MINISWHITE && photometric != PHOTOMETRIC_RGB) {
+        return "Floating point samples are supported only for grayscale and RGB images";
+    }
+    if (width == 0 || height == 0 || blockWidth == 0 || blockHeight == 0) {
+        return "Image has wrong dimensions";
+    }
+    return nullptr;
+}
+
+bool NativeRawReader::init() {
+    blockBufferSize = tiled ? TIFFTileSize(image) : TIFFStripSize(image);
+    if (blockBufferSize <= 0) {
+        return false;
+    }
+    if (readsPlanes()) {
+        //one plane keeps allocations valid when no plane is read
+        uint32 planes = planeCount > 0 ? planeCount : 1;
+        block = (unsigned char *) _TIFFmalloc(blockBufferSize * planes);
+        pixelRow = (uint32 *) malloc(sizeof(uint32) * blockWidth);
+        if (bitsPerSample == 16) {
+            //8 bit row of every plane
+            byteRow = (unsigned char *) malloc(blockWidth * planes);
+            return block && pixelRow && byteRow;
+        }
+        return block && pixelRow;
+    }
+    block = (unsigned char *) _TIFFmalloc(blockBufferSize);
+    pixelRow = (uint32 *) malloc(sizeof(uint32) * blockWidth);
+    if (sampleKind == SAMPLES_INDEXED) {
+        return block && pixelRow && buildIndexTable();
+    }
+    if (sampleKind == SAMPLES_BANDS && bitsPerSample == 16) {
+        byteRow = (unsigned char *) malloc(blockWidth * samplesPerPixel);
+        return block && pixelRow && byteRow;
+    }
+    if (sampleKind == SAMPLES_RGB || sampleKind == SAMPLES_CMYK || sampleKind == SAMPLES_BANDS) {
+        return block && pixelRow;
+    }
+    if (sampleKind == SAMPLES_LAB) {
+        //X, Y and Z rows
+        floatRow = (float *) malloc(sizeof(float) * blockWidth * 3);
+        return block && pixelRow && floatRow && buildLabTables();
+    }
+    floatRow = (float *) malloc(sizeof(float) * blockWidth * samplesPerPixel);
+    byteRow = (unsigned char *) malloc(blockWidth * samplesPerPixel);
+    return block && floatRow && byteRow && pixelRow;
+}
+
+unsigned long NativeRawReader::getWorkingMemory() const {
+    unsigned long blockBytes = tiled ? TIFFTileSize(image) : TIFFStripSize(image);
+    if (sampleKind == SAMPLES_INDEXED) {
+        return blockBytes + blockWidth * sizeof(uint32) + 256 * (8 / bitsPerSample) * sizeof(uint32);
+    }
+    if (readsPlanes()) {
+        unsigned long rowBytes = bitsPerSample == 16 ? blockWidth * planeCount : 0;
+        return blockBytes * planeCount + blockWidth * sizeof(uint32) + rowBytes;
+    }
+    if (sampleKind == SAMPLES_BANDS && bitsPerSample == 16) {
+        return blockBytes + blockWidth * sizeof(uint32) + blockWidth * samplesPerPixel;
+    }
+    if (sampleKind == SAMPLES_RGB || sampleKind == SAMPLES_CMYK || sampleKind == SAMPLES_BANDS) {
+        return blockBytes + blockWidth * sizeof(uint32);
+    }
+    if (sampleKind == SAMPLES_LAB) {
+        unsigned long tables = sizeof(TIFFCIELabToRGB) + 3 * (CIELABTORGB_TABLE_RANGE + 1);
+        if (bitsPerSample == 8) {
+            tables += (2 * 65536 + 256) * sizeof(float);
+        }
+        return blockBytes + blockWidth * (sizeof(uint32) + 3 * sizeof(float)) + tables;
+    }
+    return blockBytes + (unsigned long) blockWidth * samplesPerPixel * (sizeof(float) + 1) + blockWidth * sizeof(uint32);
+}
+
+//Colors of sample values are the same as libtiff RGBA interface gives
+bool NativeRawReader::buildIndexTable() {
+    uint32 valueCount = 1u << bitsPerSample;
+    uint32 colors[256];
+    if (photometric == PHOTOMETRIC_PALETTE) {
+        uint16 *red = nullptr;
+        uint16 *green = nullptr;
+        uint16 *blue = nullptr;
+        if (!TIFFGetField(image, TIFFTAG_COLORMAP, &red, &green, &blue)) {
+            __android_log_print(ANDROID_LOG_ERROR, "NativeRawReader", "%s", "Palette image has no colormap");
+            return false;
+        }
+        //some writers store 8 bit colormap instead of 16 bit one
+        int shift = 0;
+        for (uint32 i = 0; i < valueCount; i++) {
+            if (red[i] >= 256 || green[i] >= 256 || blue[i] >= 256) {
+                shift = 8;
+                break;
+            }
+        }
+        for (uint32 i = 0; i < valueCount; i++) {
+            colors[i] = 0xFF000000 | ((blue[i] >> shift) << 16) | ((green[i] >> shift) << 8) | (red[i] >> shift);
+        }
+    } else {
+        uint32 range = valueCount - 1;
+        for (uint32 i = 0; i < valueCount; i++) {
+            uint32 grey = (photometric == PHOTOMETRIC_MINISWHITE ? range - i : i) * 255 / range;
+            colors[i] = 0xFF000000 | grey * 0x010101;
+        }
+    }
+    indexTable = (uint32 *) malloc(sizeof(uint32) * 256 * (8 / bitsPerSample));
+    if (!indexTable) {
+        return false;
+    }
+    pixels_build_index_table(colors, bitsPerSample, indexTable);
+    return true;
+}
+
+//Same display as libtiff RGBA interface converts CIE L*a*b* images for
+static const TIFFDisplay displaySRGB = {
+        {{3.2410F, -1.5374F, -0.4986F},
+                {-0.9692F, 1.8760F, 0.0416F},
+                {0.0556F, -0.2040F, 1.0570F}},
+        100.0F, 100.0F, 100.0F,
+        255, 255, 255,
+        1.0F, 1.0F, 1.0F,
+        2.4F, 2.4F, 2.4F,
+};
+
+//Luminance curves of libtiff are rounded to colors once. XYZ of 8 bit samples are computed by libtiff
+//for every L and a or b, so vector code only multiplies them by display matrix
+bool NativeRawReader::buildLabTables() {
+    float *whitePoint = nullptr;
+    TIFFGetFieldDefaulted(image, TIFFTAG_WHITEPOINT, &whitePoint);
+    if (!whitePoint || whitePoint[1] == 0.0F) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeRawReader", "%s", "Invalid white point of CIE L*a*b* image");
+        return false;
+    }
+    float refWhite[3];
+    refWhite[1] = 100.0F;
+    refWhite[0] = whitePoint[0] / whitePoint[1] * refWhite[1];
+    refWhite[2] = (1.0F - whitePoint[0] - whitePoint[1]) / whitePoint[1] * refWhite[1];
+
+    auto *cielab = (TIFFCIELabToRGB *) malloc(sizeof(TIFFCIELabToRGB));
+    if (!cielab) {
+        return false;
+    }
+    if (TIFFCIELabToRGBInit(cielab, &displaySRGB, refWhite) < 0) {
+        free(cielab);
+        return false;
+    }
+
+    int range = cielab->range;
+    labColors = (unsigned char *) malloc(3 * (range + 1));
+    if (bitsPerSample == 8) {
+        labTables = (float *) malloc(sizeof(float) * (2 * 65536 + 256));
+    }
+    if (!labColors || (bitsPerSample == 8 && !labTables)) {
+        free(cielab);
+        return false;
+    }
+
+    const float *curves[3] = {cielab->Yr2r, cielab->Yg2g, cielab->Yb2b};
+    const uint32 white[3] = {cielab->display.d_Vrwr, cielab->display.d_Vrwg, cielab->display.d_Vrwb};
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i <= range; i++) {
+            float v = curves[c][i];
+            auto color = (uint32) (v > 0 ? v + 0.5 : v - 0.5);
+            labColors[c * (range + 1) + i] = (unsigned char) (color < white[c] ? color : white[c]);
+        }
+        xyzToRGB.colors[c] = labColors + c * (range + 1);
+    }
+    memcpy(xyzToRGB.matrix, cielab->display.d_mat, sizeof(xyzToRGB.matrix));
+    xyzToRGB.minLuminance[0] = cielab->display.d_Y0R;
+    xyzToRGB.minLuminance[1] = cielab->display.d_Y0G;
+    xyzToRGB.minLuminance[2] = cielab->display.d_Y0B;
+    xyzToRGB.maxLuminance[0] = cielab->display.d_YCR;
+    xyzToRGB.maxLuminance[1] = cielab->display.d_YCG;
+    xyzToRGB.maxLuminance[2] = cielab->display.d_YCB;
+    xyzToRGB.step[0] = cielab->rstep;
+    xyzToRGB.step[1] = cielab->gstep;
+    xyzToRGB.step[2] = cielab->bstep;
+    xyzToRGB.range = range;
+    labWhite[0] = cielab->X0;
+    labWhite[1] = cielab->Y0;
+    labWhite[2] = cielab->Z0;
+
+    if (labTables) {
+        float *tableX = labTables;
+        float *tableZ = labTables + 65536;
+        float *tableY = labTables + 2 * 65536;
+        for (uint32 l = 0; l < 256; l++) {
+            for (uint32 v = 0; v < 256; v++) {
+                float x, y, z;
+                TIFFCIELabToXYZ(cielab, l, (signed char) v, (signed char) v, &x, &y, &z);
+                tableX[(l << 8) | v] = x;
+                tableZ[(l << 8) | v] = z;
+                tableY[l] = y;
+            }
+        }
+    }
+    free(cielab);
+    return true;
+}
+
+bool NativeRawReader::loadBlock(uint32 index) {
+    if (cachedBlock == index) {
+        return true;
+    }
+    tmsize_t read;
+    if (readsPlanes()) {
+        //index is block of the first plane, blocks of other planes follow after all blocks of previous ones
+        uint32 blocksPerPlane = (tiled ? TIFFNumberOfTiles(image) : TIFFNumberOfStrips(image)) / samplesPerPixel;
+        read = 0;
+        for (uint32 p = 0; p < planeCount && read >= 0; p++) {
+            uint32 planeIndex = index + planeSamples[p] * blocksPerPlane;
+            unsigned char *plane = block + p * blockBufferSize;
+            if (tiled) {
+                read = TIFFReadEncodedTile(image, planeIndex, plane, blockBufferSize);
+            } else {
+                read = TIFFReadEncodedStrip(image, planeIndex, plane, blockBufferSize);
+            }
+        }
+    } else if (tiled) {
+        read = TIFFReadEncodedTile(image, index, block, blockBufferSize);
+    } else {
+        read = TIFFReadEncodedStrip(image, index, block, blockBufferSize);
+    }
+    if (read < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeRawReader", "%s %d", "Can\'t read block", index);
+        cachedBlock = -1;
+        return false;
+    }
+    cachedBlock = index;
+    return true;
+}
+
+const float *NativeRawReader::floatSamples(const unsigned char *src, uint32 count) {
+    if (bitsPerSample == 16) {
+        pixels_half_to_float((const uint16 *) src, floatRow, count);
+        return floatRow;
+    }
+    return (const float *) src;
+}
+
+void NativeRawReader::convertRow(const unsigned char *src, uint32 firstBit, uint32 count, uint32 *dst) {
+    switch (sampleKind) {
+        case SAMPLES_INDEXED:
+            pixels_indexed_to_abgr(src, firstBit, bitsPerSample, indexTable, dst, count);
+            return;
+        case SAMPLES_RGB:
+            pixels_rgb_to_abgr(src, dst, count);
+            return;
+        case SAMPLES_CMYK:
+            if (inkLimit > 0) {
+                pixels_cmyk_limited_to_abgr(src, samplesPerPixel, inkLimit, dst, count);
+            } else {
+                pixels_cmyk_to_abgr(src, samplesPerPixel, dst, count);
+            }
+            return;
+        case SAMPLES_LAB: {
+            float *x = floatRow;
+            float *y = floatRow + blockWidth;
+            float *z = floatRow + 2 * blockWidth;
+            if (bitsPerSample == 8) {
+                pixels_lab8_to_xyz(src, labTables, labTables + 2 * 65536, labTables + 65536, x, y, z, count);
+            } else {
+                pixels_lab16_to_xyz((const uint16 *) src, labWhite, x, y, z, count);
+            }
+            pixels_xyz_to_abgr(x, y, z, &xyzToRGB, dst, count);
+            return;
+        }
+        case SAMPLES_PLANAR:
+            convertPlanes(src, count, dst);
+            return;
+        case SAMPLES_BANDS: {
+            if (readsPlanes()) {
+                convertPlanes(src, count, dst);
+                return;
+            }
+            if (bitsPerSample == 16) {
+                pixels_u16_to_u8((const uint16 *) src, byteRow, count * samplesPerPixel);
+                src = byteRow;
+            }
+            int32_t offsets[4];
+            for (int c = 0; c < 4; c++) {
+                offsets[c] = bandSamples[c];
+            }
+            pixels_gather_to_abgr(src, samplesPerPixel, offsets, dst, count);
+            if (premultiplyBands) {
+                pixels_premultiply_abgr(dst, count);
+            }
+            return;
+        }
+        default:
+            break;
+    }
+
+    uint32 samples = count * samplesPerPixel;
+    const float *values = floatSamples(src, samples);
+    pixels_float_to_byte(values, byteRow, samples, floatMin, floatScale);
+
+    if (samplesPerPixel == 1) {
+        pixels_gray_to_abgr(byteRow, dst, count);
+    } else if (samplesPerPixel == 3 && colorChannels == 3) {
+        pixels_rgb_to_abgr(byteRow, dst, count);
+    } else {
+        const unsigned char *px = byteRow;
+        for (uint32 i = 0; i < count; i++, px += samplesPerPixel) {
+            if (colorChannels == 3) {
+                dst[i] = 0xFF000000 | (px[2] << 16) | (px[1] << 8) | px[0];
+            } else {
+                dst[i] = 0xFF000000 | (px[0] * 0x010101u);
+            }
+        }
+    }
+
+    //Alpha is not a part of value range, it is expected to be in 0..1
+    if (alphaIndex >= 0) {
+        const float *a = values + alphaIndex;
+        for (uint32 i = 0; i < count; i++, a += samplesPerPixel) {
+            float v = *a * 255.f;
+            uint32 alpha = v > 0.f ? (v < 255.f ? (uint32) (v + 0.5f) : 255) : 0;
+            dst[i] = (dst[i] & 0x00FFFFFF) | (alpha << 24);
+        }
+    }
+
+    if (photometric == PHOTOMETRIC_MINISWHITE) {
+        for (uint32 i = 0; i < count; i++) {
+            dst[i] ^= 0x00FFFFFF;
+        }
+    }
+}
+
+//src points to the first sample of row in the first plane, samples of other planes are at the same offsets
+void NativeRawReader::convertPlanes(const unsigned char *src, uint32 count, uint32 *dst) {
+    const unsigned char *planes[4];
+    for (uint32 p = 0; p < planeCount; p++) {
+        planes[p] = src + p * blockBufferSize;
+        if (bitsPerSample == 16) {
+            unsigned char *bytes = byteRow + p * blockWidth;
+            pixels_u16_to_u8((const uint16 *) planes[p], bytes, count);
+            planes[p] = bytes;
+        }
+    }
+    const unsigned char *alpha = bandPlanes[3] >= 0 ? planes[bandPlanes[3]] : nullptr;
+    if (alphaOnly) {
+        pixels_alpha_to_abgr(alpha, dst, count);
+        return;
+    }
+    pixels_planes_to_abgr(planes[bandPlanes[0]], planes[bandPlanes[1]], planes[bandPlanes[2]], alpha, dst, count);
+    if (alpha && premultiplyBands) {
+        pixels_premultiply_abgr(dst, count);
+    }
+}
+
+bool NativeRawReader::computeFloatRange() {
+    float mn = FLT_MAX;
+    float mx = -FLT_MAX;
+    uint32 blocksAcross = tiled ? (width + blockWidth - 1) / blockWidth : 1;
+    uint32 blockCount = tiled ? TIFFNumberOfTiles(image) : TIFFNumberOfStrips(image);
+    for (uint32 index = 0; index < blockCount; index++) {
+        if (!loadBlock(index)) {
+            return false;
+        }
+        uint32 bx = (index % blocksAcross) * blockWidth;
+        uint32 by = (index / blocksAcross) * blockHeight;
+        if (bx >= width || by >= height) {
+            continue;
+        }
+        uint32 cols = width - bx < blockWidth ? width - bx : blockWidth;
+        uint32 rows = height - by < blockHeight ? height - by : blockHeight;
+        tmsize_t rowBytes = (tmsize_t) blockWidth * samplesPerPixel * (bitsPerSample / 8);
+        for (uint32 row = 0; row < rows; row++) {
+            const float *values = floatSamples(block + row * rowBytes, cols * samplesPerPixel);
+            if (samplesPerPixel == colorChannels) {
+                pixels_float_min_max(values, cols * samplesPerPixel, &mn, &mx);
+            } else {
+                //leave only color samples. floatRow may be the same as values, but gathering goes forward
+                uint32 n = 0;
+                for (uint32 i = 0; i < cols; i++) {
+                    for (int c = 0; c < colorChannels; c++) {
+                        floatRow[n++] = values[i * samplesPerPixel + c];
+                    }
+                }
+                pixels_float_min_max(floatRow, n, &mn, &mx);
+            }
+        }
+    }
+    if (mn > mx) {
+        //no finite values
+        mn = 0.f;
+        mx = 1.f;
+    }
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeRawReader", "%s %f %f", "float range", mn, mx);
+    setFloatRange(mn, mx);
+    return true;
+}
+
+void NativeRawReader::setFloatRange(float min, float max) {
+    floatMin = min;
+    floatMax = max;
+    floatScale = max > min ? 255.f / (max - min) : 0.f;
+}
+
+void NativeRawReader::setInkLimit(int percent) {
+    if (percent <= 0) {
+        inkLimit = 0;
+        return;
+    }
+    if (percent < 100) {
+        percent = 100;
+    } else if (percent > 400) {
+        percent = 400;
+    }
+    inkLimit = (uint32) percent * 255 / 100;
+}
+
+float NativeRawReader::getFloatMin() const {
+    return floatMin;
+}
+
+float NativeRawReader::getFloatMax() const {
+    return floatMax;
+}
+
+int NativeRawReader::readRows(uint32 x, uint32 y, uint32 w, uint32 h, uint32 *dst, long rowStep, bool mirror) {
+    uint32 startY = y - y % blockHeight;
+    uint32 startX = x - x % blockWidth;
+    //planes hold one sample of each pixel
+    uint32 pixelBits = readsPlanes() ? bitsPerSample : samplesPerPixel * bitsPerSample;
+    //rows of packed samples are padded to whole bytes
+    tmsize_t rowBytes = ((tmsize_t) blockWidth * pixelBits + 7) / 8;
+    for (uint32 by = startY; by < y + h && by < height; by += blockHeight) {
+        for (uint32 bx = startX; bx < x + w && bx < width; bx += blockWidth) {
+            uint32 index = tiled ? TIFFComputeTile(image, bx, by, 0, 0) : TIFFComputeStrip(image, by, 0);
+            if (!loadBlock(index)) {
+                return 0;
+            }
+            uint32 y0 = by > y ? by : y;
+            uint32 y1 = by + blockHeight < y + h ? by + blockHeight : y + h;
+            if (y1 > height) y1 = height;
+            uint32 x0 = bx > x ? bx : x;
+            uint32 x1 = bx + blockWidth < x + w ? bx + blockWidth : x + w;
+            if (x1 > width) x1 = width;
+            uint32 count = x1 - x0;
+            for (uint32 yy = y0; yy < y1; yy++) {
+                uint32 firstBit = (x0 - bx) * pixelBits;
+                const unsigned char *src = block + (yy - by) * rowBytes + firstBit / 8;
+                uint32 *out = dst + (long) (yy - y) * rowStep;
+                if (!mirror) {
+                    convertRow(src, firstBit % 8, count, out + (x0 - x));
+                } else {
+                    convertRow(src, firstBit % 8, count, pixelRow);
+                    uint32 *mirrored = out + (w - 1 - (x0 - x));
+                    for (uint32 i = 0; i < count; i++) {
+                        *(mirrored - i) = pixelRow[i];
+                    }
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+//Same flips as libtiff applies for requested orientation
+int NativeRawReader::flipFor(int fileOrientation, int requestedOrientation) {
+    if (fileOrientation < ORIENTATION_TOPLEFT || fileOrientation > ORIENTATION_LEFTBOT) {
+        return 0;
+    }
+    static const bool top[] = {false, true, true, false, false, true, true, false, false};
+    static const bool left[] = {false, true, false, false, true, true, false, false, true};
+    int flip = 0;
+    if (top[fileOrientation] != top[requestedOrientation]) flip |= FLIP_VERTICALLY;
+    if (left[fileOrientation] != left[requestedOrientation]) flip |= FLIP_HORIZONTALLY;
+    return flip;
+}
+
+int NativeRawReader::readRGBAStrip(uint32 row, uint32 *raster) {
+    if (row % blockHeight != 0) {
+        return 0;
+    }
+    uint32 rows = height - row < blockHeight ? height - row : blockHeight;
+    int flip = flipFor(orientation, ORIENTATION_BOTLEFT);
+    uint32 *dst = raster;
+    long step = width;
+    if (flip & FLIP_VERTICALLY) {
+        dst = raster + (rows - 1) * width;
+        step = -step;
+    }
+    return readRows(0, row, width, rows, dst, step, (flip & FLIP_HORIZONTALLY) != 0);
+}
+
+int NativeRawReader::readRGBATile(uint32 col, uint32 row, uint32 *raster) {
+    if (!tiled || col % blockWidth != 0 || row % blockHeight != 0) {
+        return 0;
+    }
+    uint32 readWidth = width - col < blockWidth ? width - col : blockWidth;
+    uint32 readHeight = height - row < blockHeight ? height - row : blockHeight;
+    if (readWidth != blockWidth || readHeight != blockHeight) {
+        memset(raster, 0, sizeof(uint32) * blockWidth * blockHeight);
+    }
+    //libtiff moves rows of partial tile to the bottom of raster
+    uint32 *base = raster + (blockHeight - readHeight) * blockWidth;
+    int flip = flipFor(orientation, ORIENTATION_BOTLEFT);
+    uint32 *dst = base;
+    long step = blockWidth;
+    if (flip & FLIP_VERTICALLY) {
+        dst = base + (readHeight - 1) * blockWidth;
+        step = -step;
+    }
+    return readRows(col, row, readWidth, readHeight, dst, step, (flip & FLIP_HORIZONTALLY) != 0);
+}
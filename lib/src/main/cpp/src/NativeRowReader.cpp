@@ -0,0 +1,317 @@
+//
+// Sources of decoded rows for streaming decode.
+//
+
+#include "NativeRowReader.h"
+
+NativeRowReader::NativeRowReader(TIFF *tiff, uint32 startX, uint32 w) {
+    image = tiff;
+    x = startX;
+    width = w;
+}
+
+NativeRowReader::~NativeRowReader() {
+}
+
+uint32 NativeRowReader::getX() const {
+    return x;
+}
+
+uint32 NativeRowReader::getWidth() const {
+    return width;
+}
+
+bool NativeRowReader::canSkipRows() const {
+    return false;
+}
+
+unsigned long NativeRowReader::maxRawBlockSize(TIFF *tiff) {
+    unsigned long maxRaw = 0;
+    uint32 count = TIFFIsTiled(tiff) ? TIFFNumberOfTiles(tiff) : TIFFNumberOfStrips(tiff);
+    for (uint32 i = 0; i < count; i++) {
+        unsigned long raw = TIFFGetStrileByteCount(tiff, i);
+        if (raw > maxRaw) maxRaw = raw;
+    }
+    return maxRaw;
+}
+
+NativeRGBARowReader::NativeRGBARowReader(TIFF *tiff, uint32 startX, uint32 w) : NativeRowReader(tiff, startX, w) {
+    memset(&img, 0, sizeof(img));
+    started = false;
+    useColumnOffset = canUseColumnOffset(tiff);
+    imageWidth = 0;
+    TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &imageWidth);
+    wideRows = nullptr;
+}
+
+NativeRGBARowReader::~NativeRGBARowReader() {
+    if (started) {
+        TIFFRGBAImageEnd(&img);
+        started = false;
+    }
+    if (wideRows) {
+        _TIFFfree(wideRows);
+        wideRows = nullptr;
+    }
+}
+
+bool NativeRGBARowReader::canUseColumnOffset(TIFF *tiff) {
+    uint16 bitsPerSample = 1;
+    uint16 photometric = 0;
+    uint16 planarConfig = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+    //YCbCr samples are packed in subsampling blocks, so offset in samples doesn't point to the column.
+    //Separate planes are read from wrong columns by libtiff when column offset is set
+    return bitsPerSample == 8 && photometric != PHOTOMETRIC_YCBCR && planarConfig == PLANARCONFIG_CONTIG;
+}
+
+unsigned long NativeRGBARowReader::estimateMemory(TIFF *tiff, uint32 w, uint32 rows) {
+    uint32 imgWidth = 0;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imgWidth);
+    unsigned long mem = 0;
+    if (!canUseColumnOffset(tiff) && w < imgWidth) {
+        mem += (unsigned long) imgWidth * rows * sizeof(uint32); //full width rows that are cropped to window
+    }
+
+    //libtiff allocates one decoded strip or tile and reads raw data of it
+    mem += maxRawBlockSize(tiff);
+    mem += TIFFIsTiled(tiff) ? TIFFTileSize(tiff) : TIFFStripSize(tiff);
+    return mem;
+}
+
+const char *NativeRGBARowReader::begin(uint32 maxRows) {
+    char emsg[1024];
+    if (!TIFFRGBAImageOK(image, emsg) || !TIFFRGBAImageBegin(&img, image, 0, emsg)) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeRowReader", "%s", emsg);
+        return "Can\'t start reading of RGBA rows";
+    }
+    started = true;
+    //Keep rows in file order
+    img.req_orientation = img.orientation;
+
+    if (!useColumnOffset && width < imageWidth) {
+        wideRows = (uint32 *) _TIFFmalloc((tmsize_t) imageWidth * maxRows * sizeof(uint32));
+        if (!wideRows) {
+            return "Can\'t allocate memory for rows";
+        }
+    }
+    return nullptr;
+}
+
+bool NativeRGBARowReader::readRows(uint32 y, uint32 count, uint32 *dst) {
+    img.row_offset = y;
+    if (!wideRows) {
+        img.col_offset = useColumnOffset ? x : 0;
+        return TIFFRGBAImageGet(&img, dst, width, count) != 0;
+    }
+
+    img.col_offset = 0;
+    if (!TIFFRGBAImageGet(&img, wideRows, imageWidth, count)) {
+        return false;
+    }
+    for (uint32 i = 0; i < count; i++) {
+        memcpy(dst + (size_t) i * width, wideRows + (size_t) i * imageWidth + x, width * sizeof(uint32));
+    }
+    return true;
+}
+
+NativeScanlineRowReader::NativeScanlineRowReader(TIFF *tiff, uint32 startX, uint32 w) : NativeRowReader(tiff, startX, w) {
+    memset(&img, 0, sizeof(img));
+    started = false;
+    imageWidth = 0;
+    TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &imageWidth);
+    rowsPerStrip = 0;
+    TIFFGetFieldDefaulted(image, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+    nextRow = 0;
+    offset = -1;
+    scanline = nullptr;
+    scanlineSize = 0;
+    wideRow = nullptr;
+
+    directRows = hasDirectRows(tiff);
+    bitsPerSample = 1;
+    TIFFGetFieldDefaulted(image, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    uint16 fillOrder = FILLORDER_MSB2LSB;
+    TIFFGetFieldDefaulted(image, TIFFTAG_FILLORDER, &fillOrder);
+    reverseBits = fillOrder == FILLORDER_LSB2MSB;
+}
+
+NativeScanlineRowReader::~NativeScanlineRowReader() {
+    if (started) {
+        TIFFRGBAImageEnd(&img);
+        started = false;
+    }
+    if (scanline) {
+        _TIFFfree(scanline);
+        scanline = nullptr;
+    }
+    if (wideRow) {
+        _TIFFfree(wideRow);
+        wideRow = nullptr;
+    }
+}
+
+bool NativeScanlineRowReader::canRead(TIFF *tiff) {
+    if (TIFFIsTiled(tiff)) {
+        return false;
+    }
+    uint16 planarConfig = PLANARCONFIG_CONTIG;
+    uint16 photometric = 0;
+    uint16 compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &planarConfig);
+    TIFFGetField(tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+    if (planarConfig != PLANARCONFIG_CONTIG) {
+        return false;
+    }
+    return photometric != PHOTOMETRIC_YCBCR || compression == COMPRESSION_JPEG;
+}
+
+bool NativeScanlineRowReader::hasDirectRows(TIFF *tiff) {
+    uint16 compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_COMPRESSION, &compression);
+    return compression == COMPRESSION_NONE && canRead(tiff);
+}
+
+bool NativeScanlineRowReader::canSkipRows() const {
+    return directRows;
+}
+
+tmsize_t NativeScanlineRowReader::columnOffset(TIFF *tiff, uint32 startX) {
+    uint16 bitsPerSample = 1;
+    uint16 samplesPerPixel = 1;
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    if (bitsPerSample % 8 != 0) {
+        return startX == 0 ? 0 : -1;
+    }
+    return (tmsize_t) startX * samplesPerPixel * (bitsPerSample / 8);
+}
+
+unsigned long NativeScanlineRowReader::estimateMemory(TIFF *tiff, uint32 w) {
+    uint32 imgWidth = 0;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &imgWidth);
+    unsigned long mem = TIFFScanlineSize(tiff);
+    if (w < imgWidth) {
+        //window that starts inside of byte is converted in full width and cropped.
+        //Start of window is not known here, so count the worst case
+        uint16 bitsPerSample = 1;
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+        if (bitsPerSample % 8 != 0) {
+            mem += (unsigned long) imgWidth * sizeof(uint32);
+        }
+    }
+    if (!hasDirectRows(tiff)) {
+        //libtiff reads raw data of whole strip
+        mem += maxRawBlockSize(tiff);
+    }
+    return mem;
+}
+
+const char *NativeScanlineRowReader::begin(uint32 maxRows) {
+    char emsg[1024];
+    if (!TIFFRGBAImageOK(image, emsg) || !TIFFRGBAImageBegin(&img, image, 0, emsg)) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeRowReader", "%s", emsg);
+        return "Can't start reading of RGBA rows";
+    }
+    started = true;
+    if (!img.isContig || !img.put.contig) {
+        return "Can't convert scanlines of image";
+    }
+
+    //size of scanline is known after TIFFRGBAImageBegin which could switch jpeg color mode to RGB
+    scanlineSize = TIFFScanlineSize(image);
+    scanline = (unsigned char *) _TIFFmalloc(scanlineSize);
+    if (!scanline) {
+        return "Can't allocate memory for scanline";
+    }
+    offset = columnOffset(image, x);
+    if (offset < 0) {
+        wideRow = (uint32 *) _TIFFmalloc((tmsize_t) imageWidth * sizeof(uint32));
+        if (!wideRow) {
+            return "Can't allocate memory for rows";
+        }
+    }
+    return nullptr;
+}
+
+const unsigned char *NativeScanlineRowReader::readScanline(uint32 row) {
+    if (directRows) {
+        return readDirectRow(row) ? scanline : nullptr;
+    }
+    //compressed rows could be decoded only one after another from the beginning of strip
+    uint32 stripStart = rowsPerStrip > 0 ? row - row % rowsPerStrip : 0;
+    if (nextRow > row || nextRow < stripStart) {
+        nextRow = stripStart;
+    }
+    for (; nextRow <= row; nextRow++) {
+        if (TIFFReadScanline(image, scanline, nextRow, 0) < 0) {
+            return nullptr;
+        }
+    }
+    return scanline;
+}
+
+bool NativeScanlineRowReader::readRows(uint32 y, uint32 count, uint32 *dst) {
+    for (uint32 i = 0; i < count; i++) {
+        uint32 row = y + i;
+        if (!readScanline(row)) {
+            return false;
+        }
+
+        uint32 *line = dst + (size_t) i * width;
+        if (wideRow) {
+            (*img.put.contig)(&img, wideRow, 0, row, imageWidth, 1, 0, 0, scanline);
+            memcpy(line, wideRow + x, width * sizeof(uint32));
+        } else {
+            (*img.put.contig)(&img, line, 0, row, width, 1, 0, 0, scanline + offset);
+        }
+    }
+    return true;
+}
+
+bool NativeScanlineRowReader::readDirectRow(uint32 row) {
+    uint32 strip = rowsPerStrip > 0 ? row / rowsPerStrip : 0;
+    toff_t rowInStrip = rowsPerStrip > 0 ? row % rowsPerStrip : row;
+    if ((rowInStrip + 1) * scanlineSize > TIFFGetStrileByteCount(image, strip)) {
+        __android_log_print(ANDROID_LOG_ERROR, "NativeRowReader", "Strip %u is too short for row %u", strip, row);
+        return false;
+    }
+    toff_t rowOffset = TIFFGetStrileOffset(image, strip) + rowInStrip * scanlineSize;
+    thandle_t handle = TIFFClientdata(image);
+    if (TIFFGetSeekProc(image)(handle, rowOffset, SEEK_SET) != rowOffset
+        || TIFFGetReadProc(image)(handle, scanline, scanlineSize) != scanlineSize) {
+        return false;
+    }
+
+    //the same post processing as libtiff applies to uncompressed data
+    if (reverseBits) {
+        TIFFReverseBits(scanline, scanlineSize);
+    }
+    if (TIFFIsByteSwapped(image)) {
+        if (bitsPerSample == 16) {
+            TIFFSwabArrayOfShort((uint16 *) scanline, scanlineSize / 2);
+        } else if (bitsPerSample == 32) {
+            TIFFSwabArrayOfLong((uint32 *) scanline, scanlineSize / 4);
+        }
+    }
+    return true;
+}
+
+NativeRawRowReader::NativeRawRowReader(TIFF *tiff, NativeRawReader *reader, uint32 startX, uint32 w) : NativeRowReader(tiff, startX, w) {
+    rawReader = reader;
+}
+
+const char *NativeRawRowReader::begin(uint32 maxRows) {
+    return nullptr;
+}
+
+bool NativeRawRowReader::readRows(uint32 y, uint32 count, uint32 *dst) {
+    return rawReader->readRows(x, y, width, count, dst, width, false) != 0;
+}
+
+bool NativeRawRowReader::canSkipRows() const {
+    return !TIFFIsTiled(image);
+}
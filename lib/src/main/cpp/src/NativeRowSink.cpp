@@ -0,0 +1,533 @@
+//
+// Consumers of decoded rows for streaming decode.
+//
+
+#include "NativeRowSink.h"
+#include <cstring>
+#include "NativePixelKernels.h"
+
+NativeOrientationMap::NativeOrientationMap(uint32 w, uint32 h, int o) {
+    width = w;
+    height = h;
+    orientation = (o < ORIENTATION_TOPLEFT || o > ORIENTATION_LEFTBOT) ? ORIENTATION_TOPLEFT : o;
+}
+
+uint32 NativeOrientationMap::getDisplayWidth() const {
+    return orientation > ORIENTATION_BOTLEFT ? height : width;
+}
+
+uint32 NativeOrientationMap::getDisplayHeight() const {
+    return orientation > ORIENTATION_BOTLEFT ? width : height;
+}
+
+int NativeOrientationMap::getOrientation() const {
+    return orientation;
+}
+
+void NativeOrientationMap::rowPlacement(uint32 y, long *offset, long *step) const {
+    long w = width;
+    long h = height;
+    //for orientations 5-8 rows of file become columns of display raster which has width h
+    switch (orientation) {
+        case ORIENTATION_TOPRIGHT:
+            *offset = y * w + w - 1;
+            *step = -1;
+            break;
+        case ORIENTATION_BOTRIGHT:
+            *offset = (h - 1 - y) * w + w - 1;
+            *step = -1;
+            break;
+        case ORIENTATION_BOTLEFT:
+            *offset = (h - 1 - y) * w;
+            *step = 1;
+            break;
+        case ORIENTATION_LEFTTOP:
+            *offset = y;
+            *step = h;
+            break;
+        case ORIENTATION_RIGHTTOP:
+            *offset = h - 1 - y;
+            *step = h;
+            break;
+        case ORIENTATION_RIGHTBOT:
+            *offset = (w - 1) * h + h - 1 - y;
+            *step = -h;
+            break;
+        case ORIENTATION_LEFTBOT:
+            *offset = (w - 1) * h + y;
+            *step = -h;
+            break;
+        default:
+            *offset = y * w;
+            *step = 1;
+            break;
+    }
+}
+
+NativeRowSink::~NativeRowSink() {
+}
+
+NativeRasterSink::NativeRasterSink(jint *r, uint32 w, uint32 h, int orientation) : map(w, h, orientation) {
+    raster = r;
+    width = w;
+}
+
+bool NativeRasterSink::writeRow(uint32 y, const uint32 *row) {
+    long offset, step;
+    map.rowPlacement(y, &offset, &step);
+    if (step == 1) {
+        memcpy(raster + offset, row, width * sizeof(uint32));
+        return true;
+    }
+    jint *dst = raster + offset;
+    for (uint32 x = 0; x < width; x++, dst += step) {
+        *dst = row[x];
+    }
+    return true;
+}
+
+int NativeBufferSink::bytesPerPixel(int format) {
+    switch (format) {
+        case FORMAT_ARGB:
+        case FORMAT_RGBA:
+            return 4;
+        case FORMAT_RGB:
+        case FORMAT_BGR:
+            return 3;
+        case FORMAT_GRAY_8:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+NativeBufferSink::NativeBufferSink(uint8_t *b, long stride, int f, uint32 w, uint32 h, int orientation, bool swap) : map(w, h, orientation) {
+    buffer = b;
+    rowStride = stride;
+    format = f;
+    pixelBytes = bytesPerPixel(f);
+    width = w;
+    swapRedBlue = swap;
+    swappedLine = nullptr;
+    convertedLine = nullptr;
+}
+
+NativeBufferSink::~NativeBufferSink() {
+    if (swappedLine) {
+        free(swappedLine);
+        swappedLine = nullptr;
+    }
+    if (convertedLine) {
+        free(convertedLine);
+        convertedLine = nullptr;
+    }
+}
+
+bool NativeBufferSink::init() {
+    if (swapRedBlue) {
+        swappedLine = (uint32 *) malloc(width * sizeof(uint32));
+        if (!swappedLine) return false;
+    }
+    convertedLine = (uint8_t *) malloc(width * pixelBytes);
+    return convertedLine != nullptr;
+}
+
+bool NativeBufferSink::writeRow(uint32 y, const uint32 *row) {
+    if (swapRedBlue) {
+        for (uint32 x = 0; x < width; x++) {
+            uint32 p = row[x];
+            swappedLine[x] = (p & 0xff00ff00) | ((p & 0x00ff0000) >> 16) | ((p & 0xff) << 16);
+        }
+        row = swappedLine;
+    }
+
+    //position of pixel in display image and distance to next one in bytes
+    long offset, step;
+    map.rowPlacement(y, &offset, &step);
+    long displayWidth = map.getDisplayWidth();
+    uint8_t *dst = buffer + (offset / displayWidth) * rowStride + (offset % displayWidth) * pixelBytes;
+    long byteStep = step == 1 || step == -1 ? step * pixelBytes : (step > 0 ? rowStride : -rowStride);
+
+    //rows that are not flipped are converted in place
+    uint8_t *line = byteStep == pixelBytes ? dst : convertedLine;
+    switch (format) {
+        case FORMAT_ARGB:
+            pixels_abgr_to_argb(row, line, width);
+            break;
+        case FORMAT_RGBA:
+            memcpy(line, row, width * sizeof(uint32));
+            break;
+        case FORMAT_RGB:
+            pixels_abgr_to_rgb(row, line, width);
+            break;
+        case FORMAT_BGR:
+            pixels_abgr_to_bgr(row, line, width);
+            break;
+        case FORMAT_GRAY_8:
+            pixels_abgr_to_gray(row, line, width);
+            break;
+        default:
+            return false;
+    }
+    if (line == dst) {
+        return true;
+    }
+
+    for (uint32 x = 0; x < width; x++, dst += byteStep) {
+        memcpy(dst, line + x * pixelBytes, pixelBytes);
+    }
+    return true;
+}
+
+jlong NativeYuvSink::bufferSize(int format, long rowStride, uint32 height) {
+    jlong chromaHeight = (height + 1) / 2;
+    switch (format) {
+        case FORMAT_I420:
+            return (jlong) rowStride * height + 2 * (jlong) (rowStride / 2) * chromaHeight;
+        case FORMAT_NV21:
+        case FORMAT_NV12:
+            return (jlong) rowStride * height + (jlong) rowStride * chromaHeight;
+        default:
+            return 0;
+    }
+}
+
+NativeYuvSink::NativeYuvSink(uint8_t *b, long stride, int format, uint32 w, uint32 h, int orientation, bool swap) : map(w, h, orientation) {
+    buffer = b;
+    rowStride = stride;
+    width = w;
+    swapRedBlue = swap;
+    uint8_t *chroma = b + stride * map.getDisplayHeight();
+    long chromaHeight = (map.getDisplayHeight() + 1) / 2;
+    switch (format) {
+        case FORMAT_NV21:
+            planeV = chroma;
+            planeU = chroma + 1;
+            chromaStride = stride;
+            chromaStep = 2;
+            break;
+        case FORMAT_NV12:
+            planeU = chroma;
+            planeV = chroma + 1;
+            chromaStride = stride;
+            chromaStep = 2;
+            break;
+        default:
+            chromaStride = stride / 2;
+            chromaStep = 1;
+            planeU = chroma;
+            planeV = chroma + chromaStride * chromaHeight;
+            break;
+    }
+    line = nullptr;
+    pendingLine = nullptr;
+    pending = -1;
+    luma = nullptr;
+    chromaU = nullptr;
+    chromaV = nullptr;
+}
+
+NativeYuvSink::~NativeYuvSink() {
+    if (line) {
+        free(line);
+        line = nullptr;
+    }
+    if (pendingLine) {
+        free(pendingLine);
+        pendingLine = nullptr;
+    }
+    if (luma) {
+        free(luma);
+        luma = nullptr;
+    }
+    chromaU = nullptr;
+    chromaV = nullptr;
+}
+
+unsigned long NativeYuvSink::getWorkingMemory(uint32 width) {
+    return 2UL * width * sizeof(uint32) + 2UL * width;
+}
+
+bool NativeYuvSink::init() {
+    line = (uint32 *) malloc(width * sizeof(uint32));
+    pendingLine = (uint32 *) malloc(width * sizeof(uint32));
+    //luma of line and both chroma lines of half width
+    luma = (uint8_t *) malloc(2 * width + 2);
+    if (!line || !pendingLine || !luma) return false;
+    chromaU = luma + width;
+    chromaV = chromaU + (width + 1) / 2;
+    return true;
+}
+
+bool NativeYuvSink::writeRow(uint32 y, const uint32 *row) {
+    //row of file is display line: row or column of display image with pixels in order of forward step or reversed
+    long position, step;
+    map.rowPlacement(y, &position, &step);
+    long displayWidth = map.getDisplayWidth();
+    bool alongX = step == 1 || step == -1;
+    long fixed = alongX ? position / displayWidth : position % displayWidth;
+    long lines = alongX ? map.getDisplayHeight() : displayWidth;
+
+    const uint32 *src = row;
+    if (step < 0 || swapRedBlue) {
+        for (uint32 x = 0; x < width; x++) {
+            uint32 p = row[step < 0 ? width - 1 - x : x];
+            if (swapRedBlue) {
+                p = (p & 0xff00ff00) | ((p & 0x00ff0000) >> 16) | ((p & 0xff) << 16);
+            }
+            line[x] = p;
+        }
+        src = line;
+    }
+
+    if (alongX) {
+        pixels_abgr_to_y(src, buffer + fixed * rowStride, width);
+    } else {
+        pixels_abgr_to_y(src, luma, width);
+        uint8_t *dst = buffer + fixed;
+        for (uint32 x = 0; x < width; x++, dst += rowStride) {
+            *dst = luma[x];
+        }
+    }
+
+    //chroma is written when both lines of pair have come. Lines come in display order or in reversed one
+    long partner = fixed ^ 1;
+    if (partner < lines && pending != partner) {
+        memcpy(pendingLine, src, width * sizeof(uint32));
+        pending = fixed;
+        return true;
+    }
+    pixels_abgr_to_uv(partner < lines ? pendingLine : src, src, width, chromaU, chromaV);
+    pending = -1;
+
+    uint32 count = (width + 1) / 2;
+    long chromaLine = fixed / 2;
+    uint8_t *dstU = alongX ? planeU + chromaLine * chromaStride : planeU + chromaLine * chromaStep;
+    uint8_t *dstV = alongX ? planeV + chromaLine * chromaStride : planeV + chromaLine * chromaStep;
+    long chromaNext = alongX ? chromaStep : chromaStride;
+    if (chromaNext == 1) {
+        memcpy(dstU, chromaU, count);
+        memcpy(dstV, chromaV, count);
+        return true;
+    }
+    for (uint32 i = 0; i < count; i++, dstU += chromaNext, dstV += chromaNext) {
+        *dstU = chromaU[i];
+        *dstV = chromaV[i];
+    }
+    return true;
+}
+
+int NativeTensorSink::bytesPerValue(int type) {
+    switch (type) {
+        case TYPE_FLOAT32:
+            return sizeof(float);
+        case TYPE_INT8:
+            return sizeof(int8_t);
+        default:
+            return 0;
+    }
+}
+
+NativeTensorSink::NativeTensorSink(uint8_t *t, int l, int tp, uint32 tw, uint32 th, int c, const float *mean, const float *std,
+                                   uint32 w, uint32 h, int orientation, bool swap) : map(w, h, orientation) {
+    tensor = t;
+    layout = l;
+    type = tp;
+    tensorWidth = tw;
+    tensorHeight = th;
+    channels = c;
+    //cells average pixels with weights that sum up to 1, so pixels are normalized before accumulation
+    for (int i = 0; i < 3; i++) {
+        scale[i] = i < c ? 1.f / std[i] : 0.f;
+        offset[i] = i < c ? -mean[i] / std[i] : 0.f;
+    }
+    width = w;
+    swapRedBlue = swap;
+    memset(&axisX, 0, sizeof(Axis));
+    memset(&axisY, 0, sizeof(Axis));
+    axisMemory = nullptr;
+    planes = nullptr;
+    values = nullptr;
+}
+
+NativeTensorSink::~NativeTensorSink() {
+    if (axisMemory) {
+        free(axisMemory);
+        axisMemory = nullptr;
+    }
+    if (planes) {
+        free(planes);
+        planes = nullptr;
+    }
+    if (values && type == TYPE_INT8) {
+        free(values);
+    }
+    values = nullptr;
+}
+
+unsigned long NativeTensorSink::getWorkingMemory() const {
+    unsigned long memory = 3UL * width * sizeof(float);
+    memory += (3UL * (tensorWidth + tensorHeight) + 2UL * (map.getDisplayWidth() + map.getDisplayHeight())) * sizeof(uint32);
+    if (type == TYPE_INT8) {
+        memory += (unsigned long) tensorWidth * tensorHeight * channels * sizeof(float);
+    }
+    return memory;
+}
+
+void NativeTensorSink::buildAxis(Axis *axis, uint32 cells, uint32 pixels) {
+    for (uint32 d = 0; d < pixels; d++) {
+        axis->first[d] = cells;
+        axis->stop[d] = 0;
+    }
+    for (uint32 t = 0; t < cells; t++) {
+        uint32 start = (uint32) ((uint64_t) t * pixels / cells);
+        uint32 end = (uint32) ((uint64_t) (t + 1) * pixels / cells);
+        //cells of upscaled axis take nearest pixel
+        if (end <= start) {
+            end = start + 1;
+        }
+        axis->start[t] = start;
+        axis->end[t] = end;
+        axis->weight[t] = 1.f / (end - start);
+        for (uint32 d = start; d < end; d++) {
+            if (axis->first[d] > t) axis->first[d] = t;
+            axis->stop[d] = t + 1;
+        }
+    }
+}
+
+bool NativeTensorSink::init() {
+    uint32 displayWidth = map.getDisplayWidth();
+    uint32 displayHeight = map.getDisplayHeight();
+    axisMemory = (uint32 *) malloc((3 * (tensorWidth + tensorHeight) + 2 * (displayWidth + displayHeight)) * sizeof(uint32));
+    if (!axisMemory) return false;
+    uint32 *ptr = axisMemory;
+    Axis *axes[2] = {&axisX, &axisY};
+    uint32 cells[2] = {tensorWidth, tensorHeight};
+    uint32 pixels[2] = {displayWidth, displayHeight};
+    for (int i = 0; i < 2; i++) {
+        axes[i]->start = ptr;
+        axes[i]->end = ptr + cells[i];
+        axes[i]->weight = (float *) (ptr + 2 * cells[i]);
+        axes[i]->first = ptr + 3 * cells[i];
+        axes[i]->stop = ptr + 3 * cells[i] + pixels[i];
+        ptr += 3 * cells[i] + 2 * pixels[i];
+        buildAxis(axes[i], cells[i], pixels[i]);
+    }
+
+    planes = (float *) malloc(3 * width * sizeof(float));
+    if (!planes) return false;
+
+    size_t count = (size_t) tensorWidth * tensorHeight * channels;
+    if (type == TYPE_INT8) {
+        values = (float *) calloc(count, sizeof(float));
+    } else {
+        //float tensor accumulates itself
+        values = (float *) tensor;
+        memset(values, 0, count * sizeof(float));
+    }
+    return values != nullptr;
+}
+
+bool NativeTensorSink::writeRow(uint32 y, const uint32 *row) {
+    //row of file is part of display row or display column: pixel x of it is at position first + x or first - x
+    //along run axis and at position fixed along cross axis
+    long position, step;
+    map.rowPlacement(y, &position, &step);
+    long displayWidth = map.getDisplayWidth();
+    bool alongX = step == 1 || step == -1;
+    long fixed = alongX ? position / displayWidth : position % displayWidth;
+    long first = alongX ? position % displayWidth : position / displayWidth;
+    bool forward = step > 0;
+    const Axis &run = alongX ? axisX : axisY;
+    const Axis &cross = alongX ? axisY : axisX;
+    uint32 runCells = alongX ? tensorWidth : tensorHeight;
+
+    float *r = planes;
+    float *g = planes + width;
+    float *b = planes + 2 * width;
+    if (swapRedBlue) {
+        pixels_abgr_to_float(row, b, g, r, width);
+    } else {
+        pixels_abgr_to_float(row, r, g, b, width);
+    }
+
+    size_t planeSize = (size_t) tensorWidth * tensorHeight;
+    uint32 crossFirst = cross.first[fixed];
+    uint32 crossStop = cross.stop[fixed];
+    for (uint32 t = 0; t < runCells; t++) {
+        uint32 x0, x1;
+        if (forward) {
+            x0 = run.start[t] - first;
+            x1 = run.end[t] - first;
+        } else {
+            x0 = first + 1 - run.end[t];
+            x1 = first + 1 - run.start[t];
+        }
+        float sr = 0.f, sg = 0.f, sb = 0.f;
+        for (uint32 x = x0; x < x1; x++) {
+            sr += r[x];
+            sg += g[x];
+            sb += b[x];
+        }
+
+        float n = run.weight[t];
+        float v[3];
+        if (channels == 1) {
+            v[0] = (0.2125f * sr + 0.7154f * sg + 0.0721f * sb) * n * scale[0] + offset[0];
+        } else {
+            v[0] = sr * n * scale[0] + offset[0];
+            v[1] = sg * n * scale[1] + offset[1];
+            v[2] = sb * n * scale[2] + offset[2];
+        }
+
+        for (uint32 f = crossFirst; f < crossStop; f++) {
+            float w = cross.weight[f];
+            size_t cell = alongX ? (size_t) f * tensorWidth + t : (size_t) t * tensorWidth + f;
+            if (layout == LAYOUT_NHWC) {
+                float *dst = values + cell * channels;
+                for (int c = 0; c < channels; c++) {
+                    dst[c] += v[c] * w;
+                }
+            } else {
+                for (int c = 0; c < channels; c++) {
+                    values[c * planeSize + cell] += v[c] * w;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void NativeTensorSink::finish() {
+    if (type == TYPE_INT8) {
+        pixels_float_to_int8(values, (int8_t *) tensor, (uint32_t) ((size_t) tensorWidth * tensorHeight * channels));
+    }
+}
+
+NativeBandSink::NativeBandSink(uint32 *b, uint32 w, uint32 rows, uint32 total, bool m, Consumer c, void *ctx) {
+    band = b;
+    width = w;
+    bandRows = rows;
+    totalRows = total;
+    mirror = m;
+    consumer = c;
+    context = ctx;
+}
+
+bool NativeBandSink::writeRow(uint32 y, const uint32 *row) {
+    uint32 firstRow = y - y % bandRows;
+    uint32 *dst = band + (size_t) (y - firstRow) * width;
+    if (mirror) {
+        for (uint32 x = 0; x < width; x++) {
+            dst[x] = row[width - 1 - x];
+        }
+    } else {
+        memcpy(dst, row, width * sizeof(uint32));
+    }
+
+    if (y + 1 - firstRow == bandRows || y + 1 == totalRows) {
+        return consumer(context, firstRow, y + 1 - firstRow);
+    }
+    return true;
+}
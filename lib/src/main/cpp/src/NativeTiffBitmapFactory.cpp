@@ -17,6 +17,50 @@ JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeFD
     return java_bitmap;
 }
 
+JNIEXPORT jboolean
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeBandsFD
+        (JNIEnv *env, jclass clazz, jint fd, jobject options, jint bandHeight, jobject bandListener, jlong bandCallback, jlong bandCallbackData, jobject listener) {
+
+    auto *decoder = new NativeDecoder(env, clazz, fd, options, listener);
+    jboolean result = decoder->decodeBands(bandHeight, bandListener, bandCallback, bandCallbackData);
+    delete(decoder);
+
+    return result;
+}
+
+JNIEXPORT jboolean
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeIntoFD
+        (JNIEnv *env, jclass clazz, jint fd, jobject options, jobject buffer, jint rowStride, jint pixelFormat, jobject listener) {
+
+    auto *decoder = new NativeDecoder(env, clazz, fd, options, listener);
+    jboolean result = decoder->decodeInto(buffer, rowStride, pixelFormat);
+    delete(decoder);
+
+    return result;
+}
+
+JNIEXPORT jboolean
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeYuvFD
+        (JNIEnv *env, jclass clazz, jint fd, jobject options, jobject buffer, jint rowStride, jint yuvFormat, jobject listener) {
+
+    auto *decoder = new NativeDecoder(env, clazz, fd, options, listener);
+    jboolean result = decoder->decodeYuv(buffer, rowStride, yuvFormat);
+    delete(decoder);
+
+    return result;
+}
+
+JNIEXPORT jboolean
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_nativeDecodeTensorFD
+        (JNIEnv *env, jclass clazz, jint fd, jobject options, jobject buffer, jint width, jint height, jint layout, jint type, jfloatArray mean, jfloatArray std, jobject listener) {
+
+    auto *decoder = new NativeDecoder(env, clazz, fd, options, listener);
+    jboolean result = decoder->decodeTensor(buffer, width, height, layout, type, mean, std);
+    delete(decoder);
+
+    return result;
+}
+
 JNIEXPORT void
 JNICALL Java_org_beyka_tiffbitmapfactory_TiffBitmapFactory_closeFd
         (JNIEnv *env, jclass clazz, jint fd) {
@@ -8,94 +8,250 @@ extern "C" {
     #endif
 
     #include "NativeTiffSaver.h"
+    #include "NativePageEncoder.h"
     #include <string.h>
 
-    int const colorMask = 0xFF;
-
     int const paramCompression = 0;
     int const paramOrientation = 1;
 
+    //Size of band of converted rows that is written at once
+    size_t const bandBytes = 1024 * 1024;
+
     JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffSaver_save
     (JNIEnv *env, jclass clazz, jstring filePath, jint fileDescriptor, jobject bitmap, jobject options, jboolean append) {
+        NativeTiffOutput output;
+        output.fd = fileDescriptor;
+        output.append = append;
+        output.image = nullptr;
+        output.failed = false;
+        output.needsBigTiff = false;
+        jboolean saved = writeTiffPage(env, filePath, &output, bitmap, options);
+        //file opened here is closed even if image wasn't opened
+        closeOutput(&output, fileDescriptor == -1);
+        return saved;
+    }
 
-        //Options class
-        jclass jSaveOptionsClass = env->FindClass("org/beyka/tiffbitmapfactory/TiffSaver$SaveOptions");
-
-        //How much memory can we use?
-        jfieldID availableMemoryFieldID = env->GetFieldID(jSaveOptionsClass,
-                                                                          "inAvailableMemory",
-                                                                          "J");
-        unsigned long inAvailableMemory = env->GetLongField(options, availableMemoryFieldID);
-
-        //If we need to throw exceptions
-        jfieldID throwExceptionFieldID = env->GetFieldID(jSaveOptionsClass,
-                                                                           "inThrowException",
-                                                                           "Z");
-        jboolean throwException = env->GetBooleanField(options, throwExceptionFieldID);
-
-        // check is bitmap null
-        if (bitmap == nullptr) {
-            const char *message = "Bitmap is null\0";
+    jboolean writeTiffPage(JNIEnv *env, jstring filePath, NativeTiffOutput *output, jobject bitmap, jobject options) {
+        NativeSaveOptions saveOptions;
+        if (!readSaveOptions(env, filePath, options, &saveOptions)) {
+            return JNI_FALSE;
+        }
+        if (output->failed) {
+            const char *message = "Output is broken by failed page\0";
             __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "%s", message);
-            if (throwException) {
+            if (saveOptions.throwException) {
                 jstring jmessage = env->NewStringUTF(message);
                 throw_decode_file_exception(env, filePath, jmessage);
                 env->DeleteLocalRef(jmessage);
             }
+            releaseSaveOptions(env, &saveOptions);
             return JNI_FALSE;
         }
 
+        //Read pixels from bitmap
+        AndroidBitmapInfo info;
+        void *pixels;
+        if (!lockBitmap(env, filePath, bitmap, &saveOptions, &info, &pixels)) {
+            releaseSaveOptions(env, &saveOptions);
+            return JNI_FALSE;
+        }
 
-        jclass bitmapClass = env->FindClass("android/graphics/Bitmap");
+        //Pixels of bitmap are converted to samples of saved image by bands of strips or tiles, so only one band is kept in memory
+        NativeBitmapRows bitmapRows(pixels, &info, pageLayout(&saveOptions));
+        //Pages of TiffWriter after the first one are written to already opened image
+        bool opened = output->image || openOutput(env, filePath, output, estimatePageSize(&saveOptions, &bitmapRows, info.height), &saveOptions);
+        size_t requiredMemory = 0;
+        bool written = opened && writeBitmapPage(output, &bitmapRows, info.height, &saveOptions, nullptr, &requiredMemory);
 
-        //check is bitmap recycled
-        jmethodID isRecycledMethodid = env->GetMethodID(bitmapClass, "isRecycled", "()Z");
-        jboolean isRecycled = env->CallBooleanMethod(bitmap, isRecycledMethodid);
-        if (isRecycled) {
-            const char *message = "Bitmap is recycled\0";
+        //Now we don't need android pixels, so unlock
+        AndroidBitmap_unlockPixels(env, bitmap);
+
+        if (!opened) {
+            throwOpenError(env, filePath, output);
+        } else if (!written) {
+            throwWriteError(env, filePath, &saveOptions, requiredMemory);
+        }
+        releaseSaveOptions(env, &saveOptions);
+        return written ? JNI_TRUE : JNI_FALSE;
+    }
+
+    JNIEXPORT jboolean JNICALL Java_org_beyka_tiffbitmapfactory_TiffSaver_saveAll
+    (JNIEnv *env, jclass clazz, jstring filePath, jint fileDescriptor, jobjectArray bitmaps, jobject options) {
+        NativeSaveOptions saveOptions;
+        if (!readSaveOptions(env, filePath, options, &saveOptions)) {
+            return JNI_FALSE;
+        }
+        int count = bitmaps ? env->GetArrayLength(bitmaps) : 0;
+        if (count == 0) {
+            const char *message = "Bitmaps are empty\0";
             __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "%s", message);
-            if (throwException) {
+            if (saveOptions.throwException) {
                 jstring jmessage = env->NewStringUTF(message);
                 throw_decode_file_exception(env, filePath, jmessage);
                 env->DeleteLocalRef(jmessage);
             }
+            releaseSaveOptions(env, &saveOptions);
             return JNI_FALSE;
         }
 
-        //Read pixels from bitmap
-
-        AndroidBitmapInfo  info;
-        void* pixels;
-        int ret;
-
-
-
-        if ((ret = AndroidBitmap_getInfo(env, bitmap, &info)) < 0) {
-            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "AndroidBitmap_getInfo() failed ! error=");
+        //Pixels of all pages are locked before workers start, workers don't call JNI
+        jobject *pageBitmaps = (jobject *) calloc(count, sizeof(jobject));
+        uint32 *pageHeights = (uint32 *) calloc(count, sizeof(uint32));
+        NativeBitmapRows **pageRows = (NativeBitmapRows **) calloc(count, sizeof(NativeBitmapRows *));
+        NativePageEncoder **pages = (NativePageEncoder **) calloc(count, sizeof(NativePageEncoder *));
+        if (!pageBitmaps || !pageHeights || !pageRows || !pages) {
+            free(pageBitmaps);
+            free(pageHeights);
+            free(pageRows);
+            free(pages);
+            if (saveOptions.throwException) {
+                throw_not_enough_memory_exception(env, saveOptions.availableMemory, count * (sizeof(jobject) + sizeof(uint32) + sizeof(void *) * 2));
+            }
+            releaseSaveOptions(env, &saveOptions);
             return JNI_FALSE;
         }
+        int locked = 0;
+        unsigned long long estimatedSize = 0;
+        //bitmaps are held by local references until pages are written
+        if (env->EnsureLocalCapacity(count + 16) < 0) {
+            locked = -1;
+        }
+        for (; locked >= 0 && locked < count; locked++) {
+            AndroidBitmapInfo info;
+            void *pixels;
+            pageBitmaps[locked] = env->GetObjectArrayElement(bitmaps, locked);
+            if (!lockBitmap(env, filePath, pageBitmaps[locked], &saveOptions, &info, &pixels)) {
+                env->DeleteLocalRef(pageBitmaps[locked]);
+                break;
+            }
+            pageHeights[locked] = info.height;
+            pageRows[locked] = new NativeBitmapRows(pixels, &info, pageLayout(&saveOptions));
+            estimatedSize += estimatePageSize(&saveOptions, pageRows[locked], info.height);
+        }
 
-        if ((ret = AndroidBitmap_lockPixels(env, bitmap, &pixels)) < 0) {
-                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "AndroidBitmap_lockPixels() failed ! error=");
-                return JNI_FALSE;
+        NativeTiffOutput output;
+        output.fd = fileDescriptor;
+        output.append = false;
+        output.image = nullptr;
+        output.failed = false;
+        output.needsBigTiff = false;
+        //Size of all pages is known, so format of file is chosen by the whole document
+        bool opened = locked == count && openOutput(env, filePath, &output, estimatedSize, &saveOptions);
+
+        //Half of available memory is for pages compressed ahead of writing and the other half is for writing itself.
+        //Pages that don't fit into their half are compressed by bands while they are written
+        size_t pageMemory = saveOptions.availableMemory / 2;
+        NativeSaveOptions writeOptions = saveOptions;
+        writeOptions.availableMemory = saveOptions.availableMemory - pageMemory;
+        size_t requiredMemory = 0;
+        bool written = false;
+        if (opened) {
+            int encodedCount = 0;
+            for (int i = 0; i < count; i++) {
+                pages[i] = new NativePageEncoder(pageRows[i], pageHeights[i], &saveOptions);
+                if (pages[i]->getMemory() > pageMemory) {
+                    delete pages[i];
+                    pages[i] = nullptr;
+                } else {
+                    encodedCount++;
+                }
+            }
+            int threads = saveOptions.compressionThreads > 0 ? saveOptions.compressionThreads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+            if (threads > encodedCount) {
+                threads = encodedCount;
+            }
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "Pages %d, compressed ahead %d, threads %d", count, encodedCount, threads);
+            NativePageQueue queue(pages, count, threads, pageMemory);
+            written = true;
+            //pages are written in order while workers compress the next ones
+            for (int i = 0; i < count && written; i++) {
+                written = (!pages[i] || queue.waitPage(i))
+                          && writeBitmapPage(&output, pageRows[i], pageHeights[i], &writeOptions, pages[i], &requiredMemory);
+                queue.pageWritten(i);
+                if (pages[i]) {
+                    delete pages[i];
+                    pages[i] = nullptr;
+                }
+            }
+            queue.stop();
+            for (int i = 0; i < count; i++) {
+                delete pages[i];
+            }
         }
+        //pages written before failed one are kept, unless output failed in the middle of page
+        closeOutput(&output, fileDescriptor == -1);
 
-        uint32 img_width = info.width;
-        uint32 img_height= info.height;
+        for (int i = 0; i < locked; i++) {
+            delete pageRows[i];
+            AndroidBitmap_unlockPixels(env, pageBitmaps[i]);
+            env->DeleteLocalRef(pageBitmaps[i]);
+        }
+        free(pageBitmaps);
+        free(pageHeights);
+        free(pageRows);
+        free(pages);
+
+        if (locked == count && !opened) {
+            throwOpenError(env, filePath, &output);
+        } else if (opened && !written) {
+            throwWriteError(env, filePath, &writeOptions, requiredMemory);
+        }
+        releaseSaveOptions(env, &saveOptions);
+        return written ? JNI_TRUE : JNI_FALSE;
+    }
 
-/*
-        //Get array of jint from jintArray
-        jint *c_array;
-        c_array = env->GetIntArrayElements(img, nullptr);
-        if (c_array == nullptr) {
-            //if array is null - nothing to save
-            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "array is null");
-            return JNI_FALSE;
+    bool readSaveOptions(JNIEnv *env, jstring filePath, jobject options, NativeSaveOptions *saveOptions) {
+        memset(saveOptions, 0, sizeof(NativeSaveOptions));
+
+        //Options class
+        jclass jSaveOptionsClass = env->FindClass("org/beyka/tiffbitmapfactory/TiffSaver$SaveOptions");
+
+        //How much memory can we use?
+        jfieldID availableMemoryFieldID = env->GetFieldID(jSaveOptionsClass,
+                                                                          "inAvailableMemory",
+                                                                          "J");
+        jlong inAvailableMemory = env->GetLongField(options, availableMemoryFieldID);
+        saveOptions->availableMemory = inAvailableMemory > 0 ? (size_t) inAvailableMemory : (size_t) -1;
+
+        //If we need to throw exceptions
+        jfieldID throwExceptionFieldID = env->GetFieldID(jSaveOptionsClass,
+                                                                           "inThrowException",
+                                                                           "Z");
+        saveOptions->throwException = env->GetBooleanField(options, throwExceptionFieldID);
+
+        //Get layout of image data: size of strips or size of tiles
+        jfieldID stripSizeFieldID = env->GetFieldID(jSaveOptionsClass, "stripSize", "I");
+        saveOptions->stripSize = env->GetIntField(options, stripSizeFieldID);
+        jfieldID tileWidthFieldID = env->GetFieldID(jSaveOptionsClass, "tileWidth", "I");
+        jint tileWidth = env->GetIntField(options, tileWidthFieldID);
+        jfieldID tileHeightFieldID = env->GetFieldID(jSaveOptionsClass, "tileHeight", "I");
+        jint tileHeight = env->GetIntField(options, tileHeightFieldID);
+        bool tiled = tileWidth != 0 && tileHeight != 0;
+        if (tiled && (tileWidth < 0 || tileHeight < 0 || tileWidth % 16 != 0 || tileHeight % 16 != 0)) {
+            const char *message = "Tile width and height should be positive multiples of 16\0";
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "%s", message);
+            if (saveOptions->throwException) {
+                jstring jmessage = env->NewStringUTF(message);
+                throw_decode_file_exception(env, filePath, jmessage);
+                env->DeleteLocalRef(jmessage);
+            }
+            return false;
         }
-*/
+        saveOptions->tiled = tiled;
+        saveOptions->tileWidth = tileWidth;
+        saveOptions->tileHeight = tileHeight;
+
+        //Number of reduced resolution overviews
+        jfieldID overviewLevelsFieldID = env->GetFieldID(jSaveOptionsClass, "overviewLevels", "I");
+        saveOptions->overviewLevels = env->GetIntField(options, overviewLevelsFieldID);
 
+        //Estimated size of output from which BigTIFF is written
+        jfieldID bigTiffThresholdFieldID = env->GetFieldID(jSaveOptionsClass, "bigTiffThreshold", "J");
+        saveOptions->bigTiffThreshold = env->GetLongField(options, bigTiffThresholdFieldID);
 
-        //Get options
+        //Number of threads that compress strips or tiles
+        jfieldID compressionThreadsFieldID = env->GetFieldID(jSaveOptionsClass, "compressionThreads", "I");
+        saveOptions->compressionThreads = env->GetIntField(options, compressionThreadsFieldID);
 
         //Get compression mode from options object
         jfieldID gOptions_CompressionModeFieldID = env->GetFieldID(jSaveOptionsClass,
@@ -106,7 +262,8 @@ extern "C" {
         jclass compressionModeClass = env->FindClass(
         "org/beyka/tiffbitmapfactory/CompressionScheme");
         jfieldID ordinalFieldID = env->GetFieldID(compressionModeClass, "ordinal", "I");
-        jint compressionInt = env->GetIntField(compressionMode, ordinalFieldID);
+        saveOptions->compression = env->GetIntField(compressionMode, ordinalFieldID);
+        env->DeleteLocalRef(compressionModeClass);
 
         //Get image orientation from options object
         jfieldID gOptions_OrientationFieldID = env->GetFieldID(jSaveOptionsClass,
@@ -117,14 +274,63 @@ extern "C" {
         jclass orientationClass = env->FindClass(
         "org/beyka/tiffbitmapfactory/Orientation");
         jfieldID orientationOrdinalFieldID = env->GetFieldID(orientationClass, "ordinal", "I");
-        jint orientationInt = env->GetIntField(orientation, orientationOrdinalFieldID);
+        saveOptions->orientation = env->GetIntField(orientation, orientationOrdinalFieldID);
         env->DeleteLocalRef(orientationClass);
 
+        //Get sample layout from options object
+        jfieldID gOptions_SampleLayoutFieldID = env->GetFieldID(jSaveOptionsClass,
+        "sampleLayout",
+        "Lorg/beyka/tiffbitmapfactory/SampleLayout;");
+        jobject sampleLayout = env->GetObjectField(options, gOptions_SampleLayoutFieldID);
+        saveOptions->sampleLayout = NativeBitmapRows::LAYOUT_AUTO;
+        if (sampleLayout) {
+            jclass sampleLayoutClass = env->FindClass("org/beyka/tiffbitmapfactory/SampleLayout");
+            jfieldID sampleLayoutOrdinalFieldID = env->GetFieldID(sampleLayoutClass, "ordinal", "I");
+            saveOptions->sampleLayout = env->GetIntField(sampleLayout, sampleLayoutOrdinalFieldID);
+            env->DeleteLocalRef(sampleLayoutClass);
+        }
+
+        //Get predictor and Deflate parameters from options object
+        jfieldID gOptions_PredictorFieldID = env->GetFieldID(jSaveOptionsClass,
+        "predictor",
+        "Lorg/beyka/tiffbitmapfactory/Predictor;");
+        jobject predictor = env->GetObjectField(options, gOptions_PredictorFieldID);
+        saveOptions->predictor = PREDICTOR_NONE;
+        if (predictor) {
+            jclass predictorClass = env->FindClass("org/beyka/tiffbitmapfactory/Predictor");
+            jfieldID predictorOrdinalFieldID = env->GetFieldID(predictorClass, "ordinal", "I");
+            saveOptions->predictor = env->GetIntField(predictor, predictorOrdinalFieldID);
+            env->DeleteLocalRef(predictorClass);
+        }
+        jfieldID deflateLevelFieldID = env->GetFieldID(jSaveOptionsClass, "deflateLevel", "I");
+        saveOptions->deflateLevel = env->GetIntField(options, deflateLevelFieldID);
+        if (saveOptions->deflateLevel < Z_DEFAULT_COMPRESSION || saveOptions->deflateLevel > Z_BEST_COMPRESSION) {
+            const char *message = "Deflate level should be from 0 to 9 or -1 for default level\0";
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "%s", message);
+            if (saveOptions->throwException) {
+                jstring jmessage = env->NewStringUTF(message);
+                throw_decode_file_exception(env, filePath, jmessage);
+                env->DeleteLocalRef(jmessage);
+            }
+            return false;
+        }
+        jfieldID gOptions_DeflateStrategyFieldID = env->GetFieldID(jSaveOptionsClass,
+        "deflateStrategy",
+        "Lorg/beyka/tiffbitmapfactory/DeflateStrategy;");
+        jobject deflateStrategy = env->GetObjectField(options, gOptions_DeflateStrategyFieldID);
+        saveOptions->deflateStrategy = Z_DEFAULT_STRATEGY;
+        if (deflateStrategy) {
+            jclass deflateStrategyClass = env->FindClass("org/beyka/tiffbitmapfactory/DeflateStrategy");
+            jfieldID deflateStrategyOrdinalFieldID = env->GetFieldID(deflateStrategyClass, "ordinal", "I");
+            saveOptions->deflateStrategy = env->GetIntField(deflateStrategy, deflateStrategyOrdinalFieldID);
+            env->DeleteLocalRef(deflateStrategyClass);
+        }
+
         // variables for resolution
         jfieldID gOptions_xResolutionFieldID = env->GetFieldID(jSaveOptionsClass, "xResolution", "F");
-        float xRes = env->GetFloatField(options, gOptions_xResolutionFieldID);
+        saveOptions->xResolution = env->GetFloatField(options, gOptions_xResolutionFieldID);
         jfieldID gOptions_yResolutionFieldID = env->GetFieldID(jSaveOptionsClass, "yResolution", "F");
-        float yRes = env->GetFloatField(options, gOptions_yResolutionFieldID);
+        saveOptions->yResolution = env->GetFloatField(options, gOptions_yResolutionFieldID);
         jfieldID gOptions_resUnitFieldID = env->GetFieldID(jSaveOptionsClass,
                                                            "resUnit",
                                                            "Lorg/beyka/tiffbitmapfactory/ResolutionUnit;");
@@ -132,34 +338,31 @@ extern "C" {
         //Get res int from resUnitObject
         jclass resolutionUnitClass = env->FindClass("org/beyka/tiffbitmapfactory/ResolutionUnit");
         jfieldID resUnitOrdinalFieldID = env->GetFieldID(resolutionUnitClass, "ordinal", "I");
-        uint16 resUnit = env->GetIntField(resUnitObject, resUnitOrdinalFieldID);
+        saveOptions->resUnit = env->GetIntField(resUnitObject, resUnitOrdinalFieldID);
         env->DeleteLocalRef(resolutionUnitClass);
 
         //Get author field if exist
         jfieldID gOptions_authorFieldID = env->GetFieldID(jSaveOptionsClass, "author", "Ljava/lang/String;");
-        jstring jAuthor = (jstring)env->GetObjectField(options, gOptions_authorFieldID);
-        const char *authorString = nullptr;
-        if (jAuthor) {
-            authorString = env->GetStringUTFChars(jAuthor, 0);
-            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Author: ", authorString);
+        saveOptions->jAuthor = (jstring)env->GetObjectField(options, gOptions_authorFieldID);
+        if (saveOptions->jAuthor) {
+            saveOptions->author = env->GetStringUTFChars(saveOptions->jAuthor, 0);
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Author: ", saveOptions->author);
         }
 
         //Get copyright field if exist
         jfieldID gOptions_copyrightFieldID = env->GetFieldID(jSaveOptionsClass, "copyright", "Ljava/lang/String;");
-        jstring jCopyright = (jstring)env->GetObjectField(options, gOptions_copyrightFieldID);
-        const char *copyrightString = nullptr;
-        if (jCopyright) {
-            copyrightString = env->GetStringUTFChars(jCopyright, 0);
-            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Copyright: ", copyrightString);
+        saveOptions->jCopyright = (jstring)env->GetObjectField(options, gOptions_copyrightFieldID);
+        if (saveOptions->jCopyright) {
+            saveOptions->copyright = env->GetStringUTFChars(saveOptions->jCopyright, 0);
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Copyright: ", saveOptions->copyright);
         }
 
         //Get image description field if exist
         jfieldID gOptions_imgDescrFieldID = env->GetFieldID(jSaveOptionsClass, "imageDescription", "Ljava/lang/String;");
-        jstring jImgDescr = (jstring)env->GetObjectField(options, gOptions_imgDescrFieldID);
-        const char *imgDescrString = nullptr;
-        if (jImgDescr) {
-            imgDescrString = env->GetStringUTFChars(jImgDescr, 0);
-            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Image Description: ", imgDescrString);
+        saveOptions->jImageDescription = (jstring)env->GetObjectField(options, gOptions_imgDescrFieldID);
+        if (saveOptions->jImageDescription) {
+            saveOptions->imageDescription = env->GetStringUTFChars(saveOptions->jImageDescription, 0);
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Image Description: ", saveOptions->imageDescription);
         }
 
         //Get android version
@@ -171,300 +374,485 @@ extern "C" {
             releaseString = env->GetStringUTFChars(jrelease, 0);
             __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Release: ", releaseString);
         }
-        char *fullReleaseName = concat("Android ", releaseString);
-        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Full Release: ", fullReleaseName);
+        saveOptions->hostComputer = concat("Android ", releaseString);
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "Full Release: ", saveOptions->hostComputer);
+        if (releaseString) {
+            env->ReleaseStringUTFChars(jrelease, releaseString);
+        }
+        return true;
+    }
 
+    void releaseSaveOptions(JNIEnv *env, NativeSaveOptions *saveOptions) {
+        free(saveOptions->hostComputer);
+        if (saveOptions->imageDescription) {
+            env->ReleaseStringUTFChars(saveOptions->jImageDescription, saveOptions->imageDescription);
+        }
+        if (saveOptions->author) {
+            env->ReleaseStringUTFChars(saveOptions->jAuthor, saveOptions->author);
+        }
+        if (saveOptions->copyright) {
+            env->ReleaseStringUTFChars(saveOptions->jCopyright, saveOptions->copyright);
+        }
+    }
 
-        uint32 pixelsBufferSize = img_width * img_height;
-        uint32* img = nullptr;
-        int tmpImgArrayCreated = 0;
-        switch (info.format) {
-            case ANDROID_BITMAP_FORMAT_RGBA_8888:
-            {
-                __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s", "ANDROID_BITMAP_FORMAT_RGBA_8888");
-                img = (uint32*)pixels;
-                break;
-            }
-            case ANDROID_BITMAP_FORMAT_RGBA_4444:
-            {
-                __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s", "ANDROID_BITMAP_FORMAT_RGBA_4444");
-                uint16_t* tmp4444 = (uint16_t*)pixels;
-                img = (uint32*) malloc(sizeof(uint32) * pixelsBufferSize);
-                for (int x = 0; x < img_width; x++) {
-                    for (int y = 0; y < img_height; y++) {
-                        uint16_t pix = tmp4444[y * img_width + x];
-                        int alpha = colorMask & pix >> 16;
-                        int red = colorMask & pix >> 8;
-                        int green = colorMask & pix >> 4;
-                        int blue = colorMask & pix;
-                        uint32 crPix = (alpha << 24) | (blue << 16) | (green << 8) | (red);
-                        img[y * img_width + x] = crPix;
-                    }
-                }
-                tmpImgArrayCreated = 1;
-                break;
-            }
-            case ANDROID_BITMAP_FORMAT_RGB_565:
-            {
-                __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s", "ANDROID_BITMAP_FORMAT_RGB_565");
-                uint16_t* tmp565 = (uint16_t*)pixels;
-                img = (uint32*) malloc(sizeof(uint32) * pixelsBufferSize);
-                for (int x = 0; x < img_width; x++) {
-                    for (int y = 0; y < img_height; y++) {
-                        uint16_t pix = tmp565[y * img_width + x];
-                        unsigned char red = 0b11111 & pix >> 11;
-                        unsigned char green = 0b111111 & pix >> 5;
-                        unsigned char blue = 0b11111 & pix;
-                        uint32 crPix = (blue << 3 << 16) | (green << 2 << 8) | (red<<3);
-                        img[y * img_width + x] = crPix;
-                    }
-                }
-                tmpImgArrayCreated = 1;
-                break;
+    bool lockBitmap(JNIEnv *env, jstring filePath, jobject bitmap, const NativeSaveOptions *saveOptions, AndroidBitmapInfo *info, void **pixels) {
+        const char *message = nullptr;
+        // check is bitmap null
+        if (bitmap == nullptr) {
+            message = "Bitmap is null\0";
+        } else {
+            jclass bitmapClass = env->FindClass("android/graphics/Bitmap");
+            //check is bitmap recycled
+            jmethodID isRecycledMethodid = env->GetMethodID(bitmapClass, "isRecycled", "()Z");
+            jboolean isRecycled = env->CallBooleanMethod(bitmap, isRecycledMethodid);
+            env->DeleteLocalRef(bitmapClass);
+            if (isRecycled) {
+                message = "Bitmap is recycled\0";
             }
-            case ANDROID_BITMAP_FORMAT_A_8:
-            {
-                __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s", "ANDROID_BITMAP_FORMAT_A_8");
-                uint8_t* tmp8 = (uint8_t*)pixels;
-                img = (uint32*) malloc(sizeof(uint32) * pixelsBufferSize);
-                for (int x = 0; x < img_width; x++) {
-                    for (int y = 0; y < img_height; y++) {
-                        uint8_t pix = tmp8[y * img_width + x];
-                        img[y * img_width + x] = pix << 24;
-                    }
-                }
-                tmpImgArrayCreated = 1;
-                break;
+        }
+        if (message) {
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "%s", message);
+            if (saveOptions->throwException) {
+                jstring jmessage = env->NewStringUTF(message);
+                throw_decode_file_exception(env, filePath, jmessage);
+                env->DeleteLocalRef(jmessage);
             }
+            return false;
         }
 
-/*
-        int pixelsBufferSize = img_width * img_height;
-        uint32 *array = (uint32 *) malloc(sizeof(uint32) * pixelsBufferSize);
-        if (!array) {
-            throw_not_enough_memory_exception(env, sizeof(uint32) * pixelsBufferSize, 0);//todo change for estimating memory
-            return JNI_FALSE;
+        if (AndroidBitmap_getInfo(env, bitmap, info) < 0) {
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "AndroidBitmap_getInfo() failed ! error=");
+            return false;
         }
 
-        uint32_t* img = (uint32_t*)pixels;
-        for (int y = 0; y < img_height; y++) {
-            for (int x = 0; x < img_width; x++) {
-                uint32_t pix = img[y * img_width + x];
-                int alpha = colorMask & pix >> 24;
-                int red = colorMask & pix >> 16;
-                int green = colorMask & pix >> 8;
-                int blue = colorMask & pix;
-                uint32 crPix = (alpha << 24) | (blue << 16) | (green << 8) | (red);
-                array[y * img_width + x] = crPix;
+        if (AndroidBitmap_lockPixels(env, bitmap, pixels) < 0) {
+                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "AndroidBitmap_lockPixels() failed ! error=");
+                return false;
+        }
+
+        if (info->format != ANDROID_BITMAP_FORMAT_RGBA_8888 && info->format != ANDROID_BITMAP_FORMAT_RGBA_4444
+            && info->format != ANDROID_BITMAP_FORMAT_RGB_565 && info->format != ANDROID_BITMAP_FORMAT_A_8) {
+            AndroidBitmap_unlockPixels(env, bitmap);
+            message = "Unsupported bitmap format\0";
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "%s", message);
+            if (saveOptions->throwException) {
+                jstring jmessage = env->NewStringUTF(message);
+                throw_decode_file_exception(env, filePath, jmessage);
+                env->DeleteLocalRef(jmessage);
             }
+            return false;
         }
-*/
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "Bitmap format %d", info->format);
+        return true;
+    }
 
-/*
-        for (int i = 0; i < img_width; i++) {
-            for (int j = 0; j < img_height; j++) {
+    bool isBilevel(const NativeSaveOptions *saveOptions) {
+        int compression = saveOptions->compression;
+        return compression == COMPRESSION_CCITTRLE || compression == COMPRESSION_CCITTFAX3 || compression == COMPRESSION_CCITTFAX4;
+    }
 
-                uint32 crPix = getPixel(pixels,info,i,j);
+    int pageLayout(const NativeSaveOptions *saveOptions) {
+        return isBilevel(saveOptions) ? NativeBitmapRows::LAYOUT_BILEVEL : saveOptions->sampleLayout;
+    }
 
-                //jint crPix = c_array[j * img_width + i];
-                int alpha = colorMask & crPix >> 24;
-                int red = colorMask & crPix >> 16;
-                int green = colorMask & crPix >> 8;
-                int blue = colorMask & crPix;
+    int pageOverviewCount(const NativeSaveOptions *saveOptions, uint32 width, uint32 height) {
+        //Overviews are written to SubIFDs, so they don't change number of directories. Bilevel images have no overviews
+        int overviewCount = 0;
+        while (!isBilevel(saveOptions) && overviewCount < saveOptions->overviewLevels
+               && (NativeOverviewWriter::levelSize(width, overviewCount) > 1 || NativeOverviewWriter::levelSize(height, overviewCount) > 1)) {
+            overviewCount++;
+        }
+        return overviewCount;
+    }
 
-                crPix = (alpha << 24) | (blue << 16) | (green << 8) | (red);
-                array[j * img_width + i] = crPix;
-            }
+    unsigned long long estimatePageSize(const NativeSaveOptions *saveOptions, NativeBitmapRows *bitmapRows, uint32 height) {
+        unsigned long long estimatedSize = (unsigned long long) bitmapRows->getRowBytes() * height;
+        if (saveOptions->overviewLevels > 0 && !isBilevel(saveOptions)) {
+            estimatedSize += estimatedSize / 3;
+        }
+        return estimatedSize;
+    }
+
+    void closeOutput(NativeTiffOutput *output, bool closeFd) {
+        if (output->image && output->failed) {
+            //directory of failed page isn't flushed, file descriptor isn't closed by TIFFCleanup
+            TIFFCleanup(output->image);
+            close(output->fd);
+        } else if (output->image) {
+            //directories are already written, file descriptor is closed with image
+            TIFFClose(output->image);
+        } else if (closeFd && output->fd != -1) {
+            close(output->fd);
         }
-*/
-        TIFF *output_image;
+        output->image = nullptr;
+    }
 
-        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %d", "Check file descripor", fileDescriptor);
+    bool openOutput(JNIEnv *env, jstring filePath, NativeTiffOutput *output, unsigned long long estimatedSize, const NativeSaveOptions *saveOptions) {
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %d", "Check file descripor", output->fd);
 
-        const char *strPath = nullptr;
-        if (fileDescriptor == -1) {
-            strPath = env->GetStringUTFChars(filePath, 0);
+        if (output->fd == -1) {
+            const char *strPath = env->GetStringUTFChars(filePath, 0);
             __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %s", "nativeTiffOpenForSave", strPath);
             int mode = O_RDWR | O_CREAT | O_TRUNC | 0;
-            if (append) {
+            if (output->append) {
                 mode = O_RDWR | O_CREAT;
             }
-            fileDescriptor = open(strPath, mode, 0666);
-            if (fileDescriptor < 0) {
-                throw_cant_open_file_exception(env, filePath);
-                return JNI_FALSE;
+            output->fd = open(strPath, mode, 0666);
+            env->ReleaseStringUTFChars(filePath, strPath);
+            if (output->fd < 0) {
+                output->fd = -1;
+                return false;
             }
         }
 
-        // Open the TIFF file
-        if (!append) {
-            if ((output_image = TIFFFdOpen(fileDescriptor, "", "w")) == nullptr) {
-                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Unable to write tif file");
-                if (strPath) {
-                    throw_cant_open_file_exception(env, filePath);
-                } else {
-                    throw_cant_open_file_exception_fd(env, fileDescriptor);
-                }
-                return JNI_FALSE;
-            }
-        } else {
-            if ((output_image = TIFFFdOpen(fileDescriptor, "", "a")) == nullptr) {
-                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Unable to write tif file");
-                if (strPath) {
-                    throw_cant_open_file_exception(env, filePath);
-                } else {
-                    throw_cant_open_file_exception_fd(env, fileDescriptor);
-                return JNI_FALSE;
-                }
+        //Classic TIFF has 32 bit offsets, so outputs that may grow over 4 GB are written as BigTIFF.
+        //Size is estimated by uncompressed data. When appending, size of existing file is added to estimation,
+        //but format of file that is not empty is kept: libtiff breaks classic file if page is appended with BigTIFF mode.
+        //So classic file that would need BigTIFF is refused before anything is written to it.
+        //Format of TiffWriter file is chosen by its first page
+        bool emptyFile = true;
+        bool classicFile = false;
+        struct stat64 fileStat;
+        if (output->append && fstat64(output->fd, &fileStat) == 0 && fileStat.st_size > 0) {
+            estimatedSize += fileStat.st_size;
+            emptyFile = false;
+            unsigned char header[4];
+            if (pread(output->fd, header, sizeof(header), 0) == sizeof(header)) {
+                int version = header[0] == 'I' ? header[2] | header[3] << 8 : header[2] << 8 | header[3];
+                classicFile = version == TIFF_VERSION_CLASSIC;
             }
         }
+        bool bigTiff = saveOptions->bigTiffThreshold >= 0 && estimatedSize >= (unsigned long long) saveOptions->bigTiffThreshold;
+        if (classicFile && (bigTiff || estimatedSize > 0xFFFFFFFFULL)) {
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Classic file can't grow to estimated size %llu", estimatedSize);
+            output->needsBigTiff = true;
+            return false;
+        }
+        if (bigTiff && !emptyFile) {
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s", "Format of existing file is kept");
+            bigTiff = false;
+        }
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "Estimated size %llu, BigTIFF %d", estimatedSize, bigTiff);
+        const char *openMode = output->append ? (bigTiff ? "a8" : "a") : (bigTiff ? "w8" : "w");
 
-        TIFFSetField(output_image, TIFFTAG_IMAGEWIDTH, img_width);
-        TIFFSetField(output_image, TIFFTAG_IMAGELENGTH, img_height);
-        TIFFSetField(output_image, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        TIFFSetField(output_image, TIFFTAG_COMPRESSION, compressionInt);
-        TIFFSetField(output_image, TIFFTAG_ORIENTATION, orientationInt);
-        TIFFSetField(output_image, TIFFTAG_XRESOLUTION, xRes);
-        TIFFSetField(output_image, TIFFTAG_YRESOLUTION, yRes);
-        TIFFSetField(output_image, TIFFTAG_RESOLUTIONUNIT, resUnit);
-
-        if (compressionInt == COMPRESSION_CCITTRLE ||compressionInt == COMPRESSION_CCITTFAX3 || compressionInt == COMPRESSION_CCITTFAX4) {
-            TIFFSetField(output_image, TIFFTAG_BITSPERSAMPLE,	1);
-            TIFFSetField(output_image, TIFFTAG_SAMPLESPERPIXEL,	1);
-            TIFFSetField(output_image, TIFFTAG_ROWSPERSTRIP, 1);
-            TIFFSetField(output_image, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-            TIFFSetField(output_image, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
-        } else {
-            TIFFSetField(output_image, TIFFTAG_BITSPERSAMPLE, 8);
-            TIFFSetField(output_image, TIFFTAG_SAMPLESPERPIXEL, 4);
-            TIFFSetField(output_image, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+        // Open the TIFF file
+        if ((output->image = TIFFFdOpen(output->fd, "", openMode)) == nullptr) {
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Unable to write tif file");
+            return false;
         }
+        return true;
+    }
+
+    void setPageFields(TIFF *image, const NativeSaveOptions *saveOptions, NativeBitmapRows *bitmapRows, uint32 height) {
+        uint32 width = bitmapRows->getWidth();
+        TIFFSetField(image, TIFFTAG_IMAGEWIDTH, width);
+        TIFFSetField(image, TIFFTAG_IMAGELENGTH, height);
+        TIFFSetField(image, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(image, TIFFTAG_COMPRESSION, saveOptions->compression);
+        setCompressionFields(image, saveOptions->compression, isBilevel(saveOptions) ? PREDICTOR_NONE : saveOptions->predictor,
+                             saveOptions->deflateLevel);
+        TIFFSetField(image, TIFFTAG_ORIENTATION, saveOptions->orientation);
+        TIFFSetField(image, TIFFTAG_XRESOLUTION, saveOptions->xResolution);
+        TIFFSetField(image, TIFFTAG_YRESOLUTION, saveOptions->yResolution);
+        TIFFSetField(image, TIFFTAG_RESOLUTIONUNIT, saveOptions->resUnit);
+
+        bitmapRows->setFields(image);
 
         //Write additional tags
         //CreationDate tag
         char *date = getCreationDate();
-        TIFFSetField(output_image, TIFFTAG_DATETIME, date);
+        TIFFSetField(image, TIFFTAG_DATETIME, date);
         free(date);
         //Host system
-        TIFFSetField(output_image, TIFFTAG_HOSTCOMPUTER, fullReleaseName);
+        TIFFSetField(image, TIFFTAG_HOSTCOMPUTER, saveOptions->hostComputer);
 
         //image description
-        if (imgDescrString) {
-            TIFFSetField(output_image, TIFFTAG_IMAGEDESCRIPTION, imgDescrString);
+        if (saveOptions->imageDescription) {
+            TIFFSetField(image, TIFFTAG_IMAGEDESCRIPTION, saveOptions->imageDescription);
         }
         //author
-        if (authorString) {
-            TIFFSetField(output_image, TIFFTAG_ARTIST, authorString);
+        if (saveOptions->author) {
+            TIFFSetField(image, TIFFTAG_ARTIST, saveOptions->author);
         }
         //copyright
-        if (copyrightString) {
-            TIFFSetField(output_image, TIFFTAG_COPYRIGHT, copyrightString);
+        if (saveOptions->copyright) {
+            TIFFSetField(image, TIFFTAG_COPYRIGHT, saveOptions->copyright);
         }
 
-        // Write the information to the file
-        if (compressionInt == COMPRESSION_CCITTRLE || compressionInt == COMPRESSION_CCITTFAX3 || compressionInt == COMPRESSION_CCITTFAX4) {
-            unsigned char *bilevel = convertArgbToBilevel(img, img_width, img_height);
-            int compressedWidth = (img_width/8 + 0.5);
-            for (int i = 0; i < img_height; i++) {
-                TIFFWriteEncodedStrip(output_image, i, &bilevel[i * compressedWidth], (compressedWidth));
+        // Write the information to the file by whole strips or tiles
+        if (saveOptions->tiled) {
+            TIFFSetField(image, TIFFTAG_TILEWIDTH, saveOptions->tileWidth);
+            TIFFSetField(image, TIFFTAG_TILELENGTH, saveOptions->tileHeight);
+        } else {
+            tmsize_t rowBytes = bitmapRows->getRowBytes();
+            uint32 rowsPerStrip = saveOptions->stripSize > 0 ? saveOptions->stripSize / rowBytes : TIFFDefaultStripSize(image, 0);
+            if (rowsPerStrip == 0) {
+                rowsPerStrip = 1;
             }
-            free(bilevel);
-        } else if (compressionInt == COMPRESSION_JPEG) {
-            for (int row = 0; row < img_height; row++) {
-                TIFFWriteScanline(output_image, &img[row * img_width], row, 0);
+            if (saveOptions->compression == COMPRESSION_JPEG) {
+                //strips of JPEG should have whole MCU rows
+                rowsPerStrip = (rowsPerStrip + 15) / 16 * 16;
             }
-        } else {
-            TIFFSetField(output_image, TIFFTAG_ROWSPERSTRIP, 1);
-            for (int row = 0; row < img_height; row++) {
-                TIFFWriteEncodedStrip(output_image, row, &img[row * img_width], img_width * sizeof(uint32));
-                //TIFFWriteScanline(output_image, &img[row * img_width], row, 0);
+            if (rowsPerStrip > height) {
+                rowsPerStrip = height;
             }
+            TIFFSetField(image, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %d", "Rows per strip", rowsPerStrip);
         }
-       ret = TIFFWriteDirectory(output_image);
-        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "%s %d", "ret = ", ret);
+    }
+
+    void dropDirectory(TIFF *image) {
+        //changing scheme frees state of codec of page
+        TIFFSetField(image, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+        TIFFFreeDirectory(image);
+        TIFFCreateDirectory(image);
+    }
 
-        // Close the file
-        TIFFClose(output_image);
-/*
-        //free temp array
-        free (array);
-*/
-        if (tmpImgArrayCreated) {
-            free(img);
+    bool writeBitmapPage(NativeTiffOutput *output, NativeBitmapRows *bitmapRows, uint32 img_height, const NativeSaveOptions *saveOptions,
+                         NativePageEncoder *encodedPage, size_t *requiredMemory) {
+        __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "Sample layout %d", bitmapRows->getLayout());
+        TIFF *output_image = output->image;
+        setPageFields(output_image, saveOptions, bitmapRows, img_height);
+        uint32 img_width = bitmapRows->getWidth();
+        size_t availableMemory = saveOptions->availableMemory;
+        int overviewCount = pageOverviewCount(saveOptions, img_width, img_height);
+        bool written = false;
+        //data of page is written, so failure can't be undone
+        bool started = false;
+        *requiredMemory = 0;
+
+        //SubIFDs are declared only when overviews fit into memory, otherwise next pages would take their places
+        if (overviewCount > 0) {
+            *requiredMemory = overviewMemory(bitmapRows, img_width, img_height, overviewCount, saveOptions, availableMemory);
+            if (*requiredMemory > availableMemory) {
+                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Not enough memory for overviews: %zu bytes required", *requiredMemory);
+                dropDirectory(output_image);
+                return false;
+            }
+            toff_t *subOffsets = (toff_t *) calloc(overviewCount, sizeof(toff_t));
+            TIFFSetField(output_image, TIFFTAG_SUBIFD, (uint16) overviewCount, subOffsets);
+            free(subOffsets);
         }
 
-        //Now we don't need android pixels, so unlock
-        AndroidBitmap_unlockPixels(env, bitmap);
+        if (encodedPage) {
+            //strips or tiles are already compressed by worker
+            started = true;
+            written = encodedPage->write(output_image);
+        } else {
+            tmsize_t rowBytes = bitmapRows->getRowBytes();
+            NativeChunkWriter chunkWriter(output_image, rowBytes, bitmapRows->getBitsPerPixel(), saveOptions->compressionThreads);
+            chunkWriter.setDeflateStrategy(saveOptions->deflateStrategy);
+            uint32 chunkHeight = chunkWriter.getChunkHeight();
+            size_t chunkRowBytes = (size_t) rowBytes * chunkHeight;
+            //converted band has at least one row of chunks
+            *requiredMemory = bitmapRows->getWorkingMemory() + (bitmapRows->isDirect() ? 0 : chunkRowBytes);
+            chunkWriter.fitMemory(availableMemory > *requiredMemory ? availableMemory - *requiredMemory : 0);
+            *requiredMemory += chunkWriter.getWorkingMemory();
+            bool enoughMemory = *requiredMemory <= availableMemory;
+
+            uint32 bandHeight = img_height;
+            if (!bitmapRows->isDirect() && enoughMemory) {
+                //band is about a megabyte or two chunks per thread, as much as memory allows
+                uint32 chunksAcross = saveOptions->tiled ? (img_width + saveOptions->tileWidth - 1) / saveOptions->tileWidth : 1;
+                size_t bandChunkRows = bandBytes / chunkRowBytes;
+                size_t threadChunkRows = (chunkWriter.getThreadCount() * 2 + chunksAcross - 1) / chunksAcross;
+                if (bandChunkRows < threadChunkRows) {
+                    bandChunkRows = threadChunkRows;
+                }
+                size_t fitChunkRows = (availableMemory - *requiredMemory) / chunkRowBytes + 1;
+                if (bandChunkRows > fitChunkRows) {
+                    bandChunkRows = fitChunkRows;
+                }
+                if (bandChunkRows < (size_t) (img_height + chunkHeight - 1) / chunkHeight) {
+                    bandHeight = (uint32) bandChunkRows * chunkHeight;
+                }
+            }
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "Required memory %zu, band height %d, threads %d",
+                                *requiredMemory, bandHeight, chunkWriter.getThreadCount());
 
-        //Remove variables
-        if (releaseString) {
-            env->ReleaseStringUTFChars(jrelease, releaseString);
+            if (enoughMemory) {
+                unsigned char *band = nullptr;
+                if (!bitmapRows->isDirect()) {
+                    band = (unsigned char *) malloc((size_t) bandHeight * rowBytes);
+                }
+                started = bitmapRows->begin() && (bitmapRows->isDirect() || band);
+                written = started;
+                for (uint32 y = 0; y < img_height && written; y += bandHeight) {
+                    uint32 rows = img_height - y < bandHeight ? img_height - y : bandHeight;
+                    written = chunkWriter.writeRows(bitmapRows->readRows(y, rows, band), y, rows);
+                }
+                if (band) {
+                    free(band);
+                }
+            } else {
+                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Not enough memory: %zu bytes required", *requiredMemory);
+            }
         }
-        free(fullReleaseName);
-        if (imgDescrString) {
-            env->ReleaseStringUTFChars(jImgDescr, imgDescrString);
+        if (!started) {
+            dropDirectory(output_image);
+            return false;
         }
-        if (authorString) {
-            env->ReleaseStringUTFChars(jAuthor, authorString);
+        written = written && TIFFWriteDirectory(output_image);
+        if (!written) {
+            __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Unable to write image data");
         }
-        if (copyrightString) {
-            env->ReleaseStringUTFChars(jCopyright, copyrightString);
+
+        if (written && overviewCount > 0) {
+            written = writeOverviews(output_image, bitmapRows, img_width, img_height, overviewCount, saveOptions, availableMemory, requiredMemory);
+            if (!written) {
+                __android_log_print(ANDROID_LOG_ERROR, "NativeTiffSaver", "Unable to write overviews");
+            }
         }
-        if (strPath) {
-            env->ReleaseStringUTFChars(filePath, strPath);
+        output->failed = !written;
+        return written;
+    }
+
+    void throwOpenError(JNIEnv *env, jstring filePath, const NativeTiffOutput *output) {
+        if (output->needsBigTiff) {
+            jstring jmessage = env->NewStringUTF("Classic TIFF file can't grow over bigTiffThreshold or 4 GB, pages are appended only to BigTIFF file");
+            if (filePath) {
+                throw_decode_file_exception(env, filePath, jmessage);
+            } else {
+                throw_decode_file_exception_fd(env, output->fd, jmessage);
+            }
+            env->DeleteLocalRef(jmessage);
+        } else if (filePath) {
+            throw_cant_open_file_exception(env, filePath);
+        } else {
+            throw_cant_open_file_exception_fd(env, output->fd);
+        }
+    }
+
+    void throwWriteError(JNIEnv *env, jstring filePath, const NativeSaveOptions *saveOptions, size_t requiredMemory) {
+        if (!saveOptions->throwException) {
+            return;
+        }
+        if (requiredMemory > saveOptions->availableMemory) {
+            throw_not_enough_memory_exception(env, saveOptions->availableMemory, requiredMemory);
+        } else {
+            jstring jmessage = env->NewStringUTF("Unable to write image data");
+            throw_decode_file_exception(env, filePath, jmessage);
+            env->DeleteLocalRef(jmessage);
         }
-//        env->ReleaseIntArrayElements(img, c_array, 0);
+    }
 
-        if (ret == -1) return JNI_FALSE;
-        return JNI_TRUE;
+    void setOverviewFields(TIFF *image, const NativeSaveOptions *saveOptions, NativeBitmapRows *bitmapRows, uint32 width, uint32 height, int level) {
+        TIFFSetField(image, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+        TIFFSetField(image, TIFFTAG_IMAGEWIDTH, NativeOverviewWriter::levelSize(width, level));
+        TIFFSetField(image, TIFFTAG_IMAGELENGTH, NativeOverviewWriter::levelSize(height, level));
+        TIFFSetField(image, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(image, TIFFTAG_COMPRESSION, saveOptions->compression);
+        setCompressionFields(image, saveOptions->compression, saveOptions->predictor, saveOptions->deflateLevel);
+        TIFFSetField(image, TIFFTAG_ORIENTATION, saveOptions->orientation);
+        bitmapRows->setFields(image);
+        //overviews are always tiled
+        TIFFSetField(image, TIFFTAG_TILEWIDTH, saveOptions->tiled ? saveOptions->tileWidth : 256);
+        TIFFSetField(image, TIFFTAG_TILELENGTH, saveOptions->tiled ? saveOptions->tileHeight : 256);
     }
 
-    unsigned char *convertArgbToBilevel(uint32 *source, jint width, jint height) {
-        long long threshold = 0;
-        uint32 crPix;
-        uint32 grayPix;
-        int bilevelWidth = (width / 8 + 0.5);
-
-        unsigned char *dest = (unsigned char *) malloc(sizeof(unsigned char) * bilevelWidth * height);
-
-        uint32 maxGrey = (0.2125 * 255 + 0.7154 * 255 + 0.0721 * 255);
-        uint32 halfGrey = maxGrey/2;
-
-        uint32 shift = 0;
-        unsigned char charsum = 0;
-        int k = 7;
-        for (int j = 0; j < height; j++) {
-            shift = 0;
-            charsum = 0;
-            k = 7;
-            for (int i = 0; i < width; i++) {
-                crPix = source[j * width + i];
-                grayPix = (0.2125 * (colorMask & crPix >> 16) + 0.7154 * (colorMask & crPix >> 8) + 0.0721 * (colorMask & crPix));
-
-                if (grayPix < halfGrey) charsum &= ~(1 << k);
-                else charsum |= 1 << k;
-
-                if (k == 0) {
-                    dest[j * bilevelWidth + shift] = charsum;
-                    shift++;
-                    k = 7;
-
-                    charsum = 0;
-                } else {
-                    k--;
+    size_t overviewMemory(NativeBitmapRows *bitmapRows, uint32 width, uint32 height, int levels, const NativeSaveOptions *saveOptions,
+                          size_t availableMemory) {
+        size_t rowMemory = (size_t) width * sizeof(uint32);
+        size_t maxMemory = 0;
+        TIFF *fields = NativeChunkWriter::openFieldsTiff();
+        for (int level = 1; fields && level <= levels; level++) {
+            setOverviewFields(fields, saveOptions, bitmapRows, width, height, level);
+            NativeOverviewWriter overview(&fields, 1, bitmapRows, level, saveOptions->compressionThreads);
+            overview.fitMemory(availableMemory > rowMemory ? availableMemory - rowMemory : 0);
+            size_t memory = rowMemory + overview.getWorkingMemory();
+            if (memory > maxMemory) {
+                maxMemory = memory;
+            }
+        }
+        if (fields) {
+            TIFFCleanup(fields);
+        }
+        return maxMemory;
+    }
+
+    int writeOverviews(TIFF *image, NativeBitmapRows *bitmapRows, uint32 width, uint32 height, int levels,
+                       const NativeSaveOptions *saveOptions, size_t availableMemory, size_t *requiredMemory) {
+        size_t rowMemory = (size_t) width * sizeof(uint32);
+        uint32 *row = (uint32 *) malloc(rowMemory);
+        //fields of every level for writers of levels that are kept in memory
+        TIFF **levelFields = (TIFF **) calloc(levels + 1, sizeof(TIFF *));
+        TIFF **passImages = (TIFF **) calloc(levels, sizeof(TIFF *));
+        bool ok = row && levelFields && passImages;
+        for (int level = 1; level <= levels && ok; level++) {
+            levelFields[level] = NativeChunkWriter::openFieldsTiff();
+            ok = levelFields[level] != nullptr;
+            if (ok) {
+                setOverviewFields(levelFields[level], saveOptions, bitmapRows, width, height, level);
+            }
+        }
+
+        //one pass over source makes as many levels as memory allows. The first level of pass is written while rows pass,
+        //next levels are compressed to memory and written after it, so directories of levels are in order
+        for (int first = 1; first <= levels && ok; ) {
+            setOverviewFields(image, saveOptions, bitmapRows, width, height, first);
+            passImages[0] = image;
+            NativeOverviewWriter *overview = nullptr;
+            int count = levels - first + 1;
+            for (; count >= 1; count--) {
+                for (int i = 1; i < count; i++) {
+                    passImages[i] = levelFields[first + i];
+                }
+                overview = new NativeOverviewWriter(passImages, count, bitmapRows, first, saveOptions->compressionThreads);
+                overview->setDeflateStrategy(saveOptions->deflateStrategy);
+                overview->fitMemory(availableMemory > rowMemory ? availableMemory - rowMemory : 0);
+                *requiredMemory = rowMemory + overview->getWorkingMemory();
+                if (*requiredMemory <= availableMemory || count == 1) {
+                    break;
                 }
+                delete overview;
+            }
+            __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffSaver", "Overview levels %d-%d in one pass, required memory %zu",
+                                first, first + count - 1, *requiredMemory);
+
+            ok = *requiredMemory <= availableMemory && overview->begin();
+            for (uint32 y = 0; y < height && ok; y++) {
+                ok = overview->writeRow(bitmapRows->readAbgrRow(y, row));
+            }
+            ok = ok && overview->finish() && TIFFWriteDirectory(image);
+            for (int i = 1; i < count && ok; i++) {
+                setOverviewFields(image, saveOptions, bitmapRows, width, height, first + i);
+                ok = overview->writeKept(i, image) && TIFFWriteDirectory(image);
+            }
+            delete overview;
+            first += count;
+        }
+
+        for (int level = 1; levelFields && level <= levels; level++) {
+            if (levelFields[level]) {
+                TIFFCleanup(levelFields[level]);
             }
         }
-        return dest;
+        free(levelFields);
+        free(passImages);
+        free(row);
+        return ok ? 1 : 0;
+    }
+
+    void setCompressionFields(TIFF *image, int compression, int predictor, int deflateLevel) {
+        bool deflate = compression == COMPRESSION_ADOBE_DEFLATE || compression == COMPRESSION_DEFLATE;
+        //predictor is defined only for LZW and Deflate, and other codecs reject it
+        if (predictor != PREDICTOR_NONE && (deflate || compression == COMPRESSION_LZW)) {
+            TIFFSetField(image, TIFFTAG_PREDICTOR, predictor);
+        }
+        //codec field exists only after Deflate compression is set
+        if (deflate) {
+            TIFFSetField(image, TIFFTAG_ZIPQUALITY, deflateLevel);
+        }
     }
 
     char *getCreationDate() {
         char * datestr = (char *) malloc(sizeof(char) * 20);
         time_t rawtime;
-        struct tm * timeinfo;
+        struct tm timeinfo;
         time (&rawtime);
-        timeinfo = localtime (&rawtime);
-        strftime (datestr,20,/*"Now it's %I:%M%p."*/"%Y:%m:%d %H:%M:%S",timeinfo);
+        //pages are saved from several threads, so static buffer of localtime can't be used
+        localtime_r (&rawtime, &timeinfo);
+        strftime (datestr,20,/*"Now it's %I:%M%p."*/"%Y:%m:%d %H:%M:%S",&timeinfo);
 
         return datestr;
     }
@@ -0,0 +1,58 @@
+//
+// Multi-page writer that keeps TIFF open between pages.
+// Reopening file for every appended page makes libtiff walk the whole chain of directories to find the last one,
+// while opened image links every new directory to the previous one right away, so every page costs the same.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "NativeTiffWriter.h"
+
+JNIEXPORT jlong
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffWriter_nativeOpen
+        (JNIEnv *env, jclass clazz, jstring filePath, jint fileDescriptor, jboolean append) {
+    //file is opened right away, so writer fails early, but image is opened by the first page
+    if (fileDescriptor == -1) {
+        const char *strPath = env->GetStringUTFChars(filePath, 0);
+        fileDescriptor = open(strPath, append ? O_RDWR | O_CREAT : O_RDWR | O_CREAT | O_TRUNC, 0666);
+        env->ReleaseStringUTFChars(filePath, strPath);
+        if (fileDescriptor < 0) {
+            throw_cant_open_file_exception(env, filePath);
+            return 0;
+        }
+    }
+    NativeTiffOutput *output = (NativeTiffOutput *) malloc(sizeof(NativeTiffOutput));
+    if (!output) {
+        close(fileDescriptor);
+        throw_not_enough_memory_exception(env, 0, sizeof(NativeTiffOutput));
+        return 0;
+    }
+    output->fd = fileDescriptor;
+    output->append = append;
+    output->image = nullptr;
+    output->failed = false;
+    output->needsBigTiff = false;
+    __android_log_print(ANDROID_LOG_DEBUG, "NativeTiffWriter", "Open writer of file descriptor %d", fileDescriptor);
+    return (jlong) output;
+}
+
+JNIEXPORT jboolean
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffWriter_nativeAddPage
+        (JNIEnv *env, jclass clazz, jlong handle, jstring filePath, jobject bitmap, jobject options) {
+    NativeTiffOutput *output = (NativeTiffOutput *) handle;
+    return writeTiffPage(env, filePath, output, bitmap, options);
+}
+
+JNIEXPORT void
+JNICALL Java_org_beyka_tiffbitmapfactory_TiffWriter_nativeClose
+        (JNIEnv *env, jclass clazz, jlong handle) {
+    NativeTiffOutput *output = (NativeTiffOutput *) handle;
+    closeOutput(output, true);
+    free(output);
+}
+
+#ifdef __cplusplus
+}
+#endif
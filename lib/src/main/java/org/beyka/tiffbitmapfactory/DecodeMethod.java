@@ -0,0 +1,33 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Strategy that decoder used for reading image.
+ */
+
+public enum DecodeMethod {
+    /**
+     * Whole image is decoded to memory at once. Used for images with one strip.
+     */
+    IMAGE(1),
+    /**
+     * Image is decoded tile by tile.
+     */
+    TILE(2),
+    /**
+     * Image is decoded strip by strip.
+     */
+    STRIP(3),
+    /**
+     * Rows are decoded in small chunks and sampled as they arrive.
+     * Used when other methods need more memory than {@link TiffBitmapFactory.Options#inAvailableMemory}.
+     * Slower, but needs memory only for decoded bitmap and a few rows.
+     */
+    STREAM(4),
+    UNAVAILABLE(0);
+
+    final int ordinal;
+
+    DecodeMethod(int ordinal) {
+        this.ordinal = ordinal;
+    }
+}
@@ -0,0 +1,35 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Strategy of zlib used for {@link CompressionScheme#DEFLATE} and {@link CompressionScheme#ADOBE_DEFLATE} compression.
+ * All strategies make data decoded by any Deflate decoder, they differ in speed and size of file.
+ */
+
+public enum DeflateStrategy {
+    /**
+     * Strategy used by libtiff: string matching and Huffman coding.
+     */
+    DEFAULT(0),
+    /**
+     * More Huffman coding and less string matching. Fits data with small values, like data with {@link Predictor#HORIZONTAL}.
+     */
+    FILTERED(1),
+    /**
+     * Huffman coding only, without string matching. The fastest, with the biggest files.
+     */
+    HUFFMAN_ONLY(2),
+    /**
+     * Matches only runs of repeated bytes. Almost as fast as {@link #HUFFMAN_ONLY} and good for images with plain areas.
+     */
+    RLE(3),
+    /**
+     * Fixed Huffman codes instead of dynamic ones.
+     */
+    FIXED(4);
+
+    final int ordinal;
+
+    DeflateStrategy(int ordinal) {
+        this.ordinal = ordinal;
+    }
+}
@@ -0,0 +1,22 @@
+package org.beyka.tiffbitmapfactory;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Receives decoded image by bands of rows.
+ * See {@link TiffBitmapFactory#decodeFileDescriptorToBands(int, TiffBitmapFactory.Options, int, IBandListener, IProgressListener)}
+ */
+public interface IBandListener {
+    /**
+     * Called for every band in order from top to bottom of decoded image.
+     * <p>Pixels are stored in RGBA_8888 byte order (red, green, blue, alpha), row by row without padding.
+     * Buffer points to native memory that is reused for the next band, so it is valid only during this call.</p>
+     *
+     * @param pixels   - pixels of band
+     * @param firstRow - index of first row of band in decoded image
+     * @param rowCount - number of rows in band. Last band may be shorter than requested band height
+     * @param width    - width of decoded image
+     * @return true to continue decoding, false to stop it
+     */
+    public boolean onBand(ByteBuffer pixels, int firstRow, int rowCount, int width);
+}
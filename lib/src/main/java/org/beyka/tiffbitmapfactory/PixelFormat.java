@@ -0,0 +1,41 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Layout of pixels written by {@link TiffBitmapFactory#decodeFileDescriptorInto(int, TiffBitmapFactory.Options, java.nio.ByteBuffer, int, PixelFormat, IProgressListener)}.
+ * Names list bytes of pixel in memory order.
+ */
+
+public enum PixelFormat {
+    /**
+     * 4 bytes per pixel: alpha, red, green, blue.
+     */
+    ARGB(1, 4),
+    /**
+     * 4 bytes per pixel: red, green, blue, alpha. The same layout as {@link android.graphics.Bitmap.Config#ARGB_8888} in memory.
+     */
+    RGBA(2, 4),
+    /**
+     * 3 bytes per pixel: red, green, blue. Alpha is dropped.
+     */
+    RGB(3, 3),
+    /**
+     * 3 bytes per pixel: blue, green, red. Alpha is dropped.
+     */
+    BGR(4, 3),
+    /**
+     * 1 byte per pixel: luminance 0.2125 * red + 0.7154 * green + 0.0721 * blue. Alpha is dropped.
+     */
+    GRAY_8(5, 1);
+
+    final int ordinal;
+
+    /**
+     * Number of bytes of one pixel.
+     */
+    public final int bytesPerPixel;
+
+    PixelFormat(int ordinal, int bytesPerPixel) {
+        this.ordinal = ordinal;
+        this.bytesPerPixel = bytesPerPixel;
+    }
+}
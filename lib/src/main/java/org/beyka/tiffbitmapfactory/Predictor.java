@@ -0,0 +1,23 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Predictor applied to image data before LZW or Deflate compression.
+ * Predictor doesn't change pixels, it makes data of smooth images better compressible.
+ */
+
+public enum Predictor {
+    /**
+     * No prediction scheme used before coding.
+     */
+    NONE(1),
+    /**
+     * Horizontal differencing: every sample is stored as difference from the same sample of previous pixel in row.
+     */
+    HORIZONTAL(2);
+
+    final int ordinal;
+
+    Predictor(int ordinal) {
+        this.ordinal = ordinal;
+    }
+}
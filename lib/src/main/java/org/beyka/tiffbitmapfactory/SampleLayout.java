@@ -0,0 +1,35 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Samples of pixels written by {@link TiffSaver}.
+ * Images compressed with CCITT schemes are always written with 1 bit per pixel.
+ */
+
+public enum SampleLayout {
+    /**
+     * Layout is chosen by config of bitmap: {@link #GRAY_8} for {@link android.graphics.Bitmap.Config#ALPHA_8},
+     * {@link #RGB} for {@link android.graphics.Bitmap.Config#RGB_565} and bitmaps without alpha
+     * ({@link android.graphics.Bitmap#hasAlpha()} is false, known from Android 11), {@link #RGBA} for other bitmaps.
+     */
+    AUTO(0),
+    /**
+     * 1 sample per pixel, TIFFTAG_PHOTOMETRIC is PHOTOMETRIC_MINISBLACK.
+     * Grey is luminance 0.2125 * red + 0.7154 * green + 0.0721 * blue, or alpha of {@link android.graphics.Bitmap.Config#ALPHA_8} bitmap.
+     */
+    GRAY_8(1),
+    /**
+     * 3 samples per pixel: red, green, blue. Alpha is dropped.
+     */
+    RGB(2),
+    /**
+     * 4 samples per pixel: red, green, blue, alpha. TIFFTAG_EXTRASAMPLES is EXTRASAMPLE_ASSOCALPHA for premultiplied bitmaps
+     * and EXTRASAMPLE_UNASSALPHA for bitmaps that are not premultiplied.
+     */
+    RGBA(3);
+
+    final int ordinal;
+
+    SampleLayout(int ordinal) {
+        this.ordinal = ordinal;
+    }
+}
@@ -0,0 +1,23 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Order of values in tensor written by {@link TiffBitmapFactory#decodeFileDescriptorToTensor(int, TiffBitmapFactory.Options, java.nio.ByteBuffer, int, int, TensorLayout, TensorType, float[], float[], IProgressListener)}.
+ * Letters name dimensions from outermost to innermost: channels, height and width.
+ */
+
+public enum TensorLayout {
+    /**
+     * Planes of channels one after another: value of channel c of cell x, y has index (c * height + y) * width + x.
+     */
+    NCHW(1),
+    /**
+     * Channels of every cell together: value of channel c of cell x, y has index (y * width + x) * channels + c.
+     */
+    NHWC(2);
+
+    final int ordinal;
+
+    TensorLayout(int ordinal) {
+        this.ordinal = ordinal;
+    }
+}
@@ -0,0 +1,28 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Type of values in tensor written by {@link TiffBitmapFactory#decodeFileDescriptorToTensor(int, TiffBitmapFactory.Options, java.nio.ByteBuffer, int, int, TensorLayout, TensorType, float[], float[], IProgressListener)}.
+ */
+
+public enum TensorType {
+    /**
+     * 32 bit float in native byte order.
+     */
+    FLOAT32(1, 4),
+    /**
+     * Signed byte. Normalized value is rounded and clamped to -128..127.
+     */
+    INT8(2, 1);
+
+    final int ordinal;
+
+    /**
+     * Number of bytes of one value.
+     */
+    public final int bytesPerValue;
+
+    TensorType(int ordinal, int bytesPerValue) {
+        this.ordinal = ordinal;
+        this.bytesPerValue = bytesPerValue;
+    }
+}
@@ -6,6 +6,8 @@ import org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException;
 import org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException;
 import org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException;
 
+import java.nio.ByteBuffer;
+
 /**
  * Created by alexeyba on 7/17/15.
  */
@@ -109,6 +111,230 @@ public class TiffBitmapFactory {
 
     private static native Bitmap nativeDecodeFD(int fd, Options options, IProgressListener listener);
 
+    /**
+     * Decode file descriptor by bands of rows without creating bitmap. Only one band and rows that are
+     * read at once are kept in memory, so this allows processing of images that are too big for bitmap.
+     * <p>Bands have the same pixels as bitmap returned by {@link #decodeFileDescriptor(int, Options, IProgressListener)}
+     * with the same options, including {@link Options#inSampleSize}, {@link Options#inDecodeArea} and
+     * {@link Options#inUseOrientationTag}. {@link Options#inPreferredConfig} is ignored: pixels are always in RGBA_8888 byte order.</p>
+     * <p>Images with orientation other than {@link Orientation#TOP_LEFT} and {@link Orientation#TOP_RIGHT} are decoded
+     * at once if they fit into {@link Options#inAvailableMemory} when {@link Options#inUseOrientationTag} is true.
+     * Otherwise they are read again for every group of bands that fits into memory.</p>
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param bandHeight     - number of rows in every band
+     * @param bandListener   - listener which will receive bands
+     * @param listener       - listener which will receive decoding progress
+     * @return true if all bands were decoded, false if decoding failed or was stopped by listener or thread interruption
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorToBands(int fileDescriptor, Options options, int bandHeight, IBandListener bandListener, IProgressListener listener) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        if (bandListener == null) {
+            throw new IllegalArgumentException("Band listener can't be null");
+        }
+        return nativeDecodeBandsFD(fileDescriptor, options, bandHeight, bandListener, 0, 0, listener);
+    }
+
+    /**
+     * Decode file descriptor by bands of rows and pass them to native function.
+     * Works as {@link #decodeFileDescriptorToBands(int, Options, int, IBandListener, IProgressListener)},
+     * but bands are not copied to Java.
+     * <p>{@code nativeCallback} is pointer to function of type {@code tiff_band_callback} declared in NativeBandCallback.h:
+     * {@code int callback(void *userData, const uint32_t *pixels, uint32_t firstRow, uint32_t rowCount, uint32_t width)}.
+     * Callback is called on the thread of this method and returns 0 to stop decoding.</p>
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param bandHeight     - number of rows in every band
+     * @param nativeCallback - pointer to native function that receives bands
+     * @param nativeUserData - pointer that is passed to callback as is
+     * @param listener       - listener which will receive decoding progress
+     * @return true if all bands were decoded, false if decoding failed or was stopped by callback or thread interruption
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorToBands(int fileDescriptor, Options options, int bandHeight, long nativeCallback, long nativeUserData, IProgressListener listener) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        if (nativeCallback == 0) {
+            throw new IllegalArgumentException("Native callback can't be 0");
+        }
+        return nativeDecodeBandsFD(fileDescriptor, options, bandHeight, null, nativeCallback, nativeUserData, listener);
+    }
+
+    private static native boolean nativeDecodeBandsFD(int fd, Options options, int bandHeight, IBandListener bandListener, long nativeCallback, long nativeUserData, IProgressListener listener);
+
+    /**
+     * Decode file descriptor directly into direct buffer without creating bitmap.
+     * Rows are converted to {@code format} as they are decoded, so besides the buffer only a few rows are kept in memory
+     * and the same buffer may be reused for many images.
+     * <p>Decoded image has size of {@link Options#inDecodeArea} or of the whole image divided by {@link Options#inSampleSize}.
+     * Width and height are swapped for orientations {@link Orientation#LEFT_TOP} and later if {@link Options#inUseOrientationTag} is true.
+     * Use {@link Options#inJustDecodeBounds} to get size of image first. {@link Options#inPreferredConfig} is ignored.</p>
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param buffer         - direct buffer for pixels. Pixels are written from position 0 of buffer
+     * @param rowStride      - distance between starts of rows in bytes, or 0 for rows without padding
+     * @param format         - layout of pixels
+     * @param listener       - listener which will receive decoding progress
+     * @return true if image was decoded, false otherwise
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image or buffer is too small
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorInto(int fileDescriptor, Options options, ByteBuffer buffer, int rowStride, PixelFormat format, IProgressListener listener) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        if (buffer == null || !buffer.isDirect()) {
+            throw new IllegalArgumentException("Buffer should be direct");
+        }
+        if (format == null) {
+            throw new IllegalArgumentException("Pixel format can't be null");
+        }
+        return nativeDecodeIntoFD(fileDescriptor, options, buffer, rowStride, format.ordinal, listener);
+    }
+
+    /**
+     * Decode file descriptor directly into direct buffer without creating bitmap.
+     * See {@link #decodeFileDescriptorInto(int, Options, ByteBuffer, int, PixelFormat, IProgressListener)}
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param buffer         - direct buffer for pixels
+     * @param rowStride      - distance between starts of rows in bytes, or 0 for rows without padding
+     * @param format         - layout of pixels
+     * @return true if image was decoded, false otherwise
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image or buffer is too small
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorInto(int fileDescriptor, Options options, ByteBuffer buffer, int rowStride, PixelFormat format) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        return decodeFileDescriptorInto(fileDescriptor, options, buffer, rowStride, format, null);
+    }
+
+    private static native boolean nativeDecodeIntoFD(int fd, Options options, ByteBuffer buffer, int rowStride, int pixelFormat, IProgressListener listener);
+
+    /**
+     * Decode file descriptor directly into direct buffer as YUV 4:2:0 image for video encoders without creating bitmap.
+     * Rows are converted and chroma is subsampled as they are decoded, so besides the buffer only a few rows are kept in memory
+     * and the same buffer may be reused for every frame.
+     * <p>Decoded image has the same size as for {@link #decodeFileDescriptorInto(int, Options, ByteBuffer, int, PixelFormat, IProgressListener)}.
+     * Chroma of odd width or height covers the last column or row alone. Alpha is ignored.
+     * Buffer should have at least {@code rowStride * height + rowStride * ((height + 1) / 2)} bytes.</p>
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param buffer         - direct buffer for image. Planes are written from position 0 of buffer
+     * @param rowStride      - distance between starts of rows of Y plane in bytes, or 0 for width rounded up to even number
+     * @param format         - layout of planes
+     * @param listener       - listener which will receive decoding progress
+     * @return true if image was decoded, false otherwise
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image or buffer is too small
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorToYuv(int fileDescriptor, Options options, ByteBuffer buffer, int rowStride, YuvFormat format, IProgressListener listener) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        if (buffer == null || !buffer.isDirect()) {
+            throw new IllegalArgumentException("Buffer should be direct");
+        }
+        if (format == null) {
+            throw new IllegalArgumentException("YUV format can't be null");
+        }
+        return nativeDecodeYuvFD(fileDescriptor, options, buffer, rowStride, format.ordinal, listener);
+    }
+
+    /**
+     * Decode file descriptor directly into direct buffer as YUV 4:2:0 image.
+     * See {@link #decodeFileDescriptorToYuv(int, Options, ByteBuffer, int, YuvFormat, IProgressListener)}
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param buffer         - direct buffer for image
+     * @param rowStride      - distance between starts of rows of Y plane in bytes, or 0 for width rounded up to even number
+     * @param format         - layout of planes
+     * @return true if image was decoded, false otherwise
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image or buffer is too small
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorToYuv(int fileDescriptor, Options options, ByteBuffer buffer, int rowStride, YuvFormat format) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        return decodeFileDescriptorToYuv(fileDescriptor, options, buffer, rowStride, format, null);
+    }
+
+    private static native boolean nativeDecodeYuvFD(int fd, Options options, ByteBuffer buffer, int rowStride, int yuvFormat, IProgressListener listener);
+
+    /**
+     * Decode file descriptor directly into direct buffer as normalized tensor for machine learning models without creating bitmap.
+     * Rows are resized, converted and normalized as they are decoded, so besides the buffer only a few rows are kept in memory.
+     * <p>Image of size that {@link #decodeFileDescriptorInto(int, Options, ByteBuffer, int, PixelFormat, IProgressListener)} would decode
+     * with the same options is resized to {@code width} x {@code height} cells. Every cell has average of pixels it covers,
+     * so larger {@link Options#inSampleSize} only makes decoding faster. Cells of upscaled image repeat the nearest pixel.</p>
+     * <p>Tensor has 3 channels of red, green and blue or, if {@code mean} has 1 value, one channel of luminance
+     * 0.2125 * red + 0.7154 * green + 0.0721 * blue. Value of channel c is (v - mean[c]) / std[c] where v is in range 0..255.
+     * Alpha is ignored. Use {@link Options#inSwapRedBlueColors} for models that expect blue channel first.
+     * For quantized {@link TensorType#INT8} models with input scale s and zero point z pass mean[c] - z * std[c] * s as mean and std[c] * s as std.</p>
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param buffer         - direct buffer for tensor. Values are written from position 0 of buffer
+     * @param width          - width of tensor or 0 for width of decoded image
+     * @param height         - height of tensor or 0 for height of decoded image
+     * @param layout         - order of values in tensor
+     * @param type           - type of values
+     * @param mean           - 1 or 3 values subtracted from channels
+     * @param std            - values that channels are divided by, the same number as in {@code mean}
+     * @param listener       - listener which will receive decoding progress
+     * @return true if image was decoded, false otherwise
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image or buffer is too small
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorToTensor(int fileDescriptor, Options options, ByteBuffer buffer, int width, int height, TensorLayout layout, TensorType type, float[] mean, float[] std, IProgressListener listener) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        if (buffer == null || !buffer.isDirect()) {
+            throw new IllegalArgumentException("Buffer should be direct");
+        }
+        if (layout == null || type == null) {
+            throw new IllegalArgumentException("Tensor layout and type can't be null");
+        }
+        if (width < 0 || height < 0) {
+            throw new IllegalArgumentException("Tensor size can't be negative");
+        }
+        if (mean == null || std == null || (mean.length != 1 && mean.length != 3) || std.length != mean.length) {
+            throw new IllegalArgumentException("Mean and std should have 1 or 3 values each");
+        }
+        for (float s : std) {
+            if (s == 0) {
+                throw new IllegalArgumentException("Std can't be 0");
+            }
+        }
+        return nativeDecodeTensorFD(fileDescriptor, options, buffer, width, height, layout.ordinal, type.ordinal, mean, std, listener);
+    }
+
+    /**
+     * Decode file descriptor directly into direct buffer as normalized tensor.
+     * See {@link #decodeFileDescriptorToTensor(int, Options, ByteBuffer, int, int, TensorLayout, TensorType, float[], float[], IProgressListener)}
+     *
+     * @param fileDescriptor - file descriptor that represent file to decode
+     * @param options        - options for decoding
+     * @param buffer         - direct buffer for tensor
+     * @param width          - width of tensor or 0 for width of decoded image
+     * @param height         - height of tensor or 0 for height of decoded image
+     * @param layout         - order of values in tensor
+     * @param type           - type of values
+     * @param mean           - 1 or 3 values subtracted from channels
+     * @param std            - values that channels are divided by, the same number as in {@code mean}
+     * @return true if image was decoded, false otherwise
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException       when error occure while decoding image or buffer is too small
+     * @throws org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException     when {@code file} not exist or {@code file} is not tiff image
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when for decoding of image system need more memory than {@link Options#inAvailableMemory} or default value
+     */
+    public static boolean decodeFileDescriptorToTensor(int fileDescriptor, Options options, ByteBuffer buffer, int width, int height, TensorLayout layout, TensorType type, float[] mean, float[] std) throws CantOpenFileException, DecodeTiffException, NotEnoughMemoryException {
+        return decodeFileDescriptorToTensor(fileDescriptor, options, buffer, width, height, layout, type, mean, std, null);
+    }
+
+    private static native boolean nativeDecodeTensorFD(int fd, Options options, ByteBuffer buffer, int width, int height, int layout, int type, float[] mean, float[] std, IProgressListener listener);
+
     /**
      * Close detached file descriptor
      * @param fd - file descriptor to close
@@ -131,12 +357,21 @@ public class TiffBitmapFactory {
             inJustDecodeBounds = false;
             inSampleSize = 1;
             inDirectoryNumber = 0;
+            inOverview = 0;
             inAvailableMemory = 8000 * 8000 * 4;
+            inFloatMinValue = Float.NaN;
+            inFloatMaxValue = Float.NaN;
+            inCmykInkLimit = 0;
 
             outWidth = -1;
             outHeight = -1;
             outDirectoryCount = -1;
+            outOverviewCount = -1;
             outImageOrientation = Orientation.UNAVAILABLE;
+            outFloatMinValue = Float.NaN;
+            outFloatMaxValue = Float.NaN;
+            outDecodeMethod = DecodeMethod.UNAVAILABLE;
+            outEstimatedMemory = -1;
         }
 
         /**
@@ -187,10 +422,22 @@ public class TiffBitmapFactory {
          */
         public int inDirectoryNumber;
 
+        /**
+         * Reduced resolution overview of directory to decode instead of full resolution image.
+         * Overviews are SubIFDs of directory, like ones written by {@link TiffSaver.SaveOptions#overviewLevels}.
+         * <p>Overview n is SubIFD n - 1, for overviews of TiffSaver it is image reduced 2^n times.
+         * Decode area and inSampleSize are applied to overview.
+         * To get number of overviews see {@link #outOverviewCount}</p>
+         * <p>Default value is 0 - full resolution image is decoded</p>
+         */
+        public int inOverview;
+
         /**
          * Number of bytes that may be allocated during the Tiff file operations.
          * <p>-1 means memory is unlimited.</p>
          * <p>Default value is 244Mb</p>
+         * <p>If usual decoding of image needs more memory, decoder switches to {@link DecodeMethod#STREAM} that
+         * needs memory only for decoded pixels and a few rows. Exception is thrown only if even this is too much.</p>
          */
         public long inAvailableMemory;
 
@@ -217,6 +464,46 @@ public class TiffBitmapFactory {
          */
         public DecodeArea inDecodeArea;
 
+        /**
+         * Value of floating point sample that will be decoded as black.
+         * <p>Used only for images with 16 or 32 bits floating point samples (SAMPLEFORMAT_IEEEFP).
+         * Samples are linearly mapped from [{@link #inFloatMinValue}, {@link #inFloatMaxValue}] to 0..255 and clamped.</p>
+         * <p>If it is NaN decoder finds minimum of all finite samples in the image. NaN and infinite samples are skipped.</p>
+         * <p>Default value is NaN</p>
+         */
+        public float inFloatMinValue;
+
+        /**
+         * Value of floating point sample that will be decoded as white.
+         * <p>If it is NaN decoder finds maximum of all finite samples in the image.</p>
+         * <p>Default value is NaN</p>
+         * @see #inFloatMinValue
+         */
+        public float inFloatMaxValue;
+
+        /**
+         * Samples of pixel that are decoded instead of colors of image, for images with more samples than RGB needs
+         * (multispectral, satellite and other scientific data).
+         * <p>Array of 3 or 4 sample indices gives samples that are decoded as red, green, blue and alpha.
+         * Array of 1 index gives sample that is decoded as grey. Indices start from 0 and should be less than {@link #outSamplePerPixel}.
+         * Colors are multiplied by alpha sample unless it is associated alpha of image.</p>
+         * <p>Only samples that are listed are converted. If samples are stored in separate planes, only planes of these samples are read.</p>
+         * <p>Supported for 8 and 16 bits unsigned integer samples. Photometric interpretation is ignored, samples are used as they are stored,
+         * 16 bits samples are scaled to 8 bits.</p>
+         * <p>Default value is null - colors of image are decoded</p>
+         */
+        public int[] inBands;
+
+        /**
+         * Total ink limit of CMYK images in percent, for example 300 for prepress files made for 300% total area coverage.
+         * <p>Cyan, magenta and yellow of pixels with more ink than the limit are reduced in proportion before conversion to RGB,
+         * black is kept, so colors are close to ones that press prints. Limits from 100 to 400 are used.</p>
+         * <p>It is used for contiguous 8 bit CMYK images. Single strip images are then decoded by whole strip,
+         * like images with several strips.</p>
+         * <p>Default value is 0 - naive conversion, the same as libtiff does</p>
+         */
+        public int inCmykInkLimit;
+
         /**
          * The resulting width of the bitmap. If {@link #inJustDecodeBounds} is
          * set to false, this will be width of the output bitmap after any
@@ -249,6 +536,12 @@ public class TiffBitmapFactory {
          */
         public int outDirectoryCount;
 
+        /**
+         * The count of overviews (SubIFDs) of decoded directory.
+         * <p>outOverviewCount will be set to -1 if there is an error trying to decode.</p>
+         */
+        public int outOverviewCount;
+
         /**
          * This parameter returns orientation of decoded image
          * <p>For storing orientation uses {@link org.beyka.tiffbitmapfactory.Orientation ImageOrientation} enum</p>
@@ -286,6 +579,33 @@ public class TiffBitmapFactory {
          */
         public int outBitsPerSample;
 
+        /**
+         * Range of floating point samples that was mapped to 0..255 while decoding.
+         * <p>Is set only when image with floating point samples was decoded. Otherwise is NaN</p>
+         * @see #inFloatMinValue
+         */
+        public float outFloatMinValue;
+
+        /**
+         * Range of floating point samples that was mapped to 0..255 while decoding.
+         * <p>Is set only when image with floating point samples was decoded. Otherwise is NaN</p>
+         * @see #inFloatMaxValue
+         */
+        public float outFloatMaxValue;
+
+        /**
+         * Method that was chosen for decoding of image.
+         * <p>{@link DecodeMethod#STREAM} means that usual method needs more memory than {@link #inAvailableMemory}</p>
+         * <p>If image wasn't decoded this parameter will be equal to {@link DecodeMethod#UNAVAILABLE}</p>
+         */
+        public DecodeMethod outDecodeMethod;
+
+        /**
+         * Number of bytes of native memory that decoder estimated for chosen {@link #outDecodeMethod}.
+         * <p>-1 if image wasn't decoded</p>
+         */
+        public long outEstimatedMemory;
+
         /**
          * The number of pixels per {@link org.beyka.tiffbitmapfactory.TiffBitmapFactory.Options#outResolutionUnit} in the ImageWidth direction.
          */
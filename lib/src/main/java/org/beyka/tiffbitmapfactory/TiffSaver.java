@@ -16,6 +16,10 @@ public class TiffSaver {
         System.loadLibrary("imageOps");
     }
 
+    //Appending reads the last page of file and links new page to it, so appends run one at a time.
+    //Saving of new files runs in parallel
+    private static final Object appendLock = new Object();
+
     /**
      * Save bitmap to file with default {@link TiffSaver.SaveOptions options}.
      *
@@ -129,7 +133,9 @@ public class TiffSaver {
      * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
      */
     public static boolean appendBitmap(String destinationPath, Bitmap bmp,SaveOptions options) throws CantOpenFileException {
-        return save(destinationPath, -1, bmp, options, true);
+        synchronized (appendLock) {
+            return save(destinationPath, -1, bmp, options, true);
+        }
     }
 
     /**
@@ -187,10 +193,68 @@ public class TiffSaver {
      * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
      */
     public static boolean appendBitmap(int fileDescriptor, Bitmap bmp, SaveOptions options) throws CantOpenFileException, NotEnoughMemoryException {
-        return save(null, fileDescriptor, bmp, options, true);
+        synchronized (appendLock) {
+            return save(null, fileDescriptor, bmp, options, true);
+        }
+    }
+
+    /**
+     * Save bitmaps as pages of new file. Existing file is overwritten.
+     *
+     * @param destination - file to write bitmaps
+     * @param pages       - Bitmaps for saving, one page per bitmap in the same order
+     * @param options     - options for saving, the same for all pages
+     * @return true if all pages were saved successful or false otherwise
+     * @throws CantOpenFileException when {@code destination} can't be opened for writing
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when there is no avalable memory for processing bitmap
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
+     * @see #saveBitmaps(String, Bitmap[], SaveOptions)
+     */
+    public static boolean saveBitmaps(File destination, Bitmap[] pages, SaveOptions options) throws CantOpenFileException {
+        return saveBitmaps(destination.getAbsolutePath(), pages, options);
+    }
+
+    /**
+     * Save bitmaps as pages of new file. Existing file is overwritten.
+     * <p>Pages are compressed on {@link SaveOptions#compressionThreads} threads ahead of writing, while the calling thread
+     * writes previous pages to file in order, so the file is the same as one written page by page with {@link TiffWriter}.
+     * Overviews are written on the calling thread together with their page.</p>
+     * <p>Half of {@link SaveOptions#inAvailableMemory} is used by pages compressed ahead and the other half by writing of page.
+     * Page that doesn't fit into its half is compressed while it is written, like by {@link #saveBitmap(String, Bitmap, SaveOptions)}.</p>
+     * <p>Format of file is chosen by estimated size of all pages. Bitmaps should not be changed or recycled until saving ends.</p>
+     * <p>Saving stops at the first page that fails. File keeps pages written before it, failed page leaves no directory.</p>
+     *
+     * @param destinationPath - file path to write bitmaps
+     * @param pages           - Bitmaps for saving, one page per bitmap in the same order
+     * @param options         - options for saving, the same for all pages
+     * @return true if all pages were saved successful or false otherwise
+     * @throws CantOpenFileException when {@code destinationPath} can't be opened for writing
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when there is no avalable memory for processing bitmap
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
+     */
+    public static boolean saveBitmaps(String destinationPath, Bitmap[] pages, SaveOptions options) throws CantOpenFileException {
+        return saveAll(destinationPath, -1, pages, options);
+    }
+
+    /**
+     * Save bitmaps as pages of file.
+     *
+     * @param fileDescriptor - file descriptor that represent file to write bitmaps
+     * @param pages          - Bitmaps for saving, one page per bitmap in the same order
+     * @param options        - options for saving, the same for all pages
+     * @return true if all pages were saved successful or false otherwise
+     * @throws CantOpenFileException when {@code fileDescriptor} can't be opened as tiff
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when there is no avalable memory for processing bitmap
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
+     * @see #saveBitmaps(String, Bitmap[], SaveOptions)
+     */
+    public static boolean saveBitmaps(int fileDescriptor, Bitmap[] pages, SaveOptions options) throws CantOpenFileException {
+        return saveAll(null, fileDescriptor, pages, options);
     }
 
-    private static synchronized native boolean save(String filePath, int fileDescriptor, Bitmap bmp, SaveOptions options, boolean append);
+    private static native boolean save(String filePath, int fileDescriptor, Bitmap bmp, SaveOptions options, boolean append);
+
+    private static native boolean saveAll(String filePath, int fileDescriptor, Bitmap[] pages, SaveOptions options);
 
     /**
      * Close detached file descriptor
@@ -211,10 +275,23 @@ public class TiffSaver {
             xResolution = 0;
             yResolution = 0;
             resUnit = ResolutionUnit.NONE;
+            stripSize = 0;
+            tileWidth = 0;
+            tileHeight = 0;
+            compressionThreads = 0;
+            overviewLevels = 0;
+            bigTiffThreshold = 3L * 1024 * 1024 * 1024;
+            sampleLayout = SampleLayout.AUTO;
+            predictor = Predictor.NONE;
+            deflateLevel = -1;
+            deflateStrategy = DeflateStrategy.DEFAULT;
         }
 
         /**
          * Number of bytes that may be allocated during the Tiff file operations.
+         * <p>Pixels of bitmap are converted and compressed by bands of strips or tiles that fit into this memory,
+         * fewer compression threads are used if needed. If even one row of strips or tiles doesn't fit,
+         * {@link NotEnoughMemoryException} is thrown.</p>
          * <p>-1 means memory is unlimited.</p>
          * <p>Default value is 244Mb</p>
          */
@@ -287,5 +364,98 @@ public class TiffSaver {
          * <p>This parameter is link to TIFFTAG_IMAGEDESCRIPTION tag</p>
          */
         public String imageDescription;
+
+        /**
+         * Size of uncompressed strip in bytes. Strips take as many rows as fit into this size, but at least one.
+         * Rows of JPEG strips are rounded up to multiple of 16.
+         * <p>Default value is 0 which means size chosen by libtiff (about 8 KB)</p>
+         * <p>This parameter is link to TIFFTAG_ROWSPERSTRIP tag. It is ignored for tiled images</p>
+         */
+        public int stripSize;
+
+        /**
+         * Width of tiles. If both tileWidth and tileHeight are not 0 image is saved in tiles instead of strips.
+         * Should be multiple of 16.
+         * <p>Default value is 0</p>
+         * <p>This parameter is link to TIFFTAG_TILEWIDTH tag</p>
+         */
+        public int tileWidth;
+
+        /**
+         * Height of tiles. If both tileWidth and tileHeight are not 0 image is saved in tiles instead of strips.
+         * Should be multiple of 16.
+         * <p>Default value is 0</p>
+         * <p>This parameter is link to TIFFTAG_TILELENGTH tag</p>
+         */
+        public int tileHeight;
+
+        /**
+         * Number of threads that compress strips or tiles of image. Compressed data is written in order,
+         * so file is the same as one compressed on a single thread.
+         * <p>Default value is 0 which means number of processor cores. 1 compresses on the calling thread</p>
+         * <p>Images without compression and images with one strip are always written on the calling thread</p>
+         */
+        public int compressionThreads;
+
+        /**
+         * Number of reduced resolution overviews written after image: 2x, 4x, 8x... smaller.
+         * Every pixel of overview is average of block of image pixels.
+         * <p>Overviews are tiled (tileWidth x tileHeight or 256 x 256) and compressed with {@link #compressionScheme}.
+         * They are SubIFDs of the directory with TIFFTAG_SUBFILETYPE = FILETYPE_REDUCEDIMAGE,
+         * so number of directories in file doesn't change. Overviews could be decoded with
+         * {@link TiffBitmapFactory.Options#inOverview}</p>
+         * <p>Overviews stop at 1 x 1 pixel. They are not written for CCITT compression schemes</p>
+         * <p>Default value is 0 - no overviews</p>
+         */
+        public int overviewLevels;
+
+        /**
+         * Estimated size of file in bytes from which image is saved as BigTIFF with 64 bit offsets instead of classic TIFF,
+         * that can't be bigger than 4 GB. Size is estimated by uncompressed image data and overviews.
+         * <p>When page is appended to existing file, size of file is added to estimation. Format of existing file is kept,
+         * so pages could be appended to BigTIFF files at any size. Classic file can't be converted, so appending to classic file
+         * fails with {@link org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException} before anything is written,
+         * when estimation reaches this threshold or 4 GB</p>
+         * <p>0 means always BigTIFF, -1 means never</p>
+         * <p>Default value is 3 GB</p>
+         */
+        public long bigTiffThreshold;
+
+        /**
+         * Samples of saved pixels. Layouts with fewer samples make smaller files that are decoded faster.
+         * <p>Default value is {@link SampleLayout#AUTO} - layout that keeps all channels of bitmap config</p>
+         * <p>This parameter is link to TIFFTAG_SAMPLESPERPIXEL, TIFFTAG_PHOTOMETRIC and TIFFTAG_EXTRASAMPLES tags.
+         * It is ignored for CCITT compression schemes</p>
+         */
+        public SampleLayout sampleLayout;
+
+        /**
+         * Predictor applied before compression. {@link Predictor#HORIZONTAL} usually makes LZW and Deflate compressed
+         * photos and gradients noticeably smaller.
+         * <p>Default value is {@link Predictor#NONE}</p>
+         * <p>This parameter is link to TIFFTAG_PREDICTOR tag. It is used only with {@link CompressionScheme#LZW},
+         * {@link CompressionScheme#DEFLATE} and {@link CompressionScheme#ADOBE_DEFLATE}</p>
+         */
+        public Predictor predictor;
+
+        /**
+         * Level of Deflate compression from 1 (the fastest) to 9 (the smallest file).
+         * Level 1 is about twice as fast as the default one, files of photos are only a few percent bigger,
+         * while files of drawings and screenshots with flat areas may be twice as big.
+         * Level 0 stores data without compression.
+         * <p>Default value is -1 which means default level of zlib (6). Other values make saving fail</p>
+         * <p>This parameter is used only with {@link CompressionScheme#DEFLATE} and {@link CompressionScheme#ADOBE_DEFLATE}</p>
+         */
+        public int deflateLevel;
+
+        /**
+         * Strategy of zlib for Deflate compression.
+         * With {@link Predictor#HORIZONTAL}, {@link DeflateStrategy#HUFFMAN_ONLY} and {@link DeflateStrategy#RLE}
+         * compress noisy photos several times faster than {@link DeflateStrategy#DEFAULT} and usually a bit smaller,
+         * but they make files of drawings and screenshots several times bigger.
+         * <p>Default value is {@link DeflateStrategy#DEFAULT}</p>
+         * <p>This parameter is used only with {@link CompressionScheme#DEFLATE} and {@link CompressionScheme#ADOBE_DEFLATE}</p>
+         */
+        public DeflateStrategy deflateStrategy;
     }
 }
@@ -0,0 +1,138 @@
+package org.beyka.tiffbitmapfactory;
+
+import android.graphics.Bitmap;
+
+import org.beyka.tiffbitmapfactory.exceptions.CantOpenFileException;
+
+import java.io.Closeable;
+import java.io.File;
+
+/**
+ * Writer of multi-page tiff file that keeps file open between pages.
+ * <p>{@link TiffSaver#appendBitmap(String, Bitmap, TiffSaver.SaveOptions)} reopens file and looks for the last page every time,
+ * so saving of many pages gets slower with every page. Writer adds every page right after the previous one,
+ * so all pages take the same time.</p>
+ * <p>Format of file, classic TIFF or BigTIFF, is chosen by {@link TiffSaver.SaveOptions#bigTiffThreshold} of the first page.
+ * Set it to 0 for documents that may grow over 4 GB.</p>
+ * <p>When page fails after its data was written to file, file keeps only previous pages and writer refuses next pages.
+ * Page that fails before, for example because of memory, leaves no trace and writer stays usable.</p>
+ * <p>Writer should be closed after the last page. Writer that is not closed closes file when it is garbage collected.
+ * Methods of writer are synchronized.</p>
+ */
+public class TiffWriter implements Closeable {
+
+    static {
+        System.loadLibrary("imageOps");
+    }
+
+    private final String path;
+    private long handle;
+
+    private TiffWriter(String path, long handle) {
+        this.path = path;
+        this.handle = handle;
+    }
+
+    /**
+     * Open writer of new file.
+     *
+     * @param destination - file to write pages. Existing file is overwritten
+     * @return writer of file
+     * @throws CantOpenFileException when {@code destination} can't be opened for writing
+     */
+    public static TiffWriter open(File destination) throws CantOpenFileException {
+        return open(destination.getAbsolutePath(), false);
+    }
+
+    /**
+     * Open writer of new file.
+     *
+     * @param destinationPath - file path to write pages. Existing file is overwritten
+     * @return writer of file
+     * @throws CantOpenFileException when {@code destinationPath} can't be opened for writing
+     */
+    public static TiffWriter open(String destinationPath) throws CantOpenFileException {
+        return open(destinationPath, false);
+    }
+
+    /**
+     * Open writer of file.
+     *
+     * @param destinationPath - file path to write pages
+     * @param append          - if true, pages are added after pages of existing file, otherwise existing file is overwritten
+     * @return writer of file
+     * @throws CantOpenFileException when {@code destinationPath} can't be opened for writing
+     */
+    public static TiffWriter open(String destinationPath, boolean append) throws CantOpenFileException {
+        return new TiffWriter(destinationPath, nativeOpen(destinationPath, -1, append));
+    }
+
+    /**
+     * Open writer of file descriptor. Descriptor should be opened for reading and writing, it is closed by {@link #close()}.
+     *
+     * @param fileDescriptor - file descriptor that represent file to write pages
+     * @param append         - if true, pages are added after pages of existing file
+     * @return writer of file
+     */
+    public static TiffWriter open(int fileDescriptor, boolean append) {
+        return new TiffWriter(null, nativeOpen(null, fileDescriptor, append));
+    }
+
+    /**
+     * Add bitmap as next page with default {@link TiffSaver.SaveOptions options}.
+     *
+     * @param bmp - Bitmap for saving
+     * @return true if page was written successful or false otherwise
+     * @throws CantOpenFileException when the first page can't open file as tiff
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when there is no avalable memory for processing bitmap
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
+     */
+    public boolean addPage(Bitmap bmp) {
+        return addPage(bmp, new TiffSaver.SaveOptions());
+    }
+
+    /**
+     * Add bitmap as next page.
+     *
+     * @param bmp     - Bitmap for saving
+     * @param options - options for saving
+     * @return true if page was written successful or false otherwise
+     * @throws IllegalStateException when writer is closed
+     * @throws CantOpenFileException when the first page can't open file as tiff
+     * @throws org.beyka.tiffbitmapfactory.exceptions.NotEnoughMemoryException when there is no avalable memory for processing bitmap
+     * @throws org.beyka.tiffbitmapfactory.exceptions.DecodeTiffException when error occure while saving image
+     * or when previous page failed while it was written
+     */
+    public synchronized boolean addPage(Bitmap bmp, TiffSaver.SaveOptions options) {
+        if (handle == 0) {
+            throw new IllegalStateException("TiffWriter is closed");
+        }
+        return nativeAddPage(handle, path, bmp, options);
+    }
+
+    /**
+     * Close file. Closing writer that is already closed has no effect.
+     */
+    @Override
+    public synchronized void close() {
+        if (handle != 0) {
+            nativeClose(handle);
+            handle = 0;
+        }
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        try {
+            close();
+        } finally {
+            super.finalize();
+        }
+    }
+
+    private static native long nativeOpen(String filePath, int fileDescriptor, boolean append);
+
+    private static native boolean nativeAddPage(long handle, String filePath, Bitmap bmp, TiffSaver.SaveOptions options);
+
+    private static native void nativeClose(long handle);
+}
@@ -0,0 +1,28 @@
+package org.beyka.tiffbitmapfactory;
+
+/**
+ * Layout of YUV 4:2:0 image written by {@link TiffBitmapFactory#decodeFileDescriptorToYuv(int, TiffBitmapFactory.Options, java.nio.ByteBuffer, int, YuvFormat, IProgressListener)}.
+ * Buffer starts with Y plane of height rows with row stride, followed by chroma of (height + 1) / 2 rows and (width + 1) / 2 columns.
+ * Colors are converted with BT.601 limited range coefficients, the same as camera and video encoders use.
+ */
+
+public enum YuvFormat {
+    /**
+     * U plane and then V plane, both with half of row stride. The same as {@code COLOR_FormatYUV420Planar} of MediaCodec.
+     */
+    I420(1),
+    /**
+     * Interleaved V and U samples with row stride. The same as {@link android.graphics.ImageFormat#NV21}.
+     */
+    NV21(2),
+    /**
+     * Interleaved U and V samples with row stride. The same as {@code COLOR_FormatYUV420SemiPlanar} of MediaCodec.
+     */
+    NV12(3);
+
+    final int ordinal;
+
+    YuvFormat(int ordinal) {
+        this.ordinal = ordinal;
+    }
+}